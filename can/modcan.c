@@ -91,6 +91,9 @@ static const char *TAG = "TWAI";
 // Default bitrate: 500kb
 #define CAN_TASK_PRIORITY           (ESP_TASK_PRIO_MIN + 1)
 #define CAN_TASK_STACK_SIZE         (4096)  // Increased from 1024 to prevent stack overflow
+#define CAN_TX_QUEUE_LEN            (64)    // Manager TX queue depth (can_transmit_batch)
+#define CAN_SELF_ECHO_MAX           (16)    // Self-reception frames awaiting their echo
+#define CAN_SELF_ECHO_TIMEOUT_MS    (1000)  // Echo given up on (transmit aborted, bus off)
 #define CAN_DEFAULT_PRESCALER (8)
 #define CAN_DEFAULT_SJW (3)
 #define CAN_DEFAULT_BS1 (15)
@@ -181,6 +184,7 @@ static esp32_can_obj_t esp32_can_obj = {
     .tx_task_handle = NULL,
     .next_client_id = 1,
     .rx_dispatcher_should_stop = false,
+    .tx_task_should_stop = false,
 };
 
 // CAN module's own client handle (for participating in manager)
@@ -1564,12 +1568,144 @@ typedef struct {
     twai_message_t msg;
 } can_tx_queue_item_t;
 
+// Self-reception frames sent by the TX queue task, in transmit order. The
+// controller receives each one back when it completes on the bus; that echo
+// goes only to the client that queued the frame. Received frames carry no
+// self-reception flag, so echoes are routed in completion order: the driver
+// transmits one frame at a time, so only the oldest entry can be the next
+// echo. Guarded by self_echo_mutex (taken after can_manager_mutex when both
+// are held).
+typedef struct {
+    can_handle_t client;
+    twai_message_t msg;
+    TickType_t sent;
+} can_self_echo_t;
+
+static can_self_echo_t self_echo[CAN_SELF_ECHO_MAX];
+static int self_echo_head = 0;
+static int self_echo_count = 0;
+static SemaphoreHandle_t self_echo_mutex = NULL;
+
+static bool same_frame(const twai_message_t *a, const twai_message_t *b) {
+    if (a->identifier != b->identifier || a->extd != b->extd || a->rtr != b->rtr ||
+        a->data_length_code != b->data_length_code) {
+        return false;
+    }
+    uint8_t len = a->data_length_code > CAN_MAX_DATA_FRAME ? CAN_MAX_DATA_FRAME : a->data_length_code;
+    return a->rtr || memcmp(a->data, b->data, len) == 0;
+}
+
+// Drop entries whose echo should have arrived long ago. Mutex held.
+static void self_echo_expire(void) {
+    TickType_t now = xTaskGetTickCount();
+    while (self_echo_count > 0 &&
+           now - self_echo[self_echo_head].sent > pdMS_TO_TICKS(CAN_SELF_ECHO_TIMEOUT_MS)) {
+        self_echo_head = (self_echo_head + 1) % CAN_SELF_ECHO_MAX;
+        self_echo_count--;
+    }
+}
+
+// TX queue task: record a frame before it is handed to the driver
+static void self_echo_push(can_handle_t client, const twai_message_t *msg) {
+    if (self_echo_mutex == NULL || xSemaphoreTake(self_echo_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+    self_echo_expire();
+    if (self_echo_count == CAN_SELF_ECHO_MAX) {
+        // Oldest echo never arrived (e.g. transmit aborted)
+        self_echo_head = (self_echo_head + 1) % CAN_SELF_ECHO_MAX;
+        self_echo_count--;
+    }
+    can_self_echo_t *e = &self_echo[(self_echo_head + self_echo_count) % CAN_SELF_ECHO_MAX];
+    e->client = client;
+    e->msg = *msg;
+    e->sent = xTaskGetTickCount();
+    self_echo_count++;
+    xSemaphoreGive(self_echo_mutex);
+}
+
+// TX queue task: the driver refused the frame just pushed
+static void self_echo_cancel(void) {
+    if (self_echo_mutex != NULL && xSemaphoreTake(self_echo_mutex, portMAX_DELAY) == pdTRUE) {
+        if (self_echo_count > 0) {
+            self_echo_count--;
+        }
+        xSemaphoreGive(self_echo_mutex);
+    }
+}
+
+// RX dispatcher: the client a received frame is the echo for, or NULL.
+// Only the oldest outstanding frame is compared; a later entry that matches
+// is a frame still waiting for the bus, and this one came from another node.
+static can_handle_t self_echo_match(const twai_message_t *msg) {
+    can_handle_t client = NULL;
+    if (self_echo_mutex == NULL || xSemaphoreTake(self_echo_mutex, portMAX_DELAY) != pdTRUE) {
+        return NULL;
+    }
+    self_echo_expire();
+    if (self_echo_count > 0 && same_frame(&self_echo[self_echo_head].msg, msg)) {
+        client = self_echo[self_echo_head].client;
+        self_echo_head = (self_echo_head + 1) % CAN_SELF_ECHO_MAX;
+        self_echo_count--;
+    }
+    xSemaphoreGive(self_echo_mutex);
+    return client;
+}
+
 // RX dispatcher task function
 static void can_rx_dispatcher_task(void *arg);
 
 // TX queue task function
 static void can_tx_queue_task(void *arg);
 
+// Start TX queue task (driver must be running); creates the queue on first use
+static void start_tx_queue_task(void) {
+    if (self_echo_mutex == NULL) {
+        self_echo_mutex = xSemaphoreCreateMutex();
+    }
+    self_echo_count = 0;  // Echoes from before a restart will not arrive
+    if (esp32_can_obj.tx_queue == NULL) {
+        esp32_can_obj.tx_queue = xQueueCreate(CAN_TX_QUEUE_LEN, sizeof(can_tx_queue_item_t));
+        if (esp32_can_obj.tx_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create TX queue");
+            return;
+        }
+    }
+    if (esp32_can_obj.tx_task_handle == NULL) {
+        esp32_can_obj.tx_task_should_stop = false;
+        if (xTaskCreate(can_tx_queue_task, "can_tx_queue", CAN_TASK_STACK_SIZE, esp32_can_obj.tx_queue,
+                        CAN_TASK_PRIORITY, &esp32_can_obj.tx_task_handle) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create TX queue task");
+        }
+    }
+}
+
+// Stop TX queue task before the driver is stopped/uninstalled
+// Queued frames are kept unless flush is set
+static void stop_tx_queue_task(bool flush) {
+    if (esp32_can_obj.tx_task_handle != NULL) {
+        esp32_can_obj.tx_task_should_stop = true;
+        int retries = 0;
+        while (esp32_can_obj.tx_task_handle != NULL && retries < 50) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            retries++;
+        }
+        if (esp32_can_obj.tx_task_handle != NULL) {
+            ESP_LOGW(TAG, "TX queue task did not exit, forcing deletion");
+            vTaskDelete(esp32_can_obj.tx_task_handle);
+            esp32_can_obj.tx_task_handle = NULL;
+        }
+        esp32_can_obj.tx_task_should_stop = false;
+    }
+    if (flush && esp32_can_obj.tx_queue != NULL) {
+        can_tx_queue_item_t item;
+        while (xQueueReceive(esp32_can_obj.tx_queue, &item, 0) == pdTRUE) {
+            // Discard queued messages
+        }
+        ESP_LOGD(TAG, "Flushed TX queue");
+    }
+}
+
 // Internal function to find client by handle
 static can_client_t* find_client(can_handle_t h) {
     can_client_t *client = esp32_can_obj.clients;
@@ -2000,6 +2136,45 @@ esp_err_t can_transmit(can_handle_t h, const twai_message_t *msg) {
     return ret;
 }
 
+// Queue frames for asynchronous transmission by the manager TX task
+// Validates the client once for the whole batch; waits up to ticks_to_wait per
+// frame for queue space. Returns the number of frames queued.
+size_t can_transmit_batch(can_handle_t h, const twai_message_t *msgs, size_t count, TickType_t ticks_to_wait) {
+    if (h == NULL || msgs == NULL || count == 0) {
+        return 0;
+    }
+    
+    if (xSemaphoreTake(can_manager_mutex, portMAX_DELAY) != pdTRUE) {
+        return 0;
+    }
+    
+    can_client_t *client = find_client(h);
+    if (client == NULL || !client->is_registered || !client->is_activated ||
+        client->mode != CAN_CLIENT_MODE_TX_ENABLED) {
+        ESP_LOGE(TAG, "can_transmit_batch: Invalid, inactive, or RX-only client");
+        xSemaphoreGive(can_manager_mutex);
+        return 0;
+    }
+    
+    QueueHandle_t tx_queue = esp32_can_obj.tx_queue;
+    xSemaphoreGive(can_manager_mutex);
+    
+    if (tx_queue == NULL) {
+        ESP_LOGE(TAG, "can_transmit_batch: TX queue not running");
+        return 0;
+    }
+    
+    size_t queued = 0;
+    can_tx_queue_item_t item = { .client_handle = h };
+    for (; queued < count; queued++) {
+        item.msg = msgs[queued];
+        if (xQueueSend(tx_queue, &item, ticks_to_wait) != pdTRUE) {
+            break;
+        }
+    }
+    return queued;
+}
+
 // Update bus state based on activated clients
 static void update_bus_state(void) {
     if (xSemaphoreTake(can_manager_mutex, portMAX_DELAY) != pdTRUE) {
@@ -2081,20 +2256,8 @@ static void update_bus_state(void) {
                 esp32_can_obj.rx_dispatcher_should_stop = false;
             }
             
-            // Stop TX task
-            if (esp32_can_obj.tx_task_handle != NULL) {
-                vTaskDelete(esp32_can_obj.tx_task_handle);
-                esp32_can_obj.tx_task_handle = NULL;
-            }
-            
-            // Flush TX queue to prevent stale client handles
-            if (esp32_can_obj.tx_queue != NULL) {
-                can_tx_queue_item_t item;
-                while (xQueueReceive(esp32_can_obj.tx_queue, &item, 0) == pdTRUE) {
-                    // Discard queued messages
-                }
-                ESP_LOGD(TAG, "update_bus_state: Flushed TX queue");
-            }
+            // Stop TX task and flush TX queue to prevent stale client handles
+            stop_tx_queue_task(true);
             
             // Now safe to stop and uninstall driver
             if (esp32_can_obj.handle != NULL) {
@@ -2146,12 +2309,19 @@ static void update_bus_state(void) {
             }
         }
         
+        // Start TX queue task for can_transmit_batch()
+        start_tx_queue_task();
+        
         ESP_LOGI(TAG, "update_bus_state: Driver started (mode=%d)", target_mode);
         
     } else if (current_mode != target_mode) {
         // Driver running but mode needs to change - stop, reconfigure, restart
         ESP_LOGI(TAG, "update_bus_state: Reconfiguring driver %d -> %d", current_mode, target_mode);
         
+        // TX queue task must not touch the driver while it is reinstalled
+        // (queued frames are kept and sent once the driver restarts)
+        stop_tx_queue_task(false);
+        
         // CRITICAL: Stop RX dispatcher task gracefully to ensure no callbacks are executing
         // This prevents crashes during driver stop/uninstall
         TaskHandle_t old_rx_task = esp32_can_obj.rx_dispatcher_task;
@@ -2235,6 +2405,8 @@ static void update_bus_state(void) {
             }
         }
         
+        start_tx_queue_task();
+        
         ESP_LOGI(TAG, "update_bus_state: Driver reconfigured (mode=%d)", target_mode);
     }
 }
@@ -2282,12 +2454,15 @@ static void can_rx_dispatcher_task(void *arg) {
         int callback_count = 0;
         
         if (xSemaphoreTake(can_manager_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            // Echo of a frame from can_transmit_batch(): only its sender gets it
+            can_handle_t echo_client = self_echo_match(&rx_msg);
             can_client_t *client = esp32_can_obj.clients;
             while (client != NULL && callback_count < MAX_CLIENTS_PER_FRAME) {
                 // Check if client is valid, activated, not pending delete, and has callback
                 // IMPORTANT: Capture should_call flag while holding mutex - don't check later!
                 bool should_call = (client->is_activated && client->is_registered && 
-                                   !client->pending_delete && client->rx_callback != NULL);
+                                   !client->pending_delete && client->rx_callback != NULL &&
+                                   (echo_client == NULL || client == echo_client));
                 
                 if (should_call) {
                     // Add reference before releasing mutex (prevents free during callback)
@@ -2338,22 +2513,35 @@ static void can_tx_queue_task(void *arg) {
     
     ESP_LOGI(TAG, "TX queue task started");
     
-    while (1) {
-        // Wait for message from queue
-        if (xQueueReceive(tx_queue, &item, portMAX_DELAY) != pdTRUE) {
+    while (!esp32_can_obj.tx_task_should_stop) {
+        // Wait for message from queue (bounded so stop requests are noticed)
+        if (xQueueReceive(tx_queue, &item, pdMS_TO_TICKS(100)) != pdTRUE) {
             continue;
         }
         
         // Transmit frame directly (no client validation to avoid use-after-free)
         // If client was unregistered, that's fine - message was queued before unregistration
+        // Retry while the driver TX queue is full, but give up if a stop is requested
         if (esp32_can_obj.handle != NULL) {
-            esp_err_t ret = twai_transmit_v2(esp32_can_obj.handle, &item.msg, portMAX_DELAY);
+            // Record before transmitting: the echo can arrive before twai_transmit_v2 returns
+            bool self = item.msg.self;
+            if (self) {
+                self_echo_push(item.client_handle, &item.msg);
+            }
+            esp_err_t ret;
+            do {
+                ret = twai_transmit_v2(esp32_can_obj.handle, &item.msg, pdMS_TO_TICKS(100));
+            } while (ret == ESP_ERR_TIMEOUT && !esp32_can_obj.tx_task_should_stop);
+            if (ret != ESP_OK && self) {
+                self_echo_cancel();
+            }
             if (ret != ESP_OK) {
                 ESP_LOGW(TAG, "TX queue task: Transmit failed: %s", esp_err_to_name(ret));
             }
         }
     }
     
-    ESP_LOGI(TAG, "TX queue task deleted");
+    ESP_LOGI(TAG, "TX queue task exiting");
+    esp32_can_obj.tx_task_handle = NULL;
     vTaskDelete(NULL);
 }
@@ -164,6 +164,7 @@ typedef struct {
     QueueHandle_t rx_queue;  // RX queue for frames from manager callback
     TaskHandle_t rx_dispatcher_task;  // RX dispatcher task
     TaskHandle_t tx_task_handle;  // TX queue task
+    volatile bool tx_task_should_stop;  // Signal to TX queue task to stop
     uint32_t next_client_id;  // Incrementing client ID counter
     volatile bool rx_dispatcher_should_stop;  // Signal to RX dispatcher to stop
 } esp32_can_obj_t;
@@ -185,6 +186,7 @@ void can_set_rx_callback(can_handle_t h, can_rx_callback_t cb, void *arg);
 esp_err_t can_add_filter(can_handle_t h, uint32_t id, uint32_t mask);
 esp_err_t can_set_mode(can_handle_t h, can_client_mode_t mode);
 esp_err_t can_transmit(can_handle_t h, const twai_message_t *msg);
+size_t can_transmit_batch(can_handle_t h, const twai_message_t *msgs, size_t count, TickType_t ticks_to_wait);
 bool can_is_registered(can_handle_t h);
 void can_set_loopback(bool enabled);  // Set loopback mode (for testing)
 
@@ -22,6 +22,7 @@ Boot Sequence:
 5. Register connection callbacks for LED state management
 6. Start async background tasks:
    - queue_pump: Processes WBP queues for both transports (10ms interval)
+   - http_pump: Processes HTTP/WebSocket queue as soon as work arrives (httpserver.next_event)
 
 Helper Utilities (imported from lib.sys.utils):
     - getSysInfo()        - Comprehensive system info
@@ -183,17 +184,31 @@ def start_servers(ip):
 # Async Background Tasks
 # =============================================================================
 
+# Older firmware has no httpserver.next_event() - fall back to polling
+_HTTP_EVENTS = hasattr(httpserver, 'next_event')
+
 async def queue_pump():
     """Process webRTC, WebREPL and HTTP queues - core task that keeps REPL responsive"""
     while True:
         try:
             webrepl.process_queue()  # Handles both WebSocket and WebRTC transports
-            httpserver.process_queue()
+            if not _HTTP_EVENTS:
+                httpserver.process_queue()
         except Exception as e:
             _log("warning", f"queue_pump error: {e}")
         
         await asyncio.sleep_ms(10)
 
+async def http_pump():
+    """Process HTTP requests and WebSocket messages as soon as they are queued"""
+    while True:
+        try:
+            await httpserver.next_event()
+            httpserver.process_queue()
+        except Exception as e:
+            _log("warning", f"http_pump error: {e}")
+            await asyncio.sleep_ms(10)
+
 async def system_root():
     """Main async entry point - starts all background tasks"""
     _log("info", "Starting background tasks...")
@@ -201,6 +216,9 @@ async def system_root():
     # Start system tasks (protected from Stop button)
     bg_tasks.start("queue_pump", queue_pump, is_system=True)
     _log("debug", "queue_pump started (system)")
+    if _HTTP_EVENTS:
+        bg_tasks.start("http_pump", http_pump, is_system=True)
+        _log("debug", "http_pump started (system)")
     
     _log("info", f"Active tasks: {list(bg_tasks.list_tasks().keys())}")
     
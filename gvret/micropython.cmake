@@ -1,5 +1,6 @@
 # CMake configuration for pyDirect GVRET module
 # GVRET protocol implementation for CAN over TCP (SavvyCAN compatible)
+# plus the cannelloni module (CAN over UDP to a Linux SocketCAN host)
 #
 # NOTE: GVRET depends on the CAN module for CAN manager API
 
@@ -18,6 +19,7 @@ add_library(usermod_gvret INTERFACE)
 # Add source files
 target_sources(usermod_gvret INTERFACE
     ${GVRET_MODULE_DIR}/modgvret.c
+    ${GVRET_MODULE_DIR}/modcannelloni.c
 )
 
 # Add include directories (including can/ for modcan.h dependency)
@@ -31,3 +33,10 @@ target_link_libraries(usermod_gvret INTERFACE usermod_can)
 
 # Link to MicroPython's usermod target
 target_link_libraries(usermod INTERFACE usermod_gvret)
+
+# WebSocket transport (gvret.start_ws) needs the wsserver C API from httpserver
+if(MODULE_PYDIRECT_HTTPSERVER)
+    target_compile_definitions(usermod_gvret INTERFACE GVRET_WS_TRANSPORT=1)
+    target_include_directories(usermod_gvret INTERFACE ${PYDIRECT_DIR}/httpserver)
+    message(STATUS "pyDirect gvret: WebSocket transport enabled")
+endif()
@@ -0,0 +1,563 @@
+/*
+ * modcannelloni.c - Cannelloni-compatible CAN-over-UDP tunnel
+ *
+ * Bridges the CAN manager to a Linux SocketCAN host running cannelloni
+ * (https://github.com/mguentner/cannelloni), so candump/cantools/python-can
+ * can use a local vcan interface as if it were the device's bus.
+ *
+ * Packet format (cannelloni frame version 2, all multi-byte fields big-endian):
+ *   Header:  version(1)=2, op_code(1)=DATA, seq_no(1), count(2)
+ *   Frame:   can_id(4) [bit31=EFF, bit30=RTR, bit29=ERR], len(1), data(len)
+ *            If len bit 7 is set the frame is CAN FD and a flags byte follows len.
+ *
+ * Many frames are packed per datagram; a datagram is sent when it is full or
+ * when the oldest frame in it has waited timeout_ms.
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#include "esp_log.h"
+
+#include "py/runtime.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "driver/twai.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "freertos/semphr.h"
+#include "modcan.h"  // For CAN manager API
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+static const char *TAG = "CANNELLONI";
+
+// Protocol constants (from cannelloni's parser.h)
+#define CANNELLONI_FRAME_VERSION 2
+#define CANNELLONI_OP_DATA 0
+#define CANNELLONI_HEADER_SIZE 5
+#define CANNELLONI_EFF_FLAG 0x80000000U
+#define CANNELLONI_RTR_FLAG 0x40000000U
+#define CANNELLONI_ERR_FLAG 0x20000000U
+#define CANNELLONI_CANFD_FRAME 0x80
+
+// Configuration
+#define CANNELLONI_DEFAULT_PORT 20000
+#define CANNELLONI_MAX_PACKET 1400        // Stay below typical Wi-Fi/VPN MTU
+#define CANNELLONI_MAX_FRAME_SIZE 13      // id(4) + len(1) + data(8)
+#define CANNELLONI_RINGBUF_SIZE (16 * 1024)
+#define CANNELLONI_STACK_SIZE 4096
+#define CANNELLONI_PRIORITY 5
+#define CANNELLONI_TX_BATCH_MAX 16        // Frames per manager TX queue hand-off
+#define CANNELLONI_TX_QUEUE_WAIT_MS 20    // Max wait per batch when the manager TX queue is full
+
+typedef struct {
+    volatile bool enabled;
+    can_handle_t can_handle;
+    RingbufHandle_t ringbuf_handle;   // Encoded frames waiting for a datagram
+    TaskHandle_t tx_task_handle;      // CAN -> UDP
+    TaskHandle_t rx_task_handle;      // UDP -> CAN
+    int sock;
+    struct sockaddr_in remote_addr;
+    bool remote_known;                // false until configured or learned from first packet
+    int timeout_ms;
+    uint8_t tx_seq;
+    uint8_t rx_seq;
+    bool rx_seq_valid;
+    // Statistics
+    uint32_t frames_to_udp;
+    uint32_t frames_from_udp;
+    uint32_t packets_sent;
+    uint32_t packets_received;
+    uint32_t dropped_count;
+    uint32_t seq_errors;
+    volatile int callback_active;
+    int tasks_running;                // Tasks created; each gives cnl_task_exit on the way out
+} cannelloni_config_t;
+
+static cannelloni_config_t cnl_cfg = {
+    .can_handle = NULL,
+    .sock = -1,
+    .timeout_ms = 2,
+};
+
+static SemaphoreHandle_t cnl_stats_mutex = NULL;
+static SemaphoreHandle_t cnl_task_exit = NULL;  // Counting: one give per exited task
+
+static void cnl_stats_add(uint32_t *counter, uint32_t n) {
+    if (cnl_stats_mutex == NULL) {
+        cnl_stats_mutex = xSemaphoreCreateMutex();
+    }
+    if (cnl_stats_mutex != NULL && xSemaphoreTake(cnl_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+        *counter += n;
+        xSemaphoreGive(cnl_stats_mutex);
+    }
+}
+
+// The peer address is learned by the RX task and used by the TX task
+static SemaphoreHandle_t cnl_addr_mutex = NULL;
+
+static bool cnl_get_remote(struct sockaddr_in *addr) {
+    bool known = false;
+    if (cnl_addr_mutex != NULL && xSemaphoreTake(cnl_addr_mutex, portMAX_DELAY) == pdTRUE) {
+        known = cnl_cfg.remote_known;
+        *addr = cnl_cfg.remote_addr;
+        xSemaphoreGive(cnl_addr_mutex);
+    }
+    return known;
+}
+
+static void cnl_set_remote(const struct sockaddr_in *addr) {
+    if (cnl_addr_mutex != NULL && xSemaphoreTake(cnl_addr_mutex, portMAX_DELAY) == pdTRUE) {
+        cnl_cfg.remote_addr = *addr;
+        cnl_cfg.remote_known = true;
+        xSemaphoreGive(cnl_addr_mutex);
+    }
+}
+
+// CAN RX callback - called by manager's RX dispatcher task
+// Encodes the frame in cannelloni wire format and queues it for the TX task
+static void cnl_can_rx_callback(const twai_message_t *message, void *arg) {
+    __sync_fetch_and_add(&cnl_cfg.callback_active, 1);
+
+    if (message == NULL || !cnl_cfg.enabled || cnl_cfg.ringbuf_handle == NULL) {
+        __sync_fetch_and_sub(&cnl_cfg.callback_active, 1);
+        return;
+    }
+
+    uint8_t buffer[CANNELLONI_MAX_FRAME_SIZE];
+    uint8_t len = message->data_length_code > 8 ? 8 : message->data_length_code;
+    uint32_t id = message->identifier;
+    if (message->extd) {
+        id |= CANNELLONI_EFF_FLAG;
+    }
+    if (message->rtr) {
+        id |= CANNELLONI_RTR_FLAG;
+    }
+
+    int idx = 0;
+    buffer[idx++] = (uint8_t)(id >> 24);
+    buffer[idx++] = (uint8_t)(id >> 16);
+    buffer[idx++] = (uint8_t)(id >> 8);
+    buffer[idx++] = (uint8_t)(id & 0xFF);
+    buffer[idx++] = len;
+    if (!message->rtr) {
+        memcpy(&buffer[idx], message->data, len);
+        idx += len;
+    }
+
+    if (xRingbufferSend(cnl_cfg.ringbuf_handle, buffer, idx, 0) != pdTRUE) {
+        cnl_stats_add(&cnl_cfg.dropped_count, 1);
+    }
+
+    __sync_fetch_and_sub(&cnl_cfg.callback_active, 1);
+}
+
+static void cnl_write_header(uint8_t *packet, uint8_t seq, uint16_t count) {
+    packet[0] = CANNELLONI_FRAME_VERSION;
+    packet[1] = CANNELLONI_OP_DATA;
+    packet[2] = seq;
+    packet[3] = (uint8_t)(count >> 8);
+    packet[4] = (uint8_t)(count & 0xFF);
+}
+
+// CAN -> UDP: pack queued frames into datagrams
+static void cnl_tx_task(void *arg) {
+    uint8_t packet[CANNELLONI_MAX_PACKET];
+
+    while (cnl_cfg.enabled) {
+        size_t item_size;
+        uint8_t *item = (uint8_t *)xRingbufferReceive(cnl_cfg.ringbuf_handle, &item_size, pdMS_TO_TICKS(50));
+        if (item == NULL) {
+            continue;
+        }
+
+        // First frame starts the flush window; keep packing until full or timed out
+        size_t packet_len = CANNELLONI_HEADER_SIZE;
+        uint16_t count = 0;
+        // At least one tick, or the window is a busy loop at 100 Hz
+        TickType_t window = pdMS_TO_TICKS(cnl_cfg.timeout_ms);
+        TickType_t flush_deadline = xTaskGetTickCount() + (window > 0 ? window : 1);
+        while (item != NULL) {
+            memcpy(packet + packet_len, item, item_size);
+            packet_len += item_size;
+            count++;
+            vRingbufferReturnItem(cnl_cfg.ringbuf_handle, (void *)item);
+
+            if (packet_len + CANNELLONI_MAX_FRAME_SIZE > CANNELLONI_MAX_PACKET) {
+                break;
+            }
+            TickType_t now = xTaskGetTickCount();
+            TickType_t wait = (int32_t)(flush_deadline - now) > 0 ? flush_deadline - now : 0;
+            item = (uint8_t *)xRingbufferReceive(cnl_cfg.ringbuf_handle, &item_size, wait);
+        }
+
+        struct sockaddr_in remote;
+        if (!cnl_get_remote(&remote)) {
+            // No peer yet - nothing to send to
+            cnl_stats_add(&cnl_cfg.dropped_count, count);
+            continue;
+        }
+
+        cnl_write_header(packet, cnl_cfg.tx_seq++, count);
+        int sent = sendto(cnl_cfg.sock, packet, packet_len, 0,
+                          (struct sockaddr *)&remote, sizeof(remote));
+        if (sent < 0) {
+            ESP_LOGW(TAG, "sendto failed: errno %d", errno);
+            cnl_stats_add(&cnl_cfg.dropped_count, count);
+        } else {
+            cnl_stats_add(&cnl_cfg.packets_sent, 1);
+            cnl_stats_add(&cnl_cfg.frames_to_udp, count);
+        }
+    }
+
+    ESP_LOGI(TAG, "TX task exiting");
+    xSemaphoreGive(cnl_task_exit);
+    vTaskDelete(NULL);
+}
+
+// Hand a batch of frames to the manager TX queue
+static uint32_t cnl_transmit_batch(const twai_message_t *batch, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    size_t queued = can_transmit_batch(cnl_cfg.can_handle, batch, count, pdMS_TO_TICKS(CANNELLONI_TX_QUEUE_WAIT_MS));
+    if (queued < count) {
+        cnl_stats_add(&cnl_cfg.dropped_count, count - queued);
+    }
+    return queued;
+}
+
+// Parse one datagram and queue its frames for the bus
+static void cnl_handle_packet(const uint8_t *packet, size_t len) {
+    if (len < CANNELLONI_HEADER_SIZE) {
+        return;
+    }
+    if (packet[0] != CANNELLONI_FRAME_VERSION || packet[1] != CANNELLONI_OP_DATA) {
+        ESP_LOGD(TAG, "Ignoring packet: version=%d op=%d", packet[0], packet[1]);
+        return;
+    }
+
+    uint8_t seq = packet[2];
+    if (cnl_cfg.rx_seq_valid && seq != (uint8_t)(cnl_cfg.rx_seq + 1)) {
+        cnl_stats_add(&cnl_cfg.seq_errors, 1);
+    }
+    cnl_cfg.rx_seq = seq;
+    cnl_cfg.rx_seq_valid = true;
+
+    uint16_t count = ((uint16_t)packet[3] << 8) | packet[4];
+    size_t pos = CANNELLONI_HEADER_SIZE;
+    uint32_t transmitted = 0;
+    twai_message_t batch[CANNELLONI_TX_BATCH_MAX];
+    size_t batch_count = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (pos + 5 > len) {
+            ESP_LOGW(TAG, "Truncated packet (%d/%d frames)", i, count);
+            break;
+        }
+        uint32_t id = ((uint32_t)packet[pos] << 24) | ((uint32_t)packet[pos + 1] << 16) |
+                      ((uint32_t)packet[pos + 2] << 8) | packet[pos + 3];
+        uint8_t frame_len = packet[pos + 4];
+        pos += 5;
+
+        bool is_fd = (frame_len & CANNELLONI_CANFD_FRAME) != 0;
+        if (is_fd) {
+            frame_len &= ~CANNELLONI_CANFD_FRAME;
+            pos++;  // Skip CAN FD flags byte
+        }
+        bool rtr = (id & CANNELLONI_RTR_FLAG) != 0;
+        size_t data_len = rtr ? 0 : frame_len;
+        if (pos + data_len > len) {
+            ESP_LOGW(TAG, "Truncated frame data");
+            break;
+        }
+
+        // TWAI is classic CAN only - skip FD, error and oversize frames
+        if (is_fd || (id & CANNELLONI_ERR_FLAG) || frame_len > 8) {
+            cnl_stats_add(&cnl_cfg.dropped_count, 1);
+            pos += data_len;
+            continue;
+        }
+
+        twai_message_t *tx_msg = &batch[batch_count++];
+        memset(tx_msg, 0, sizeof(*tx_msg));
+        tx_msg->extd = (id & CANNELLONI_EFF_FLAG) ? 1 : 0;
+        tx_msg->rtr = rtr ? 1 : 0;
+        tx_msg->identifier = id & (tx_msg->extd ? 0x1FFFFFFF : 0x7FF);
+        tx_msg->data_length_code = frame_len;
+        memcpy(tx_msg->data, packet + pos, data_len);
+        pos += data_len;
+
+        if (batch_count == CANNELLONI_TX_BATCH_MAX) {
+            transmitted += cnl_transmit_batch(batch, batch_count);
+            batch_count = 0;
+        }
+    }
+    transmitted += cnl_transmit_batch(batch, batch_count);
+
+    cnl_stats_add(&cnl_cfg.packets_received, 1);
+    cnl_stats_add(&cnl_cfg.frames_from_udp, transmitted);
+}
+
+// UDP -> CAN
+static void cnl_rx_task(void *arg) {
+    uint8_t packet[CANNELLONI_MAX_PACKET];
+
+    while (cnl_cfg.enabled) {
+        struct sockaddr_in source_addr;
+        socklen_t addr_len = sizeof(source_addr);
+        int len = recvfrom(cnl_cfg.sock, packet, sizeof(packet), 0,
+                           (struct sockaddr *)&source_addr, &addr_len);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                continue;  // Receive timeout - re-check enabled flag
+            }
+            if (cnl_cfg.enabled) {
+                ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(100));
+            }
+            continue;
+        }
+
+        // Learn the peer from the first packet if no remote was configured
+        struct sockaddr_in remote;
+        if (!cnl_get_remote(&remote)) {
+            cnl_set_remote(&source_addr);
+            ESP_LOGI(TAG, "Learned remote peer %s:%d",
+                     inet_ntoa(source_addr.sin_addr), ntohs(source_addr.sin_port));
+        }
+
+        cnl_handle_packet(packet, len);
+    }
+
+    ESP_LOGI(TAG, "RX task exiting");
+    xSemaphoreGive(cnl_task_exit);
+    vTaskDelete(NULL);
+}
+
+void cannelloni_stop(void);
+
+bool cannelloni_start(const char *remote_ip, int remote_port, int local_port, int timeout_ms, bool listen_only) {
+    if (cnl_cfg.enabled) {
+        ESP_LOGI(TAG, "Tunnel already running, restarting");
+        cannelloni_stop();
+    }
+
+    if (cnl_addr_mutex == NULL) {
+        cnl_addr_mutex = xSemaphoreCreateMutex();
+        if (cnl_addr_mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create address mutex");
+            return false;
+        }
+    }
+    if (cnl_stats_mutex == NULL) {
+        cnl_stats_mutex = xSemaphoreCreateMutex();  // Before the tasks use it
+    }
+    if (cnl_task_exit == NULL) {
+        cnl_task_exit = xSemaphoreCreateCounting(2, 0);
+        if (cnl_task_exit == NULL) {
+            ESP_LOGE(TAG, "Failed to create task exit semaphore");
+            return false;
+        }
+    }
+    memset(&cnl_cfg.remote_addr, 0, sizeof(cnl_cfg.remote_addr));
+    cnl_cfg.remote_known = false;
+    if (remote_ip != NULL) {
+        cnl_cfg.remote_addr.sin_family = AF_INET;
+        cnl_cfg.remote_addr.sin_port = htons(remote_port);
+        if (inet_aton(remote_ip, &cnl_cfg.remote_addr.sin_addr) == 0) {
+            ESP_LOGE(TAG, "Invalid remote address '%s'", remote_ip);
+            return false;
+        }
+        cnl_cfg.remote_known = true;
+    }
+    cnl_cfg.timeout_ms = timeout_ms > 0 ? timeout_ms : 1;
+    cnl_cfg.tx_seq = 0;
+    cnl_cfg.rx_seq_valid = false;
+    cnl_cfg.frames_to_udp = 0;
+    cnl_cfg.frames_from_udp = 0;
+    cnl_cfg.packets_sent = 0;
+    cnl_cfg.packets_received = 0;
+    cnl_cfg.dropped_count = 0;
+    cnl_cfg.seq_errors = 0;
+
+    // UDP socket
+    cnl_cfg.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (cnl_cfg.sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return false;
+    }
+    struct sockaddr_in local_addr = {0};
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    local_addr.sin_port = htons(local_port);
+    if (bind(cnl_cfg.sock, (struct sockaddr *)&local_addr, sizeof(local_addr)) != 0) {
+        ESP_LOGE(TAG, "Socket unable to bind port %d: errno %d", local_port, errno);
+        close(cnl_cfg.sock);
+        cnl_cfg.sock = -1;
+        return false;
+    }
+    struct timeval rcv_timeout = { .tv_sec = 0, .tv_usec = 100000 };
+    setsockopt(cnl_cfg.sock, SOL_SOCKET, SO_RCVTIMEO, &rcv_timeout, sizeof(rcv_timeout));
+
+    cnl_cfg.ringbuf_handle = xRingbufferCreate(CANNELLONI_RINGBUF_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (cnl_cfg.ringbuf_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create ring buffer");
+        close(cnl_cfg.sock);
+        cnl_cfg.sock = -1;
+        return false;
+    }
+
+    // Register and activate with CAN manager - the tunnel is always live
+    cnl_cfg.can_handle = can_register(listen_only ? CAN_CLIENT_MODE_RX_ONLY : CAN_CLIENT_MODE_TX_ENABLED);
+    if (cnl_cfg.can_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to register with CAN manager");
+        vRingbufferDelete(cnl_cfg.ringbuf_handle);
+        cnl_cfg.ringbuf_handle = NULL;
+        close(cnl_cfg.sock);
+        cnl_cfg.sock = -1;
+        return false;
+    }
+    can_set_rx_callback(cnl_cfg.can_handle, cnl_can_rx_callback, NULL);
+
+    cnl_cfg.enabled = true;
+    cnl_cfg.tasks_running = 0;
+
+    if (xTaskCreate(cnl_tx_task, "cnl_tx", CANNELLONI_STACK_SIZE, NULL, CANNELLONI_PRIORITY, &cnl_cfg.tx_task_handle) == pdPASS) {
+        cnl_cfg.tasks_running++;
+    }
+    if (xTaskCreate(cnl_rx_task, "cnl_rx", CANNELLONI_STACK_SIZE, NULL, CANNELLONI_PRIORITY, &cnl_cfg.rx_task_handle) == pdPASS) {
+        cnl_cfg.tasks_running++;
+    }
+    if (cnl_cfg.tasks_running < 2) {
+        ESP_LOGE(TAG, "Failed to create tunnel tasks");
+        cannelloni_stop();
+        return false;
+    }
+
+    esp_err_t ret = can_activate(cnl_cfg.can_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to activate CAN client: %s", esp_err_to_name(ret));
+        cannelloni_stop();
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Tunnel started: local port %d, remote %s:%d, timeout %d ms",
+             local_port, remote_ip ? remote_ip : "(learn)", remote_port, cnl_cfg.timeout_ms);
+    return true;
+}
+
+void cannelloni_stop(void) {
+    if (!cnl_cfg.enabled) {
+        return;
+    }
+    ESP_LOGI(TAG, "Stopping tunnel...");
+    cnl_cfg.enabled = false;
+
+    // Tasks see enabled=false within one receive timeout (100 ms socket, 50 ms
+    // ringbuffer) and may still be using the CAN handle, socket and ringbuffer
+    // until then, so wait for every one of them to exit before freeing those
+    while (cnl_cfg.tasks_running > 0) {
+        xSemaphoreTake(cnl_task_exit, portMAX_DELAY);
+        cnl_cfg.tasks_running--;
+    }
+    cnl_cfg.tx_task_handle = NULL;
+    cnl_cfg.rx_task_handle = NULL;
+
+    // No new CAN callbacks after this; wait out the ones in flight
+    if (cnl_cfg.can_handle != NULL) {
+        can_unregister(cnl_cfg.can_handle);
+        cnl_cfg.can_handle = NULL;
+    }
+    while (__sync_fetch_and_add(&cnl_cfg.callback_active, 0) > 0) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    if (cnl_cfg.sock >= 0) {
+        close(cnl_cfg.sock);
+        cnl_cfg.sock = -1;
+    }
+    if (cnl_cfg.ringbuf_handle != NULL) {
+        vRingbufferDelete(cnl_cfg.ringbuf_handle);
+        cnl_cfg.ringbuf_handle = NULL;
+    }
+    ESP_LOGI(TAG, "Tunnel stopped");
+}
+
+// MicroPython wrapper functions
+
+// cannelloni.start(remote_ip=None, remote_port=20000, local_port=20000, timeout_ms=2, listen_only=False)
+static mp_obj_t cannelloni_start_wrapper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_remote_ip, ARG_remote_port, ARG_local_port, ARG_timeout_ms, ARG_listen_only };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_remote_ip, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_remote_port, MP_ARG_INT, {.u_int = CANNELLONI_DEFAULT_PORT} },
+        { MP_QSTR_local_port, MP_ARG_INT, {.u_int = CANNELLONI_DEFAULT_PORT} },
+        { MP_QSTR_timeout_ms, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 2} },
+        { MP_QSTR_listen_only, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    const char *remote_ip = args[ARG_remote_ip].u_obj == mp_const_none ? NULL : mp_obj_str_get_str(args[ARG_remote_ip].u_obj);
+    return mp_obj_new_bool(cannelloni_start(remote_ip, args[ARG_remote_port].u_int, args[ARG_local_port].u_int,
+                                            args[ARG_timeout_ms].u_int, args[ARG_listen_only].u_bool));
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(cannelloni_start_obj, 0, cannelloni_start_wrapper);
+
+static mp_obj_t cannelloni_stop_wrapper(void) {
+    cannelloni_stop();
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(cannelloni_stop_obj, cannelloni_stop_wrapper);
+
+static mp_obj_t cannelloni_is_running_wrapper(void) {
+    return mp_obj_new_bool(cnl_cfg.enabled);
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(cannelloni_is_running_obj, cannelloni_is_running_wrapper);
+
+static mp_obj_t cannelloni_get_stats_wrapper(void) {
+    // Snapshot the counters together, under the lock the tasks update them with
+    uint32_t counters[6] = {0};
+    if (cnl_stats_mutex != NULL && xSemaphoreTake(cnl_stats_mutex, portMAX_DELAY) == pdTRUE) {
+        counters[0] = cnl_cfg.frames_to_udp;
+        counters[1] = cnl_cfg.frames_from_udp;
+        counters[2] = cnl_cfg.packets_sent;
+        counters[3] = cnl_cfg.packets_received;
+        counters[4] = cnl_cfg.dropped_count;
+        counters[5] = cnl_cfg.seq_errors;
+        xSemaphoreGive(cnl_stats_mutex);
+    }
+    mp_obj_t dict = mp_obj_new_dict(6);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_frames_to_udp), mp_obj_new_int_from_uint(counters[0]));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_frames_from_udp), mp_obj_new_int_from_uint(counters[1]));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_packets_sent), mp_obj_new_int_from_uint(counters[2]));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_packets_received), mp_obj_new_int_from_uint(counters[3]));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dropped), mp_obj_new_int_from_uint(counters[4]));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_seq_errors), mp_obj_new_int_from_uint(counters[5]));
+    return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(cannelloni_get_stats_obj, cannelloni_get_stats_wrapper);
+
+// Module globals table
+static const mp_rom_map_elem_t cannelloni_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_cannelloni) },
+    { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&cannelloni_start_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&cannelloni_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_is_running), MP_ROM_PTR(&cannelloni_is_running_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get_stats), MP_ROM_PTR(&cannelloni_get_stats_obj) },
+};
+static MP_DEFINE_CONST_DICT(cannelloni_module_globals, cannelloni_module_globals_table);
+
+const mp_obj_module_t cannelloni_user_cmodule = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t *)&cannelloni_module_globals,
+};
+
+MP_REGISTER_MODULE(MP_QSTR_cannelloni, cannelloni_user_cmodule);
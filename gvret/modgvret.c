@@ -2,7 +2,10 @@
 #include "esp_log.h"
 
 #include "py/runtime.h"
+#include "py/stream.h"
+#include "py/builtin.h"  // For mp_vfs_open()
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
 #include "driver/twai.h"
@@ -19,6 +22,10 @@
 #include <errno.h>
 #include <inttypes.h>  // For PRIx32 format specifier
 
+#if GVRET_WS_TRANSPORT
+#include "wsserver.h"  // wsserver C API (from httpserver module)
+#endif
+
 // Logger tag
 static const char *TAG = "GVRET";
 
@@ -61,6 +68,27 @@ static SemaphoreHandle_t gvret_cfg_mutex = NULL;
 #define GVRET_TCP_PORT 23
 #define GVRET_STACK_SIZE 4096
 #define GVRET_PRIORITY 5
+#define GVRET_MAX_FRAME_SIZE 19        // F1 00 + timestamp(4) + id(4) + bus/len(1) + data(8)
+#define GVRET_WS_BATCH_SIZE 1400       // Max bytes of encoded frames per WebSocket binary message
+#define GVRET_WS_FLUSH_MS 5            // Max time a frame waits for its batch to fill
+#define GVRET_WS_PATH_MAX 32
+#define GVRET_WS_REPLAY_PENDING 4      // Max queued WebSocket sends while replaying the capture
+#define GVRET_WS_REPLAY_STALL_MS 2000  // Give up on a replay chunk after this long
+#define GVRET_TX_BATCH_MAX 16           // Frames parsed per manager TX queue hand-off
+#define GVRET_TX_QUEUE_WAIT_MS 20      // Max wait per frame when the manager TX queue is full (TCP only)
+#define GVRET_STREAM_WAIT_SLICE_MS 100  // Longest single wait of stream.read(); under gvret_stop()'s barrier
+#define GVRET_CAPTURE_DEFAULT_SECONDS 30
+#define GVRET_CAPTURE_DEFAULT_SIZE (1024 * 1024)  // 1MB of PSRAM
+#define GVRET_CAPTURE_READ_BATCH 32    // Records copied out per mutex hold
+
+// Transport that currently owns the GVRET session (only one client at a time,
+// since TCP and WebSocket drain the same ringbuffer)
+typedef enum {
+    GVRET_TRANSPORT_NONE = 0,
+    GVRET_TRANSPORT_TCP,
+    GVRET_TRANSPORT_WS,
+    GVRET_TRANSPORT_STREAM,  // Python reader via gvret.stream()
+} gvret_transport_t;
 
 typedef struct {
     bool enabled;
@@ -72,7 +100,16 @@ typedef struct {
     RingbufHandle_t ringbuf_handle;
     int tcp_client_sock;
     int tcp_listen_sock;  // Listen socket for TCP server
+    volatile int active_transport;  // gvret_transport_t owning the session
+    volatile int ws_client_id;      // wsserver client ID of WebSocket session, -1 if none
+    TaskHandle_t ws_task_handle;    // WebSocket batching task
+    uint32_t ws_replay_start;       // Capture records to replay to the WebSocket client
+    uint32_t ws_replay_end;
+    char ws_path[GVRET_WS_PATH_MAX];  // WebSocket endpoint path ("" if not started)
+    uint32_t stream_generation;     // Bumped on each gvret.stream() so stale stream objects read EOF
+    volatile bool stream_release_pending;  // Stream finalised, CAN client still to be deactivated
     mp_obj_t bitrate_change_callback;  // MicroPython callback for bitrate changes
+    volatile bool tx_echo;  // Echo transmitted frames back (self-reception)
     // Statistics counters (atomic access from multiple tasks)
     uint32_t rx_count;
     uint32_t tx_count;
@@ -89,6 +126,8 @@ static gvret_config_t gvret_cfg = {
     .dropped_count = 0,
     .tcp_listen_sock = -1,
     .tcp_client_sock = -1,
+    .active_transport = GVRET_TRANSPORT_NONE,
+    .ws_client_id = -1,
     .callback_active = 0
 };
 
@@ -111,6 +150,60 @@ static gvret_filter_t filters[MAX_FILTERS];
 //     return val;
 // }
 
+// Software filtering: accept if no filters are active or any filter matches
+static bool gvret_filter_accepts(uint32_t identifier, bool extd) {
+    bool has_active_filters = false;
+    for (int i = 0; i < MAX_FILTERS; i++) {
+        if (filters[i].active) {
+            has_active_filters = true;
+            // Check if ID matches: (ID & Mask) == (Filter & Mask)
+            if ((identifier & filters[i].mask) == (filters[i].id & filters[i].mask)) {
+                if (extd == filters[i].extended) {
+                    return true;
+                }
+            }
+        }
+    }
+    return !has_active_filters;
+}
+
+// Format a received frame as a GVRET packet (F1 00 timestamp id bus/len data)
+// Returns the encoded length (at most GVRET_MAX_FRAME_SIZE)
+static int gvret_encode_frame(uint8_t *buffer, uint32_t timestamp, uint32_t identifier, bool extd,
+                              uint8_t dlc, const uint8_t *data) {
+    int idx = 0;
+    buffer[idx++] = GVRET_START_BYTE;
+    buffer[idx++] = 0; // Command: Frame Received
+
+    buffer[idx++] = (uint8_t)(timestamp & 0xFF);
+    buffer[idx++] = (uint8_t)(timestamp >> 8);
+    buffer[idx++] = (uint8_t)(timestamp >> 16);
+    buffer[idx++] = (uint8_t)(timestamp >> 24);
+
+    uint32_t id = identifier;
+    if (extd) {
+        id |= (1 << 31);
+    }
+    buffer[idx++] = (uint8_t)(id & 0xFF);
+    buffer[idx++] = (uint8_t)(id >> 8);
+    buffer[idx++] = (uint8_t)(id >> 16);
+    buffer[idx++] = (uint8_t)(id >> 24);
+
+    // Bus 0 (default) << 4 | Length
+    if (dlc > 8) {
+        dlc = 8;
+    }
+    buffer[idx++] = (0 << 4) | (dlc & 0x0F);
+
+    for (int i = 0; i < dlc; i++) {
+        buffer[idx++] = data[i];
+    }
+
+    // Note: SavvyCAN doesn't read checksum byte - it processes frame at rx_step == buildData.length() + 8
+    // So we don't send a checksum byte for CAN frames
+    return idx;
+}
+
 // CAN RX callback - called by manager's RX dispatcher task
 // NOTE: This is called from a FreeRTOS task, not from MicroPython context
 // Must be careful about accessing gvret_cfg - it's a static structure so should be safe
@@ -148,28 +241,14 @@ static void gvret_can_rx_callback(const twai_message_t *message, void *arg) {
     // Skip RTR frames - they shouldn't be forwarded
     if (message->rtr) {
         ESP_LOGD(TAG, "Skipping RTR frame: ID=0x%08" PRIx32, message->identifier);
+        __sync_fetch_and_sub(&gvret_cfg.callback_active, 1);
         return;
     }
     
-    uint8_t buffer[32]; // GVRET frame buffer (max 32 bytes: start + cmd + timestamp(4) + id(4) + bus+len(1) + data(8) + checksum(1))
+    uint8_t buffer[GVRET_MAX_FRAME_SIZE];
     
     // Software Filtering
-    bool accepted = false;
-    bool has_active_filters = false;
-    for (int i = 0; i < MAX_FILTERS; i++) {
-        if (filters[i].active) {
-            has_active_filters = true;
-            // Check if ID matches: (ID & Mask) == (Filter & Mask)
-            if ((message->identifier & filters[i].mask) == (filters[i].id & filters[i].mask)) {
-                if (message->extd == filters[i].extended) {
-                    accepted = true;
-                    break;
-                }
-            }
-        }
-    }
-    
-    if (has_active_filters && !accepted) {
+    if (!gvret_filter_accepts(message->identifier, message->extd)) {
         // Increment dropped count for filtered frames
         gvret_init_stats_mutex();
         if (gvret_stats_mutex != NULL && xSemaphoreTake(gvret_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
@@ -181,34 +260,8 @@ static void gvret_can_rx_callback(const twai_message_t *message, void *arg) {
     }
 
     // Format GVRET packet
-    int idx = 0;
-    buffer[idx++] = GVRET_START_BYTE;
-    buffer[idx++] = 0; // Command: Frame Received
-
-    uint32_t now = (uint32_t)esp_timer_get_time();
-    buffer[idx++] = (uint8_t)(now & 0xFF);
-    buffer[idx++] = (uint8_t)(now >> 8);
-    buffer[idx++] = (uint8_t)(now >> 16);
-    buffer[idx++] = (uint8_t)(now >> 24);
-
-    uint32_t id = message->identifier;
-    if (message->extd) {
-        id |= (1 << 31);
-    }
-    buffer[idx++] = (uint8_t)(id & 0xFF);
-    buffer[idx++] = (uint8_t)(id >> 8);
-    buffer[idx++] = (uint8_t)(id >> 16);
-    buffer[idx++] = (uint8_t)(id >> 24);
-
-    // Bus 0 (default) << 4 | Length
-    buffer[idx++] = (0 << 4) | (message->data_length_code & 0x0F);
-
-    for (int i = 0; i < message->data_length_code; i++) {
-        buffer[idx++] = message->data[i];
-    }
-
-    // Note: SavvyCAN doesn't read checksum byte - it processes frame at rx_step == buildData.length() + 8
-    // So we don't send a checksum byte for CAN frames
+    int idx = gvret_encode_frame(buffer, (uint32_t)esp_timer_get_time(), message->identifier, message->extd,
+                                 message->data_length_code, message->data);
 
     // Use non-blocking send to avoid blocking the RX dispatcher task
     // If ringbuffer is full, drop the frame immediately
@@ -254,11 +307,27 @@ typedef enum {
     SET_EXT_BUSES
 } gvret_state_t;
 
-static gvret_state_t state = IDLE;
-static int step = 0;
-static int frame_len = 0;
-static uint8_t setup_canbus_buffer[9] = {0};  // Buffer for SETUP_CANBUS payload
-static uint8_t build_can_frame_buffer[16] = {0};  // Buffer for BUILD_CAN_FRAME payload (max 16 bytes: 4 ID + 1 bus + 1 len + 8 data + 1 checksum)
+// Sends a command response to the session's client
+typedef void (*gvret_send_fn_t)(const uint8_t *data, size_t len, void *ctx);
+
+// Per-connection parser state (one per transport)
+typedef struct {
+    gvret_state_t state;
+    int step;
+    int frame_len;
+    uint8_t setup_canbus_buffer[9];  // Buffer for SETUP_CANBUS payload
+    uint8_t build_can_frame_buffer[16];  // Buffer for BUILD_CAN_FRAME payload (max 16 bytes: 4 ID + 1 bus + 1 len + 8 data + 1 checksum)
+    twai_message_t tx_batch[GVRET_TX_BATCH_MAX];  // Parsed frames waiting for the manager TX queue
+    int tx_batch_count;
+    TickType_t tx_wait;  // Per-frame wait for TX queue space; 0 for sessions parsed in the HTTP server task
+    gvret_send_fn_t send;
+    void *send_ctx;
+} gvret_session_t;
+
+static gvret_session_t tcp_session;
+#if GVRET_WS_TRANSPORT
+static gvret_session_t ws_session;
+#endif
 
 // Helper function to send response with error handling
 static void send_response(int sock, uint8_t *data, int len) {
@@ -285,15 +354,83 @@ static void send_response(int sock, uint8_t *data, int len) {
     }
 }
 
-static void process_incoming_byte(uint8_t in_byte, int sock) {
+// TCP transport: send on the session's socket
+static void gvret_tcp_send(const uint8_t *data, size_t len, void *ctx) {
+    send_response((int)(intptr_t)ctx, (uint8_t *)data, (int)len);
+}
+
+static void gvret_count_tx(uint32_t sent, uint32_t dropped) {
+    gvret_init_stats_mutex();
+    if (gvret_stats_mutex != NULL && xSemaphoreTake(gvret_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+        gvret_cfg.tx_count += sent;
+        gvret_cfg.dropped_count += dropped;
+        xSemaphoreGive(gvret_stats_mutex);
+    }
+}
+
+// Hand the session's parsed frames to the CAN manager TX queue in one batch
+static void gvret_flush_tx(gvret_session_t *session) {
+    if (session->tx_batch_count == 0) {
+        return;
+    }
+    size_t queued = 0;
+    if (gvret_cfg.can_handle != NULL && gvret_cfg.enabled) {
+        queued = can_transmit_batch(gvret_cfg.can_handle, session->tx_batch, session->tx_batch_count,
+                                    session->tx_wait);
+    }
+    if (queued != (size_t)session->tx_batch_count) {
+        ESP_LOGW(TAG, "TX queue full or inactive: %d of %d frames dropped",
+                 session->tx_batch_count - (int)queued, session->tx_batch_count);
+    }
+    gvret_count_tx(queued, session->tx_batch_count - queued);
+    session->tx_batch_count = 0;
+}
+
+// Add a BUILD_CAN_FRAME payload (ID(4), Bus(1), Len(1), Data(Len)) to the TX batch
+static void gvret_queue_tx(gvret_session_t *session, const uint8_t *payload, int frame_len) {
+    uint32_t can_id = payload[0] |
+                     ((uint32_t)payload[1] << 8) |
+                     ((uint32_t)payload[2] << 16) |
+                     ((uint32_t)payload[3] << 24);
+    
+    bool extended = (can_id & 0x80000000) != 0;
+    can_id &= 0x7FFFFFFF;  // Mask out extended flag
+    
+    // Bus number (byte 4) - we only support bus 0, ignore others
+    uint8_t bus = payload[4];
+    if (bus != 0 || gvret_cfg.can_handle == NULL || !gvret_cfg.enabled) {
+        if (bus != 0) {
+            ESP_LOGW(TAG, "Ignoring frame for unsupported bus %d", bus);
+        } else {
+            ESP_LOGW(TAG, "Cannot transmit: CAN handle NULL or GVRET disabled");
+        }
+        gvret_count_tx(0, 1);
+        return;
+    }
+    
+    twai_message_t *tx_msg = &session->tx_batch[session->tx_batch_count++];
+    memset(tx_msg, 0, sizeof(*tx_msg));
+    tx_msg->identifier = can_id;
+    tx_msg->flags = (extended ? TWAI_MSG_FLAG_EXTD : 0) |
+                    (gvret_cfg.tx_echo ? TWAI_MSG_FLAG_SELF : 0);
+    tx_msg->data_length_code = frame_len;
+    memcpy(tx_msg->data, payload + 6, frame_len);
+    ESP_LOGD(TAG, "TX frame queued: ID=0x%08" PRIx32 " (%s), len=%d", can_id, extended ? "EXT" : "STD", frame_len);
+    
+    if (session->tx_batch_count >= GVRET_TX_BATCH_MAX) {
+        gvret_flush_tx(session);
+    }
+}
+
+static void process_incoming_byte(gvret_session_t *session, uint8_t in_byte) {
     uint32_t now = (uint32_t)esp_timer_get_time();
     uint8_t resp[32];
 
-    switch (state) {
+    switch (session->state) {
     case IDLE:
         if (in_byte == 0xF1) {
             ESP_LOGD(TAG, "Received 0xF1, entering GET_COMMAND state");
-            state = GET_COMMAND;
+            session->state = GET_COMMAND;
         } else if (in_byte == 0xE7) {
             ESP_LOGD(TAG, "Received 0xE7 (binary mode), ignoring");
             // Stay in IDLE, we're always in binary mode
@@ -307,7 +444,7 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
         case 0xE7:
             // Handle 0xE7 even in GET_COMMAND state (shouldn't happen, but be safe)
             ESP_LOGD(TAG, "Received 0xE7 in GET_COMMAND state, resetting to IDLE");
-            state = IDLE;
+            session->state = IDLE;
             break;
         case GVRET_CMD_GET_DEV_INFO: // 0x07
             resp[0] = 0xF1;
@@ -318,17 +455,17 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
             resp[5] = 0x00; // File type (ignored by SavvyCAN)
             resp[6] = 0x00; // Auto log (ignored by SavvyCAN)
             resp[7] = 0x00; // Single wire mode
-            send_response(sock, resp, 8);
+            session->send(resp, 8, session->send_ctx);
             ESP_LOGI(TAG, "Received GET_DEV_INFO");
-            state = IDLE;
+            session->state = IDLE;
             break;
         case GVRET_CMD_GET_NUMBUSES: // 0x0C
             resp[0] = 0xF1;
             resp[1] = 0x0C;
             resp[2] = 1; // Num buses (we only have one CAN bus implemented)
-            send_response(sock, resp, 3);
+            session->send(resp, 3, session->send_ctx);
             ESP_LOGI(TAG, "Received GET_NUMBUSES");
-            state = IDLE;
+            session->state = IDLE;
             break;
         case GVRET_CMD_GET_CANBUS_PARAMS: // 0x06
             resp[0] = 0xF1;
@@ -345,28 +482,28 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
             resp[9] = 0; // Bus 1 baud
             resp[10] = 0; // Bus 1 baud
             resp[11] = 0; // Bus 1 baud MSB
-            send_response(sock, resp, 12);
+            session->send(resp, 12, session->send_ctx);
             ESP_LOGI(TAG, "Received GET_CANBUS_PARAMS");
-            state = IDLE;
+            session->state = IDLE;
             break;
         case GVRET_CMD_GET_EXT_BUSES: // 0x0D
             resp[0] = 0xF1;
             resp[1] = 0x0D;
             for (int i=0; i<15; i++) resp[2+i] = 0;
-            send_response(sock, resp, 17);
-            state = IDLE;
+            session->send(resp, 17, session->send_ctx);
+            session->state = IDLE;
             break;
         case GVRET_CMD_SET_EXT_BUSES: // 0x0E
-            state = SET_EXT_BUSES;
-            step = 0;
+            session->state = SET_EXT_BUSES;
+            session->step = 0;
             break;
         case GVRET_CMD_KEEPALIVE: // 0x09
             resp[0] = 0xF1;
             resp[1] = 0x09;
             resp[2] = 0xDE;
             resp[3] = 0xAD;
-            send_response(sock, resp, 4);
-            state = IDLE;
+            session->send(resp, 4, session->send_ctx);
+            session->state = IDLE;
             break;
         case GVRET_CMD_TIME_SYNC: // 0x01
             // SavvyCAN sends F1 01 and expects response, no data payload.
@@ -376,21 +513,21 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
             resp[3] = (uint8_t)(now >> 8);
             resp[4] = (uint8_t)(now >> 16);
             resp[5] = (uint8_t)(now >> 24);
-            send_response(sock, resp, 6);
+            session->send(resp, 6, session->send_ctx);
             ESP_LOGI(TAG, "Received TIME_SYNC");
-            state = IDLE; 
+            session->state = IDLE; 
             break;
         case GVRET_CMD_SETUP_CANBUS: // 0x05
-            state = SETUP_CANBUS;
-            step = 0;
+            session->state = SETUP_CANBUS;
+            session->step = 0;
             break;
         case GVRET_CMD_BUILD_CAN_FRAME: // 0x00
-            state = BUILD_CAN_FRAME;
-            step = 0;
+            session->state = BUILD_CAN_FRAME;
+            session->step = 0;
             break;
         default:
             ESP_LOGW(TAG, "Unknown CMD: %02X", in_byte);
-            state = IDLE;
+            session->state = IDLE;
             break;
         }
         break;
@@ -403,16 +540,16 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
         //   Bit 31: Valid flag (if set, use this config)
         //   Bit 30: Enabled flag
         //   Bit 29: Listen-only flag
-        if (step < 8) {
-            setup_canbus_buffer[step] = in_byte;
+        if (session->step < 8) {
+            session->setup_canbus_buffer[session->step] = in_byte;
         }
-        step++;
-        if (step >= 9) {
+        session->step++;
+        if (session->step >= 9) {
             // Parse CAN0 bitrate (bytes 0-3)
-            uint32_t can0_config = (uint32_t)setup_canbus_buffer[0] |
-                                   ((uint32_t)setup_canbus_buffer[1] << 8) |
-                                   ((uint32_t)setup_canbus_buffer[2] << 16) |
-                                   ((uint32_t)setup_canbus_buffer[3] << 24);
+            uint32_t can0_config = (uint32_t)session->setup_canbus_buffer[0] |
+                                   ((uint32_t)session->setup_canbus_buffer[1] << 8) |
+                                   ((uint32_t)session->setup_canbus_buffer[2] << 16) |
+                                   ((uint32_t)session->setup_canbus_buffer[3] << 24);
             
             // Check if valid flag is set (bit 31)
             if (can0_config & 0x80000000) {
@@ -467,15 +604,15 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
             }
             
             // Reset buffer and state
-            memset(setup_canbus_buffer, 0, sizeof(setup_canbus_buffer));
-            state = IDLE;
+            memset(session->setup_canbus_buffer, 0, sizeof(session->setup_canbus_buffer));
+            session->state = IDLE;
         }
         break;
 
     case SET_EXT_BUSES:
         // SavvyCAN sends 13 bytes (12 config + 1 zero byte)
-        step++;
-        if (step >= 13) state = IDLE;
+        session->step++;
+        if (session->step >= 13) session->state = IDLE;
         break;
 
         
@@ -484,100 +621,306 @@ static void process_incoming_byte(uint8_t in_byte, int sock) {
         // Total bytes: 4 + 1 + 1 + Len + 1 = 7 + Len
         
         // Store byte in buffer (max 16 bytes needed)
-        if (step < sizeof(build_can_frame_buffer)) {
-            build_can_frame_buffer[step] = in_byte;
+        if (session->step < sizeof(session->build_can_frame_buffer)) {
+            session->build_can_frame_buffer[session->step] = in_byte;
         }
         
-        if (step == 5) {
-            frame_len = in_byte & 0xF;
-            if (frame_len > 8) frame_len = 8;
+        if (session->step == 5) {
+            session->frame_len = in_byte & 0xF;
+            if (session->frame_len > 8) session->frame_len = 8;
         }
         
-        step++;
+        session->step++;
         
         // When we've received all bytes, transmit the CAN frame
-        if (step >= (7 + frame_len)) {
-            // Parse frame: ID (bytes 0-3), Bus (byte 4), Len (byte 5), Data (bytes 6+), Checksum (last byte, ignored)
-            uint32_t can_id = build_can_frame_buffer[0] |
-                             ((uint32_t)build_can_frame_buffer[1] << 8) |
-                             ((uint32_t)build_can_frame_buffer[2] << 16) |
-                             ((uint32_t)build_can_frame_buffer[3] << 24);
-            
-            bool extended = (can_id & 0x80000000) != 0;
-            can_id &= 0x7FFFFFFF;  // Mask out extended flag
-            
-            // Bus number (byte 4) - we only support bus 0, ignore others
-            uint8_t bus = build_can_frame_buffer[4];
-            
-            // Length already parsed (byte 5, lower 4 bits)
-            // Data starts at byte 6
-            
-            // Only transmit if CAN handle is valid and enabled
-            if (gvret_cfg.can_handle != NULL && gvret_cfg.enabled && bus == 0) {
-                twai_message_t tx_msg;
-                tx_msg.identifier = can_id;
-                tx_msg.flags = extended ? TWAI_MSG_FLAG_EXTD : 0;
-                tx_msg.data_length_code = frame_len;
-                tx_msg.rtr = 0;
-                
-                // Copy data (bytes 6 to 6+frame_len-1)
-                for (int i = 0; i < frame_len && i < 8; i++) {
-                    tx_msg.data[i] = build_can_frame_buffer[6 + i];
-                }
-                
-                // Transmit frame via CAN manager
-                esp_err_t tx_ret = can_transmit(gvret_cfg.can_handle, &tx_msg);
-                if (tx_ret == ESP_OK) {
-                    gvret_init_stats_mutex();
-                    if (gvret_stats_mutex != NULL && xSemaphoreTake(gvret_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-                        gvret_cfg.tx_count++;
-                        xSemaphoreGive(gvret_stats_mutex);
-                    }
-                    ESP_LOGD(TAG, "TX frame: ID=0x%08" PRIx32 " (%s), len=%d", can_id, extended ? "EXT" : "STD", frame_len);
-                } else {
-                    gvret_init_stats_mutex();
-                    if (gvret_stats_mutex != NULL && xSemaphoreTake(gvret_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-                        gvret_cfg.dropped_count++;
-                        xSemaphoreGive(gvret_stats_mutex);
-                    }
-                    ESP_LOGW(TAG, "TX failed: %s (0x%x)", esp_err_to_name(tx_ret), tx_ret);
-                }
-            } else {
-                if (bus != 0) {
-                    ESP_LOGW(TAG, "Ignoring frame for unsupported bus %d", bus);
-                } else {
-                    ESP_LOGW(TAG, "Cannot transmit: CAN handle NULL or GVRET disabled");
-                }
-                gvret_init_stats_mutex();
-                if (gvret_stats_mutex != NULL && xSemaphoreTake(gvret_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-                    gvret_cfg.dropped_count++;
-                    xSemaphoreGive(gvret_stats_mutex);
-                }
-            }
+        if (session->step >= (7 + session->frame_len)) {
+            // Frame: ID (bytes 0-3), Bus (byte 4), Len (byte 5), Data (bytes 6+), Checksum (last byte, ignored)
+            gvret_queue_tx(session, session->build_can_frame_buffer, session->frame_len);
             
             // Reset buffer and state
-            memset(build_can_frame_buffer, 0, sizeof(build_can_frame_buffer));
-            state = IDLE;
-            step = 0;
-            frame_len = 0;
+            memset(session->build_can_frame_buffer, 0, sizeof(session->build_can_frame_buffer));
+            session->state = IDLE;
+            session->step = 0;
+            session->frame_len = 0;
         }
         break;
 
     default:
-        state = IDLE;
+        session->state = IDLE;
         break;
     }
 }
 
-static void gvret_reset_state(void) {
-    state = IDLE;
-    step = 0;
-    frame_len = 0;
-    memset(setup_canbus_buffer, 0, sizeof(setup_canbus_buffer));
-    memset(build_can_frame_buffer, 0, sizeof(build_can_frame_buffer));
+// Parse a received chunk. Complete BUILD_CAN_FRAME commands (F1 00 ...) are
+// decoded in place; everything else, and frames split across chunks, goes
+// through the byte state machine. Parsed frames are handed to the manager TX
+// queue in batches, at the latest when the chunk has been consumed.
+static void process_incoming(gvret_session_t *session, const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if (session->state == IDLE && data[i] == GVRET_START_BYTE && len - i >= 8 &&
+            data[i + 1] == GVRET_CMD_BUILD_CAN_FRAME) {
+            // F1 00 ID(4) Bus(1) Len(1) Data(Len) Checksum(1)
+            int frame_len = data[i + 7] & 0xF;
+            if (frame_len > 8) frame_len = 8;
+            size_t total = 2 + 7 + frame_len;
+            if (len - i >= total) {
+                gvret_queue_tx(session, data + i + 2, frame_len);
+                i += total;
+                continue;
+            }
+        }
+        // Keep TX order relative to other commands (e.g. SETUP_CANBUS)
+        if (session->state == IDLE) {
+            gvret_flush_tx(session);
+        }
+        process_incoming_byte(session, data[i++]);
+    }
+    gvret_flush_tx(session);
+}
+
+static void gvret_reset_state(gvret_session_t *session, gvret_send_fn_t send, void *send_ctx, TickType_t tx_wait) {
+    session->state = IDLE;
+    session->step = 0;
+    session->frame_len = 0;
+    memset(session->setup_canbus_buffer, 0, sizeof(session->setup_canbus_buffer));
+    memset(session->build_can_frame_buffer, 0, sizeof(session->build_can_frame_buffer));
+    session->tx_batch_count = 0;
+    session->tx_wait = tx_wait;
+    session->send = send;
+    session->send_ctx = send_ctx;
     ESP_LOGI(TAG, "GVRET State Reset");
 }
 
+// ============================================================================
+// Pre-trigger capture
+// ============================================================================
+// Always-on circular record of recent bus traffic, kept in PSRAM. It is a CAN
+// manager client of its own (RX-only, activated for as long as capture runs),
+// so the bus stays live even when no GVRET client is attached. When a client
+// connects, the last N seconds are sent ahead of live frames with their
+// original timestamps, so attaching after a fault still shows what happened.
+
+typedef struct {
+    int64_t time_us;     // esp_timer time at reception
+    uint32_t identifier;
+    uint8_t extd;
+    uint8_t dlc;
+    uint8_t data[8];
+} gvret_capture_rec_t;
+
+typedef struct {
+    volatile bool enabled;
+    can_handle_t can_handle;
+    gvret_capture_rec_t *records;  // Ring of `capacity` records
+    uint32_t capacity;
+    uint32_t total;                // Records ever written; next slot is total % capacity
+    volatile uint32_t dropped;     // Bumped atomically by the RX callback
+    int64_t window_us;             // Only replay/dump records newer than this
+    SemaphoreHandle_t mutex;
+    volatile int callback_active;
+} gvret_capture_t;
+
+static gvret_capture_t gvret_capture = {
+    .can_handle = NULL,
+    .records = NULL,
+    .mutex = NULL,
+};
+
+// CONTEXT: CAN manager RX dispatcher task
+static void gvret_capture_rx_callback(const twai_message_t *message, void *arg) {
+    __sync_fetch_and_add(&gvret_capture.callback_active, 1);
+
+    if (message == NULL || message->rtr || !gvret_capture.enabled) {
+        __sync_fetch_and_sub(&gvret_capture.callback_active, 1);
+        return;
+    }
+
+    if (xSemaphoreTake(gvret_capture.mutex, pdMS_TO_TICKS(5)) == pdTRUE) {
+        if (gvret_capture.records != NULL) {
+            gvret_capture_rec_t *rec = &gvret_capture.records[gvret_capture.total % gvret_capture.capacity];
+            rec->time_us = esp_timer_get_time();
+            rec->identifier = message->identifier;
+            rec->extd = message->extd;
+            rec->dlc = message->data_length_code > 8 ? 8 : message->data_length_code;
+            memcpy(rec->data, message->data, rec->dlc);
+            gvret_capture.total++;
+        }
+        xSemaphoreGive(gvret_capture.mutex);
+    } else {
+        __sync_fetch_and_add(&gvret_capture.dropped, 1);
+    }
+
+    __sync_fetch_and_sub(&gvret_capture.callback_active, 1);
+}
+
+// Copy up to `max` records in [*cursor, end) that fall inside the capture window.
+// Records already overwritten by the writer are skipped. Advances *cursor.
+static int gvret_capture_read(uint32_t *cursor, uint32_t end, gvret_capture_rec_t *out, int max) {
+    int n = 0;
+    if (xSemaphoreTake(gvret_capture.mutex, portMAX_DELAY) != pdTRUE) {
+        return 0;
+    }
+    if (gvret_capture.records == NULL) {
+        *cursor = end;
+        xSemaphoreGive(gvret_capture.mutex);
+        return 0;
+    }
+    uint32_t oldest = gvret_capture.total > gvret_capture.capacity ? gvret_capture.total - gvret_capture.capacity : 0;
+    if ((int32_t)(*cursor - oldest) < 0) {
+        *cursor = oldest;
+    }
+    int64_t cutoff = esp_timer_get_time() - gvret_capture.window_us;
+    int scanned = 0;
+    // Bound the scan so the writer is never held off for long
+    while (*cursor != end && n < max && scanned < GVRET_CAPTURE_READ_BATCH * 8) {
+        const gvret_capture_rec_t *rec = &gvret_capture.records[*cursor % gvret_capture.capacity];
+        (*cursor)++;
+        scanned++;
+        if (rec->time_us >= cutoff) {
+            out[n++] = *rec;
+        }
+    }
+    xSemaphoreGive(gvret_capture.mutex);
+    return n;
+}
+
+// Snapshot the range of records currently held: [*start, *end)
+static bool gvret_capture_range(uint32_t *start, uint32_t *end) {
+    if (!gvret_capture.enabled || xSemaphoreTake(gvret_capture.mutex, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    *end = gvret_capture.total;
+    *start = *end > gvret_capture.capacity ? *end - gvret_capture.capacity : 0;
+    xSemaphoreGive(gvret_capture.mutex);
+    return true;
+}
+
+// Send records [cursor, end) to a newly connected client, oldest first,
+// batched into chunks of up to GVRET_WS_BATCH_SIZE bytes. The range is
+// snapshotted before the session's CAN client is activated, so frames that
+// arrive after that go out live only. Returns frames sent.
+static uint32_t gvret_capture_replay(gvret_send_fn_t send, void *ctx, uint32_t cursor, uint32_t end) {
+    if (cursor == end) {
+        return 0;
+    }
+
+    uint8_t *chunk = (uint8_t *)malloc(GVRET_WS_BATCH_SIZE);
+    gvret_capture_rec_t *recs = (gvret_capture_rec_t *)malloc(GVRET_CAPTURE_READ_BATCH * sizeof(gvret_capture_rec_t));
+    if (chunk == NULL || recs == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate capture replay buffers");
+        free(chunk);
+        free(recs);
+        return 0;
+    }
+
+    uint32_t sent = 0;
+    size_t chunk_len = 0;
+    while (cursor != end) {
+        int n = gvret_capture_read(&cursor, end, recs, GVRET_CAPTURE_READ_BATCH);
+        for (int i = 0; i < n; i++) {
+            if (!gvret_filter_accepts(recs[i].identifier, recs[i].extd)) {
+                continue;
+            }
+            if (chunk_len + GVRET_MAX_FRAME_SIZE > GVRET_WS_BATCH_SIZE) {
+                send(chunk, chunk_len, ctx);
+                chunk_len = 0;
+            }
+            chunk_len += gvret_encode_frame(chunk + chunk_len, (uint32_t)recs[i].time_us, recs[i].identifier,
+                                            recs[i].extd, recs[i].dlc, recs[i].data);
+            sent++;
+        }
+    }
+    if (chunk_len > 0) {
+        send(chunk, chunk_len, ctx);
+    }
+
+    free(chunk);
+    free(recs);
+    ESP_LOGI(TAG, "Replayed %lu captured frames", (unsigned long)sent);
+    return sent;
+}
+
+void gvret_capture_stop(void);
+
+bool gvret_capture_start(int seconds, size_t size) {
+    if (gvret_capture.enabled) {
+        gvret_capture_stop();
+    }
+    if (gvret_capture.mutex == NULL) {
+        gvret_capture.mutex = xSemaphoreCreateMutex();
+        if (gvret_capture.mutex == NULL) {
+            ESP_LOGE(TAG, "Failed to create capture mutex");
+            return false;
+        }
+    }
+
+    uint32_t capacity = size / sizeof(gvret_capture_rec_t);
+    if (capacity == 0) {
+        ESP_LOGE(TAG, "Capture size too small");
+        return false;
+    }
+    gvret_capture_rec_t *records = heap_caps_malloc(capacity * sizeof(gvret_capture_rec_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (records == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes of PSRAM for capture", (unsigned)size);
+        return false;
+    }
+
+    gvret_capture.can_handle = can_register(CAN_CLIENT_MODE_RX_ONLY);
+    if (gvret_capture.can_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to register capture client with CAN manager");
+        heap_caps_free(records);
+        return false;
+    }
+
+    xSemaphoreTake(gvret_capture.mutex, portMAX_DELAY);
+    gvret_capture.records = records;
+    gvret_capture.capacity = capacity;
+    gvret_capture.total = 0;
+    gvret_capture.dropped = 0;
+    gvret_capture.window_us = (int64_t)seconds * 1000000;
+    xSemaphoreGive(gvret_capture.mutex);
+    gvret_capture.enabled = true;
+
+    can_set_rx_callback(gvret_capture.can_handle, gvret_capture_rx_callback, NULL);
+    esp_err_t ret = can_activate(gvret_capture.can_handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to activate capture client: %s", esp_err_to_name(ret));
+        gvret_capture_stop();
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Capture started: %lu records (%u bytes), %d s window",
+             (unsigned long)capacity, (unsigned)(capacity * sizeof(gvret_capture_rec_t)), seconds);
+    return true;
+}
+
+void gvret_capture_stop(void) {
+    if (!gvret_capture.enabled) {
+        return;
+    }
+    gvret_capture.enabled = false;
+
+    if (gvret_capture.can_handle != NULL) {
+        can_unregister(gvret_capture.can_handle);
+        gvret_capture.can_handle = NULL;
+    }
+
+    int retries = 0;
+    while (__sync_fetch_and_add(&gvret_capture.callback_active, 0) > 0 && retries < 100) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        retries++;
+    }
+
+    xSemaphoreTake(gvret_capture.mutex, portMAX_DELAY);
+    heap_caps_free(gvret_capture.records);
+    gvret_capture.records = NULL;
+    gvret_capture.capacity = 0;
+    gvret_capture.total = 0;
+    xSemaphoreGive(gvret_capture.mutex);
+    ESP_LOGI(TAG, "Capture stopped");
+}
+
 static void tcp_server_task(void *arg) {
     int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
     if (listen_sock < 0) {
@@ -632,8 +975,20 @@ static void tcp_server_task(void *arg) {
             break;
         }
         ESP_LOGI(TAG, "Socket accepted from client");
+        
+        // Only one GVRET session at a time (TCP and WebSocket share the ringbuffer)
+        if (!__sync_bool_compare_and_swap(&gvret_cfg.active_transport, GVRET_TRANSPORT_NONE, GVRET_TRANSPORT_TCP)) {
+            ESP_LOGW(TAG, "GVRET session already active on another transport, rejecting TCP client");
+            close(sock);
+            continue;
+        }
+        
         gvret_cfg.tcp_client_sock = sock;
-        gvret_reset_state(); // Reset state for new connection
+        gvret_reset_state(&tcp_session, gvret_tcp_send, (void *)(intptr_t)sock, pdMS_TO_TICKS(GVRET_TX_QUEUE_WAIT_MS)); // Reset state for new connection
+        
+        // Capture to replay: everything recorded before the bus goes live for this client
+        uint32_t replay_start = 0, replay_end = 0;
+        gvret_capture_range(&replay_start, &replay_end);
         
         // Stage 2: Activate CAN client (bus activates to NORMAL mode)
         if (gvret_cfg.can_handle != NULL) {
@@ -642,6 +997,7 @@ static void tcp_server_task(void *arg) {
                 ESP_LOGE(TAG, "Failed to activate CAN client: %s", esp_err_to_name(ret));
                 close(sock);
                 gvret_cfg.tcp_client_sock = -1;
+                gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
                 continue;
             }
             ESP_LOGI(TAG, "CAN client activated - bus now active");
@@ -659,6 +1015,9 @@ static void tcp_server_task(void *arg) {
         
         ESP_LOGI(TAG, "Client connected, socket configured (TCP_NODELAY enabled)");
 
+        // Pre-trigger capture goes out before any live frames
+        gvret_capture_replay(gvret_tcp_send, (void *)(intptr_t)sock, replay_start, replay_end);
+
         // Adaptive timeout: shorter when processing commands, longer when idle
         bool in_command_processing = false;
         uint32_t last_rx_time = esp_timer_get_time() / 1000; // ms
@@ -706,16 +1065,13 @@ static void tcp_server_task(void *arg) {
             // Read all available data in a loop (SavvyCAN may send multiple commands in one packet)
             if (FD_ISSET(sock, &read_fds)) {
                 while (1) {
-                    uint8_t rx_buffer[64];
+                    uint8_t rx_buffer[256];
                     int len = recv(sock, rx_buffer, sizeof(rx_buffer), 0);
                     if (len > 0) {
                         processed_incoming = true;
                         last_rx_time = esp_timer_get_time() / 1000; // Update for adaptive timeout
                         ESP_LOGD(TAG, "Received %d bytes", len);
-                        for (int i = 0; i < len; i++) {
-                            ESP_LOGD(TAG, "Processing byte %d: 0x%02X", i, rx_buffer[i]);
-                            process_incoming_byte(rx_buffer[i], sock);
-                        }
+                        process_incoming(&tcp_session, rx_buffer, len);
                         // Continue reading if more data is available
                     } else if (len == 0) {
                         ESP_LOGI(TAG, "Connection closed");
@@ -739,7 +1095,7 @@ static void tcp_server_task(void *arg) {
             // 1. Socket is writable
             // 2. We're in IDLE state (not processing a command)
             // 3. We didn't process incoming data this iteration (to avoid interleaving with command responses)
-            if (FD_ISSET(sock, &write_fds) && state == IDLE && !processed_incoming) {
+            if (FD_ISSET(sock, &write_fds) && tcp_session.state == IDLE && !processed_incoming) {
                 size_t item_size;
                 uint8_t *item = (uint8_t *)xRingbufferReceive(gvret_cfg.ringbuf_handle, &item_size, 0);
                 if (item) {
@@ -777,6 +1133,7 @@ static void tcp_server_task(void *arg) {
             close(sock);
             gvret_cfg.tcp_client_sock = -1;
         }
+        gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
     }
     if (listen_sock >= 0) {
         close(listen_sock);
@@ -786,6 +1143,385 @@ static void tcp_server_task(void *arg) {
     vTaskDelete(NULL);
 }
 
+#if GVRET_WS_TRANSPORT
+// ============================================================================
+// WebSocket transport
+// ============================================================================
+// Same binary encoding and command state machine as TCP, carried in WebSocket
+// binary messages. Commands arrive via the wsserver endpoint callbacks (HTTP
+// server task); received CAN frames are batched from the ringbuffer into one
+// binary message per GVRET_WS_BATCH_SIZE / GVRET_WS_FLUSH_MS window.
+
+static void gvret_ws_send(const uint8_t *data, size_t len, void *ctx) {
+    int client_id = (int)(intptr_t)ctx;
+    if (!wsserver_send_to_client(client_id, data, len, true)) {
+        ESP_LOGW(TAG, "WS send failed: %d bytes to client %d", (int)len, client_id);
+    }
+}
+
+// Replay sends from the batching task. Each message is a heap copy queued to
+// the HTTP server task, so wait for earlier ones to go out rather than
+// queueing a whole capture at once; give up on a chunk if the client stalls.
+static void gvret_ws_replay_send(const uint8_t *data, size_t len, void *ctx) {
+    int client_id = (int)(intptr_t)ctx;
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(GVRET_WS_REPLAY_STALL_MS);
+    while (wsserver_pending_sends() >= GVRET_WS_REPLAY_PENDING) {
+        if (client_id != gvret_cfg.ws_client_id || !gvret_cfg.enabled) {
+            return;
+        }
+        if ((int32_t)(deadline - xTaskGetTickCount()) <= 0) {
+            ESP_LOGW(TAG, "WS replay stalled, dropping %d bytes", (int)len);
+            return;
+        }
+        vTaskDelay(1);
+    }
+    gvret_ws_send(data, len, ctx);
+}
+
+// CONTEXT: HTTP server task
+static void gvret_ws_on_connect(int client_id) {
+    if (!gvret_cfg.enabled) {
+        return;
+    }
+    if (!__sync_bool_compare_and_swap(&gvret_cfg.active_transport, GVRET_TRANSPORT_NONE, GVRET_TRANSPORT_WS)) {
+        ESP_LOGW(TAG, "GVRET session already active, ignoring WebSocket client %d", client_id);
+        return;
+    }
+    
+    // Commands are parsed in the HTTP server task, which must not wait for queue space
+    gvret_reset_state(&ws_session, gvret_ws_send, (void *)(intptr_t)client_id, 0);
+    
+    // Capture to replay, taken before activation (the batching task sends it)
+    gvret_cfg.ws_replay_start = 0;
+    gvret_cfg.ws_replay_end = 0;
+    gvret_capture_range(&gvret_cfg.ws_replay_start, &gvret_cfg.ws_replay_end);
+    
+    if (gvret_cfg.can_handle != NULL) {
+        esp_err_t ret = can_activate(gvret_cfg.can_handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to activate CAN client: %s", esp_err_to_name(ret));
+            gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
+            return;
+        }
+    }
+    
+    __sync_synchronize();  // Replay range visible before the client ID
+    gvret_cfg.ws_client_id = client_id;
+    ESP_LOGI(TAG, "WebSocket client %d connected - CAN client activated", client_id);
+}
+
+// CONTEXT: HTTP server task
+static void gvret_ws_on_disconnect(int client_id) {
+    if (client_id != gvret_cfg.ws_client_id) {
+        return;
+    }
+    gvret_cfg.ws_client_id = -1;
+    if (gvret_cfg.can_handle != NULL) {
+        can_deactivate(gvret_cfg.can_handle);
+    }
+    gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
+    ESP_LOGI(TAG, "WebSocket client %d disconnected - CAN client deactivated", client_id);
+}
+
+// CONTEXT: HTTP server task
+static void gvret_ws_on_message(int client_id, const uint8_t *data, size_t len, bool is_binary) {
+    (void)is_binary;  // Commands are accepted in either frame type
+    if (client_id != gvret_cfg.ws_client_id || !gvret_cfg.enabled) {
+        return;
+    }
+    process_incoming(&ws_session, data, len);
+}
+
+// Drain ringbuffer into batched WebSocket binary messages
+static void gvret_ws_task(void *arg) {
+    uint8_t *batch = (uint8_t *)malloc(GVRET_WS_BATCH_SIZE);
+    if (batch == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate WS batch buffer");
+        gvret_cfg.ws_task_handle = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+    
+    int replayed_client_id = -1;
+    while (gvret_cfg.enabled) {
+        int client_id = gvret_cfg.ws_client_id;
+        if (client_id < 0) {
+            replayed_client_id = -1;
+            vTaskDelay(pdMS_TO_TICKS(50));
+            continue;
+        }
+        
+        // New session: pre-trigger capture goes out before any live frames
+        if (client_id != replayed_client_id) {
+            replayed_client_id = client_id;
+            gvret_capture_replay(gvret_ws_replay_send, (void *)(intptr_t)client_id,
+                                 gvret_cfg.ws_replay_start, gvret_cfg.ws_replay_end);
+        }
+        
+        // Block (briefly) for the first frame, then keep filling until the batch
+        // is full or the flush window has elapsed
+        size_t batch_len = 0;
+        size_t item_size;
+        uint8_t *item = (uint8_t *)xRingbufferReceive(gvret_cfg.ringbuf_handle, &item_size, pdMS_TO_TICKS(50));
+        TickType_t flush_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(GVRET_WS_FLUSH_MS);
+        while (item != NULL) {
+            memcpy(batch + batch_len, item, item_size);
+            batch_len += item_size;
+            vRingbufferReturnItem(gvret_cfg.ringbuf_handle, (void *)item);
+            
+            if (batch_len + GVRET_MAX_FRAME_SIZE > GVRET_WS_BATCH_SIZE) {
+                break;
+            }
+            TickType_t now = xTaskGetTickCount();
+            TickType_t wait = (int32_t)(flush_deadline - now) > 0 ? flush_deadline - now : 0;
+            item = (uint8_t *)xRingbufferReceive(gvret_cfg.ringbuf_handle, &item_size, wait);
+        }
+        
+        if (batch_len > 0 && client_id == gvret_cfg.ws_client_id) {
+            if (!wsserver_send_to_client(client_id, batch, batch_len, true)) {
+                gvret_init_stats_mutex();
+                if (gvret_stats_mutex != NULL && xSemaphoreTake(gvret_stats_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+                    gvret_cfg.dropped_count += batch_len / GVRET_MAX_FRAME_SIZE + 1;
+                    xSemaphoreGive(gvret_stats_mutex);
+                }
+            }
+        }
+    }
+    
+    free(batch);
+    ESP_LOGI(TAG, "WS batching task exiting");
+    gvret_cfg.ws_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+// Register the GVRET WebSocket endpoint (GVRET and wsserver must be running)
+bool gvret_start_ws(const char *path) {
+    if (!gvret_cfg.enabled) {
+        ESP_LOGE(TAG, "GVRET not started - call gvret.start() first");
+        return false;
+    }
+    if (strlen(path) >= GVRET_WS_PATH_MAX) {
+        ESP_LOGE(TAG, "WebSocket path too long");
+        return false;
+    }
+    
+    if (!wsserver_register_endpoint(path, gvret_ws_on_connect, gvret_ws_on_disconnect, gvret_ws_on_message)) {
+        ESP_LOGE(TAG, "Failed to register WebSocket endpoint '%s' (is wsserver running?)", path);
+        return false;
+    }
+    strcpy(gvret_cfg.ws_path, path);
+    
+    if (gvret_cfg.ws_task_handle == NULL &&
+        xTaskCreate(gvret_ws_task, "gvret_ws", GVRET_STACK_SIZE, NULL, GVRET_PRIORITY, &gvret_cfg.ws_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create WS batching task");
+        wsserver_unregister_endpoint(path);
+        gvret_cfg.ws_path[0] = '\0';
+        return false;
+    }
+    
+    ESP_LOGI(TAG, "GVRET WebSocket transport on '%s'", path);
+    return true;
+}
+#endif // GVRET_WS_TRANSPORT
+
+// ============================================================================
+// Python stream transport
+// ============================================================================
+// gvret.stream() hands the encoder ring to Python as a read-only stream, so
+// forwarders (MQTT, WebRTC, ...) can move pre-encoded GVRET frames in bulk
+// without creating an object per frame. The stream owns the GVRET session
+// like a TCP or WebSocket client does.
+
+typedef struct {
+    mp_obj_base_t base;
+    uint32_t generation;       // Matches gvret_cfg.stream_generation while open
+    uint32_t timeout_ms;       // Max wait for the first frame of a read (0 = non-blocking)
+    uint8_t pending[GVRET_MAX_FRAME_SIZE];  // Frame that did not fit the previous read
+    size_t pending_len;
+} gvret_stream_obj_t;
+
+static bool gvret_stream_is_open(gvret_stream_obj_t *self) {
+    return self->generation == gvret_cfg.stream_generation &&
+           gvret_cfg.active_transport == GVRET_TRANSPORT_STREAM && gvret_cfg.enabled;
+}
+
+// Fill buf with whole encoded frames (frames are only split if size is smaller
+// than one frame). Blocks up to timeout_ms for the first frame, then takes
+// whatever else is already queued.
+static mp_uint_t gvret_stream_read(mp_obj_t self_in, void *buf_in, mp_uint_t size, int *errcode) {
+    gvret_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    uint8_t *buf = (uint8_t *)buf_in;
+    size_t len = 0;
+
+    if (size == 0) {
+        return 0;
+    }
+    if (self->pending_len > 0) {
+        size_t n = self->pending_len < size ? self->pending_len : size;
+        memcpy(buf, self->pending, n);
+        memmove(self->pending, self->pending + n, self->pending_len - n);
+        self->pending_len -= n;
+        len = n;
+    }
+
+    // Barrier: gvret_stop() waits for readers before deleting the ringbuffer
+    __sync_fetch_and_add(&gvret_cfg.callback_active, 1);
+    if (!gvret_stream_is_open(self) || gvret_cfg.ringbuf_handle == NULL) {
+        __sync_fetch_and_sub(&gvret_cfg.callback_active, 1);
+        return len;  // EOF once the stream is closed
+    }
+
+    while (len < size && self->pending_len == 0) {
+        size_t item_size;
+        uint8_t *item;
+        if (len == 0 && self->timeout_ms > 0) {
+            // Wait in slices, so gvret_stop() never deletes the ringbuffer
+            // under a long read: each slice re-checks that the stream is open
+            TickType_t start = xTaskGetTickCount();
+            TickType_t total = pdMS_TO_TICKS(self->timeout_ms);
+            item = NULL;
+            MP_THREAD_GIL_EXIT();
+            while (item == NULL && gvret_stream_is_open(self)) {
+                TickType_t elapsed = xTaskGetTickCount() - start;
+                if (elapsed >= total) {
+                    break;
+                }
+                TickType_t wait = total - elapsed;
+                if (wait > pdMS_TO_TICKS(GVRET_STREAM_WAIT_SLICE_MS)) {
+                    wait = pdMS_TO_TICKS(GVRET_STREAM_WAIT_SLICE_MS);
+                }
+                item = (uint8_t *)xRingbufferReceive(gvret_cfg.ringbuf_handle, &item_size, wait);
+            }
+            MP_THREAD_GIL_ENTER();
+        } else {
+            item = (uint8_t *)xRingbufferReceive(gvret_cfg.ringbuf_handle, &item_size, 0);
+        }
+        if (item == NULL) {
+            break;
+        }
+        if (item_size <= size - len) {
+            memcpy(buf + len, item, item_size);
+            len += item_size;
+        } else if (len == 0) {
+            // Caller buffer smaller than one frame - split it
+            memcpy(buf, item, size);
+            memcpy(self->pending, item + size, item_size - size);
+            self->pending_len = item_size - size;
+            len = size;
+        } else {
+            memcpy(self->pending, item, item_size);
+            self->pending_len = item_size;
+        }
+        vRingbufferReturnItem(gvret_cfg.ringbuf_handle, (void *)item);
+    }
+    __sync_fetch_and_sub(&gvret_cfg.callback_active, 1);
+
+    if (len == 0) {
+        *errcode = MP_EAGAIN;
+        return MP_STREAM_ERROR;
+    }
+    return len;
+}
+
+static void gvret_stream_release(gvret_stream_obj_t *self) {
+    if (!gvret_stream_is_open(self)) {
+        return;
+    }
+    gvret_cfg.stream_generation++;
+    self->pending_len = 0;
+    if (gvret_cfg.can_handle != NULL) {
+        can_deactivate(gvret_cfg.can_handle);
+    }
+    gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
+    ESP_LOGI(TAG, "Python stream closed - CAN client deactivated");
+}
+
+// Deactivate the CAN client of a stream closed by its finaliser
+static void gvret_stream_finish_release(void) {
+    if (!gvret_cfg.stream_release_pending) {
+        return;
+    }
+    gvret_cfg.stream_release_pending = false;
+    if (gvret_cfg.active_transport != GVRET_TRANSPORT_STREAM) {
+        return;  // gvret_stop() got there first
+    }
+    if (gvret_cfg.can_handle != NULL) {
+        can_deactivate(gvret_cfg.can_handle);
+    }
+    gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
+    ESP_LOGI(TAG, "Python stream collected - CAN client deactivated");
+}
+
+static mp_obj_t gvret_stream_release_cb(mp_obj_t arg) {
+    (void)arg;
+    gvret_stream_finish_release();
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(gvret_stream_release_cb_obj, gvret_stream_release_cb);
+
+// Finaliser for a stream dropped without close(). The GC runs it inside an
+// allocation, so it only closes the stream here (it reads EOF from now on)
+// and leaves can_deactivate() and the manager locking to the scheduler.
+static mp_obj_t gvret_stream_del(mp_obj_t self_in) {
+    gvret_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (gvret_stream_is_open(self)) {
+        gvret_cfg.stream_generation++;
+        gvret_cfg.stream_release_pending = true;
+        // If the queue is full, the next gvret.stream() finishes the release
+        mp_sched_schedule(MP_OBJ_FROM_PTR(&gvret_stream_release_cb_obj), mp_const_none);
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(gvret_stream_del_obj, gvret_stream_del);
+
+static mp_uint_t gvret_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    gvret_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    (void)arg;
+
+    if (request == MP_STREAM_CLOSE) {
+        gvret_stream_release(self);
+        return 0;
+    }
+    if (request == MP_STREAM_POLL) {
+        mp_uint_t flags = 0;
+        if (self->pending_len > 0 || !gvret_stream_is_open(self)) {
+            flags |= MP_STREAM_POLL_RD;  // Data, or EOF
+        } else if (gvret_cfg.ringbuf_handle != NULL) {
+            UBaseType_t waiting = 0;
+            vRingbufferGetInfo(gvret_cfg.ringbuf_handle, NULL, NULL, NULL, NULL, &waiting);
+            if (waiting > 0) {
+                flags |= MP_STREAM_POLL_RD;
+            }
+        }
+        return flags;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+static const mp_stream_p_t gvret_stream_p = {
+    .read = gvret_stream_read,
+    .ioctl = gvret_stream_ioctl,
+};
+
+static const mp_rom_map_elem_t gvret_stream_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&gvret_stream_del_obj) },  // Dropped without close()
+    { MP_ROM_QSTR(MP_QSTR___enter__), MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__), MP_ROM_PTR(&mp_stream___exit___obj) },
+};
+static MP_DEFINE_CONST_DICT(gvret_stream_locals_dict, gvret_stream_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    gvret_stream_type,
+    MP_QSTR_GVRETStream,
+    MP_TYPE_FLAG_NONE,
+    protocol, &gvret_stream_p,
+    locals_dict, &gvret_stream_locals_dict
+);
+
 void gvret_init(void) {
     // Initialize config defaults if needed
 }
@@ -816,6 +1552,9 @@ bool gvret_start(int tx_pin, int rx_pin, int baud_rate) {
     gvret_cfg.ringbuf_handle = NULL;
     gvret_cfg.tcp_client_sock = -1;
     gvret_cfg.tcp_listen_sock = -1;
+    gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
+    gvret_cfg.ws_client_id = -1;
+    gvret_cfg.ws_task_handle = NULL;
     gvret_cfg.enabled = false;
 
     gvret_cfg.tx_pin = tx_pin;
@@ -903,6 +1642,15 @@ void gvret_stop(void) {
         gvret_cfg.tcp_client_sock = -1;
     }
 
+#if GVRET_WS_TRANSPORT
+    // Detach WebSocket endpoint (its client is disconnected)
+    if (gvret_cfg.ws_path[0]) {
+        wsserver_unregister_endpoint(gvret_cfg.ws_path);
+        gvret_cfg.ws_path[0] = '\0';
+    }
+    gvret_cfg.ws_client_id = -1;
+#endif
+
     // Give tasks time to exit gracefully (they check enabled flag and delete themselves)
     // Wait longer to ensure tasks have fully exited and are no longer accessing resources
     vTaskDelay(pdMS_TO_TICKS(200));
@@ -911,6 +1659,10 @@ void gvret_stop(void) {
     // Don't try to delete tasks here - they've already deleted themselves
     // Just clear the handles to mark them as gone
     gvret_cfg.tcp_task_handle = NULL;
+    gvret_cfg.ws_task_handle = NULL;
+    gvret_cfg.stream_generation++;  // Open Python streams now read EOF
+    gvret_cfg.stream_release_pending = false;
+    gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
 
     // Unregister from CAN manager (manager handles bus state)
     // This will mark client as pending_delete and prevent new callbacks
@@ -1009,6 +1761,15 @@ static mp_obj_t gvret_stop_wrapper(void) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_0(gvret_stop_obj, gvret_stop_wrapper);
 
+#if GVRET_WS_TRANSPORT
+// gvret.start_ws(path="/gvret") - serve GVRET on a wsserver path
+static mp_obj_t gvret_start_ws_wrapper(size_t n_args, const mp_obj_t *args) {
+    const char *path = n_args > 0 ? mp_obj_str_get_str(args[0]) : "/gvret";
+    return mp_obj_new_bool(gvret_start_ws(path));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gvret_start_ws_obj, 0, 1, gvret_start_ws_wrapper);
+#endif
+
 static mp_obj_t gvret_add_filter_wrapper(size_t n_args, const mp_obj_t *args) {
     uint32_t id = mp_obj_get_int(args[0]);
     uint32_t mask = mp_obj_get_int(args[1]);
@@ -1053,16 +1814,153 @@ static mp_obj_t gvret_get_stats_wrapper(void) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_0(gvret_get_stats_obj, gvret_get_stats_wrapper);
 
+// gvret.stream(timeout_ms=0) - claim the GVRET session and read encoded frames from Python
+static mp_obj_t gvret_stream_wrapper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_timeout_ms };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_timeout_ms, MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (!gvret_cfg.enabled) {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("GVRET not started"));
+    }
+    // Allocate first so a MemoryError cannot leave the session taken. The
+    // finaliser releases the session if the stream is dropped without close().
+    gvret_stream_obj_t *self = mp_obj_malloc_with_finaliser(gvret_stream_obj_t, &gvret_stream_type);
+    self->generation = gvret_cfg.stream_generation - 1;  // Not open yet
+    self->timeout_ms = args[ARG_timeout_ms].u_int;
+    self->pending_len = 0;
+    gvret_stream_finish_release();  // A collected stream may still hold the session
+    if (!__sync_bool_compare_and_swap(&gvret_cfg.active_transport, GVRET_TRANSPORT_NONE, GVRET_TRANSPORT_STREAM)) {
+        mp_raise_OSError(MP_EBUSY);
+    }
+    if (gvret_cfg.can_handle != NULL) {
+        esp_err_t ret = can_activate(gvret_cfg.can_handle);
+        if (ret != ESP_OK) {
+            gvret_cfg.active_transport = GVRET_TRANSPORT_NONE;
+            mp_raise_OSError(MP_EIO);
+        }
+    }
+
+    self->generation = ++gvret_cfg.stream_generation;
+    ESP_LOGI(TAG, "Python stream opened - CAN client activated");
+    return MP_OBJ_FROM_PTR(self);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(gvret_stream_obj, 0, gvret_stream_wrapper);
+
+// gvret.set_tx_echo(enable) - echo transmitted frames back to the client
+// Frames are sent as self-reception requests; the CAN manager routes the copy
+// our controller receives at end of frame back to this client only. It is
+// timestamped on dispatch like any received frame.
+static mp_obj_t gvret_set_tx_echo_wrapper(mp_obj_t enable) {
+    gvret_cfg.tx_echo = mp_obj_is_true(enable);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(gvret_set_tx_echo_obj, gvret_set_tx_echo_wrapper);
+
+// gvret.capture_start(seconds=30, size=1048576) - always-on pre-trigger capture
+static mp_obj_t gvret_capture_start_wrapper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_seconds, ARG_size };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_seconds, MP_ARG_INT, {.u_int = GVRET_CAPTURE_DEFAULT_SECONDS} },
+        { MP_QSTR_size, MP_ARG_INT, {.u_int = GVRET_CAPTURE_DEFAULT_SIZE} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    if (args[ARG_seconds].u_int <= 0 || args[ARG_size].u_int <= 0) {
+        mp_raise_ValueError(MP_ERROR_TEXT("seconds and size must be positive"));
+    }
+    return mp_obj_new_bool(gvret_capture_start(args[ARG_seconds].u_int, args[ARG_size].u_int));
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(gvret_capture_start_obj, 0, gvret_capture_start_wrapper);
+
+static mp_obj_t gvret_capture_stop_wrapper(void) {
+    gvret_capture_stop();
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(gvret_capture_stop_obj, gvret_capture_stop_wrapper);
+
+// gvret.capture_dump(path) - write the capture window to a SavvyCAN native CSV file
+// Returns the number of frames written
+static mp_obj_t gvret_capture_dump_wrapper(mp_obj_t path_obj) {
+    uint32_t cursor, end;
+    if (!gvret_capture_range(&cursor, &end)) {
+        ESP_LOGW(TAG, "Capture not running");
+        return MP_OBJ_NEW_SMALL_INT(0);
+    }
+
+    mp_obj_t open_args[2] = { path_obj, MP_OBJ_NEW_QSTR(MP_QSTR_w) };
+    mp_obj_t file = mp_vfs_open(MP_ARRAY_SIZE(open_args), open_args, (mp_map_t *)&mp_const_empty_map);
+
+    static const char header[] = "Time Stamp,ID,Extended,Dir,Bus,LEN,D1,D2,D3,D4,D5,D6,D7,D8\n";
+    gvret_capture_rec_t recs[GVRET_CAPTURE_READ_BATCH];
+    char line[96];
+    uint32_t written = 0;
+
+    // Close the file if a write raises (e.g. filesystem full)
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_stream_write(file, header, sizeof(header) - 1, MP_STREAM_RW_WRITE);
+        while (cursor != end) {
+            int n = gvret_capture_read(&cursor, end, recs, GVRET_CAPTURE_READ_BATCH);
+            for (int i = 0; i < n; i++) {
+                int len = snprintf(line, sizeof(line), "%lld,%08" PRIX32 ",%s,Rx,0,%d",
+                                   (long long)recs[i].time_us, recs[i].identifier,
+                                   recs[i].extd ? "true" : "false", recs[i].dlc);
+                for (int b = 0; b < 8; b++) {
+                    len += snprintf(line + len, sizeof(line) - len, b < recs[i].dlc ? ",%02X" : ",", recs[i].data[b]);
+                }
+                line[len++] = '\n';
+                mp_stream_write(file, line, len, MP_STREAM_RW_WRITE);
+                written++;
+            }
+        }
+        nlr_pop();
+    } else {
+        mp_stream_close(file);
+        nlr_jump(nlr.ret_val);
+    }
+    mp_stream_close(file);
+
+    ESP_LOGI(TAG, "Dumped %lu captured frames", (unsigned long)written);
+    return mp_obj_new_int_from_uint(written);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(gvret_capture_dump_obj, gvret_capture_dump_wrapper);
+
+// gvret.capture_stats() -> dict
+static mp_obj_t gvret_capture_stats_wrapper(void) {
+    uint32_t start = 0, end = 0;
+    bool running = gvret_capture_range(&start, &end);
+    mp_obj_t dict = mp_obj_new_dict(4);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_running), mp_obj_new_bool(running));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_frames), mp_obj_new_int_from_uint(end - start));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_capacity), mp_obj_new_int_from_uint(gvret_capture.capacity));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dropped), mp_obj_new_int_from_uint(gvret_capture.dropped));
+    return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(gvret_capture_stats_obj, gvret_capture_stats_wrapper);
+
 // Module globals table
 static const mp_rom_map_elem_t gvret_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_gvret) },
     { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&gvret_start_obj) },
     { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&gvret_stop_obj) },
+#if GVRET_WS_TRANSPORT
+    { MP_ROM_QSTR(MP_QSTR_start_ws), MP_ROM_PTR(&gvret_start_ws_obj) },
+#endif
     { MP_ROM_QSTR(MP_QSTR_add_filter), MP_ROM_PTR(&gvret_add_filter_obj) },
     { MP_ROM_QSTR(MP_QSTR_clear_filters), MP_ROM_PTR(&gvret_clear_filters_obj) },
     { MP_ROM_QSTR(MP_QSTR_set_bitrate_change_callback), MP_ROM_PTR(&gvret_set_bitrate_change_callback_obj) },
     { MP_ROM_QSTR(MP_QSTR_get_bitrate), MP_ROM_PTR(&gvret_get_bitrate_obj) },
     { MP_ROM_QSTR(MP_QSTR_get_stats), MP_ROM_PTR(&gvret_get_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream), MP_ROM_PTR(&gvret_stream_obj) },
+    { MP_ROM_QSTR(MP_QSTR_set_tx_echo), MP_ROM_PTR(&gvret_set_tx_echo_obj) },
+    { MP_ROM_QSTR(MP_QSTR_capture_start), MP_ROM_PTR(&gvret_capture_start_obj) },
+    { MP_ROM_QSTR(MP_QSTR_capture_stop), MP_ROM_PTR(&gvret_capture_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_capture_dump), MP_ROM_PTR(&gvret_capture_dump_obj) },
+    { MP_ROM_QSTR(MP_QSTR_capture_stats), MP_ROM_PTR(&gvret_capture_stats_obj) },
 };
 static MP_DEFINE_CONST_DICT(gvret_module_globals, gvret_module_globals_table);
 
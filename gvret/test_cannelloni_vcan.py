@@ -0,0 +1,201 @@
+"""
+Linux harness for the cannelloni tunnel: bridges the device's UDP stream to a
+local vcan interface, so candump/cansend/python-can can be used against the
+device's bus. Equivalent to running `cannelloni -I vcan0 -R <device-ip>`.
+
+Setup:
+    sudo modprobe vcan
+    sudo ip link add dev vcan0 type vcan
+    sudo ip link set up vcan0
+
+On the device:
+    import cannelloni
+    cannelloni.start("<host-ip>")
+
+On the host:
+    python3 test_cannelloni_vcan.py <device-ip> [vcan0]
+    candump vcan0                  # frames from the device's bus
+    cansend vcan0 123#DEADBEEF     # transmitted on the device's bus
+
+Run with --selftest to check the packet encoder/decoder against vcan0 without
+a device (loops UDP back to this host).
+"""
+import socket
+import struct
+import sys
+import threading
+import time
+
+# Configuration
+DEVICE_IP = '192.168.1.32'  # Change this to your device IP
+IFACE = 'vcan0'
+PORT = 20000
+TIMEOUT_MS = 2
+
+# Cannelloni frame version 2
+VERSION = 2
+OP_DATA = 0
+HEADER = struct.Struct('>BBBH')
+CAN_FRAME = struct.Struct('=IB3x8s')  # struct can_frame
+CANNELLONI_EFF_FLAG = 0x80000000
+CANNELLONI_RTR_FLAG = 0x40000000
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+MAX_PACKET = 1400
+
+
+def encode_packet(seq, frames):
+    """frames: list of (can_id, data) with SocketCAN flags in can_id"""
+    body = b''
+    for can_id, data in frames:
+        body += struct.pack('>IB', can_id, len(data))
+        if not (can_id & CAN_RTR_FLAG):
+            body += data
+    return HEADER.pack(VERSION, OP_DATA, seq & 0xFF, len(frames)) + body
+
+
+def decode_packet(packet):
+    """Returns (seq, [(can_id, data), ...]); classic CAN frames only"""
+    version, op, seq, count = HEADER.unpack_from(packet)
+    if version != VERSION or op != OP_DATA:
+        return seq, []
+    pos = HEADER.size
+    frames = []
+    for _ in range(count):
+        can_id, length = struct.unpack_from('>IB', packet, pos)
+        pos += 5
+        if length & 0x80:  # CAN FD: flags byte follows
+            length &= 0x7F
+            pos += 1
+        data = b'' if can_id & CANNELLONI_RTR_FLAG else packet[pos:pos + length]
+        pos += len(data)
+        frames.append((can_id, data))
+    return seq, frames
+
+
+def open_can(iface):
+    s = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    s.bind((iface,))
+    return s
+
+
+def can_to_udp(can_sock, udp_sock, remote, stop):
+    """Pack frames read from vcan into datagrams (flush on full or TIMEOUT_MS)"""
+    seq = 0
+    can_sock.settimeout(0.1)
+    while not stop.is_set():
+        try:
+            frame = can_sock.recv(CAN_FRAME.size)
+        except socket.timeout:
+            continue
+        frames = []
+        size = HEADER.size
+        deadline = time.monotonic() + TIMEOUT_MS / 1000.0
+        while frame:
+            can_id, dlc, data = CAN_FRAME.unpack(frame)
+            frames.append((can_id, data[:dlc]))
+            size += 5 + dlc
+            if size + 13 > MAX_PACKET:
+                break
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                break
+            can_sock.settimeout(remaining)
+            try:
+                frame = can_sock.recv(CAN_FRAME.size)
+            except socket.timeout:
+                frame = None
+        can_sock.settimeout(0.1)
+        udp_sock.sendto(encode_packet(seq, frames), remote)
+        seq += 1
+
+
+def udp_to_can(can_sock, udp_sock, stop, stats):
+    udp_sock.settimeout(0.1)
+    last_seq = None
+    while not stop.is_set():
+        try:
+            packet, _ = udp_sock.recvfrom(2048)
+        except socket.timeout:
+            continue
+        seq, frames = decode_packet(packet)
+        if last_seq is not None and seq != (last_seq + 1) & 0xFF:
+            stats['seq_errors'] += 1
+        last_seq = seq
+        for can_id, data in frames:
+            can_sock.send(CAN_FRAME.pack(can_id, len(data), data.ljust(8, b'\x00')))
+            stats['frames'] += 1
+
+
+def bridge(device_ip, iface):
+    can_sock = open_can(iface)
+    udp_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp_sock.bind(('0.0.0.0', PORT))
+    stop = threading.Event()
+    stats = {'frames': 0, 'seq_errors': 0}
+
+    threads = [
+        threading.Thread(target=can_to_udp, args=(can_sock, udp_sock, (device_ip, PORT), stop), daemon=True),
+        threading.Thread(target=udp_to_can, args=(can_sock, udp_sock, stop, stats), daemon=True),
+    ]
+    for t in threads:
+        t.start()
+    print(f"Bridging {iface} <-> {device_ip}:{PORT} (Ctrl+C to stop)")
+    try:
+        while True:
+            time.sleep(1)
+            print(f"frames from device: {stats['frames']}, seq errors: {stats['seq_errors']}")
+    except KeyboardInterrupt:
+        stop.set()
+
+
+def selftest(iface):
+    """Encode/decode round trip plus a vcan loop through the UDP bridge; returns the failure count"""
+    failures = 0
+    frames = [(0x123, b'\xde\xad\xbe\xef'), (0x18DAF110 | CAN_EFF_FLAG, bytes(range(8))),
+              (0x7DF | CAN_RTR_FLAG, b'')]
+    seq, decoded = decode_packet(encode_packet(7, frames))
+    if seq == 7 and decoded == frames:
+        print("PASS: packet round trip")
+    else:
+        print(f"FAIL: packet round trip {decoded}")
+        failures += 1
+
+    # Bridge vcan -> UDP to ourselves, then check the datagram contents
+    can_sock = open_can(iface)
+    tx_sock = open_can(iface)
+    udp_rx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp_rx.bind(('127.0.0.1', 0))
+    udp_rx.settimeout(1.0)
+    udp_tx = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    stop = threading.Event()
+    t = threading.Thread(target=can_to_udp, args=(can_sock, udp_tx, udp_rx.getsockname(), stop), daemon=True)
+    t.start()
+    time.sleep(0.2)
+    for can_id, data in frames:
+        tx_sock.send(CAN_FRAME.pack(can_id, len(data), data.ljust(8, b'\x00')))
+    received = []
+    try:
+        while len(received) < len(frames):
+            received += decode_packet(udp_rx.recv(2048))[1]
+    except socket.timeout:
+        pass
+    stop.set()
+    if received == frames:
+        print(f"PASS: {iface} -> UDP ({len(received)} frames)")
+    else:
+        print(f"FAIL: {iface} -> UDP got {received}")
+        failures += 1
+    return failures
+
+
+if __name__ == "__main__":
+    args = [a for a in sys.argv[1:] if not a.startswith('--')]
+    if '--selftest' in sys.argv:
+        sys.exit(1 if selftest(args[0] if args else IFACE) else 0)
+    else:
+        if args:
+            DEVICE_IP = args[0]
+        if len(args) > 1:
+            IFACE = args[1]
+        bridge(DEVICE_IP, IFACE)
@@ -10,6 +10,8 @@ add_library(usermod_httpserver INTERFACE)
 target_sources(usermod_httpserver INTERFACE
     ${MODULE_DIR}/modhttpserver.c
     ${MODULE_DIR}/modwebfiles.c
+    ${MODULE_DIR}/webbundle.c
+    ${MODULE_DIR}/otawriter.c
     ${MODULE_DIR}/modwsserver.c
     ${MODULE_DIR}/modwebDAP.c
 )
@@ -38,5 +40,15 @@ else()
     message(STATUS "pyDirect httpserver: littlefs managed component not found (modwebfiles.c may fail)")
 endif()
 
+# Count TLS session resumptions: modhttpserver.c wraps the ticket parser that
+# esp-tls installs (only referenced when session tickets are enabled)
+target_link_options(usermod_httpserver INTERFACE "-Wl,--wrap=mbedtls_ssl_ticket_parse")
+
+# Firmware update progress (httpserver.ota) goes out on the WBP event channel
+if(MODULE_PYDIRECT_WEBREPL)
+    target_compile_definitions(usermod_httpserver INTERFACE HTTPSERVER_WBP_EVENTS=1)
+    message(STATUS "pyDirect httpserver: OTA progress over WBP enabled")
+endif()
+
 # Link the module to MicroPython's usermod target
 target_link_libraries(usermod INTERFACE usermod_httpserver)
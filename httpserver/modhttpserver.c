@@ -10,22 +10,36 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
 
 // ESP-IDF includes
 #define LOG_LOCAL_LEVEL ESP_LOG_INFO
 #include "esp_log.h"
 #include "esp_http_server.h"
 #include "esp_https_server.h"
+#include "esp_tls.h"
 #include "esp_system.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "lwip/sockets.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
 
 // MicroPython includes
 #include "py/runtime.h"
@@ -38,12 +52,21 @@
 #include "py/compile.h"
 #include "py/persistentcode.h"
 
+#include "otawriter.h"
+
 // Module is registered as part of esp32 module (see modesp32.c)
 
 // External functions from webfiles module
 extern const char* webfiles_get_mime_type(const char *path);
 extern void webfiles_set_content_type_from_file(httpd_req_t *req, const char *filepath);
-extern void webfiles_resolve_gzip(char *filepath, size_t filepath_size, const char *accept_encoding, bool *use_compression);
+extern void webfiles_cache_invalidate(const char *path);
+extern void webfiles_precompress_queue(const char *path);
+extern void webfiles_server_stopped(void);
+
+#if HTTPSERVER_WBP_EVENTS
+// WBP event channel (from webrepl module): [0, WBP_EVT_OTA, state, written, total, ?error]
+extern void wbp_send_ota(uint8_t state, size_t written, size_t total, const char *error);
+#endif
 
 // File request structure (defined in modwebfiles.c)
 // Contains: filepath[128], accept_encoding[64], use_compression
@@ -60,7 +83,10 @@ typedef struct {
 typedef enum {
     HTTP_MSG_WEBSOCKET = 1,
     HTTP_MSG_FILE = 2,
-    HTTP_MSG_WEB = 3
+    HTTP_MSG_WEB = 3,
+    HTTP_MSG_UPLOAD = 4,  // File stored by an upload endpoint
+    HTTP_MSG_OTA_AUTHORIZE = 5,  // Firmware update waiting for Python's decision
+    HTTP_MSG_OTA_DONE = 6        // Firmware update written and set to boot
 } http_msg_type_t;
 
 // Message structure for queue
@@ -72,11 +98,29 @@ typedef struct {
     void *user_data;
     mp_obj_t func;  // MicroPython function object
     httpd_req_t *req;  // HTTP request handle for async processing
+    int64_t queued_us;  // When a web request was queued (admission control)
+    uint32_t connect_us;  // Connection open to first request (0 on reused connections)
 } http_queue_msg_t;
 
+// user_data of HTTP_MSG_UPLOAD (the stored path is the message data)
+typedef struct {
+    size_t size;
+    char sha256[65];
+} upload_done_t;
+
+// user_data of HTTP_MSG_OTA_AUTHORIZE (the Authorization header, if any, is the message data)
+typedef struct {
+    uint32_t ticket;
+    size_t size;
+    char sha256[65];
+} ota_request_t;
+
 // Forward declarations for internal functions
+static void httpserver_notify_event(void);
+static esp_err_t httpserver_route_err_handler(httpd_req_t *req, httpd_err_code_t error);
+static void httpserver_sse_forget(httpd_handle_t hd, int fd);
+static void ota_authorize_reply(uint32_t ticket, bool allowed);
 bool httpserver_queue_message(http_msg_type_t type, int client_id, const void *data, size_t data_len, void *user_data);
-bool httpserver_queue_web_request(int handler_id, httpd_req_t *req, mp_obj_t func);
 
 // Forward declaration for WebSocket message processing (from modwsserver.c)
 extern void wsserver_process_websocket_msg(int client_id, const char *data, size_t data_len, bool is_binary);
@@ -97,56 +141,443 @@ static QueueHandle_t http_msg_queue = NULL;
 static SemaphoreHandle_t http_queue_mutex = NULL;
 static bool http_queue_initialized = false;
 
-// Maximum number of HTTP handlers
-#define HTTP_HANDLER_MAX 12 // Enough for multiple modules (httpserver + wsserver + cwebrepl)
+// Admission control for Python routes. The queue is shared, so normal routes
+// leave HTTP_QUEUE_RESERVE slots free for "high" routes (which also go to the
+// front), and "low" routes only get in while the queue is short. A route also
+// sheds load when Python has not taken anything from the queue for longer
+// than its max_wait_ms: the request would only time out in the queue.
+#define HTTP_QUEUE_SIZE 50
+#define HTTP_QUEUE_RESERVE 8          // Slots only "high" routes may use
+#define HTTP_QUEUE_LOW_MAX 8          // "low" routes only while fewer are pending
+#define HTTP_MAX_WAIT_MS_DEFAULT 0       // No limit unless the route asks for one
+
+// URI handler slots per server. Python routes take none (the 404/405 handlers
+// find them); these are the C-served paths registered on the same servers.
+#define HTTP_URI_HANDLERS_MAX (4 /* sse(): SSE_ENDPOINT_MAX */ + \
+                               1 /* metrics() */ + \
+                               4 /* upload(): UPLOAD_ENDPOINT_MAX x PUT/POST */ + \
+                               2 /* ota(): PUT/POST */ + \
+                               5 /* webfiles: serve GET/HEAD, direct, index list/batch */ + \
+                               4 /* webfiles.serve_bundle(): BUNDLE_PREFIX_MAX x GET/HEAD */ + \
+                               5 /* wsserver: main path + MAX_WS_ENDPOINTS */ + \
+                               2 /* spare */)
+
+typedef enum {
+    HTTP_PRIORITY_LOW,
+    HTTP_PRIORITY_NORMAL,
+    HTTP_PRIORITY_HIGH
+} http_priority_t;
+
+static const char *const http_priority_names[] = { "low", "normal", "high" };
+
+// Guarded by http_queue_mutex
+static struct {
+    uint16_t pending;           // Web requests queued and not yet taken by Python
+    int64_t progress_us;        // Python last took a message (or the queue stopped being empty)
+    uint32_t dequeued;          // Web requests taken from the queue
+    uint64_t wait_total_us;
+    uint32_t wait_max_us;
+    uint32_t shed_busy;         // 503: queue full or Python stalled
+    uint32_t shed_concurrency;  // 503: route at max_concurrent
+    uint32_t expired;           // 503: waited in the queue longer than max_wait_ms
+} http_admission = {0};
+
+//=============================================================================
+// Python routes: handler table and radix tree router
+//=============================================================================
+// Python routes are not registered with ESP-IDF one by one. They live in a
+// radix tree that is searched in the HTTP server task by a single catch-all:
+// the 404/405 error handlers, so handlers registered directly by C modules
+// (wsserver, webfiles, ...) keep working as before. Only requests that match
+// a route are queued for Python; anything else gets a 404 without touching
+// the VM.
+//
+// Patterns are static text plus "{name}" parameters (one whole path segment)
+// and an optional trailing "*" wildcard, e.g. "/api/can/{id}" or "/files/*".
+// Static text wins over a parameter, and a parameter over a wildcard.
+
+#define HTTP_ROUTE_MAX_PARAMS 8   // Parameters (including the wildcard) per route
+#define HTTP_ROUTE_GROW 8         // Handler table growth step
+#define HTTP_CACHE_URIS 4         // Cached responses per route, one per URI
 
-// Handler storage
+typedef enum {
+    HTTP_ROUTE_GET,
+    HTTP_ROUTE_POST,
+    HTTP_ROUTE_PUT,
+    HTTP_ROUTE_DELETE,
+    HTTP_ROUTE_PATCH,
+    HTTP_ROUTE_ANY,               // Registered with method "*": any method
+    HTTP_ROUTE_METHODS
+} http_route_method_t;
+
+static const char *const http_route_method_names[HTTP_ROUTE_METHODS] = {
+    "GET", "POST", "PUT", "DELETE", "PATCH", "*"
+};
+
+// Cached response of a route registered with cache_ms. Refcounted so the
+// server task can send it without holding http_route_mutex while Python
+// replaces or invalidates it.
+typedef struct {
+    int refs;             // The handler slot plus responses being sent
+    char *uri;            // Request URI (path and query) the response is for
+    char *body;
+    size_t len;
+    char etag[16];        // Quoted FNV-1a of the body
+    int64_t expires_us;
+} http_cache_entry_t;
+
+// Request latency is split into stages: connection open to first request
+// (connect), waiting for Python (queue), the Python handler, and sending the
+// response (send). Durations go into fixed histogram buckets.
+typedef enum {
+    HTTP_STAGE_CONNECT,
+    HTTP_STAGE_QUEUE,
+    HTTP_STAGE_HANDLER,
+    HTTP_STAGE_SEND,
+    HTTP_STAGES
+} http_stage_t;
+
+#define HTTP_METRIC_BUCKETS 12    // Plus +Inf
+
+typedef struct {
+    uint32_t buckets[HTTP_METRIC_BUCKETS + 1];  // Not cumulative; +Inf last
+    uint32_t count;
+    uint64_t total_us;
+} http_histogram_t;
+
+static void http_histogram_add(http_histogram_t *h, uint32_t us);
+
+typedef struct {
+    http_histogram_t latency;        // Request in to response sent (queue + handler + send)
+    uint64_t stage_us[HTTP_STAGES];  // Time spent per stage
+    uint32_t errors;                 // 5xx responses
+} http_route_metrics_t;
+
+// Handler storage (Python functions are kept in MP_STATE_PORT(httpserver_route_funcs)
+// at the same index, where the GC can see them)
 typedef struct {
     bool active;          // Whether this handler is in use
-    mp_obj_t func;        // MicroPython function to call for requests
+    uint32_t id;          // Unique per registration, so a queued request can tell it was replaced
     char *uri;            // URI pattern (dynamically allocated)
-    httpd_method_t method; // HTTP method (GET, POST, etc.)
+    http_route_method_t method;
+    bool stream;          // Pass an HTTPRequest body stream instead of the body as str
+    size_t max_body;      // Reject larger bodies with 413 (0 = no limit)
+    uint32_t cache_ms;    // Serve the last GET response from C for this long (0 = off)
+    http_cache_entry_t *cache[HTTP_CACHE_URIS];  // By URI (path and query)
+    http_priority_t priority;
+    uint16_t max_concurrent;  // Queued plus running requests allowed (0 = no limit)
+    uint16_t concurrent;
+    uint32_t max_wait_ms;     // Longest queue wait before 503 (0 = no limit)
+    http_route_metrics_t metrics;
 } http_handler_t;
 
-static http_handler_t http_handlers[HTTP_HANDLER_MAX];
-
-// Handler function pointers for ESP-IDF
-#define HTTP_HANDLER_FUNC(n) \
-    static esp_err_t httpserver_http_handler_##n(httpd_req_t *req) { \
-        return httpserver_http_handler_impl(req); \
-    }
-
-// Forward declaration for handler implementation
-static esp_err_t httpserver_http_handler_impl(httpd_req_t *req);
-
-HTTP_HANDLER_FUNC(0)
-HTTP_HANDLER_FUNC(1)
-HTTP_HANDLER_FUNC(2)
-HTTP_HANDLER_FUNC(3)
-HTTP_HANDLER_FUNC(4)
-HTTP_HANDLER_FUNC(5)
-HTTP_HANDLER_FUNC(6)
-HTTP_HANDLER_FUNC(7)
-HTTP_HANDLER_FUNC(8)
-HTTP_HANDLER_FUNC(9)
-HTTP_HANDLER_FUNC(10)
-HTTP_HANDLER_FUNC(11)
-
-typedef esp_err_t (*http_handler_func_t)(httpd_req_t *req);
-static const http_handler_func_t httpserver_handlers[HTTP_HANDLER_MAX] = {
-    httpserver_http_handler_0,
-    httpserver_http_handler_1,
-    httpserver_http_handler_2,
-    httpserver_http_handler_3,
-    httpserver_http_handler_4,
-    httpserver_http_handler_5,
-    httpserver_http_handler_6,
-    httpserver_http_handler_7,
-    httpserver_http_handler_8,
-    httpserver_http_handler_9,
-    httpserver_http_handler_10,
-    httpserver_http_handler_11
-};
+static http_handler_t *http_handlers = NULL;
+static int http_handler_count = 0;      // Allocated entries
+static uint32_t http_handler_next_id = 0;
+
+MP_REGISTER_ROOT_POINTER(mp_obj_t httpserver_route_funcs);
+
+// Radix tree node. Static children are keyed by the first character of their
+// label; a shared prefix is split into its own node on insert.
+typedef struct http_route_node {
+    char *label;                         // Static path fragment ("" for root/param/wildcard)
+    struct http_route_node **children;   // Static children
+    uint8_t n_children;
+    struct http_route_node *param;       // "{name}" child
+    struct http_route_node *wildcard;    // "*" child
+    int16_t handlers[HTTP_ROUTE_METHODS]; // Index into http_handlers per method, -1 = none
+} http_route_node_t;
+
+static http_route_node_t *http_route_root = NULL;
+static SemaphoreHandle_t http_route_mutex = NULL;  // Guards the tree and http_handlers
+
+// Result of a lookup, passed with the queued request
+typedef struct {
+    int handler_id;
+    uint32_t route_id;
+    uint8_t n_params;
+    struct {
+        uint16_t offset;  // Into req->uri
+        uint16_t len;
+    } params[HTTP_ROUTE_MAX_PARAMS];
+} http_route_match_t;
+
+static http_route_node_t *http_route_node_new(const char *label, size_t len) {
+    http_route_node_t *node = calloc(1, sizeof(http_route_node_t));
+    if (!node) {
+        return NULL;
+    }
+    node->label = strndup(label, len);
+    if (!node->label) {
+        free(node);
+        return NULL;
+    }
+    for (int i = 0; i < HTTP_ROUTE_METHODS; i++) {
+        node->handlers[i] = -1;
+    }
+    return node;
+}
+
+static void http_route_node_free(http_route_node_t *node) {
+    if (!node) {
+        return;
+    }
+    for (int i = 0; i < node->n_children; i++) {
+        http_route_node_free(node->children[i]);
+    }
+    http_route_node_free(node->param);
+    http_route_node_free(node->wildcard);
+    free(node->children);
+    free(node->label);
+    free(node);
+}
+
+static http_route_node_t *http_route_child(const http_route_node_t *node, char c, int *index) {
+    for (int i = 0; i < node->n_children; i++) {
+        if (node->children[i]->label[0] == c) {
+            if (index) {
+                *index = i;
+            }
+            return node->children[i];
+        }
+    }
+    return NULL;
+}
+
+static bool http_route_add_child(http_route_node_t *node, http_route_node_t *child) {
+    if (node->n_children == UINT8_MAX) {
+        return false;
+    }
+    http_route_node_t **children = realloc(node->children, (node->n_children + 1) * sizeof(*children));
+    if (!children) {
+        return false;
+    }
+    children[node->n_children++] = child;
+    node->children = children;
+    return true;
+}
+
+// Check a pattern and count its parameters. Returns -1 if invalid.
+static int http_route_validate(const char *pattern) {
+    int n_params = 0;
+    if (pattern[0] != '/') {
+        return -1;
+    }
+    for (const char *p = pattern; *p; p++) {
+        if (*p == '{') {
+            const char *end = strchr(p, '}');
+            // A parameter is a whole segment with a non-empty name
+            if (!end || end == p + 1 || p[-1] != '/' || (end[1] != '\0' && end[1] != '/') ||
+                memchr(p + 1, '/', end - p - 1)) {
+                return -1;
+            }
+            n_params++;
+            p = end;
+        } else if (*p == '}') {
+            return -1;
+        } else if (*p == '*') {
+            if (p[1] != '\0') {
+                return -1;  // Wildcard only at the end
+            }
+            n_params++;
+        }
+    }
+    return n_params <= HTTP_ROUTE_MAX_PARAMS ? n_params : -1;
+}
+
+// Walk (create == false) or build (create == true) the node for a pattern.
+// Caller holds http_route_mutex.
+static http_route_node_t *http_route_node_for(const char *pattern, bool create) {
+    http_route_node_t *node = http_route_root;
+    const char *p = pattern;
+
+    while (node && *p) {
+        if (*p == '{') {
+            if (!node->param && create) {
+                node->param = http_route_node_new("", 0);
+            }
+            node = node->param;
+            p = strchr(p, '}') + 1;
+        } else if (*p == '*') {
+            if (!node->wildcard && create) {
+                node->wildcard = http_route_node_new("", 0);
+            }
+            return node->wildcard;
+        } else {
+            size_t len = strcspn(p, "{*");
+            int index = 0;
+            http_route_node_t *child = http_route_child(node, *p, &index);
+            if (!create) {
+                size_t label_len = child ? strlen(child->label) : 0;
+                if (!child || label_len > len || memcmp(child->label, p, label_len) != 0) {
+                    return NULL;
+                }
+                node = child;
+                p += label_len;
+                continue;
+            }
+            if (!child) {
+                child = http_route_node_new(p, len);
+                if (!child || !http_route_add_child(node, child)) {
+                    http_route_node_free(child);
+                    return NULL;
+                }
+                node = child;
+                p += len;
+                continue;
+            }
+            size_t common = 0;
+            while (common < len && child->label[common] == p[common]) {
+                common++;
+            }
+            if (child->label[common] != '\0') {
+                // Split: a new node takes the shared prefix, the child keeps the rest
+                http_route_node_t *split = http_route_node_new(child->label, common);
+                if (!split || !http_route_add_child(split, child)) {
+                    http_route_node_free(split);
+                    return NULL;
+                }
+                memmove(child->label, child->label + common, strlen(child->label + common) + 1);
+                node->children[index] = split;
+                child = split;
+            }
+            node = child;
+            p += common;
+        }
+    }
+    return node;
+}
+
+// Handler for a method on a node; HTTP_ROUTE_METHODS means any registered handler
+static int http_route_node_handler(const http_route_node_t *node, int method, bool *path_found) {
+    int any = -1;
+    for (int i = 0; i < HTTP_ROUTE_METHODS; i++) {
+        if (node->handlers[i] >= 0) {
+            *path_found = true;
+            any = node->handlers[i];
+        }
+    }
+    if (method == HTTP_ROUTE_METHODS) {
+        return any;
+    }
+    return node->handlers[method] >= 0 ? node->handlers[method] : node->handlers[HTTP_ROUTE_ANY];
+}
+
+// Match path[pos..len) below node, backtracking from static text to a
+// parameter to a wildcard. Caller holds http_route_mutex.
+static bool http_route_match(const http_route_node_t *node, const char *path, size_t pos, size_t len,
+                             int method, http_route_match_t *match, bool *path_found) {
+    if (pos == len) {
+        int handler = http_route_node_handler(node, method, path_found);
+        if (handler >= 0) {
+            match->handler_id = handler;
+            return true;
+        }
+    } else {
+        const http_route_node_t *child = http_route_child(node, path[pos], NULL);
+        if (child) {
+            size_t label_len = strlen(child->label);
+            if (label_len <= len - pos && memcmp(child->label, path + pos, label_len) == 0 &&
+                http_route_match(child, path, pos + label_len, len, method, match, path_found)) {
+                return true;
+            }
+        }
+        if (node->param && match->n_params < HTTP_ROUTE_MAX_PARAMS) {
+            size_t end = pos;
+            while (end < len && path[end] != '/') {
+                end++;
+            }
+            if (end > pos) {
+                uint8_t n = match->n_params++;
+                match->params[n].offset = pos;
+                match->params[n].len = end - pos;
+                if (http_route_match(node->param, path, end, len, method, match, path_found)) {
+                    return true;
+                }
+                match->n_params = n;
+            }
+        }
+    }
+    // The wildcard takes the rest of the path, which may be empty
+    if (node->wildcard && match->n_params < HTTP_ROUTE_MAX_PARAMS) {
+        int handler = http_route_node_handler(node->wildcard, method, path_found);
+        if (handler >= 0) {
+            uint8_t n = match->n_params++;
+            match->params[n].offset = pos;
+            match->params[n].len = len - pos;
+            match->handler_id = handler;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int http_route_method_from_httpd(int method) {
+    switch (method) {
+        case HTTP_GET: return HTTP_ROUTE_GET;
+        case HTTP_POST: return HTTP_ROUTE_POST;
+        case HTTP_PUT: return HTTP_ROUTE_PUT;
+        case HTTP_DELETE: return HTTP_ROUTE_DELETE;
+        case HTTP_PATCH: return HTTP_ROUTE_PATCH;
+        default: return HTTP_ROUTE_ANY;  // Only "*" routes take other methods
+    }
+}
+
+static struct {
+    uint32_t hits;          // Served from the cache in the server task
+    uint32_t not_modified;  // ... of which 304 (If-None-Match)
+    uint32_t stores;        // Responses from Python stored in the cache
+} http_cache_stats = {0};
+
+// Drop a reference. Caller holds http_route_mutex.
+static void http_cache_unref(http_cache_entry_t *entry) {
+    if (entry && --entry->refs == 0) {
+        free(entry->uri);
+        free(entry->body);
+        free(entry);
+    }
+}
+
+// Drop a route's cached responses and return how many there were. Caller
+// holds http_route_mutex.
+static int http_cache_drop(http_handler_t *handler) {
+    int dropped = 0;
+    for (int i = 0; i < HTTP_CACHE_URIS; i++) {
+        if (handler->cache[i]) {
+            http_cache_unref(handler->cache[i]);
+            handler->cache[i] = NULL;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+// Fresh cached response of a route for this exact URI, or NULL. Caller holds
+// http_route_mutex.
+static http_cache_entry_t *http_cache_find(http_handler_t *handler, const char *uri) {
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < HTTP_CACHE_URIS; i++) {
+        http_cache_entry_t *entry = handler->cache[i];
+        if (entry && now < entry->expires_us && strcmp(entry->uri, uri) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Remove every route. Caller holds http_route_mutex (if it exists).
+static void http_route_clear(void) {
+    http_route_node_free(http_route_root);
+    http_route_root = NULL;
+    for (int i = 0; i < http_handler_count; i++) {
+        free(http_handlers[i].uri);
+        http_cache_drop(&http_handlers[i]);
+    }
+    free(http_handlers);
+    http_handlers = NULL;
+    http_handler_count = 0;
+    MP_STATE_PORT(httpserver_route_funcs) = MP_OBJ_NULL;
+}
 
 // Maximum concurrent HTTP server connections
 #define HTTPD_MAX_CONNECTIONS 10 // Match max_open_sockets in config
@@ -159,10 +590,30 @@ static httpd_handle_t https_server = NULL;
 
 // SSL/TLS configuration
 static bool use_https = false;
-static uint8_t *server_cert = NULL;
-static size_t server_cert_len = 0;
-static uint8_t *server_key = NULL;
-static size_t server_key_len = 0;
+
+#define TLS_HANDSHAKE_SLOTS 4      // Handshakes timed at once (failed ones are reused)
+
+// Certificate and key, read once at start into PSRAM. With the certificate
+// selection hook they are also parsed once, so handshakes skip the PEM and
+// key parsing esp-tls otherwise repeats for every connection.
+static struct {
+    uint8_t *cert;
+    size_t cert_len;               // Including the NUL terminator PEM parsing needs
+    uint8_t *key;
+    size_t key_len;
+    bool parsed;
+    mbedtls_x509_crt crt;
+    mbedtls_pk_context pk;
+    bool session_tickets;
+    // Handshakes between ClientHello and open_fn, keyed by their mbedTLS
+    // context. Only the HTTPS server task touches these.
+    struct {
+        const void *ssl;           // NULL = free
+        int64_t start_us;          // ClientHello seen
+        bool resumed;              // A session ticket was accepted
+    } handshakes[TLS_HANDSHAKE_SLOTS];
+    bool ticket_accepted;          // Set by the ticket parser, taken by the next ClientHello
+} server_tls = {0};
 
 // Export function for webrepl module
 httpd_handle_t mp_httpserver_get_handle(void) {
@@ -172,11 +623,257 @@ httpd_handle_t mp_httpserver_get_handle(void) {
 // Current HTTP request being processed (for MicroPython access)
 static httpd_req_t *current_request = NULL;
 
-// Connection tracking for WebSocket clients
+// Set when httpserver.send() has already answered the current request
+static bool current_response_sent = false;
+
+//=============================================================================
+// Keep-alive session tracking
+//=============================================================================
+// Python route responses are framed with Content-Length, so connections can
+// stay open between requests. Each socket opened on either server gets a slot
+// here (via open_fn/close_fn) so we can count handshakes, cap the number of
+// requests per connection and close connections left idle too long.
+
+#define HTTP_SESSION_MAX 8  // max_open_sockets of HTTP (4) + HTTPS (3), plus one spare
+#define HTTP_KEEPALIVE_SWEEP_MS 1000
+
+typedef struct {
+    httpd_handle_t hd;    // Server owning the socket (NULL = free slot)
+    int fd;
+    uint32_t requests;    // Python route requests served on this connection
+    int64_t last_us;      // Time of last route request/response
+    bool in_flight;       // Route request queued or being processed
+    bool sse;             // Serving an event stream, which stays open
+} http_session_t;
+
 static struct {
-    int count;
+    int count;            // Open sessions
     SemaphoreHandle_t mutex;
-} connection_tracking = {0, NULL};
+    http_session_t sessions[HTTP_SESSION_MAX];
+    uint32_t keepalive_timeout_s;  // 0 = close after every route response
+    uint32_t max_requests;         // Route requests per connection before close
+    char keepalive_hdr[32];        // "timeout=N, max=M" (must outlive the response)
+    esp_timer_handle_t sweep_timer;
+    // Stats
+    uint32_t http_connections;     // TCP connections accepted on the HTTP server
+    uint32_t tls_handshakes;       // Completed TLS handshakes on the HTTPS server
+    http_histogram_t tls_handshake_time[2];  // ClientHello to open, [0] full, [1] resumed
+    uint32_t tls_handshake_max_us;
+    uint32_t requests;             // Python route requests
+    uint32_t reused;               // ... served on an already-used connection
+    uint32_t idle_closes;
+    uint32_t limit_closes;
+} connection_tracking = {0};
+
+// Find the slot for a socket; caller holds connection_tracking.mutex
+static http_session_t *httpserver_session_find(httpd_handle_t hd, int fd) {
+    for (int i = 0; i < HTTP_SESSION_MAX; i++) {
+        http_session_t *s = &connection_tracking.sessions[i];
+        if (s->hd == hd && s->fd == fd) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Time from ClientHello of the handshake that opened this connection, and
+// whether it resumed a session; false if it wasn't seen (no selection hook).
+// CONTEXT: HTTPS server task, from open_fn
+static bool httpserver_tls_handshake_done(httpd_handle_t hd, int sockfd, uint32_t *us, bool *resumed) {
+    server_tls.ticket_accepted = false;  // Not left for the next handshake
+    esp_tls_t *tls = httpd_sess_get_transport_ctx(hd, sockfd);
+    const void *ssl = tls ? esp_tls_get_ssl_context(tls) : NULL;
+    for (int i = 0; ssl && i < TLS_HANDSHAKE_SLOTS; i++) {
+        if (server_tls.handshakes[i].ssl == ssl) {
+            *us = (uint32_t)(esp_timer_get_time() - server_tls.handshakes[i].start_us);
+            *resumed = server_tls.handshakes[i].resumed;
+            server_tls.handshakes[i].ssl = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+// CONTEXT: HTTP server task (for HTTPS, called after the TLS handshake)
+static esp_err_t httpserver_session_open(httpd_handle_t hd, int sockfd) {
+    if (!connection_tracking.mutex) {
+        return ESP_OK;
+    }
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    http_session_t *s = httpserver_session_find(NULL, 0);
+    if (s) {
+        s->hd = hd;
+        s->fd = sockfd;
+        s->requests = 0;
+        s->last_us = esp_timer_get_time();
+        s->in_flight = false;
+        s->sse = false;
+        connection_tracking.count++;
+    }
+    if (hd == https_server) {
+        connection_tracking.tls_handshakes++;
+        uint32_t us;
+        bool resumed;
+        if (httpserver_tls_handshake_done(hd, sockfd, &us, &resumed)) {
+            http_histogram_add(&connection_tracking.tls_handshake_time[resumed], us);
+            if (us > connection_tracking.tls_handshake_max_us) {
+                connection_tracking.tls_handshake_max_us = us;
+            }
+        }
+    } else {
+        connection_tracking.http_connections++;
+    }
+    xSemaphoreGive(connection_tracking.mutex);
+    return ESP_OK;
+}
+
+// CONTEXT: HTTP server task. Setting close_fn means we must close the socket.
+static void httpserver_session_close(httpd_handle_t hd, int sockfd) {
+    if (connection_tracking.mutex) {
+        xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+        http_session_t *s = httpserver_session_find(hd, sockfd);
+        if (s) {
+            memset(s, 0, sizeof(*s));
+            connection_tracking.count--;
+        }
+        xSemaphoreGive(connection_tracking.mutex);
+    }
+    httpserver_sse_forget(hd, sockfd);
+    if (external_close_callback) {
+        external_close_callback(sockfd);
+    }
+    close(sockfd);
+}
+
+// Mark a route request as queued so the idle sweep leaves its connection alone
+static void httpserver_session_set_in_flight(httpd_req_t *req, bool in_flight) {
+    if (!connection_tracking.mutex) {
+        return;
+    }
+    int fd = httpd_req_to_sockfd(req);
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    http_session_t *s = httpserver_session_find(req->handle, fd);
+    if (s) {
+        s->in_flight = in_flight;
+        s->last_us = esp_timer_get_time();
+    }
+    xSemaphoreGive(connection_tracking.mutex);
+}
+
+// Mark a connection as an event stream. EventSource often reuses a keep-alive
+// connection that served routes before, and the idle sweep must not close it.
+// CONTEXT: HTTP server task
+static void httpserver_session_set_sse(httpd_req_t *req) {
+    if (!connection_tracking.mutex) {
+        return;
+    }
+    int fd = httpd_req_to_sockfd(req);
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    http_session_t *s = httpserver_session_find(req->handle, fd);
+    if (s) {
+        s->sse = true;
+    }
+    xSemaphoreGive(connection_tracking.mutex);
+}
+
+// Time from the connection opening (after the TLS handshake on HTTPS) to this
+// request, if it is the first route request on the connection; 0 otherwise.
+// CONTEXT: HTTP server task
+static uint32_t httpserver_session_connect_us(httpd_req_t *req) {
+    uint32_t connect_us = 0;
+    if (!connection_tracking.mutex) {
+        return 0;
+    }
+    int fd = httpd_req_to_sockfd(req);
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    http_session_t *s = httpserver_session_find(req->handle, fd);
+    if (s && s->requests == 0 && !s->in_flight) {
+        connect_us = esp_timer_get_time() - s->last_us;
+    }
+    xSemaphoreGive(connection_tracking.mutex);
+    return connect_us;
+}
+
+// Count a route request and decide whether its connection stays open.
+// CONTEXT: Main MicroPython Task
+static bool httpserver_session_keep_alive(httpd_req_t *req) {
+    if (!connection_tracking.mutex) {
+        return false;
+    }
+    bool keep_alive = connection_tracking.keepalive_timeout_s > 0;
+
+    // Honour "Connection: close" from the client
+    char value[16];
+    if (httpd_req_get_hdr_value_str(req, "Connection", value, sizeof(value)) == ESP_OK &&
+        strcasecmp(value, "close") == 0) {
+        keep_alive = false;
+    }
+
+    int fd = httpd_req_to_sockfd(req);
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    connection_tracking.requests++;
+    http_session_t *s = httpserver_session_find(req->handle, fd);
+    if (s) {
+        if (s->requests++ > 0) {
+            connection_tracking.reused++;
+        }
+        if (keep_alive && s->requests >= connection_tracking.max_requests) {
+            keep_alive = false;
+            connection_tracking.limit_closes++;
+        }
+    }
+    xSemaphoreGive(connection_tracking.mutex);
+    return keep_alive;
+}
+
+// Close route connections idle for longer than the keep-alive timeout.
+// CONTEXT: HTTP server task (queued with httpd_queue_work), so it never runs
+// in the middle of a synchronous handler on the same server.
+static void httpserver_session_sweep(void *arg) {
+    httpd_handle_t hd = (httpd_handle_t)arg;
+    int idle_fds[HTTP_SESSION_MAX];
+    int n = 0;
+
+    if (!connection_tracking.mutex || connection_tracking.keepalive_timeout_s == 0) {
+        return;
+    }
+    int64_t cutoff = esp_timer_get_time() - (int64_t)connection_tracking.keepalive_timeout_s * 1000000;
+
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    for (int i = 0; i < HTTP_SESSION_MAX; i++) {
+        http_session_t *s = &connection_tracking.sessions[i];
+        // Only connections that have served a route; WebSocket and static-file
+        // connections keep their existing lifetime (LRU purge), event streams
+        // stay open until the client or the publisher drops them
+        if (s->hd != hd || s->requests == 0 || s->in_flight || s->sse || s->last_us > cutoff) {
+            continue;
+        }
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        if (httpd_ws_get_fd_info(hd, s->fd) == HTTPD_WS_CLIENT_WEBSOCKET) {
+            continue;
+        }
+#endif
+        s->last_us = INT64_MAX;  // Don't trigger twice before close_fn runs
+        idle_fds[n++] = s->fd;
+        connection_tracking.idle_closes++;
+    }
+    xSemaphoreGive(connection_tracking.mutex);
+
+    for (int i = 0; i < n; i++) {
+        ESP_LOGD(TAG, "Closing idle keep-alive connection (fd %d)", idle_fds[i]);
+        httpd_sess_trigger_close(hd, idle_fds[i]);
+    }
+}
+
+// CONTEXT: esp_timer task
+static void httpserver_sweep_timer_cb(void *arg) {
+    if (http_server) {
+        httpd_queue_work(http_server, httpserver_session_sweep, http_server);
+    }
+    if (https_server) {
+        httpd_queue_work(https_server, httpserver_session_sweep, https_server);
+    }
+}
 
 
 // Get MIME type function from webfiles module
@@ -282,7 +979,8 @@ bool httpserver_queue_message(http_msg_type_t type, int client_id, const void *d
         return false;
     }
 
-    // Message successfully queued
+    // Message successfully queued - wake any next_event() waiter
+    httpserver_notify_event();
     ESP_LOGD(TAG, "Message queued successfully (type %d, client %d)", type, client_id);
     ESP_LOGD(TAG, "DIAGNOSTIC: Queue has %d messages waiting", uxQueueMessagesWaiting(http_msg_queue));
 
@@ -296,8 +994,9 @@ bool httpserver_queue_message(http_msg_type_t type, int client_id, const void *d
     return true;
 }
 
-// Specialized function for queuing HTTP web requests with a MicroPython function
-bool httpserver_queue_web_request(int handler_id, httpd_req_t *req, mp_obj_t func) {
+// Specialized function for queuing HTTP web requests matched to a Python route
+static bool httpserver_queue_web_request(const http_route_match_t *match, httpd_req_t *req, http_priority_t priority,
+                                         uint32_t connect_us) {
     if (!http_queue_initialized) {
         ESP_LOGE(TAG, "Queue not initialized");
         return false;
@@ -308,11 +1007,20 @@ bool httpserver_queue_web_request(int handler_id, httpd_req_t *req, mp_obj_t fun
         return false;
     }
 
+    // The match (route and parameter positions) travels with the request
+    http_route_match_t *match_copy = malloc(sizeof(http_route_match_t));
+    if (!match_copy) {
+        ESP_LOGE(TAG, "Failed to allocate route match");
+        return false;
+    }
+    memcpy(match_copy, match, sizeof(http_route_match_t));
+
     // Create a copy of the request that we can process asynchronously
     httpd_req_t *req_copy = NULL;
     esp_err_t err = httpd_req_async_handler_begin(req, &req_copy);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create async request: %d", err);
+        free(match_copy);
         return false;
     }
 
@@ -321,6 +1029,7 @@ bool httpserver_queue_web_request(int handler_id, httpd_req_t *req, mp_obj_t fun
         ESP_LOGE(TAG, "Failed to take mutex");
         // Release the request copy since we won't be using it
         httpd_req_async_handler_complete(req_copy);
+        free(match_copy);
         return false;
     }
 
@@ -328,22 +1037,34 @@ bool httpserver_queue_web_request(int handler_id, httpd_req_t *req, mp_obj_t fun
     http_queue_msg_t msg = {0};
 
     msg.type = HTTP_MSG_WEB;
-    msg.client_id = handler_id;
+    msg.client_id = match->handler_id;
     msg.user_data = NULL;
-    msg.func = func;     // Store the function reference
+    msg.data = match_copy;
+    msg.data_len = sizeof(http_route_match_t);
     msg.req = req_copy;  // Store the COPY of the request handle
+    msg.queued_us = esp_timer_get_time();
+    msg.connect_us = connect_us;
 
-    // Queue the message
-    if (xQueueSend(http_msg_queue, &msg, 0) != pdTRUE) {
+    // Queue the message; high priority requests overtake everything queued
+    BaseType_t queued = priority == HTTP_PRIORITY_HIGH ? xQueueSendToFront(http_msg_queue, &msg, 0) :
+                                                         xQueueSend(http_msg_queue, &msg, 0);
+    if (queued != pdTRUE) {
         // Queue is full
         ESP_LOGE(TAG, "Failed to queue web request - queue is full");
         // Release the request copy since we won't be using it
         httpd_req_async_handler_complete(req_copy);
+        free(match_copy);
         xSemaphoreGive(http_queue_mutex);
         return false;
     }
 
-    // Message successfully queued
+    // Message successfully queued - keep the idle sweep off this connection
+    // and wake any next_event() waiter
+    if (http_admission.pending++ == 0) {
+        http_admission.progress_us = msg.queued_us;
+    }
+    httpserver_session_set_in_flight(req_copy, true);
+    httpserver_notify_event();
     ESP_LOGD(TAG, "HTTP request queued successfully (type %d, handler %d)", msg.type, msg.client_id);
     ESP_LOGD(TAG, "DIAGNOSTIC: Queue has %d messages waiting", uxQueueMessagesWaiting(http_msg_queue));
     ESP_LOGD(TAG, "QUEUE ITEM: type=%d, client=%d, data_len=%d, data_ptr=%p, user_data=%p, req=%p",
@@ -353,66 +1074,626 @@ bool httpserver_queue_web_request(int handler_id, httpd_req_t *req, mp_obj_t fun
     return true;
 }
 
-// ------------------------------------------------------------------------
-// Web request processing function
-// CONTEXT: Main MicroPython Task
-// This function processes queued web requests in the main task context
-// ------------------------------------------------------------------------
-
-void httpserver_process_web_request(http_queue_msg_t *msg) {
-    ESP_LOGD(TAG, "Processing web request: msg=%p", msg);
+// Answer 503 from the server task. Any unread body is discarded by the server.
+static esp_err_t httpserver_send_busy(httpd_req_t *req, uint32_t retry_after_s) {
+    char retry[12];
+    snprintf(retry, sizeof(retry), "%lu", (unsigned long)(retry_after_s > 0 ? retry_after_s : 1));
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    httpd_resp_set_hdr(req, "Retry-After", retry);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_sendstr(req, "Server busy");
+    return ESP_OK;
+}
 
-    if (!msg) {
-        ESP_LOGE(TAG, "NULL message handle");
-        return;
+// Decide whether a matched request may be queued for Python.
+// CONTEXT: HTTP server task
+static bool httpserver_admit(http_priority_t priority, uint32_t max_wait_ms) {
+    if (priority == HTTP_PRIORITY_HIGH) {
+        return true;  // Only limited by the queue itself
     }
-
-    if (!msg->req) {
-        ESP_LOGE(TAG, "NULL request handle");
-        return;
+    bool admit = true;
+    xSemaphoreTake(http_queue_mutex, portMAX_DELAY);
+    UBaseType_t spaces = uxQueueSpacesAvailable(http_msg_queue);
+    if (spaces <= HTTP_QUEUE_RESERVE ||
+        (priority == HTTP_PRIORITY_LOW && http_admission.pending >= HTTP_QUEUE_LOW_MAX)) {
+        admit = false;
+    } else if (max_wait_ms > 0 && http_admission.pending > 0 &&
+               esp_timer_get_time() - http_admission.progress_us > (int64_t)max_wait_ms * 1000) {
+        // Python is stuck (long exec, blocking handler): fail fast
+        admit = false;
     }
+    if (!admit) {
+        http_admission.shed_busy++;
+    }
+    xSemaphoreGive(http_queue_mutex);
+    return admit;
+}
 
-    // Get handler ID (passed in client_id field)
-    int handler_id = msg->client_id;
-    if (handler_id < 0 || handler_id >= HTTP_HANDLER_MAX || !http_handlers[handler_id].active) {
-        ESP_LOGE(TAG, "Invalid handler ID: %d", handler_id);
-        httpd_resp_set_status(msg->req, "500 Internal Server Error");
-        httpd_resp_sendstr(msg->req, "Invalid handler ID");
-        httpd_req_async_handler_complete(msg->req);
-        return;
+// A queued request was answered (or dropped): give back its concurrency slot.
+// CONTEXT: Main MicroPython Task
+static void httpserver_admission_release(const http_route_match_t *match) {
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    if (match->handler_id >= 0 && match->handler_id < http_handler_count) {
+        http_handler_t *handler = &http_handlers[match->handler_id];
+        // A replaced route started counting from zero
+        if (handler->id == match->route_id && handler->concurrent > 0) {
+            handler->concurrent--;
+        }
     }
+    xSemaphoreGive(http_route_mutex);
+}
 
-    ESP_LOGI(TAG, "Processing request: %s (handler %d)", msg->req->uri, handler_id);
+//=============================================================================
+// Request metrics: per-route histograms and access log
+//=============================================================================
+// Recorded for every request a Python route matched, including those answered
+// in the server task (cache hits, 503s). Guarded by http_route_mutex.
 
-    // Get the MicroPython function
-    mp_obj_t func = http_handlers[handler_id].func;
+#define HTTP_ACCESS_LOG_SIZE 32
+#define HTTP_ACCESS_LOG_URI 48
 
-    ESP_LOGI(TAG, "Retrieved function %p for handler %d", func, handler_id);
+static const uint32_t http_bucket_us[HTTP_METRIC_BUCKETS] = {
+    1000, 2000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+static const char *const http_bucket_le[HTTP_METRIC_BUCKETS] = {
+    "0.001", "0.002", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5", "1", "2.5", "5"
+};
+static const char *const http_stage_names[HTTP_STAGES] = { "connect", "queue", "handler", "send" };
 
-    if (func == MP_OBJ_NULL) {
-        ESP_LOGE(TAG, "MicroPython function is NULL for handler %d", handler_id);
-        httpd_resp_set_status(msg->req, "500 Internal Server Error");
-        httpd_resp_sendstr(msg->req, "Function error");
-        // Complete the async request
-        httpd_req_async_handler_complete(msg->req);
-        return;
+typedef struct {
+    uint32_t time_ms;                // Since boot, when the response was sent
+    uint16_t status;
+    uint8_t method;                  // httpd method (HTTP_GET, ...)
+    uint32_t stage_us[HTTP_STAGES];
+    char uri[HTTP_ACCESS_LOG_URI];   // Truncated
+} http_access_entry_t;
+
+static http_histogram_t http_stage_histograms[HTTP_STAGES];
+static http_access_entry_t http_access_log[HTTP_ACCESS_LOG_SIZE];
+static uint16_t http_access_head = 0;   // Next entry to write
+static uint16_t http_access_count = 0;
+
+static void http_histogram_add(http_histogram_t *h, uint32_t us) {
+    int bucket = 0;
+    while (bucket < HTTP_METRIC_BUCKETS && us > http_bucket_us[bucket]) {
+        bucket++;
     }
-    
-    if (!mp_obj_is_callable(func)) {
-        ESP_LOGE(TAG, "Stored object is not callable for handler %d", handler_id);
-        httpd_resp_set_status(msg->req, "500 Internal Server Error");
-        httpd_resp_sendstr(msg->req, "Handler not callable");
-        // Complete the async request
-        httpd_req_async_handler_complete(msg->req);
+    h->buckets[bucket]++;
+    h->count++;
+    h->total_us += us;
+}
+
+// Record a finished request. handler_id < 0 (or a replaced route) only logs it.
+// CONTEXT: HTTP server task or Main MicroPython Task
+static void httpserver_metrics_record(int handler_id, uint32_t route_id, httpd_req_t *req, int status,
+                                      const uint32_t stage_us[HTTP_STAGES]) {
+    if (!http_route_mutex) {
         return;
     }
-    
+    uint32_t total_us = stage_us[HTTP_STAGE_QUEUE] + stage_us[HTTP_STAGE_HANDLER] + stage_us[HTTP_STAGE_SEND];
+
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    if (handler_id >= 0 && handler_id < http_handler_count && http_handlers[handler_id].id == route_id) {
+        http_route_metrics_t *m = &http_handlers[handler_id].metrics;
+        http_histogram_add(&m->latency, total_us);
+        for (int i = 0; i < HTTP_STAGES; i++) {
+            m->stage_us[i] += stage_us[i];
+        }
+        if (status >= 500) {
+            m->errors++;
+        }
+    }
+    for (int i = 0; i < HTTP_STAGES; i++) {
+        // No connect time on reused connections, no handler time for C-only answers
+        if (stage_us[i] > 0 || i == HTTP_STAGE_QUEUE || i == HTTP_STAGE_SEND) {
+            http_histogram_add(&http_stage_histograms[i], stage_us[i]);
+        }
+    }
 
-    // Set current request for access in MicroPython functions
-    current_request = msg->req;
+    http_access_entry_t *entry = &http_access_log[http_access_head];
+    entry->time_ms = esp_timer_get_time() / 1000;
+    entry->status = status;
+    entry->method = req->method;
+    memcpy(entry->stage_us, stage_us, sizeof(entry->stage_us));
+    strlcpy(entry->uri, req->uri, sizeof(entry->uri));
+    http_access_head = (http_access_head + 1) % HTTP_ACCESS_LOG_SIZE;
+    if (http_access_count < HTTP_ACCESS_LOG_SIZE) {
+        http_access_count++;
+    }
+    xSemaphoreGive(http_route_mutex);
+}
 
-    // Prepare arguments for the MicroPython function call
-    mp_obj_t args[3];  // URI, POST data, Remote IP
+// Record a request answered in the server task without Python
+static void httpserver_metrics_record_direct(const http_route_match_t *match, httpd_req_t *req, int status,
+                                             uint32_t connect_us, int64_t start_us) {
+    uint32_t stage_us[HTTP_STAGES] = {0};
+    stage_us[HTTP_STAGE_CONNECT] = connect_us;
+    stage_us[HTTP_STAGE_SEND] = esp_timer_get_time() - start_us;
+    httpserver_metrics_record(match->handler_id, match->route_id, req, status, stage_us);
+}
+
+// ------------------------------------------------------------------------
+// Web request processing function
+// CONTEXT: Main MicroPython Task
+// This function processes queued web requests in the main task context
+// ------------------------------------------------------------------------
+
+//=============================================================================
+// HTTPRequest - request body stream for handlers registered with stream=True
+//=============================================================================
+// Valid only while the handler runs: the body is read straight from the
+// socket into the caller's buffer, so bodies of any size need no heap.
+
+#define HTTP_BODY_RECV_RETRIES 3     // recv_wait_timeout periods before giving up
+#define HTTP_BODY_DRAIN_MAX 4096     // Unread body drained to keep the connection; more closes it
+
+typedef struct {
+    mp_obj_base_t base;
+    httpd_req_t *req;     // NULL once the handler has returned
+    size_t remaining;     // Body bytes not yet read
+} httpserver_request_obj_t;
+
+// Read up to size body bytes, waiting with the GIL released
+static int httpserver_request_recv(httpd_req_t *req, void *buf, size_t size) {
+    int received;
+    int retries = 0;
+    MP_THREAD_GIL_EXIT();
+    do {
+        received = httpd_req_recv(req, buf, size);
+    } while (received == HTTPD_SOCK_ERR_TIMEOUT && ++retries < HTTP_BODY_RECV_RETRIES);
+    MP_THREAD_GIL_ENTER();
+    return received;
+}
+
+static mp_uint_t httpserver_request_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
+    httpserver_request_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->req == NULL) {
+        *errcode = MP_EBADF;
+        return MP_STREAM_ERROR;
+    }
+    if (size > self->remaining) {
+        size = self->remaining;
+    }
+    if (size == 0) {
+        return 0;  // EOF
+    }
+    int received = httpserver_request_recv(self->req, buf, size);
+    if (received <= 0) {
+        ESP_LOGE(TAG, "Failed to read request body: %d", received);
+        *errcode = received == HTTPD_SOCK_ERR_TIMEOUT ? MP_ETIMEDOUT : MP_EIO;
+        return MP_STREAM_ERROR;
+    }
+    self->remaining -= received;
+    return received;
+}
+
+// Discard *remaining unread body bytes so the next request on the connection
+// parses. Returns false if the connection should be closed instead.
+static bool httpserver_body_drain(httpd_req_t *req, size_t *remaining) {
+    if (*remaining > HTTP_BODY_DRAIN_MAX) {
+        return false;
+    }
+    char dummy[256];
+    while (*remaining > 0) {
+        size_t len = *remaining < sizeof(dummy) ? *remaining : sizeof(dummy);
+        int received = httpserver_request_recv(req, dummy, len);
+        if (received <= 0) {
+            return false;
+        }
+        *remaining -= received;
+    }
+    return true;
+}
+
+static bool httpserver_request_drain(httpserver_request_obj_t *self) {
+    return httpserver_body_drain(self->req, &self->remaining);
+}
+
+// req.header(name) -> str or None
+static mp_obj_t httpserver_request_header(mp_obj_t self_in, mp_obj_t name_in) {
+    httpserver_request_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->req == NULL) {
+        mp_raise_OSError(MP_EBADF);
+    }
+    const char *name = mp_obj_str_get_str(name_in);
+    size_t len = httpd_req_get_hdr_value_len(self->req, name);
+    if (len == 0) {
+        return mp_const_none;
+    }
+    vstr_t vstr;
+    vstr_init_len(&vstr, len);
+    // Needs room for the terminator, which vstr_init_len() reserves
+    if (httpd_req_get_hdr_value_str(self->req, name, vstr.buf, len + 1) != ESP_OK) {
+        vstr_clear(&vstr);
+        return mp_const_none;
+    }
+    return mp_obj_new_str_from_vstr(&vstr);
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(httpserver_request_header_obj, httpserver_request_header);
+
+static void httpserver_request_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest) {
+    if (dest[0] != MP_OBJ_NULL) {
+        return;  // Read-only
+    }
+    httpserver_request_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (attr == MP_QSTR_content_length) {
+        dest[0] = self->req ? mp_obj_new_int_from_uint(self->req->content_len) : mp_const_none;
+    } else if (attr == MP_QSTR_remaining) {
+        dest[0] = mp_obj_new_int_from_uint(self->remaining);
+    } else if (attr == MP_QSTR_method) {
+        if (self->req) {
+            const char *method = http_method_str(self->req->method);
+            dest[0] = mp_obj_new_str(method, strlen(method));
+        } else {
+            dest[0] = mp_const_none;
+        }
+    } else {
+        // Fall back to locals_dict for methods
+        dest[1] = MP_OBJ_SENTINEL;
+    }
+}
+
+static const mp_stream_p_t httpserver_request_stream_p = {
+    .read = httpserver_request_read,
+};
+
+static const mp_rom_map_elem_t httpserver_request_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_header), MP_ROM_PTR(&httpserver_request_header_obj) },
+};
+static MP_DEFINE_CONST_DICT(httpserver_request_locals_dict, httpserver_request_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    httpserver_request_type,
+    MP_QSTR_HTTPRequest,
+    MP_TYPE_FLAG_NONE,
+    protocol, &httpserver_request_stream_p,
+    attr, httpserver_request_attr,
+    locals_dict, &httpserver_request_locals_dict
+);
+
+//=============================================================================
+// Route response cache (httpserver.on(..., cache_ms=N))
+//=============================================================================
+// The last GET response of a cached route is kept in C with an ETag and
+// served straight from the server task until it expires or Python calls
+// httpserver.invalidate(). Clients revalidating with If-None-Match get 304.
+
+// Headers shared by a fresh response being stored and a cache hit
+static void httpserver_set_route_headers(httpd_req_t *req) {
+    httpd_resp_set_type(req, "application/json");
+    // Enable CORS for browser access
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", "Content-Type");
+}
+
+static void httpserver_set_cache_headers(httpd_req_t *req, const http_cache_entry_t *entry) {
+    httpd_resp_set_hdr(req, "ETag", entry->etag);
+    // Let browsers keep the body but revalidate every time (cheap 304s)
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+}
+
+// If-None-Match is "*" or a comma-separated list of entity tags, compared
+// weakly (a W/ prefix is ignored); one must equal the entry's tag exactly.
+static bool httpserver_etag_matches(httpd_req_t *req, const http_cache_entry_t *entry) {
+    char value[128];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) != ESP_OK) {
+        return false;
+    }
+    size_t etag_len = strlen(entry->etag);
+    const char *p = value;
+    while (*p) {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, ",");
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')) {
+            len--;
+        }
+        const char *tag = p;
+        if (len == 1 && tag[0] == '*') {
+            return true;
+        }
+        if (len > 2 && tag[0] == 'W' && tag[1] == '/') {
+            tag += 2;
+            len -= 2;
+        }
+        if (len == etag_len && memcmp(tag, entry->etag, len) == 0) {
+            return true;
+        }
+        p += strcspn(p, ",");
+    }
+    return false;
+}
+
+// Store a Python response for a cached route and return the entry (owned by
+// the handler slot), or NULL if out of memory. It replaces the entry for the
+// same URI, else takes a free or expired slot, else the one expiring first.
+// CONTEXT: Main MicroPython Task
+static http_cache_entry_t *httpserver_cache_store(int handler_id, const char *uri, const char *body, size_t len) {
+    http_cache_entry_t *entry = calloc(1, sizeof(http_cache_entry_t));
+    if (!entry) {
+        return NULL;
+    }
+    entry->uri = strdup(uri);
+    entry->body = malloc(len ? len : 1);
+    if (!entry->uri || !entry->body) {
+        free(entry->uri);
+        free(entry->body);
+        free(entry);
+        return NULL;
+    }
+    memcpy(entry->body, body, len);
+    entry->len = len;
+    entry->refs = 1;
+
+    // FNV-1a: cheap, and clients only compare it for equality
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)body[i]) * 16777619u;
+    }
+    snprintf(entry->etag, sizeof(entry->etag), "\"%08lx\"", (unsigned long)hash);
+
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    http_handler_t *handler = &http_handlers[handler_id];
+    int64_t now = esp_timer_get_time();
+    entry->expires_us = now + (int64_t)handler->cache_ms * 1000;
+    int slot = 0;
+    for (int i = 0; i < HTTP_CACHE_URIS; i++) {
+        http_cache_entry_t *old = handler->cache[i];
+        if (old && strcmp(old->uri, uri) == 0) {
+            slot = i;
+            break;
+        }
+        http_cache_entry_t *best = handler->cache[slot];
+        if (best && (!old || old->expires_us < best->expires_us)) {
+            slot = i;
+        }
+    }
+    http_cache_unref(handler->cache[slot]);
+    handler->cache[slot] = entry;
+    http_cache_stats.stores++;
+    xSemaphoreGive(http_route_mutex);
+    return entry;
+}
+
+// Serve a cache hit; takes over the caller's reference. CONTEXT: HTTP server task
+static esp_err_t httpserver_cache_send(httpd_req_t *req, http_cache_entry_t *entry, int *status) {
+    bool keep_alive = httpserver_session_keep_alive(req);
+    if (keep_alive) {
+        httpd_resp_set_hdr(req, "Keep-Alive", connection_tracking.keepalive_hdr);
+    } else {
+        httpd_resp_set_hdr(req, "Connection", "close");
+    }
+    httpserver_set_route_headers(req);
+    httpserver_set_cache_headers(req, entry);
+
+    bool not_modified = httpserver_etag_matches(req, entry);
+    *status = not_modified ? 304 : 200;
+    esp_err_t ret;
+    if (not_modified) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        ret = httpd_resp_send(req, NULL, 0);
+    } else {
+        ret = httpd_resp_send(req, entry->body, entry->len);
+    }
+
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    http_cache_stats.hits++;
+    if (not_modified) {
+        http_cache_stats.not_modified++;
+    }
+    http_cache_unref(entry);
+    xSemaphoreGive(http_route_mutex);
+
+    // ESP_FAIL makes the server close the connection
+    return ret == ESP_OK && keep_alive ? ESP_OK : ESP_FAIL;
+}
+
+// Dict/list handler results are encoded to JSON in C, the same text
+// json.dumps() would give, without building the string in the MicroPython heap.
+// Output goes out in chunks of HTTP_JSON_CHUNK, or into a malloc'd buffer
+// when the route is cached.
+#define HTTP_JSON_CHUNK 1024
+
+typedef struct {
+    httpd_req_t *req;     // NULL = collect into buf (grows)
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool started;         // A chunk (and so the headers) went out
+    bool failed;
+} httpserver_json_out_t;
+
+static void httpserver_json_flush(httpserver_json_out_t *out) {
+    if (out->len == 0 || out->failed) {
+        return;
+    }
+    esp_err_t ret;
+    MP_THREAD_GIL_EXIT();
+    ret = httpd_resp_send_chunk(out->req, out->buf, out->len);
+    MP_THREAD_GIL_ENTER();
+    out->started = true;
+    if (ret != ESP_OK) {
+        out->failed = true;
+    }
+    out->len = 0;
+}
+
+static void httpserver_json_strn(void *data, const char *str, size_t len) {
+    httpserver_json_out_t *out = data;
+    while (len > 0 && !out->failed) {
+        if (out->len == out->cap) {
+            if (out->req) {
+                httpserver_json_flush(out);
+                continue;
+            }
+            size_t cap = out->cap * 2;
+            char *buf = realloc(out->buf, cap);
+            if (!buf) {
+                out->failed = true;
+                return;
+            }
+            out->buf = buf;
+            out->cap = cap;
+        }
+        size_t n = out->cap - out->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(out->buf + out->len, str, n);
+        out->len += n;
+        str += n;
+        len -= n;
+    }
+}
+
+// Encode obj as JSON into out. Returns false if encoding raised (the
+// exception is printed) or the output could not be written.
+static bool httpserver_json_encode(httpserver_json_out_t *out, mp_obj_t obj) {
+    mp_print_t print = { out, httpserver_json_strn };
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_print_helper(&print, obj, PRINT_JSON);
+        nlr_pop();
+    } else {
+        mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+        out->failed = true;
+    }
+    return !out->failed;
+}
+
+// Build the parameter dict for a matched route: names come from the pattern
+// in order, the wildcard (if any) is last under "*"
+static mp_obj_t httpserver_route_params(const char *pattern, const char *uri, const http_route_match_t *match) {
+    mp_obj_t params = mp_obj_new_dict(match->n_params);
+    const char *p = pattern;
+    for (int i = 0; i < match->n_params; i++) {
+        const char *name = "*";
+        size_t name_len = 1;
+        const char *open = strchr(p, '{');
+        if (open) {
+            name = open + 1;
+            name_len = strchr(name, '}') - name;
+            p = name + name_len;
+        }
+        mp_obj_dict_store(params, mp_obj_new_str(name, name_len),
+                          mp_obj_new_str(uri + match->params[i].offset, match->params[i].len));
+    }
+    return params;
+}
+
+// Stage boundaries of the request being processed
+static struct {
+    int64_t started_us;   // Taken from the queue
+    int64_t handled_us;   // Python handler returned (0 = not called)
+} current_timing;
+
+// Release an answered route request, closing its connection if it is not kept alive
+static void httpserver_finish_web_request(http_queue_msg_t *msg, int status, bool keep_alive) {
+    httpd_req_t *req = msg->req;
+    httpd_handle_t hd = req->handle;
+    int fd = httpd_req_to_sockfd(req);
+
+    // Record before the request is released (req->uri goes with it)
+    const http_route_match_t *match = msg->data;
+    int64_t now = esp_timer_get_time();
+    int64_t send_start_us = current_timing.handled_us ? current_timing.handled_us : current_timing.started_us;
+    uint32_t stage_us[HTTP_STAGES];
+    stage_us[HTTP_STAGE_CONNECT] = msg->connect_us;
+    stage_us[HTTP_STAGE_QUEUE] = current_timing.started_us - msg->queued_us;
+    stage_us[HTTP_STAGE_HANDLER] = current_timing.handled_us ? current_timing.handled_us - current_timing.started_us : 0;
+    stage_us[HTTP_STAGE_SEND] = now - send_start_us;
+    httpserver_metrics_record(match ? match->handler_id : -1, match ? match->route_id : 0, req, status, stage_us);
+
+    httpserver_session_set_in_flight(req, false);
+
+    // Clear current_request BEFORE completing async handler
+    current_request = NULL;
+
+    // Complete the async request - ALWAYS call this to release the request
+    httpd_req_async_handler_complete(req);
+
+    if (!keep_alive) {
+        httpd_sess_trigger_close(hd, fd);
+    }
+}
+
+void httpserver_process_web_request(http_queue_msg_t *msg) {
+    ESP_LOGD(TAG, "Processing web request: msg=%p", msg);
+
+    if (!msg) {
+        ESP_LOGE(TAG, "NULL message handle");
+        return;
+    }
+
+    if (!msg->req) {
+        ESP_LOGE(TAG, "NULL request handle");
+        return;
+    }
+    current_timing.started_us = esp_timer_get_time();
+    current_timing.handled_us = 0;
+
+    // Get handler ID (passed in client_id field). The route may have been
+    // removed or replaced by off()/on() while the request was queued.
+    int handler_id = msg->client_id;
+    const http_route_match_t *match = msg->data;
+    if (!match || handler_id < 0 || handler_id >= http_handler_count || !http_handlers[handler_id].active ||
+        http_handlers[handler_id].id != match->route_id) {
+        ESP_LOGW(TAG, "Route for %s was removed before it was processed", msg->req->uri);
+        httpd_resp_send_err(msg->req, HTTPD_404_NOT_FOUND, NULL);
+        httpserver_finish_web_request(msg, 404, false);
+        return;
+    }
+
+    // Waited too long in the queue: the client has likely given up, don't run the handler
+    uint32_t max_wait_ms = http_handlers[handler_id].max_wait_ms;
+    if (max_wait_ms > 0 && current_timing.started_us - msg->queued_us > (int64_t)max_wait_ms * 1000) {
+        ESP_LOGW(TAG, "Request for %s expired in the queue", msg->req->uri);
+        xSemaphoreTake(http_queue_mutex, portMAX_DELAY);
+        http_admission.expired++;
+        xSemaphoreGive(http_queue_mutex);
+        httpserver_send_busy(msg->req, (max_wait_ms + 999) / 1000);
+        httpserver_finish_web_request(msg, 503, false);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Processing request: %s (handler %d)", msg->req->uri, handler_id);
+
+    // Get the MicroPython function
+    mp_obj_t func = mp_obj_subscr(MP_STATE_PORT(httpserver_route_funcs), MP_OBJ_NEW_SMALL_INT(handler_id), MP_OBJ_SENTINEL);
+
+    ESP_LOGI(TAG, "Retrieved function %p for handler %d", func, handler_id);
+
+    if (func == MP_OBJ_NULL) {
+        ESP_LOGE(TAG, "MicroPython function is NULL for handler %d", handler_id);
+        httpd_resp_set_status(msg->req, "500 Internal Server Error");
+        httpd_resp_sendstr(msg->req, "Function error");
+        // Complete the async request
+        httpserver_finish_web_request(msg, 500, false);
+        return;
+    }
+    
+    if (!mp_obj_is_callable(func)) {
+        ESP_LOGE(TAG, "Stored object is not callable for handler %d", handler_id);
+        httpd_resp_set_status(msg->req, "500 Internal Server Error");
+        httpd_resp_sendstr(msg->req, "Handler not callable");
+        // Complete the async request
+        httpserver_finish_web_request(msg, 500, false);
+        return;
+    }
+    
+
+    // Set current request for access in MicroPython functions
+    current_request = msg->req;
+    current_response_sent = false;
+
+    // Keep the connection open unless disabled, over the per-connection
+    // request limit or the client asked to close
+    bool keep_alive = httpserver_session_keep_alive(msg->req);
+
+    // Prepare arguments for the MicroPython function call
+    mp_obj_t args[4];  // URI, POST data, Remote IP, route parameters
     int arg_count = 1;
 
     // Push URI as first argument
@@ -436,8 +1717,18 @@ void httpserver_process_web_request(http_queue_msg_t *msg) {
     }
     ESP_LOGI(TAG, "Client IP: %s", client_ip);
 
-    // Check if this is a POST request and handle POST data
-    if (msg->req->method == HTTP_POST) {
+    httpserver_request_obj_t *body_stream = NULL;
+    size_t body_left = msg->req->content_len;  // Body bytes not read below
+    if (http_handlers[handler_id].stream) {
+        // Streaming handler: pass a request object, the handler reads the body
+        body_stream = mp_obj_malloc(httpserver_request_obj_t, &httpserver_request_type);
+        body_stream->req = msg->req;
+        body_stream->remaining = msg->req->content_len;
+        body_left = 0;  // Drained after the handler
+        args[1] = MP_OBJ_FROM_PTR(body_stream);
+        arg_count = 2;
+    } else if (msg->req->method == HTTP_POST) {
+        // Check if this is a POST request and handle POST data
         ESP_LOGI(TAG, "Processing POST request data");
 
         // Get content length
@@ -448,18 +1739,27 @@ void httpserver_process_web_request(http_queue_msg_t *msg) {
             // Allocate buffer for POST data
             char *post_data = malloc(content_len + 1);
             if (post_data) {
-                // Read POST data
-                int received = httpd_req_recv(msg->req, post_data, content_len);
+                // Read POST data - one recv may return only part of the body
+                int received = 0;
+                while (received < content_len) {
+                    int ret = httpserver_request_recv(msg->req, post_data + received, content_len - received);
+                    if (ret <= 0) {
+                        ESP_LOGE(TAG, "Failed to read POST data, error: %d", ret);
+                        received = ret < 0 && received == 0 ? ret : received;
+                        break;
+                    }
+                    received += ret;
+                }
+                body_left = content_len - (received > 0 ? received : 0);
                 if (received >= 0) {
                     // Null-terminate the data (safe even if received == 0)
                     post_data[received] = '\0';
-                    ESP_LOGI(TAG, "Received POST data (%d bytes): %s", received, post_data);
+                    ESP_LOGI(TAG, "Received POST data (%d bytes)", received);
 
                     // Push POST data as second argument
                     args[1] = mp_obj_new_str(post_data, received);
                     arg_count = 2;  // Now we have 2 arguments
                 } else {
-                    ESP_LOGE(TAG, "Failed to read POST data, error: %d", received);
                     // Push empty string as second argument
                     args[1] = mp_obj_new_str("", 0);
                     arg_count = 2;
@@ -467,9 +1767,11 @@ void httpserver_process_web_request(http_queue_msg_t *msg) {
                 free(post_data);
             } else {
                 ESP_LOGE(TAG, "Failed to allocate memory for POST data");
-                // Push empty string as second argument
-                args[1] = mp_obj_new_str("", 0);
-                arg_count = 2;
+                httpd_resp_set_hdr(msg->req, "Connection", "close");  // Body left unread
+                httpd_resp_set_status(msg->req, "500 Internal Server Error");
+                httpd_resp_sendstr(msg->req, "Request body too large for available memory");
+                httpserver_finish_web_request(msg, 500, false);
+                return;
             }
         } else {
             // No content, push empty string as second argument
@@ -483,10 +1785,29 @@ void httpserver_process_web_request(http_queue_msg_t *msg) {
          arg_count = 2;
     }
 
+    // A body the handler does not read (short read, PUT/PATCH/DELETE bodies)
+    // would be parsed as the next request: drain a small remainder, otherwise
+    // close. Decided before the handler runs, since it may send the response
+    // itself with httpserver.send(); the headers set here apply to that too.
+    if (body_left > 0 && keep_alive && !httpserver_body_drain(msg->req, &body_left)) {
+        keep_alive = false;
+    }
+    if (keep_alive) {
+        httpd_resp_set_hdr(msg->req, "Keep-Alive", connection_tracking.keepalive_hdr);
+    } else {
+        httpd_resp_set_hdr(msg->req, "Connection", "close");
+    }
+
     // Push Client IP as third argument
     args[2] = mp_obj_new_str(client_ip, strlen(client_ip));
     arg_count = 3;
 
+    // Routes with parameters get a dict of them as fourth argument
+    if (match->n_params > 0) {
+        args[3] = httpserver_route_params(http_handlers[handler_id].uri, msg->req->uri, match);
+        arg_count = 4;
+    }
+
     // Call the MicroPython function
     nlr_buf_t nlr;
     mp_obj_t result = MP_OBJ_NULL;
@@ -494,52 +1815,113 @@ void httpserver_process_web_request(http_queue_msg_t *msg) {
     if (nlr_push(&nlr) == 0) {
         result = mp_call_function_n_kw(func, arg_count, 0, args);
         nlr_pop();
+        current_timing.handled_us = esp_timer_get_time();
     } else {
+        current_timing.handled_us = esp_timer_get_time();
+        if (body_stream) {
+            keep_alive = false;  // Body state unknown
+            body_stream->req = NULL;
+        }
         // Handle exception
         mp_obj_t exc = MP_OBJ_FROM_PTR(nlr.ret_val);
         mp_obj_print_exception(&mp_plat_print, exc);
 
         // Send error response
         httpd_resp_set_type(msg->req, "text/html");
-        httpd_resp_send(msg->req, "Internal Server Error", strlen("Internal Server Error"));
-        // Clear current_request BEFORE completing async handler
-        current_request = NULL;
-        // Complete the async request
-        httpd_req_async_handler_complete(msg->req);
+        if (!current_response_sent) {
+            httpd_resp_send(msg->req, "Internal Server Error", strlen("Internal Server Error"));
+        }
+        httpserver_finish_web_request(msg, 500, keep_alive);
         return;
     }
 
+    // Unread body left by a streaming handler would be parsed as the next
+    // request: drain a small remainder, otherwise close after this response
+    if (body_stream) {
+        if (keep_alive && !httpserver_request_drain(body_stream)) {
+            keep_alive = false;
+        }
+        body_stream->req = NULL;
+    }
+
     // Check the result
-    if (result != MP_OBJ_NULL && mp_obj_is_str_or_bytes(result)) {
+    int status = 200;
+    if (result != MP_OBJ_NULL && !current_response_sent && mp_obj_is_str_or_bytes(result)) {
         // Function returned a string, send it as response
-        const char *response_str = mp_obj_str_get_str(result);
-        size_t response_len = strlen(response_str);
-        httpd_resp_set_type(msg->req, "application/json");
-        // Enable CORS for browser access
-        httpd_resp_set_hdr(msg->req, "Access-Control-Allow-Origin", "*");
-        httpd_resp_set_hdr(msg->req, "Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-        httpd_resp_set_hdr(msg->req, "Access-Control-Allow-Headers", "Content-Type");
-        // Force connection close to prevent keep-alive issues
-        httpd_resp_set_hdr(msg->req, "Connection", "close");
-        // Use httpd_resp_send with explicit length for async responses
-        httpd_resp_send(msg->req, response_str, response_len);
-    } else {
-        // Function didn't return a string - assume httpserver.send() was used
-        // If neither return value nor httpserver.send() provided a response,
+        size_t response_len;
+        const char *response_str = mp_obj_str_get_data(result, &response_len);
+        httpserver_set_route_headers(msg->req);
+
+        // Cached routes keep the response in C for the next cache_ms
+        http_cache_entry_t *cached = NULL;
+        if (http_handlers[handler_id].cache_ms > 0 && msg->req->method == HTTP_GET) {
+            cached = httpserver_cache_store(handler_id, msg->req->uri, response_str, response_len);
+        }
+        if (cached) {
+            httpserver_set_cache_headers(msg->req, cached);
+        }
+        if (cached && httpserver_etag_matches(msg->req, cached)) {
+            status = 304;
+            httpd_resp_set_status(msg->req, "304 Not Modified");
+            httpd_resp_send(msg->req, NULL, 0);
+        } else {
+            // Use httpd_resp_send with explicit length: Content-Length framing
+            // is what lets the connection stay open for the next request
+            httpd_resp_send(msg->req, response_str, response_len);
+        }
+    } else if (result != MP_OBJ_NULL && !current_response_sent &&
+               (mp_obj_is_type(result, &mp_type_dict) || mp_obj_is_type(result, &mp_type_list) ||
+                mp_obj_is_type(result, &mp_type_tuple))) {
+        httpserver_set_route_headers(msg->req);
+        if (http_handlers[handler_id].cache_ms > 0 && msg->req->method == HTTP_GET) {
+            // Cached: encode into C memory, then send like a string result
+            httpserver_json_out_t out = { NULL, malloc(HTTP_JSON_CHUNK), 0, HTTP_JSON_CHUNK, false, false };
+            http_cache_entry_t *cached = NULL;
+            out.failed = out.buf == NULL;
+            if (!out.failed && httpserver_json_encode(&out, result)) {
+                cached = httpserver_cache_store(handler_id, msg->req->uri, out.buf, out.len);
+            }
+            if (cached) {
+                httpserver_set_cache_headers(msg->req, cached);
+                if (httpserver_etag_matches(msg->req, cached)) {
+                    status = 304;
+                    httpd_resp_set_status(msg->req, "304 Not Modified");
+                    httpd_resp_send(msg->req, NULL, 0);
+                } else {
+                    httpd_resp_send(msg->req, cached->body, cached->len);
+                }
+            } else if (!out.failed) {
+                httpd_resp_send(msg->req, out.buf, out.len);
+            } else {
+                status = 500;
+                httpd_resp_send_err(msg->req, HTTPD_500_INTERNAL_SERVER_ERROR, "JSON encoding failed");
+            }
+            free(out.buf);
+        } else {
+            // Chunked: headers go with the first chunk, so an encoding error
+            // after that can only end the connection
+            char chunk[HTTP_JSON_CHUNK];
+            httpserver_json_out_t out = { msg->req, chunk, 0, sizeof(chunk), false, false };
+            if (httpserver_json_encode(&out, result)) {
+                httpserver_json_flush(&out);
+            }
+            if (out.failed && !out.started) {
+                status = 500;
+                httpd_resp_send_err(msg->req, HTTPD_500_INTERNAL_SERVER_ERROR, "JSON encoding failed");
+            } else if (out.failed || httpd_resp_send_chunk(msg->req, NULL, 0) != ESP_OK) {
+                keep_alive = false;
+            }
+        }
+    } else if (!current_response_sent) {
+        // Neither a return value nor httpserver.send() provided a response,
         // send a default empty response to avoid hanging the connection
         httpd_resp_set_type(msg->req, "text/html");
         // Enable CORS
         httpd_resp_set_hdr(msg->req, "Access-Control-Allow-Origin", "*");
-        // Force connection close
-        httpd_resp_set_hdr(msg->req, "Connection", "close");
         httpd_resp_send(msg->req, "", 0);
     }
 
-    // Clear current_request BEFORE completing async handler
-    current_request = NULL;
-
-    // Complete the async request - ALWAYS call this to release the request
-    httpd_req_async_handler_complete(msg->req);
+    httpserver_finish_web_request(msg, status, keep_alive);
 }
 
 
@@ -548,7 +1930,8 @@ void httpserver_process_web_request(http_queue_msg_t *msg) {
 // ------------------------------------------------------------------------
 
 // Process queued messages (called from MicroPython)
-static mp_obj_t httpserver_process_queue(void) {
+// process_queue(limit=10)
+static mp_obj_t httpserver_process_queue(size_t n_args, const mp_obj_t *args) {
     if (!http_msg_queue) {
         ESP_LOGW(TAG, "Queue not initialized");
         return mp_obj_new_int(0);
@@ -557,8 +1940,9 @@ static mp_obj_t httpserver_process_queue(void) {
     // Count of messages processed in this call
     int processed = 0;
 
-    // Process up to 10 messages in a single call to avoid blocking
-    for (int i = 0; i < 10; i++) {
+    // Process up to `limit` messages in a single call to avoid blocking
+    int limit = n_args > 0 ? mp_obj_get_int(args[0]) : 10;
+    for (int i = 0; i < limit; i++) {
         // Take mutex before accessing queue
         if (xSemaphoreTake(http_queue_mutex, 0) != pdTRUE) {
             ESP_LOGW(TAG, "Failed to take mutex, will retry");
@@ -568,6 +1952,18 @@ static mp_obj_t httpserver_process_queue(void) {
         // Process one message from the queue
         http_queue_msg_t msg;
         if (xQueueReceive(http_msg_queue, &msg, 0) == pdTRUE) {
+            int64_t now = esp_timer_get_time();
+            http_admission.progress_us = now;
+            if (msg.type == HTTP_MSG_WEB) {
+                uint32_t wait_us = now - msg.queued_us;
+                http_admission.pending--;
+                http_admission.dequeued++;
+                http_admission.wait_total_us += wait_us;
+                if (wait_us > http_admission.wait_max_us) {
+                    http_admission.wait_max_us = wait_us;
+                }
+            }
+
             // Release mutex while processing message
             xSemaphoreGive(http_queue_mutex);
 
@@ -613,7 +2009,91 @@ static mp_obj_t httpserver_process_queue(void) {
                     }
                     httpserver_process_web_request(&msg);
                     // Note: httpserver_process_web_request handles async completion internally
+                    if (msg.data) {
+                        httpserver_admission_release(msg.data);
+                    }
+                    free(msg.data);  // Route match
+                    break;
+
+                case HTTP_MSG_UPLOAD: {
+                    // Upload callback: callback(path, size, sha256)
+                    upload_done_t *done = msg.user_data;
+                    mp_obj_t callbacks = MP_STATE_PORT(httpserver_upload_callbacks);
+                    if (callbacks != MP_OBJ_NULL && done) {
+                        nlr_buf_t nlr;
+                        if (nlr_push(&nlr) == 0) {
+                            mp_obj_t callback = mp_obj_subscr(callbacks, MP_OBJ_NEW_SMALL_INT(msg.client_id), MP_OBJ_SENTINEL);
+                            if (callback != mp_const_none) {
+                                mp_obj_t cb_args[3] = {
+                                    mp_obj_new_str(msg.data, msg.data_len),
+                                    mp_obj_new_int_from_uint(done->size),
+                                    mp_obj_new_str(done->sha256, strlen(done->sha256)),
+                                };
+                                mp_call_function_n_kw(callback, 3, 0, cb_args);
+                            }
+                            nlr_pop();
+                        } else {
+                            mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+                        }
+                    }
+                    free(done);
+                    free(msg.data);
+                    break;
+                }
+
+                case HTTP_MSG_OTA_AUTHORIZE: {
+                    // authorize(size, sha256, token) -> bool; the client's retry picks up the answer
+                    ota_request_t *request = msg.user_data;
+                    mp_obj_t callbacks = MP_STATE_PORT(httpserver_ota_callbacks);
+                    bool allowed = false;
+                    if (callbacks != MP_OBJ_NULL && request) {
+                        nlr_buf_t nlr;
+                        if (nlr_push(&nlr) == 0) {
+                            mp_obj_t cb_args[3] = {
+                                mp_obj_new_int_from_uint(request->size),
+                                mp_obj_new_str(request->sha256, strlen(request->sha256)),
+                                msg.data ? mp_obj_new_str(msg.data, msg.data_len) : mp_const_none,
+                            };
+                            mp_obj_t authorize = mp_obj_subscr(callbacks, MP_OBJ_NEW_SMALL_INT(0), MP_OBJ_SENTINEL);
+                            allowed = mp_obj_is_true(mp_call_function_n_kw(authorize, 3, 0, cb_args));
+                            nlr_pop();
+                        } else {
+                            mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+                        }
+                    }
+                    if (request) {
+                        ota_authorize_reply(request->ticket, allowed);
+                    }
+                    free(request);
+                    free(msg.data);
+                    break;
+                }
+
+                case HTTP_MSG_OTA_DONE: {
+                    // done(size, sha256, version): typically machine.reset()
+                    upload_done_t *done = msg.user_data;
+                    mp_obj_t callbacks = MP_STATE_PORT(httpserver_ota_callbacks);
+                    if (callbacks != MP_OBJ_NULL && done) {
+                        nlr_buf_t nlr;
+                        if (nlr_push(&nlr) == 0) {
+                            mp_obj_t callback = mp_obj_subscr(callbacks, MP_OBJ_NEW_SMALL_INT(1), MP_OBJ_SENTINEL);
+                            if (callback != mp_const_none) {
+                                mp_obj_t cb_args[3] = {
+                                    mp_obj_new_int_from_uint(done->size),
+                                    mp_obj_new_str(done->sha256, strlen(done->sha256)),
+                                    mp_obj_new_str(msg.data ? msg.data : "", msg.data_len),
+                                };
+                                mp_call_function_n_kw(callback, 3, 0, cb_args);
+                            }
+                            nlr_pop();
+                        } else {
+                            mp_obj_print_exception(&mp_plat_print, MP_OBJ_FROM_PTR(nlr.ret_val));
+                        }
+                    }
+                    free(done);
+                    free(msg.data);
                     break;
+                }
 
                 default:
                     ESP_LOGW(TAG, "Unknown message type: %d", msg.type);
@@ -637,38 +2117,314 @@ static mp_obj_t httpserver_process_queue(void) {
     // Return the number of messages processed
     return mp_obj_new_int(processed);
 }
-static MP_DEFINE_CONST_FUN_OBJ_0(httpserver_process_queue_obj, httpserver_process_queue);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_process_queue_obj, 0, 1, httpserver_process_queue);
 
-// Start the HTTP server (and optionally HTTPS)
-static mp_obj_t httpserver_start(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    // Define allowed keyword arguments
-    // Note: Using numbered args instead of 'port' to avoid QSTR conflicts
-    static const mp_arg_t allowed_args[] = {
-        { MP_QSTR_, MP_ARG_INT, {.u_int = 80} },  // First positional arg (port)
-        { MP_QSTR_cert_file, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
-        { MP_QSTR_key_file, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
-    };
+// ------------------------------------------------------------------------
+// Event notification for asyncio
+// ------------------------------------------------------------------------
+// next_event() returns the wait() awaitable of an asyncio.ThreadSafeFlag.
+// Producers (HTTP server tasks) schedule httpserver_event_wake on the VM,
+// which sets the flag - at most one wake is outstanding per burst. Until
+// next_event() has been called nothing is scheduled, so polling callers of
+// process_queue() are unaffected.
+//
+// The HTTP server tasks outlive a soft reset, but the flag does not. A guard
+// object allocated with the flag is finalised when the heap is swept on
+// reset; it forgets the flag and bumps the generation, so a wake scheduled
+// before the reset is ignored.
 
-    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
-    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+static volatile bool http_event_wake_pending = false;
+static volatile uint32_t http_event_generation = 0;
 
-    if (http_server != NULL) {
-        ESP_LOGW(TAG, "HTTP server already running");
-        return mp_obj_new_bool(true);  // Server already running
+typedef struct {
+    mp_obj_base_t base;
+} httpserver_event_guard_t;
+
+static mp_obj_t httpserver_event_guard_del(mp_obj_t self_in) {
+    if (MP_STATE_PORT(httpserver_event_guard) != self_in) {
+        return mp_const_none;  // Orphaned by a module re-import
     }
+    http_event_generation++;
+    MP_STATE_PORT(httpserver_event_flag) = MP_OBJ_NULL;
+    MP_STATE_PORT(httpserver_event_guard) = MP_OBJ_NULL;
+    http_event_wake_pending = false;
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(httpserver_event_guard_del_obj, httpserver_event_guard_del);
 
-    // Initialize esp_netif if not already done (required for HTTP server)
-    // This is safe to call multiple times
-    esp_err_t netif_err = esp_netif_init();
-    if (netif_err != ESP_OK && netif_err != ESP_ERR_INVALID_STATE) {
-        ESP_LOGE(TAG, "Failed to initialize esp_netif: %d (0x%x)", netif_err, netif_err);
-        return mp_obj_new_bool(false);
+static const mp_rom_map_elem_t httpserver_event_guard_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&httpserver_event_guard_del_obj) },
+};
+static MP_DEFINE_CONST_DICT(httpserver_event_guard_locals_dict, httpserver_event_guard_locals_dict_table);
+
+static MP_DEFINE_CONST_OBJ_TYPE(
+    httpserver_event_guard_type,
+    MP_QSTR_EventGuard,
+    MP_TYPE_FLAG_NONE,
+    locals_dict, &httpserver_event_guard_locals_dict
+);
+
+static void httpserver_event_flag_call(qstr method, mp_obj_t *result) {
+    mp_obj_t dest[2];
+    mp_load_method(MP_STATE_PORT(httpserver_event_flag), method, dest);
+    mp_obj_t ret = mp_call_method_n_kw(0, 0, dest);
+    if (result) {
+        *result = ret;
     }
-    ESP_LOGI(TAG, "Network interface initialized (status: %d)", netif_err);
-    
-    // Initialize connection tracking
-    connection_tracking.mutex = xSemaphoreCreateMutex();
-    if (!connection_tracking.mutex) {
+}
+
+// CONTEXT: Main MicroPython Task (scheduled)
+static mp_obj_t httpserver_event_wake(mp_obj_t arg) {
+    if ((uint32_t)MP_OBJ_SMALL_INT_VALUE(arg) != (http_event_generation & 0xffff)) {
+        return mp_const_none;  // Scheduled for a flag from before a soft reset
+    }
+    http_event_wake_pending = false;
+    if (MP_STATE_PORT(httpserver_event_flag) != MP_OBJ_NULL) {
+        httpserver_event_flag_call(MP_QSTR_set, NULL);
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(httpserver_event_wake_obj, httpserver_event_wake);
+
+// CONTEXT: Any Task (typically ESP-IDF HTTP Server Task)
+static void httpserver_notify_event(void) {
+    uint32_t generation = http_event_generation;
+    if (MP_STATE_PORT(httpserver_event_flag) == MP_OBJ_NULL || http_event_wake_pending) {
+        return;
+    }
+    http_event_wake_pending = true;
+    if (mp_sched_schedule(MP_OBJ_FROM_PTR(&httpserver_event_wake_obj),
+                          MP_OBJ_NEW_SMALL_INT(generation & 0xffff))) {
+        mp_hal_wake_main_task();  // Leave the idle wait now rather than at the next tick
+    } else {
+        http_event_wake_pending = false;  // Scheduler full - the next message retries
+    }
+}
+
+// await httpserver.next_event() - completes when queued work is available
+static mp_obj_t httpserver_next_event(void) {
+    if (MP_STATE_PORT(httpserver_event_flag) == MP_OBJ_NULL) {
+        mp_obj_t asyncio = mp_import_name(MP_QSTR_asyncio, mp_const_none, MP_OBJ_NEW_SMALL_INT(0));
+        MP_STATE_PORT(httpserver_event_flag) = mp_call_function_0(mp_load_attr(asyncio, MP_QSTR_ThreadSafeFlag));
+        MP_STATE_PORT(httpserver_event_guard) = MP_OBJ_FROM_PTR(
+            mp_obj_malloc_with_finaliser(httpserver_event_guard_t, &httpserver_event_guard_type));
+    }
+    // Work already queued (e.g. process_queue() hit its limit): complete immediately
+    if (http_msg_queue != NULL && uxQueueMessagesWaiting(http_msg_queue) > 0) {
+        httpserver_event_flag_call(MP_QSTR_set, NULL);
+    }
+    mp_obj_t awaitable;
+    httpserver_event_flag_call(MP_QSTR_wait, &awaitable);
+    return awaitable;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(httpserver_next_event_obj, httpserver_next_event);
+
+// Module __init__: runs on each (re-)import, i.e. after a soft reset drops the old flag
+static mp_obj_t httpserver_module_init(void) {
+    http_event_generation++;
+    MP_STATE_PORT(httpserver_event_flag) = MP_OBJ_NULL;
+    MP_STATE_PORT(httpserver_event_guard) = MP_OBJ_NULL;
+    http_event_wake_pending = false;
+    // Route handlers were Python functions on the old heap
+    if (http_route_mutex) {
+        xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+        http_route_clear();
+        xSemaphoreGive(http_route_mutex);
+    }
+    MP_STATE_PORT(httpserver_route_funcs) = MP_OBJ_NULL;
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(httpserver_module_init_obj, httpserver_module_init);
+
+// Read a whole file into PSRAM (internal RAM if there is none), NUL-terminated
+// for mbedTLS PEM parsing. *len includes the NUL. Returns NULL on failure.
+// CONTEXT: Main MicroPython Task
+static uint8_t *httpserver_read_file(mp_obj_t path, size_t *len) {
+    mp_obj_t open_args[2] = { path, MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+    mp_obj_t file;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        file = mp_builtin_open(2, open_args, (mp_map_t *)&mp_const_empty_map);
+        nlr_pop();
+    } else {
+        ESP_LOGE(TAG, "Failed to open %s", mp_obj_str_get_str(path));
+        return NULL;
+    }
+
+    const mp_stream_p_t *stream = mp_get_stream(file);
+    struct mp_stream_seek_t seek_s = { .offset = 0, .whence = 2 };  // SEEK_END
+    int err;
+    if (stream->ioctl(file, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &err) == MP_STREAM_ERROR) {
+        mp_stream_close(file);
+        return NULL;
+    }
+    size_t size = seek_s.offset;
+    seek_s.offset = 0;
+    seek_s.whence = 0;  // SEEK_SET
+    stream->ioctl(file, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &err);
+
+    uint8_t *buf = heap_caps_malloc(size + 1, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buf) {
+        buf = malloc(size + 1);
+    }
+    if (!buf) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for %s", (unsigned)size + 1, mp_obj_str_get_str(path));
+        mp_stream_close(file);
+        return NULL;
+    }
+    size_t got = 0;
+    while (got < size) {
+        mp_uint_t n = stream->read(file, buf + got, size - got, &err);
+        if (n == MP_STREAM_ERROR || n == 0) {
+            break;
+        }
+        got += n;
+    }
+    mp_stream_close(file);
+    buf[got] = '\0';
+    *len = got + 1;
+    return buf;
+}
+
+static void httpserver_tls_free(void) {
+    if (server_tls.parsed) {
+        mbedtls_x509_crt_free(&server_tls.crt);
+        mbedtls_pk_free(&server_tls.pk);
+        server_tls.parsed = false;
+    }
+    free(server_tls.cert);
+    free(server_tls.key);
+    server_tls.cert = NULL;
+    server_tls.key = NULL;
+    server_tls.cert_len = 0;
+    server_tls.key_len = 0;
+    memset(server_tls.handshakes, 0, sizeof(server_tls.handshakes));
+    server_tls.ticket_accepted = false;
+}
+
+static int httpserver_tls_rng(void *ctx, unsigned char *buf, size_t len) {
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+// Parse and match the certificate and key once, so a bad pair fails start()
+// rather than every handshake. Kept parsed when the selection hook can use it.
+// CONTEXT: Main MicroPython Task
+static bool httpserver_tls_parse(void) {
+    mbedtls_x509_crt_init(&server_tls.crt);
+    mbedtls_pk_init(&server_tls.pk);
+    server_tls.parsed = true;
+    int ret = mbedtls_x509_crt_parse(&server_tls.crt, server_tls.cert, server_tls.cert_len);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to parse certificate: -0x%04x", (unsigned)-ret);
+        return false;
+    }
+    ret = mbedtls_pk_parse_key(&server_tls.pk, server_tls.key, server_tls.key_len, NULL, 0,
+                               httpserver_tls_rng, NULL);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to parse private key: -0x%04x", (unsigned)-ret);
+        return false;
+    }
+    ret = mbedtls_pk_check_pair(&server_tls.crt.pk, &server_tls.pk, httpserver_tls_rng, NULL);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Private key does not match the certificate: -0x%04x", (unsigned)-ret);
+        return false;
+    }
+#if !CONFIG_ESP_TLS_SERVER_CERT_SELECT_HOOK
+    // esp-tls parses its own copy per connection
+    mbedtls_x509_crt_free(&server_tls.crt);
+    mbedtls_pk_free(&server_tls.pk);
+    server_tls.parsed = false;
+#endif
+    return true;
+}
+
+#if CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+// esp-tls installs mbedtls_ssl_ticket_parse() as the ticket callback; the
+// link wraps it (micropython.cmake) so accepted tickets can be counted. It
+// runs while the ClientHello's extensions are parsed, just before
+// httpserver_tls_cert_select() for the same handshake.
+// CONTEXT: HTTPS server task
+int __real_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len);
+int __wrap_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len) {
+    int ret = __real_mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    server_tls.ticket_accepted = ret == 0;
+    return ret;
+}
+#endif
+
+#if CONFIG_ESP_TLS_SERVER_CERT_SELECT_HOOK
+// Hand mbedTLS the pre-parsed certificate and key, and start timing the
+// handshake. Called once per ClientHello, after its extensions (including a
+// session ticket) have been processed.
+// CONTEXT: HTTPS server task, inside the handshake run by its open_fn
+static int httpserver_tls_cert_select(mbedtls_ssl_context *ssl) {
+    // The slot of this context (a retried ClientHello), else a free one, else
+    // the oldest: a handshake that failed never reached open_fn
+    int slot = 0;
+    for (int i = 0; i < TLS_HANDSHAKE_SLOTS; i++) {
+        if (server_tls.handshakes[i].ssl == ssl) {
+            slot = i;
+            break;
+        }
+        if (server_tls.handshakes[slot].ssl &&
+            (!server_tls.handshakes[i].ssl || server_tls.handshakes[i].start_us < server_tls.handshakes[slot].start_us)) {
+            slot = i;
+        }
+    }
+    server_tls.handshakes[slot].ssl = ssl;
+    server_tls.handshakes[slot].start_us = esp_timer_get_time();
+    server_tls.handshakes[slot].resumed = server_tls.ticket_accepted;
+    server_tls.ticket_accepted = false;
+    return mbedtls_ssl_set_hs_own_cert(ssl, &server_tls.crt, &server_tls.pk);
+}
+#endif
+
+// Start the HTTP server (and optionally HTTPS)
+static mp_obj_t httpserver_start(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    // Define allowed keyword arguments
+    // Note: Using numbered args instead of 'port' to avoid QSTR conflicts
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_, MP_ARG_INT, {.u_int = 80} },  // First positional arg (port)
+        { MP_QSTR_cert_file, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_key_file, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_keepalive_timeout, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 5} },
+        { MP_QSTR_max_requests, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 100} },
+        { MP_QSTR_session_tickets, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true} },
+    };
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (http_server != NULL) {
+        ESP_LOGW(TAG, "HTTP server already running");
+        return mp_obj_new_bool(true);  // Server already running
+    }
+
+    // Initialize esp_netif if not already done (required for HTTP server)
+    // This is safe to call multiple times
+    esp_err_t netif_err = esp_netif_init();
+    if (netif_err != ESP_OK && netif_err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "Failed to initialize esp_netif: %d (0x%x)", netif_err, netif_err);
+        return mp_obj_new_bool(false);
+    }
+    ESP_LOGI(TAG, "Network interface initialized (status: %d)", netif_err);
+    
+    // Initialize connection tracking (also resets keep-alive stats)
+    memset(&connection_tracking, 0, sizeof(connection_tracking));
+    memset(&http_cache_stats, 0, sizeof(http_cache_stats));
+    memset(&http_admission, 0, sizeof(http_admission));
+    memset(http_stage_histograms, 0, sizeof(http_stage_histograms));
+    http_access_head = 0;
+    http_access_count = 0;
+    connection_tracking.keepalive_timeout_s = args[3].u_int > 0 ? args[3].u_int : 0;
+    connection_tracking.max_requests = args[4].u_int > 0 ? args[4].u_int : 1;
+    server_tls.session_tickets = args[5].u_bool;
+    snprintf(connection_tracking.keepalive_hdr, sizeof(connection_tracking.keepalive_hdr),
+             "timeout=%u, max=%u", (unsigned)connection_tracking.keepalive_timeout_s,
+             (unsigned)connection_tracking.max_requests);
+    connection_tracking.mutex = xSemaphoreCreateMutex();
+    if (!connection_tracking.mutex) {
         ESP_LOGE(TAG, "Failed to create connection tracking mutex");
         return mp_obj_new_bool(false);
     }
@@ -685,407 +2441,2231 @@ static mp_obj_t httpserver_start(size_t n_args, const mp_obj_t *pos_args, mp_map
         ESP_LOGI(TAG, "Loading SSL certificate from: %s", cert_path);
         ESP_LOGI(TAG, "Loading SSL key from: %s", key_path);
 
-        // Read certificate file using MicroPython VFS (like webrepl does)
-        mp_obj_t cert_args[2] = {
-            args[1].u_obj,  // filename
-            MP_OBJ_NEW_QSTR(MP_QSTR_rb)  // mode
-        };
-        
-        mp_obj_t cert_file_obj = mp_builtin_open(2, cert_args, (mp_map_t*)&mp_const_empty_map);
-        if (cert_file_obj == MP_OBJ_NULL) {
-            ESP_LOGE(TAG, "Failed to open certificate file: %s", cert_path);
+        server_tls.cert = httpserver_read_file(args[1].u_obj, &server_tls.cert_len);
+        server_tls.key = server_tls.cert ? httpserver_read_file(args[2].u_obj, &server_tls.key_len) : NULL;
+        if (!server_tls.key || !httpserver_tls_parse()) {
+            httpserver_tls_free();
             vSemaphoreDelete(connection_tracking.mutex);
             connection_tracking.mutex = NULL;
             return mp_obj_new_bool(false);
         }
 
-        // Get file size using seek
-        const mp_stream_p_t *cert_stream = mp_get_stream(cert_file_obj);
-        struct mp_stream_seek_t seek_s;
-        seek_s.offset = 0;
-        seek_s.whence = 2; // SEEK_END
-        int cert_err;
-        cert_stream->ioctl(cert_file_obj, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &cert_err);
-        long cert_size = seek_s.offset;
-        
-        // Seek back to beginning
-        seek_s.offset = 0;
-        seek_s.whence = 0; // SEEK_SET
-        cert_stream->ioctl(cert_file_obj, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &cert_err);
-
-        server_cert = malloc(cert_size + 1);
-        if (!server_cert) {
-            ESP_LOGE(TAG, "Failed to allocate memory for certificate (%ld bytes)", cert_size);
-            mp_stream_close(cert_file_obj);
+        use_https = true;
+        ESP_LOGI(TAG, "SSL certificates loaded (cert: %zu bytes, key: %zu bytes)",
+                 server_tls.cert_len, server_tls.key_len);
+    } else if (has_cert || has_key) {
+        ESP_LOGE(TAG, "Both cert_file and key_file required for HTTPS");
+        vSemaphoreDelete(connection_tracking.mutex);
+        connection_tracking.mutex = NULL;
+        return mp_obj_new_bool(false);
+    }
+
+    // Log current memory status
+    size_t free_heap = esp_get_free_heap_size();
+    size_t min_free_heap = esp_get_minimum_free_heap_size();
+    size_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    ESP_LOGI(TAG, "Memory status: free_heap=%u, min_free_heap=%u, largest_block=%u", 
+             free_heap, min_free_heap, largest_free_block);
+
+    // Initialize the queue for thread-safe message passing BEFORE starting servers
+    if (!http_queue_initialized) {
+        http_msg_queue = xQueueCreate(HTTP_QUEUE_SIZE, sizeof(http_queue_msg_t));
+        http_queue_mutex = xSemaphoreCreateMutex();
+
+        if (http_msg_queue != NULL && http_queue_mutex != NULL) {
+            http_queue_initialized = true;
+            ESP_LOGI(TAG, "HTTP queue initialized");
+        } else {
+            ESP_LOGE(TAG, "Failed to create HTTP queue");
             vSemaphoreDelete(connection_tracking.mutex);
             connection_tracking.mutex = NULL;
             return mp_obj_new_bool(false);
         }
+    }
 
-        size_t read_size = cert_stream->read(cert_file_obj, server_cert, cert_size, &cert_err);
-        mp_stream_close(cert_file_obj);
-        server_cert[read_size] = '\0';
-        server_cert_len = read_size + 1;
+    // Route table lock, kept for the lifetime of the firmware
+    if (!http_route_mutex) {
+        http_route_mutex = xSemaphoreCreateMutex();
+        if (!http_route_mutex) {
+            ESP_LOGE(TAG, "Failed to create route mutex");
+            return mp_obj_new_bool(false);
+        }
+    }
 
-        // Read key file using MicroPython VFS (like webrepl does)
-        mp_obj_t key_args[2] = {
-            args[2].u_obj,  // filename
-            MP_OBJ_NEW_QSTR(MP_QSTR_rb)  // mode
-        };
+    // Start HTTP server on specified port
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.stack_size = 8192;
+    config.max_uri_handlers = HTTP_URI_HANDLERS_MAX;
+    config.max_open_sockets = 4;  // Reduced from 10 - LWIP default allows max 7 total
+    config.lru_purge_enable = true;
+    config.backlog_conn = 5;
+    config.server_port = args[0].u_int;
+    config.open_fn = httpserver_session_open;
+    config.close_fn = httpserver_session_close;
+
+    ESP_LOGI(TAG, "Starting HTTP server on port %d", config.server_port);
+    esp_err_t ret = httpd_start(&http_server, &config);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP server: %d (0x%x)", ret, ret);
+        // Cleanup
+        httpserver_tls_free();
+        use_https = false;
+        vSemaphoreDelete(connection_tracking.mutex);
+        connection_tracking.mutex = NULL;
+        return mp_obj_new_bool(false);
+    }
+
+    ESP_LOGI(TAG, "HTTP server started successfully on port %d", config.server_port);
+
+    // Python routes are looked up by the catch-all error handlers
+    httpd_register_err_handler(http_server, HTTPD_404_NOT_FOUND, httpserver_route_err_handler);
+    httpd_register_err_handler(http_server, HTTPD_405_METHOD_NOT_ALLOWED, httpserver_route_err_handler);
+
+    // Start HTTPS server if certificates were loaded
+    if (use_https) {
+        httpd_ssl_config_t https_conf = HTTPD_SSL_CONFIG_DEFAULT();
         
-        mp_obj_t key_file_obj = mp_builtin_open(2, key_args, (mp_map_t*)&mp_const_empty_map);
-        if (key_file_obj == MP_OBJ_NULL) {
-            ESP_LOGE(TAG, "Failed to open key file: %s", key_path);
-            free(server_cert);
-            server_cert = NULL;
-            vSemaphoreDelete(connection_tracking.mutex);
-            connection_tracking.mutex = NULL;
-            return mp_obj_new_bool(false);
+        // Configure HTTPS parameters
+        https_conf.httpd.uri_match_fn = httpd_uri_match_wildcard;
+        https_conf.httpd.stack_size = 10240;  // HTTPS needs more stack
+        https_conf.httpd.max_uri_handlers = HTTP_URI_HANDLERS_MAX;
+        https_conf.httpd.max_open_sockets = 3;  // SSL uses more memory per socket, keep total under 7
+        https_conf.httpd.lru_purge_enable = true;
+        https_conf.httpd.backlog_conn = 5;
+        https_conf.httpd.open_fn = httpserver_session_open;  // Called after the TLS handshake
+        https_conf.httpd.close_fn = httpserver_session_close;
+        https_conf.port_secure = 443;
+        https_conf.port_insecure = 80;
+        
+        // Session tickets let returning clients skip the ECDHE exchange and
+        // certificate signature. The ticket key lives in RAM, so tickets from
+        // before a restart fall back to a full handshake.
+#if CONFIG_ESP_TLS_SERVER_SESSION_TICKETS
+        https_conf.session_tickets = server_tls.session_tickets;
+#else
+        if (server_tls.session_tickets) {
+            ESP_LOGW(TAG, "Session tickets need CONFIG_ESP_TLS_SERVER_SESSION_TICKETS");
+        }
+        https_conf.session_tickets = false;
+#endif
+
+        // Certificates (esp-tls ignores them when the selection hook is set)
+        https_conf.servercert = server_tls.cert;
+        https_conf.servercert_len = server_tls.cert_len;
+        https_conf.prvtkey_pem = server_tls.key;
+        https_conf.prvtkey_len = server_tls.key_len;
+#if CONFIG_ESP_TLS_SERVER_CERT_SELECT_HOOK
+        https_conf.cert_select_cb = httpserver_tls_cert_select;
+#endif
+
+        ESP_LOGI(TAG, "Starting HTTPS server on port 443");
+        
+        ret = httpd_ssl_start(&https_server, &https_conf);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start HTTPS server: %d (0x%x)", ret, ret);
+            // Continue with HTTP only - don't fail completely
+            use_https = false;
+            httpserver_tls_free();
+        } else {
+            ESP_LOGI(TAG, "HTTPS server started successfully on port 443");
+            httpd_register_err_handler(https_server, HTTPD_404_NOT_FOUND, httpserver_route_err_handler);
+            httpd_register_err_handler(https_server, HTTPD_405_METHOD_NOT_ALLOWED, httpserver_route_err_handler);
+        }
+    }
+
+    // Idle sweep for keep-alive connections
+    if (connection_tracking.keepalive_timeout_s > 0) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = httpserver_sweep_timer_cb,
+            .name = "http_keepalive",
+        };
+        if (esp_timer_create(&timer_args, &connection_tracking.sweep_timer) == ESP_OK) {
+            esp_timer_start_periodic(connection_tracking.sweep_timer, HTTP_KEEPALIVE_SWEEP_MS * 1000);
+        } else {
+            // Without the sweep idle connections still go via LRU purge
+            ESP_LOGW(TAG, "Failed to create keep-alive sweep timer");
+            connection_tracking.sweep_timer = NULL;
+        }
+    }
+    ESP_LOGI(TAG, "Keep-alive: %s", connection_tracking.keepalive_timeout_s ? connection_tracking.keepalive_hdr : "off");
+
+    return mp_obj_new_bool(true);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(httpserver_start_obj, 0, httpserver_start);
+
+// Parse a method argument ("GET", "POST", "PUT", "DELETE", "PATCH" or "*")
+static http_route_method_t httpserver_parse_method(mp_obj_t method_obj) {
+    if (method_obj == mp_const_none) {
+        return HTTP_ROUTE_GET;  // Default method
+    }
+    if (!mp_obj_is_str(method_obj)) {
+        mp_raise_TypeError(MP_ERROR_TEXT("Method must be a string"));
+    }
+    const char *method_str = mp_obj_str_get_str(method_obj);
+    for (int i = 0; i < HTTP_ROUTE_METHODS; i++) {
+        if (strcasecmp(method_str, http_route_method_names[i]) == 0) {
+            return (http_route_method_t)i;
+        }
+    }
+    mp_raise_ValueError(MP_ERROR_TEXT("Method must be GET, POST, PUT, DELETE, PATCH or '*'"));
+}
+
+static http_priority_t httpserver_parse_priority(mp_obj_t priority_obj) {
+    const char *priority_str = mp_obj_str_get_str(priority_obj);
+    for (size_t i = 0; i < MP_ARRAY_SIZE(http_priority_names); i++) {
+        if (strcasecmp(priority_str, http_priority_names[i]) == 0) {
+            return (http_priority_t)i;
+        }
+    }
+    mp_raise_ValueError(MP_ERROR_TEXT("Priority must be 'high', 'normal' or 'low'"));
+}
+
+// Register a URI handler
+static mp_obj_t httpserver_on(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_uri, ARG_handler, ARG_method, ARG_stream, ARG_max_body, ARG_cache_ms,
+           ARG_priority, ARG_max_concurrent, ARG_max_wait_ms };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_uri, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_handler, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_method, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_stream, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_max_body, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_cache_ms, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_priority, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_QSTR(MP_QSTR_normal)} },
+        { MP_QSTR_max_concurrent, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_max_wait_ms, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = HTTP_MAX_WAIT_MS_DEFAULT} },
+    };
+    mp_arg_val_t parsed[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, parsed);
+    mp_obj_t args[2] = { parsed[ARG_uri].u_obj, parsed[ARG_handler].u_obj };
+
+    if (http_server == NULL || !http_queue_initialized) {
+        mp_raise_ValueError(http_server == NULL ? MP_ERROR_TEXT("Server not started") :
+                           MP_ERROR_TEXT("Queue not initialized"));
+    }
+
+    if (!mp_obj_is_str(args[0]) || !mp_obj_is_callable(args[1])) {
+        mp_raise_TypeError(MP_ERROR_TEXT("String and callable required"));
+    }
+
+    http_route_method_t method = httpserver_parse_method(parsed[ARG_method].u_obj);
+
+    if (parsed[ARG_max_body].u_int < 0 || parsed[ARG_cache_ms].u_int < 0) {
+        mp_raise_ValueError(MP_ERROR_TEXT("max_body and cache_ms must be >= 0"));
+    }
+    http_priority_t priority = httpserver_parse_priority(parsed[ARG_priority].u_obj);
+    if (parsed[ARG_max_concurrent].u_int < 0 || parsed[ARG_max_concurrent].u_int > UINT16_MAX ||
+        parsed[ARG_max_wait_ms].u_int < 0) {
+        mp_raise_ValueError(MP_ERROR_TEXT("max_concurrent and max_wait_ms must be >= 0"));
+    }
+
+    const char *uri = mp_obj_str_get_str(args[0]);
+    if (http_route_validate(uri) < 0) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid route pattern"));
+    }
+    ESP_LOGI(TAG, "Registering handler for URI: %s, Method: %s", uri, http_route_method_names[method]);
+
+    // Python functions live in a list rooted in MP_STATE_PORT so the GC keeps them
+    if (MP_STATE_PORT(httpserver_route_funcs) == MP_OBJ_NULL) {
+        MP_STATE_PORT(httpserver_route_funcs) = mp_obj_new_list(0, NULL);
+    }
+    mp_obj_t funcs = MP_STATE_PORT(httpserver_route_funcs);
+
+    char *uri_copy = strdup(uri);  // Allocate and store URI
+    if (uri_copy == NULL) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate URI memory"));
+    }
+
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+
+    if (!http_route_root) {
+        http_route_root = http_route_node_new("", 0);
+    }
+    http_route_node_t *node = http_route_root ? http_route_node_for(uri, true) : NULL;
+    if (!node) {
+        xSemaphoreGive(http_route_mutex);
+        free(uri_copy);
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate route"));
+    }
+
+    // Re-registering a pattern and method replaces its handler; otherwise
+    // take a free slot, growing the table when it is full
+    int slot = node->handlers[method];
+    if (slot < 0) {
+        for (int i = 0; i < http_handler_count; i++) {
+            if (!http_handlers[i].active) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot < 0) {
+        http_handler_t *grown = NULL;
+        if (http_handler_count + HTTP_ROUTE_GROW <= INT16_MAX) {  // Tree nodes store int16_t slots
+            grown = realloc(http_handlers, (http_handler_count + HTTP_ROUTE_GROW) * sizeof(http_handler_t));
+        }
+        if (!grown) {
+            xSemaphoreGive(http_route_mutex);
+            free(uri_copy);
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate route"));
+        }
+        memset(grown + http_handler_count, 0, HTTP_ROUTE_GROW * sizeof(http_handler_t));
+        http_handlers = grown;
+        slot = http_handler_count;
+        http_handler_count += HTTP_ROUTE_GROW;
+    }
+
+    // Store handler info
+    free(http_handlers[slot].uri);
+    http_handlers[slot].active = true;
+    http_handlers[slot].id = ++http_handler_next_id;
+    http_handlers[slot].uri = uri_copy;
+    http_handlers[slot].method = method;  // Store HTTP method
+    http_handlers[slot].stream = parsed[ARG_stream].u_bool;
+    http_handlers[slot].max_body = parsed[ARG_max_body].u_int;
+    http_handlers[slot].cache_ms = parsed[ARG_cache_ms].u_int;
+    http_cache_drop(&http_handlers[slot]);
+    http_handlers[slot].priority = priority;
+    http_handlers[slot].max_concurrent = parsed[ARG_max_concurrent].u_int;
+    http_handlers[slot].concurrent = 0;
+    http_handlers[slot].max_wait_ms = parsed[ARG_max_wait_ms].u_int;
+    memset(&http_handlers[slot].metrics, 0, sizeof(http_route_metrics_t));
+    node->handlers[method] = slot;
+
+    xSemaphoreGive(http_route_mutex);
+
+    // Store the function at the slot's index (None-padded)
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_list_get(funcs, &len, &items);
+    while (len <= (size_t)slot) {
+        mp_obj_list_append(funcs, mp_const_none);
+        mp_obj_list_get(funcs, &len, &items);
+    }
+    items[slot] = args[1];
+
+    ESP_LOGI(TAG, "Stored function %p for handler slot %d (URI: %s, method: %s)",
+             args[1], slot, uri, http_route_method_names[method]);
+
+    return mp_obj_new_int(slot);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(httpserver_on_obj, 2, httpserver_on);
+
+// Unregister a URI handler
+static mp_obj_t httpserver_off(size_t n_args, const mp_obj_t *args) {
+    if (http_server == NULL) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Server not started"));
+    }
+
+    if (!mp_obj_is_str(args[0])) {
+        mp_raise_TypeError(MP_ERROR_TEXT("URI must be a string"));
+    }
+
+    // Check for optional method argument
+    http_route_method_t method = httpserver_parse_method(n_args >= 2 ? args[1] : mp_const_none);
+
+    const char *uri = mp_obj_str_get_str(args[0]);
+    ESP_LOGI(TAG, "Unregistering handler for URI: %s, Method: %s", uri, http_route_method_names[method]);
+
+    // Find the matching handler slot first
+    int slot = -1;
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    http_route_node_t *node = NULL;
+    if (http_route_root && http_route_validate(uri) >= 0) {
+        node = http_route_node_for(uri, false);
+    }
+    if (node) {
+        slot = node->handlers[method];
+        node->handlers[method] = -1;
+    }
+    if (slot >= 0) {
+        // The slot keeps its URI until reused; its id no longer matches queued requests
+        http_handlers[slot].active = false;
+        http_cache_drop(&http_handlers[slot]);
+    }
+    xSemaphoreGive(http_route_mutex);
+
+    if (slot < 0) {
+        ESP_LOGW(TAG, "Handler not found for URI: %s, method: %s", uri, http_route_method_names[method]);
+        return mp_obj_new_bool(false);
+    }
+
+    mp_obj_t funcs = MP_STATE_PORT(httpserver_route_funcs);
+    if (funcs != MP_OBJ_NULL) {
+        mp_obj_subscr(funcs, MP_OBJ_NEW_SMALL_INT(slot), mp_const_none);
+    }
+
+    ESP_LOGI(TAG, "Handler unregistered successfully (slot %d)", slot);
+    return mp_obj_new_bool(true);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_off_obj, 1, 2, httpserver_off);
+
+// Drop cached responses: for the GET route matching a path, or all with no argument
+static mp_obj_t httpserver_invalidate(size_t n_args, const mp_obj_t *args) {
+    const char *path = n_args > 0 && args[0] != mp_const_none ? mp_obj_str_get_str(args[0]) : NULL;
+    int dropped = 0;
+
+    if (!http_route_mutex) {
+        return mp_obj_new_int(0);
+    }
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    if (path) {
+        http_route_match_t match = { .handler_id = -1 };
+        bool found = false;
+        if (http_route_root &&
+            http_route_match(http_route_root, path, 0, strcspn(path, "?"), HTTP_ROUTE_GET, &match, &found)) {
+            dropped = http_cache_drop(&http_handlers[match.handler_id]);
+        }
+    } else {
+        for (int i = 0; i < http_handler_count; i++) {
+            dropped += http_cache_drop(&http_handlers[i]);
+        }
+    }
+    xSemaphoreGive(http_route_mutex);
+    return mp_obj_new_int(dropped);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_invalidate_obj, 0, 1, httpserver_invalidate);
+
+//=============================================================================
+// Server-Sent Events (httpserver.sse(path))
+//=============================================================================
+// publish() encodes an event once, already framed as an HTTP chunk, into a
+// refcounted buffer and queues a reference on every client of the endpoint.
+// Each server task then writes the queued buffers to its own clients
+// (httpd_queue_work), so Python never waits on a socket. The last few events
+// stay in a ring so reconnecting clients get what they missed (Last-Event-ID).
+
+#define SSE_ENDPOINT_MAX 4         // Counted in HTTP_URI_HANDLERS_MAX
+#define SSE_CLIENTS_MAX 4          // Per endpoint
+#define SSE_QUEUE_MAX 64           // Upper bound for queue_limit
+#define SSE_RING_MAX 64            // Upper bound for replay
+#define SSE_PATH_MAX 64
+#define SSE_RETRY_MS 50            // Retry interval for clients whose socket is full
+
+typedef struct {
+    int refs;             // Replay ring plus client queues holding it
+    uint32_t id;
+    size_t len;
+    char data[];          // "<hex len>\r\nid: ...\nevent: ...\ndata: ...\n\n\r\n"
+} sse_msg_t;
+
+typedef struct {
+    httpd_handle_t hd;    // NULL = free slot
+    int fd;
+    sse_msg_t *queue[SSE_QUEUE_MAX];
+    uint8_t head;
+    uint8_t count;
+    size_t sent;          // Bytes of queue[head] already written
+} sse_client_t;
+
+typedef struct {
+    bool active;
+    uint32_t generation;  // Bumped on close, so stale publishers are detected
+    char path[SSE_PATH_MAX];
+    uint32_t next_id;
+    uint8_t queue_limit;
+    uint8_t replay;       // Ring capacity
+    sse_msg_t *ring[SSE_RING_MAX];
+    uint8_t ring_head;
+    uint8_t ring_count;
+    sse_client_t clients[SSE_CLIENTS_MAX];
+    uint32_t published;
+    uint32_t dropped_clients;  // Disconnected for exceeding queue_limit
+} sse_endpoint_t;
+
+static sse_endpoint_t sse_endpoints[SSE_ENDPOINT_MAX];
+static SemaphoreHandle_t sse_mutex = NULL;
+static bool sse_flush_pending[2];  // [0] HTTP server, [1] HTTPS server
+static esp_timer_handle_t sse_retry_timer = NULL;
+
+// Caller holds sse_mutex
+static void sse_msg_unref(sse_msg_t *msg) {
+    if (msg && --msg->refs == 0) {
+        free(msg);
+    }
+}
+
+// Empty a client's queue and free its slot. Caller holds sse_mutex.
+static void sse_client_drop(sse_client_t *client) {
+    while (client->count > 0) {
+        sse_msg_unref(client->queue[client->head]);
+        client->head = (client->head + 1) % SSE_QUEUE_MAX;
+        client->count--;
+    }
+    client->sent = 0;
+    client->hd = NULL;
+    client->fd = -1;
+}
+
+// Caller holds sse_mutex
+static bool sse_client_push(sse_client_t *client, sse_msg_t *msg) {
+    if (client->count >= SSE_QUEUE_MAX) {
+        return false;
+    }
+    client->queue[(client->head + client->count) % SSE_QUEUE_MAX] = msg;
+    client->count++;
+    msg->refs++;
+    return true;
+}
+
+// Session closed. CONTEXT: HTTP server task (close_fn)
+static void httpserver_sse_forget(httpd_handle_t hd, int fd) {
+    if (!sse_mutex) {
+        return;
+    }
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    for (int e = 0; e < SSE_ENDPOINT_MAX; e++) {
+        for (int c = 0; c < SSE_CLIENTS_MAX; c++) {
+            sse_client_t *client = &sse_endpoints[e].clients[c];
+            if (client->hd == hd && client->fd == fd) {
+                sse_client_drop(client);
+            }
+        }
+    }
+    xSemaphoreGive(sse_mutex);
+}
+
+// Write queued events to this server's clients without blocking the server
+// task. A client whose socket is full keeps its place in the current event and
+// is retried after SSE_RETRY_MS; one that stays behind hits queue_limit in
+// publish() and is disconnected there.
+// CONTEXT: HTTP server task. Only this task adds clients of hd, but publish()
+// may drop one meanwhile, so the event is referenced while we send it.
+static void httpserver_sse_flush(httpd_handle_t hd) {
+    bool blocked = false;
+    for (int e = 0; e < SSE_ENDPOINT_MAX; e++) {
+        for (int c = 0; c < SSE_CLIENTS_MAX; c++) {
+            sse_client_t *client = &sse_endpoints[e].clients[c];
+            while (true) {
+                xSemaphoreTake(sse_mutex, portMAX_DELAY);
+                if (client->hd != hd || client->count == 0) {
+                    xSemaphoreGive(sse_mutex);
+                    break;
+                }
+                int fd = client->fd;
+                sse_msg_t *msg = client->queue[client->head];
+                size_t sent = client->sent;
+                msg->refs++;
+                xSemaphoreGive(sse_mutex);
+
+                // Non-blocking for this send only; httpd's own sends stay blocking.
+                // A full socket shows up as a timeout (HTTP) or WANT_WRITE (TLS,
+                // which must be retried with the same data - it is).
+                int flags = fcntl(fd, F_GETFL, 0);
+                fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+                int ret = httpd_socket_send(hd, fd, msg->data + sent, msg->len - sent, 0);
+                fcntl(fd, F_SETFL, flags);
+
+                xSemaphoreTake(sse_mutex, portMAX_DELAY);
+                bool current = client->hd == hd && client->fd == fd && client->count > 0 &&
+                               client->queue[client->head] == msg;
+                sse_msg_unref(msg);
+                if (!current) {
+                    xSemaphoreGive(sse_mutex);  // Dropped by publish(), which closes it
+                    break;
+                }
+                if (ret > 0) {
+                    client->sent += ret;
+                    if (client->sent == msg->len) {
+                        sse_msg_unref(msg);
+                        client->head = (client->head + 1) % SSE_QUEUE_MAX;
+                        client->count--;
+                        client->sent = 0;
+                    }
+                    xSemaphoreGive(sse_mutex);
+                    continue;
+                }
+                if (ret == HTTPD_SOCK_ERR_TIMEOUT || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+                    blocked = true;
+                    xSemaphoreGive(sse_mutex);
+                    break;
+                }
+                ESP_LOGW(TAG, "SSE send failed, closing client (fd %d)", fd);
+                sse_client_drop(client);
+                xSemaphoreGive(sse_mutex);
+                httpd_sess_trigger_close(hd, fd);
+                break;
+            }
+        }
+    }
+    if (blocked && sse_retry_timer) {
+        esp_timer_start_once(sse_retry_timer, SSE_RETRY_MS * 1000);  // No-op if already armed
+    }
+}
+
+static void httpserver_sse_flush_work(void *arg) {
+    httpd_handle_t hd = (httpd_handle_t)arg;
+    sse_flush_pending[hd == https_server ? 1 : 0] = false;
+    httpserver_sse_flush(hd);
+}
+
+// Schedule a flush on a server unless one is already queued
+static void httpserver_sse_schedule(httpd_handle_t hd) {
+    int index = hd == https_server ? 1 : 0;
+    if (hd == NULL || sse_flush_pending[index]) {
+        return;
+    }
+    sse_flush_pending[index] = true;
+    if (httpd_queue_work(hd, httpserver_sse_flush_work, hd) != ESP_OK) {
+        sse_flush_pending[index] = false;
+    }
+}
+
+// Retry clients whose socket was full. CONTEXT: esp_timer task
+static void httpserver_sse_retry_cb(void *arg) {
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    httpserver_sse_schedule(http_server);
+    httpserver_sse_schedule(https_server);
+    xSemaphoreGive(sse_mutex);
+}
+
+// GET handler for an SSE path. CONTEXT: HTTP server task
+static esp_err_t httpserver_sse_handler(httpd_req_t *req) {
+    sse_endpoint_t *ep = (sse_endpoint_t *)req->user_ctx;
+    int fd = httpd_req_to_sockfd(req);
+
+    // Reconnecting EventSource clients send the id of the last event they saw
+    char value[16];
+    bool resume = httpd_req_get_hdr_value_str(req, "Last-Event-ID", value, sizeof(value)) == ESP_OK;
+    uint32_t last_id = resume ? strtoul(value, NULL, 10) : 0;
+
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    sse_client_t *client = NULL;
+    for (int c = 0; ep->active && c < SSE_CLIENTS_MAX; c++) {
+        if (ep->clients[c].hd == NULL) {
+            client = &ep->clients[c];
+            break;
+        }
+    }
+    if (!client) {
+        xSemaphoreGive(sse_mutex);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "5");
+        httpd_resp_sendstr(req, "Too many event stream clients");
+        return ESP_OK;
+    }
+    client->hd = req->handle;
+    client->fd = fd;
+    client->head = 0;
+    client->count = 0;
+    client->sent = 0;
+    if (resume) {
+        // Replay newer events from the ring, at most queue_limit of the latest
+        int skip = 0;
+        for (int i = 0; i < ep->ring_count; i++) {
+            if (ep->ring[(ep->ring_head + i) % ep->replay]->id > last_id) {
+                break;
+            }
+            skip++;
+        }
+        int start = ep->ring_count - skip > ep->queue_limit ? ep->ring_count - ep->queue_limit : skip;
+        for (int i = start; i < ep->ring_count; i++) {
+            sse_client_push(client, ep->ring[(ep->ring_head + i) % ep->replay]);
+        }
+    }
+    xSemaphoreGive(sse_mutex);
+
+    // Chunked response that stays open; events follow as chunks
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "X-Accel-Buffering", "no");
+    static const char retry[] = "retry: 2000\n\n";
+    if (httpd_resp_send_chunk(req, retry, sizeof(retry) - 1) != ESP_OK) {
+        xSemaphoreTake(sse_mutex, portMAX_DELAY);
+        sse_client_drop(client);
+        xSemaphoreGive(sse_mutex);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "SSE client connected to %s (fd %d, resume from %lu)", ep->path, fd, (unsigned long)last_id);
+    httpserver_session_set_sse(req);
+
+    httpserver_sse_flush(req->handle);
+    return ESP_OK;
+}
+
+// Encode an event once as a complete HTTP chunk
+static sse_msg_t *sse_msg_encode(uint32_t id, const char *event, size_t event_len, const char *data, size_t data_len) {
+    // One "data: " line per line of data
+    size_t lines = 1;
+    for (size_t i = 0; i < data_len; i++) {
+        if (data[i] == '\n') {
+            lines++;
+        }
+    }
+    size_t payload = 4 + 10 + 1 + (event ? 7 + event_len + 1 : 0) + lines * 7 + data_len + 1;
+    sse_msg_t *msg = malloc(sizeof(sse_msg_t) + payload + 16);
+    if (!msg) {
+        return NULL;
+    }
+    // Leave room for the chunk size line, written once the payload length is known
+    char *body = msg->data + 10;
+    size_t n = sprintf(body, "id: %lu\n", (unsigned long)id);
+    if (event) {
+        n += sprintf(body + n, "event: %.*s\n", (int)event_len, event);
+    }
+    const char *line = data;
+    const char *end = data + data_len;
+    while (true) {
+        const char *nl = memchr(line, '\n', end - line);
+        size_t len = nl ? (size_t)(nl - line) : (size_t)(end - line);
+        memcpy(body + n, "data: ", 6);
+        memcpy(body + n + 6, line, len);
+        n += 6 + len;
+        body[n++] = '\n';
+        if (!nl) {
+            break;
+        }
+        line = nl + 1;
+    }
+    body[n++] = '\n';
+
+    char size_line[12];
+    int size_len = sprintf(size_line, "%x\r\n", (unsigned)n);
+    memmove(msg->data, size_line, size_len);
+    memmove(msg->data + size_len, body, n);
+    memcpy(msg->data + size_len + n, "\r\n", 2);
+    msg->len = size_len + n + 2;
+    msg->id = id;
+    msg->refs = 0;
+    return msg;
+}
+
+// Python publisher object
+typedef struct {
+    mp_obj_base_t base;
+    int index;
+    uint32_t generation;
+} sse_publisher_obj_t;
+
+static sse_endpoint_t *sse_publisher_endpoint(mp_obj_t self_in) {
+    sse_publisher_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    sse_endpoint_t *ep = &sse_endpoints[self->index];
+    if (!ep->active || ep->generation != self->generation) {
+        mp_raise_OSError(MP_EBADF);
+    }
+    return ep;
+}
+
+// publisher.publish(event, data) -> number of clients the event was queued to
+static mp_obj_t sse_publisher_publish(mp_obj_t self_in, mp_obj_t event_in, mp_obj_t data_in) {
+    sse_endpoint_t *ep = sse_publisher_endpoint(self_in);
+    size_t event_len = 0;
+    const char *event = event_in == mp_const_none ? NULL : mp_obj_str_get_data(event_in, &event_len);
+    // A line break would end the event: field and start another field
+    if (event && (memchr(event, '\r', event_len) || memchr(event, '\n', event_len))) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Event name must not contain CR or LF"));
+    }
+    size_t data_len;
+    const char *data = mp_obj_str_get_data(data_in, &data_len);
+
+    // Reserve the id, then encode outside the lock
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    uint32_t id = ++ep->next_id;
+    xSemaphoreGive(sse_mutex);
+    sse_msg_t *msg = sse_msg_encode(id, event, event_len, data, data_len);
+    if (!msg) {
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("SSE event allocation failed"));
+    }
+
+    int queued = 0;
+    bool flush[2] = { false, false };
+    int overflow_fds[SSE_CLIENTS_MAX];
+    httpd_handle_t overflow_hds[SSE_CLIENTS_MAX];
+    int overflows = 0;
+
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    ep->published++;
+
+    // Replay ring keeps one reference
+    if (ep->replay > 0) {
+        if (ep->ring_count == ep->replay) {
+            sse_msg_unref(ep->ring[ep->ring_head]);
+            ep->ring_head = (ep->ring_head + 1) % ep->replay;
+            ep->ring_count--;
+        }
+        ep->ring[(ep->ring_head + ep->ring_count) % ep->replay] = msg;
+        ep->ring_count++;
+        msg->refs++;
+    }
+
+    for (int c = 0; c < SSE_CLIENTS_MAX; c++) {
+        sse_client_t *client = &ep->clients[c];
+        if (client->hd == NULL) {
+            continue;
+        }
+        if (client->count >= ep->queue_limit || !sse_client_push(client, msg)) {
+            // Too slow: disconnect, it will reconnect and replay from the ring
+            overflow_hds[overflows] = client->hd;
+            overflow_fds[overflows++] = client->fd;
+            sse_client_drop(client);
+            ep->dropped_clients++;
+            continue;
+        }
+        flush[client->hd == https_server ? 1 : 0] = true;
+        queued++;
+    }
+    if (msg->refs == 0) {
+        free(msg);  // No ring and no clients
+    }
+    if (flush[0]) {
+        httpserver_sse_schedule(http_server);
+    }
+    if (flush[1]) {
+        httpserver_sse_schedule(https_server);
+    }
+    xSemaphoreGive(sse_mutex);
+
+    for (int i = 0; i < overflows; i++) {
+        ESP_LOGW(TAG, "SSE client on %s over queue limit, disconnecting (fd %d)", ep->path, overflow_fds[i]);
+        httpd_sess_trigger_close(overflow_hds[i], overflow_fds[i]);
+    }
+    return mp_obj_new_int(queued);
+}
+static MP_DEFINE_CONST_FUN_OBJ_3(sse_publisher_publish_obj, sse_publisher_publish);
+
+// publisher.clients() -> number of connected clients
+static mp_obj_t sse_publisher_clients(mp_obj_t self_in) {
+    sse_endpoint_t *ep = sse_publisher_endpoint(self_in);
+    int count = 0;
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    for (int c = 0; c < SSE_CLIENTS_MAX; c++) {
+        if (ep->clients[c].hd != NULL) {
+            count++;
+        }
+    }
+    xSemaphoreGive(sse_mutex);
+    return mp_obj_new_int(count);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(sse_publisher_clients_obj, sse_publisher_clients);
+
+// publisher.stats() -> dict
+static mp_obj_t sse_publisher_stats(mp_obj_t self_in) {
+    sse_endpoint_t *ep = sse_publisher_endpoint(self_in);
+    mp_obj_t dict = mp_obj_new_dict(4);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_clients), sse_publisher_clients(self_in));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_published), mp_obj_new_int_from_uint(ep->published));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dropped_clients), mp_obj_new_int_from_uint(ep->dropped_clients));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_last_id), mp_obj_new_int_from_uint(ep->next_id));
+    return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(sse_publisher_stats_obj, sse_publisher_stats);
+
+// Free an endpoint's ring and clients (closing them). Caller holds sse_mutex.
+static void sse_endpoint_reset(sse_endpoint_t *ep, bool close_clients) {
+    for (int c = 0; c < SSE_CLIENTS_MAX; c++) {
+        sse_client_t *client = &ep->clients[c];
+        if (client->hd != NULL) {
+            if (close_clients) {
+                httpd_sess_trigger_close(client->hd, client->fd);
+            }
+            sse_client_drop(client);
+        }
+    }
+    while (ep->ring_count > 0) {
+        sse_msg_unref(ep->ring[ep->ring_head]);
+        ep->ring_head = (ep->ring_head + 1) % ep->replay;
+        ep->ring_count--;
+    }
+    ep->active = false;
+    ep->generation++;
+}
+
+// Apply new sse() settings to an endpoint being reused. The replay ring keeps
+// its newest events that still fit; clients over the new queue_limit are
+// disconnected by the next publish(). sse_mutex held.
+static void sse_endpoint_configure(sse_endpoint_t *ep, uint8_t queue_limit, uint8_t replay) {
+    sse_msg_t *kept[SSE_RING_MAX];
+    int count = 0;
+    for (int i = 0; i < ep->ring_count; i++) {
+        sse_msg_t *msg = ep->ring[(ep->ring_head + i) % ep->replay];
+        if (ep->ring_count - i > replay) {
+            sse_msg_unref(msg);
+        } else {
+            kept[count++] = msg;
+        }
+    }
+    memcpy(ep->ring, kept, count * sizeof(kept[0]));
+    ep->ring_head = 0;
+    ep->ring_count = count;
+    ep->queue_limit = queue_limit;
+    ep->replay = replay;
+}
+
+// publisher.close(): unregister the path and disconnect its clients
+static mp_obj_t sse_publisher_close(mp_obj_t self_in) {
+    sse_publisher_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    sse_endpoint_t *ep = &sse_endpoints[self->index];
+    if (!ep->active || ep->generation != self->generation) {
+        return mp_const_none;
+    }
+    if (http_server) {
+        httpd_unregister_uri_handler(http_server, ep->path, HTTP_GET);
+    }
+    if (https_server) {
+        httpd_unregister_uri_handler(https_server, ep->path, HTTP_GET);
+    }
+    xSemaphoreTake(sse_mutex, portMAX_DELAY);
+    sse_endpoint_reset(ep, true);
+    xSemaphoreGive(sse_mutex);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(sse_publisher_close_obj, sse_publisher_close);
+
+static const mp_rom_map_elem_t sse_publisher_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_publish), MP_ROM_PTR(&sse_publisher_publish_obj) },
+    { MP_ROM_QSTR(MP_QSTR_clients), MP_ROM_PTR(&sse_publisher_clients_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&sse_publisher_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&sse_publisher_close_obj) },
+};
+static MP_DEFINE_CONST_DICT(sse_publisher_locals_dict, sse_publisher_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    sse_publisher_type,
+    MP_QSTR_SSEPublisher,
+    MP_TYPE_FLAG_NONE,
+    locals_dict, &sse_publisher_locals_dict
+);
+
+// httpserver.sse(path, queue_limit=16, replay=16) -> SSEPublisher
+static mp_obj_t httpserver_sse(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_path, ARG_queue_limit, ARG_replay };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_path, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_queue_limit, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 16} },
+        { MP_QSTR_replay, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 16} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (http_server == NULL) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Server not started"));
+    }
+    const char *path = mp_obj_str_get_str(args[ARG_path].u_obj);
+    if (strlen(path) >= SSE_PATH_MAX) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Path too long"));
+    }
+    if (args[ARG_queue_limit].u_int < 1 || args[ARG_queue_limit].u_int > SSE_QUEUE_MAX ||
+        args[ARG_replay].u_int < 0 || args[ARG_replay].u_int > SSE_RING_MAX) {
+        mp_raise_ValueError(MP_ERROR_TEXT("queue_limit must be 1-64 and replay 0-64"));
+    }
+
+    if (!sse_mutex) {
+        sse_mutex = xSemaphoreCreateMutex();
+        if (!sse_mutex) {
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to create SSE mutex"));
+        }
+    }
+    if (!sse_retry_timer) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = httpserver_sse_retry_cb,
+            .name = "http_sse_retry",
+        };
+        if (esp_timer_create(&timer_args, &sse_retry_timer) != ESP_OK) {
+            // Blocked clients then wait for the next publish()
+            ESP_LOGW(TAG, "Failed to create SSE retry timer");
+            sse_retry_timer = NULL;
+        }
+    }
+
+    // An existing endpoint for the path (e.g. after a soft reset) is reused,
+    // with the settings of this call
+    int index = -1;
+    for (int e = 0; e < SSE_ENDPOINT_MAX; e++) {
+        if (sse_endpoints[e].active && strcmp(sse_endpoints[e].path, path) == 0) {
+            index = e;
+            break;
+        }
+    }
+    if (index >= 0) {
+        xSemaphoreTake(sse_mutex, portMAX_DELAY);
+        sse_endpoint_configure(&sse_endpoints[index], args[ARG_queue_limit].u_int, args[ARG_replay].u_int);
+        xSemaphoreGive(sse_mutex);
+    } else {
+        for (int e = 0; e < SSE_ENDPOINT_MAX; e++) {
+            if (!sse_endpoints[e].active) {
+                index = e;
+                break;
+            }
+        }
+        if (index < 0) {
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("No more SSE endpoints available"));
+        }
+        sse_endpoint_t *ep = &sse_endpoints[index];
+        xSemaphoreTake(sse_mutex, portMAX_DELAY);
+        strcpy(ep->path, path);
+        ep->queue_limit = args[ARG_queue_limit].u_int;
+        ep->replay = args[ARG_replay].u_int;
+        ep->ring_head = 0;
+        ep->ring_count = 0;
+        ep->published = 0;
+        ep->dropped_clients = 0;
+        for (int c = 0; c < SSE_CLIENTS_MAX; c++) {
+            ep->clients[c].hd = NULL;
+            ep->clients[c].fd = -1;
+        }
+        ep->active = true;
+        xSemaphoreGive(sse_mutex);
+
+        httpd_uri_t sse_uri = {
+            .uri      = ep->path,
+            .method   = HTTP_GET,
+            .handler  = httpserver_sse_handler,
+            .user_ctx = ep
+        };
+        esp_err_t ret = httpd_register_uri_handler(http_server, &sse_uri);
+        if (ret == ESP_OK && https_server != NULL) {
+            ret = httpd_register_uri_handler(https_server, &sse_uri);
+            if (ret != ESP_OK) {
+                httpd_unregister_uri_handler(http_server, ep->path, HTTP_GET);
+            }
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register SSE handler for %s: %d", path, ret);
+            ep->active = false;
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to register SSE path"));
+        }
+        ESP_LOGI(TAG, "SSE endpoint registered at %s", path);
+    }
+
+    sse_publisher_obj_t *self = mp_obj_malloc(sse_publisher_obj_t, &sse_publisher_type);
+    self->index = index;
+    self->generation = sse_endpoints[index].generation;
+    return MP_OBJ_FROM_PTR(self);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(httpserver_sse_obj, 1, httpserver_sse);
+
+//=============================================================================
+// Prometheus metrics endpoint (httpserver.metrics(path))
+//=============================================================================
+// Served by the server task straight from the C counters, in the Prometheus
+// text format, so scraping never waits for Python.
+
+#define HTTP_METRICS_PATH_MAX 32
+#define HTTP_METRICS_CHUNK 512
+
+static char http_metrics_path[HTTP_METRICS_PATH_MAX] = "";
+
+typedef struct {
+    httpd_req_t *req;
+    char buf[HTTP_METRICS_CHUNK];
+    size_t len;
+    bool failed;
+} http_metrics_out_t;
+
+static void http_metrics_flush(http_metrics_out_t *out) {
+    if (out->len > 0 && !out->failed && httpd_resp_send_chunk(out->req, out->buf, out->len) != ESP_OK) {
+        out->failed = true;
+    }
+    out->len = 0;
+}
+
+// Append a line; a line never exceeds HTTP_METRICS_CHUNK / 2
+static void http_metrics_printf(http_metrics_out_t *out, const char *fmt, ...) {
+    if (out->len > HTTP_METRICS_CHUNK / 2) {
+        http_metrics_flush(out);
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out->buf + out->len, HTTP_METRICS_CHUNK - out->len, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        out->len += (size_t)n < HTTP_METRICS_CHUNK - out->len ? (size_t)n : HTTP_METRICS_CHUNK - out->len - 1;
+    }
+}
+
+// Seconds with microsecond precision, without floating point
+#define HTTP_SECONDS_FMT "%llu.%06llu"
+#define HTTP_SECONDS(us) (unsigned long long)((us) / 1000000), (unsigned long long)((us) % 1000000)
+
+// labels: already formatted, e.g. route="/a",method="GET" (may be empty)
+static void http_metrics_histogram(http_metrics_out_t *out, const char *name, const char *labels,
+                                   const http_histogram_t *h) {
+    const char *sep = labels[0] ? "," : "";
+    uint32_t cumulative = 0;
+    for (int i = 0; i < HTTP_METRIC_BUCKETS; i++) {
+        cumulative += h->buckets[i];
+        http_metrics_printf(out, "%s_bucket{%s%sle=\"%s\"} %lu\n", name, labels, sep, http_bucket_le[i],
+                            (unsigned long)cumulative);
+    }
+    http_metrics_printf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, (unsigned long)h->count);
+    http_metrics_printf(out, "%s_sum{%s} " HTTP_SECONDS_FMT "\n", name, labels, HTTP_SECONDS(h->total_us));
+    http_metrics_printf(out, "%s_count{%s} %lu\n", name, labels, (unsigned long)h->count);
+}
+
+// Route patterns only contain URI characters, but keep the label valid anyway
+static void http_metrics_label_value(char *dst, size_t size, const char *src) {
+    size_t n = 0;
+    for (; *src && n + 2 < size; src++) {
+        if (*src == '"' || *src == '\\') {
+            dst[n++] = '\\';
+        }
+        dst[n++] = *src;
+    }
+    dst[n] = '\0';
+}
+
+// CONTEXT: HTTP server task
+static esp_err_t httpserver_metrics_handler(httpd_req_t *req) {
+    http_metrics_out_t *out = malloc(sizeof(http_metrics_out_t));
+    if (!out) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+        return ESP_FAIL;
+    }
+    out->req = req;
+    out->len = 0;
+    out->failed = false;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+    // Connection and queue counters
+    http_metrics_printf(out, "# TYPE httpserver_open_connections gauge\nhttpserver_open_connections %d\n",
+                        connection_tracking.count);
+    http_metrics_printf(out, "# TYPE httpserver_connections_total counter\n"
+                        "httpserver_connections_total{server=\"http\"} %lu\n"
+                        "httpserver_connections_total{server=\"https\"} %lu\n",
+                        (unsigned long)connection_tracking.http_connections,
+                        (unsigned long)connection_tracking.tls_handshakes);
+    http_histogram_t tls_time[2];
+    xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+    memcpy(tls_time, connection_tracking.tls_handshake_time, sizeof(tls_time));
+    xSemaphoreGive(connection_tracking.mutex);
+    http_metrics_printf(out, "# HELP httpserver_tls_handshake_duration_seconds ClientHello to connection open.\n"
+                        "# TYPE httpserver_tls_handshake_duration_seconds histogram\n");
+    http_metrics_histogram(out, "httpserver_tls_handshake_duration_seconds", "resumed=\"false\"", &tls_time[0]);
+    http_metrics_histogram(out, "httpserver_tls_handshake_duration_seconds", "resumed=\"true\"", &tls_time[1]);
+    http_metrics_printf(out, "# TYPE httpserver_requests_total counter\nhttpserver_requests_total %lu\n"
+                        "# TYPE httpserver_reused_requests_total counter\nhttpserver_reused_requests_total %lu\n",
+                        (unsigned long)connection_tracking.requests, (unsigned long)connection_tracking.reused);
+    http_metrics_printf(out, "# TYPE httpserver_cache_hits_total counter\nhttpserver_cache_hits_total %lu\n",
+                        (unsigned long)http_cache_stats.hits);
+    xSemaphoreTake(http_queue_mutex, portMAX_DELAY);
+    uint16_t pending = http_admission.pending;
+    uint32_t shed_busy = http_admission.shed_busy;
+    uint32_t shed_concurrency = http_admission.shed_concurrency;
+    uint32_t expired = http_admission.expired;
+    xSemaphoreGive(http_queue_mutex);
+    http_metrics_printf(out, "# TYPE httpserver_queued gauge\nhttpserver_queued %u\n", (unsigned)pending);
+    http_metrics_printf(out, "# TYPE httpserver_shed_total counter\n"
+                        "httpserver_shed_total{reason=\"busy\"} %lu\n"
+                        "httpserver_shed_total{reason=\"concurrency\"} %lu\n"
+                        "httpserver_shed_total{reason=\"expired\"} %lu\n",
+                        (unsigned long)shed_busy, (unsigned long)shed_concurrency, (unsigned long)expired);
+
+    // Per-stage latency over all routes
+    http_metrics_printf(out, "# HELP httpserver_stage_duration_seconds Time spent per request stage.\n"
+                        "# TYPE httpserver_stage_duration_seconds histogram\n");
+    for (int i = 0; i < HTTP_STAGES; i++) {
+        char labels[24];
+        http_histogram_t h;
+        snprintf(labels, sizeof(labels), "stage=\"%s\"", http_stage_names[i]);
+        xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+        h = http_stage_histograms[i];
+        xSemaphoreGive(http_route_mutex);
+        http_metrics_histogram(out, "httpserver_stage_duration_seconds", labels, &h);
+    }
+
+    // Per-route latency; each route is copied out under the lock, then formatted
+    http_metrics_printf(out, "# HELP httpserver_request_duration_seconds Python route latency, request to response sent.\n"
+                        "# TYPE httpserver_request_duration_seconds histogram\n");
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            http_metrics_printf(out, "# HELP httpserver_route_stage_seconds_total Time per route and stage.\n"
+                                "# TYPE httpserver_route_stage_seconds_total counter\n"
+                                "# TYPE httpserver_route_errors_total counter\n");
+        }
+        for (int id = 0; ; id++) {
+            char route[HTTP_METRICS_CHUNK / 4];
+            char labels[HTTP_METRICS_CHUNK / 4 + 32];
+            http_route_metrics_t m;
+            const char *method;
+            xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+            if (id >= http_handler_count) {
+                xSemaphoreGive(http_route_mutex);
+                break;
+            }
+            if (!http_handlers[id].active) {
+                xSemaphoreGive(http_route_mutex);
+                continue;
+            }
+            http_metrics_label_value(route, sizeof(route), http_handlers[id].uri);
+            method = http_route_method_names[http_handlers[id].method];
+            m = http_handlers[id].metrics;
+            xSemaphoreGive(http_route_mutex);
+
+            snprintf(labels, sizeof(labels), "route=\"%s\",method=\"%s\"", route, method);
+            if (pass == 0) {
+                http_metrics_histogram(out, "httpserver_request_duration_seconds", labels, &m.latency);
+                continue;
+            }
+            for (int i = 0; i < HTTP_STAGES; i++) {
+                http_metrics_printf(out, "httpserver_route_stage_seconds_total{%s,stage=\"%s\"} " HTTP_SECONDS_FMT "\n",
+                                    labels, http_stage_names[i], HTTP_SECONDS(m.stage_us[i]));
+            }
+            http_metrics_printf(out, "httpserver_route_errors_total{%s} %lu\n", labels, (unsigned long)m.errors);
+        }
+    }
+
+    http_metrics_flush(out);
+    bool failed = out->failed;
+    free(out);
+    if (failed || httpd_resp_send_chunk(req, NULL, 0) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// httpserver.metrics(path="/metrics"): serve Prometheus metrics at path (None = stop)
+static mp_obj_t httpserver_metrics(size_t n_args, const mp_obj_t *args) {
+    if (http_server == NULL) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Server not started"));
+    }
+    const char *path = "/metrics";
+    if (n_args > 0) {
+        path = args[0] == mp_const_none ? NULL : mp_obj_str_get_str(args[0]);
+    }
+    if (path && (path[0] != '/' || strlen(path) >= HTTP_METRICS_PATH_MAX)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid metrics path"));
+    }
+
+    // Replace any earlier registration
+    if (http_metrics_path[0]) {
+        httpd_unregister_uri_handler(http_server, http_metrics_path, HTTP_GET);
+        if (https_server) {
+            httpd_unregister_uri_handler(https_server, http_metrics_path, HTTP_GET);
+        }
+        http_metrics_path[0] = '\0';
+    }
+    if (!path) {
+        return mp_const_none;
+    }
+
+    strcpy(http_metrics_path, path);
+    httpd_uri_t metrics_uri = {
+        .uri      = http_metrics_path,
+        .method   = HTTP_GET,
+        .handler  = httpserver_metrics_handler,
+        .user_ctx = NULL
+    };
+    esp_err_t ret = httpd_register_uri_handler(http_server, &metrics_uri);
+    if (ret == ESP_OK && https_server) {
+        ret = httpd_register_uri_handler(https_server, &metrics_uri);
+        if (ret != ESP_OK) {
+            httpd_unregister_uri_handler(http_server, http_metrics_path, HTTP_GET);
+        }
+    }
+    if (ret != ESP_OK) {
+        http_metrics_path[0] = '\0';
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to register metrics path"));
+    }
+    ESP_LOGI(TAG, "Prometheus metrics at %s", path);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_metrics_obj, 0, 1, httpserver_metrics);
+
+// httpserver.access_log() -> list of recent requests, oldest first:
+// (time_ms, method, uri, status, connect_us, queue_us, handler_us, send_us)
+static mp_obj_t httpserver_access_log(void) {
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    if (!http_route_mutex) {
+        return list;
+    }
+    for (int i = 0; ; i++) {
+        http_access_entry_t entry;
+        xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+        if (i >= http_access_count) {
+            xSemaphoreGive(http_route_mutex);
+            break;
+        }
+        entry = http_access_log[(http_access_head + HTTP_ACCESS_LOG_SIZE - http_access_count + i) % HTTP_ACCESS_LOG_SIZE];
+        xSemaphoreGive(http_route_mutex);
+
+        const char *method = http_method_str(entry.method);
+        mp_obj_t items[8] = {
+            mp_obj_new_int_from_uint(entry.time_ms),
+            mp_obj_new_str(method, strlen(method)),
+            mp_obj_new_str(entry.uri, strlen(entry.uri)),
+            MP_OBJ_NEW_SMALL_INT(entry.status),
+            mp_obj_new_int_from_uint(entry.stage_us[HTTP_STAGE_CONNECT]),
+            mp_obj_new_int_from_uint(entry.stage_us[HTTP_STAGE_QUEUE]),
+            mp_obj_new_int_from_uint(entry.stage_us[HTTP_STAGE_HANDLER]),
+            mp_obj_new_int_from_uint(entry.stage_us[HTTP_STAGE_SEND]),
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(8, items));
+    }
+    return list;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(httpserver_access_log_obj, httpserver_access_log);
+
+//=============================================================================
+// Uploads (httpserver.upload(path_prefix, dest_dir))
+//=============================================================================
+// PUT <prefix>/<name> stores the raw body as <dest_dir>/<name>; POST <prefix>
+// with multipart/form-data stores every file part under its filename. The
+// body is parsed in the server task as it arrives and written through one
+// fixed buffer into "<name>.part", which is renamed into place once complete
+// (and matching X-Content-SHA256, if the client sent it). Python only hears
+// about stored files.
+//
+// Destinations under /www are written to the www LittleFS partition through
+// ESP-IDF's VFS without the GIL; anything else goes to the MicroPython VFS,
+// taking the GIL for each block only.
+
+#define UPLOAD_ENDPOINT_MAX 2      // Counted in HTTP_URI_HANDLERS_MAX
+#define UPLOAD_BUF_SIZE 4096
+#define UPLOAD_PATH_MAX 128
+#define UPLOAD_BOUNDARY_MAX 70     // RFC 2046
+
+typedef struct {
+    bool active;
+    bool notify;                   // Python callback registered
+    char uri[40];                  // "<prefix>/?*" (must outlive the registration)
+    size_t prefix_len;
+    char dest_dir[64];
+} upload_endpoint_t;
+
+static upload_endpoint_t upload_endpoints[UPLOAD_ENDPOINT_MAX];
+
+MP_REGISTER_ROOT_POINTER(mp_obj_t httpserver_upload_callbacks);  // Per endpoint
+// MicroPython VFS file being written, per server task (HTTP, HTTPS)
+MP_REGISTER_ROOT_POINTER(mp_obj_t httpserver_upload_file[2]);
+
+typedef struct {
+    int slot;                      // httpserver_upload_file index: 0 HTTP, 1 HTTPS
+    bool open;
+    bool native;                   // ESP-IDF VFS (www partition)
+    FILE *fp;
+    char path[UPLOAD_PATH_MAX];
+    char tmp_path[UPLOAD_PATH_MAX + 5];
+    size_t size;
+    mbedtls_sha256_context sha;
+} upload_file_t;
+
+typedef enum {
+    UPLOAD_OK,
+    UPLOAD_ERR_IO,
+    UPLOAD_ERR_SHA
+} upload_result_t;
+
+static bool upload_is_native(const char *path) {
+    return strncmp(path, "/www", 4) == 0 && (path[4] == '/' || path[4] == '\0');
+}
+
+// Names are relative to dest_dir: no absolute paths, "..", or backslashes
+static bool upload_name_valid(const char *name) {
+    if (name[0] == '\0' || name[0] == '/' || strchr(name, '\\')) {
+        return false;
+    }
+    for (const char *p = name; p; p = strchr(p, '/')) {
+        p += *p == '/';
+        if (strncmp(p, "..", 2) == 0 && (p[2] == '/' || p[2] == '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool upload_file_open(upload_file_t *f, const char *dest_dir, const char *name) {
+    int slot = f->slot;
+    memset(f, 0, sizeof(*f));
+    f->slot = slot;
+    f->native = upload_is_native(dest_dir);
+    if ((size_t)snprintf(f->path, sizeof(f->path), "%s/%s", dest_dir, name) >= sizeof(f->path)) {
+        return false;
+    }
+    snprintf(f->tmp_path, sizeof(f->tmp_path), "%s.part", f->path);
+
+    if (f->native) {
+        f->fp = fopen(f->tmp_path, "wb");
+        if (!f->fp) {
+            ESP_LOGE(TAG, "Upload: cannot create %s (errno %d)", f->tmp_path, errno);
+            return false;
+        }
+    } else {
+        bool ok = false;
+        MP_THREAD_GIL_ENTER();
+        nlr_buf_t nlr;
+        if (nlr_push(&nlr) == 0) {
+            mp_obj_t args[2] = { mp_obj_new_str(f->tmp_path, strlen(f->tmp_path)), MP_OBJ_NEW_QSTR(MP_QSTR_wb) };
+            MP_STATE_PORT(httpserver_upload_file)[f->slot] = mp_vfs_open(2, args, (mp_map_t *)&mp_const_empty_map);
+            nlr_pop();
+            ok = true;
+        } else {
+            ESP_LOGE(TAG, "Upload: cannot create %s", f->tmp_path);
+        }
+        MP_THREAD_GIL_EXIT();
+        if (!ok) {
+            return false;
+        }
+    }
+    mbedtls_sha256_init(&f->sha);
+    mbedtls_sha256_starts(&f->sha, 0);
+    f->open = true;
+    return true;
+}
+
+static bool upload_file_write(upload_file_t *f, const char *data, size_t len) {
+    if (len == 0) {
+        return true;
+    }
+    mbedtls_sha256_update(&f->sha, (const unsigned char *)data, len);
+    f->size += len;
+    if (f->native) {
+        return fwrite(data, 1, len, f->fp) == len;
+    }
+
+    bool ok = true;
+    MP_THREAD_GIL_ENTER();
+    mp_obj_t file = MP_STATE_PORT(httpserver_upload_file)[f->slot];
+    const mp_stream_p_t *stream = mp_get_stream(file);
+    while (len > 0) {
+        int errcode;
+        mp_uint_t n = stream->write(file, data, len, &errcode);
+        if (n == MP_STREAM_ERROR || n == 0) {
+            ok = false;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    MP_THREAD_GIL_EXIT();
+    return ok;
+}
+
+// Close the .part file, then move it into place (keep) or delete it.
+// sha256_hex receives the digest; expect_sha256 (hex, may be empty) must match it.
+static upload_result_t upload_file_close(upload_file_t *f, bool keep, const char *expect_sha256, char sha256_hex[65]) {
+    if (!f->open) {
+        return UPLOAD_ERR_IO;
+    }
+    f->open = false;
+    unsigned char digest[32];
+    mbedtls_sha256_finish(&f->sha, digest);
+    mbedtls_sha256_free(&f->sha);
+    for (int i = 0; i < 32; i++) {
+        sprintf(sha256_hex + i * 2, "%02x", digest[i]);
+    }
+    upload_result_t result = keep ? UPLOAD_OK : UPLOAD_ERR_IO;
+    if (keep && expect_sha256[0] && strcasecmp(expect_sha256, sha256_hex) != 0) {
+        ESP_LOGW(TAG, "Upload: SHA-256 mismatch for %s", f->path);
+        result = UPLOAD_ERR_SHA;
+    }
+
+    if (f->native) {
+        if (fclose(f->fp) != 0 && result == UPLOAD_OK) {
+            result = UPLOAD_ERR_IO;
+        }
+        if (result == UPLOAD_OK) {
+            unlink(f->path);  // rename() may not replace an existing file
+            if (rename(f->tmp_path, f->path) != 0) {
+                result = UPLOAD_ERR_IO;
+            }
+        }
+        if (result != UPLOAD_OK) {
+            unlink(f->tmp_path);
+        } else {
+            webfiles_cache_invalidate(f->path);
+            webfiles_precompress_queue(f->path);
+        }
+        return result;
+    }
+
+    MP_THREAD_GIL_ENTER();
+    mp_obj_t tmp = mp_obj_new_str(f->tmp_path, strlen(f->tmp_path));
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_stream_close(MP_STATE_PORT(httpserver_upload_file)[f->slot]);
+        nlr_pop();
+    } else if (result == UPLOAD_OK) {
+        result = UPLOAD_ERR_IO;
+    }
+    MP_STATE_PORT(httpserver_upload_file)[f->slot] = MP_OBJ_NULL;
+    if (result == UPLOAD_OK) {
+        mp_obj_t path = mp_obj_new_str(f->path, strlen(f->path));
+        if (nlr_push(&nlr) == 0) {
+            mp_vfs_remove(path);
+            nlr_pop();
+        }
+        if (nlr_push(&nlr) == 0) {
+            mp_vfs_rename(tmp, path);
+            nlr_pop();
+        } else {
+            result = UPLOAD_ERR_IO;
+        }
+    }
+    if (result != UPLOAD_OK && nlr_push(&nlr) == 0) {
+        mp_vfs_remove(tmp);
+        nlr_pop();
+    }
+    MP_THREAD_GIL_EXIT();
+    if (result == UPLOAD_OK) {
+        webfiles_cache_invalidate(f->path);
+        webfiles_precompress_queue(f->path);
+    }
+    return result;
+}
+
+// Tell Python about a stored file (if it asked)
+static void upload_notify(int index, const upload_file_t *f, const char *sha256_hex) {
+    if (!upload_endpoints[index].notify) {
+        return;
+    }
+    upload_done_t *done = malloc(sizeof(upload_done_t));
+    if (!done) {
+        return;
+    }
+    done->size = f->size;
+    strcpy(done->sha256, sha256_hex);
+    if (!httpserver_queue_message(HTTP_MSG_UPLOAD, index, f->path, strlen(f->path), done)) {
+        free(done);
+    }
+}
+
+static int upload_recv(httpd_req_t *req, char *buf, size_t len) {
+    for (int retries = 0; retries < HTTP_BODY_RECV_RETRIES; retries++) {
+        int ret = httpd_req_recv(req, buf, len);
+        if (ret != HTTPD_SOCK_ERR_TIMEOUT) {
+            return ret;
+        }
+    }
+    return HTTPD_SOCK_ERR_TIMEOUT;
+}
+
+static const char *upload_find(const char *haystack, size_t len, const char *needle, size_t needle_len) {
+    for (size_t i = 0; i + needle_len <= len; i++) {
+        if (haystack[i] == needle[0] && memcmp(haystack + i, needle, needle_len) == 0) {
+            return haystack + i;
+        }
+    }
+    return NULL;
+}
+
+// Parse one part's headers (NUL-terminated); copies the file name, if the part is a file
+static bool upload_part_filename(const char *headers, char *name, size_t size) {
+    const char *p = strstr(headers, "filename=\"");
+    if (!p) {
+        return false;
+    }
+    p += 10;
+    const char *end = strchr(p, '"');
+    if (!end) {
+        return false;
+    }
+    // Browsers send a bare name, some clients a path: keep the last component
+    for (const char *s = p; s < end; s++) {
+        if (*s == '/' || *s == '\\') {
+            p = s + 1;
+        }
+    }
+    size_t len = end - p;
+    if (len == 0 || len >= size) {
+        return false;
+    }
+    memcpy(name, p, len);
+    name[len] = '\0';
+    return true;
+}
+
+typedef enum {
+    UPLOAD_MP_PREAMBLE,
+    UPLOAD_MP_DELIMITER,           // After a boundary: "--" ends the body, CRLF starts a part
+    UPLOAD_MP_HEADERS,
+    UPLOAD_MP_DATA,
+    UPLOAD_MP_DONE
+} upload_mp_state_t;
+
+// CONTEXT: HTTP server task
+static esp_err_t httpserver_upload_handler(httpd_req_t *req) {
+    upload_endpoint_t *ep = (upload_endpoint_t *)req->user_ctx;
+    int index = ep - upload_endpoints;
+
+    char expect_sha256[65] = "";
+    httpd_req_get_hdr_value_str(req, "X-Content-SHA256", expect_sha256, sizeof(expect_sha256));
+
+    // multipart/form-data; boundary=... (POST), anything else is a raw body (PUT)
+    char content_type[128] = "";
+    httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+    char delim[UPLOAD_BOUNDARY_MAX + 5];  // "\r\n--" + boundary
+    size_t delim_len = 0;
+    bool multipart = strncasecmp(content_type, "multipart/form-data", 19) == 0;
+    if (multipart) {
+        const char *b = strstr(content_type, "boundary=");
+        if (b) {
+            b += 9;
+            bool quoted = *b == '"';
+            b += quoted;
+            size_t len = quoted ? strcspn(b, "\"") : strcspn(b, "; ");
+            if (len > 0 && len <= UPLOAD_BOUNDARY_MAX) {
+                delim_len = snprintf(delim, sizeof(delim), "\r\n--%.*s", (int)len, b);
+            }
+        }
+        if (delim_len == 0) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing multipart boundary");
+            return ESP_FAIL;
+        }
+    } else if (req->method != HTTP_PUT) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Use PUT or multipart/form-data");
+        return ESP_FAIL;
+    }
+
+    // PUT: the name is the path below the prefix
+    char name[UPLOAD_PATH_MAX];
+    if (!multipart) {
+        const char *rest = req->uri + ep->prefix_len;
+        rest += *rest == '/';
+        size_t len = strcspn(rest, "?");
+        if (len >= sizeof(name)) {
+            len = 0;
+        }
+        memcpy(name, rest, len);
+        name[len] = '\0';
+        if (!upload_name_valid(name)) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid file name");
+            return ESP_FAIL;
+        }
+    }
+
+    if (!upload_is_native(ep->dest_dir) && !httpserver_ensure_mp_thread_state()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Thread init failed");
+        return ESP_FAIL;
+    }
+
+    char *buf = malloc(UPLOAD_BUF_SIZE);
+    if (!buf) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+
+    upload_file_t file = { .slot = req->handle == https_server, .open = false };
+    char sha256_hex[65] = "";
+    const char *error = NULL;
+    httpd_err_code_t error_code = HTTPD_400_BAD_REQUEST;
+    int stored = 0;
+    size_t stored_bytes = 0;
+    size_t remaining = req->content_len;
+    size_t len = 0;
+    upload_mp_state_t state = multipart ? UPLOAD_MP_PREAMBLE : UPLOAD_MP_DATA;
+
+    if (!multipart && !upload_file_open(&file, ep->dest_dir, name)) {
+        error = "Cannot create file";
+        error_code = HTTPD_500_INTERNAL_SERVER_ERROR;
+    }
+
+    while (!error && state != UPLOAD_MP_DONE) {
+        if (remaining > 0 && len < UPLOAD_BUF_SIZE) {
+            size_t want = UPLOAD_BUF_SIZE - len < remaining ? UPLOAD_BUF_SIZE - len : remaining;
+            int n = upload_recv(req, buf + len, want);
+            if (n <= 0) {
+                error = "Upload interrupted";
+                break;
+            }
+            len += n;
+            remaining -= n;
+        }
+
+        // Raw body: everything goes to the file
+        if (!multipart) {
+            if (!upload_file_write(&file, buf, len)) {
+                error = "Write failed";
+                error_code = HTTPD_500_INTERNAL_SERVER_ERROR;
+            }
+            len = 0;
+            if (remaining == 0) {
+                state = UPLOAD_MP_DONE;
+            }
+            continue;
+        }
+
+        size_t used = 0;
+        bool need_more = false;
+        while (!error && !need_more && state != UPLOAD_MP_DONE) {
+            char *p = buf + used;
+            size_t avail = len - used;
+            switch (state) {
+                case UPLOAD_MP_PREAMBLE: {
+                    // The first boundary has no CRLF in front of it
+                    const char *d = upload_find(p, avail, delim + 2, delim_len - 2);
+                    if (d) {
+                        used += d - p + delim_len - 2;
+                        state = UPLOAD_MP_DELIMITER;
+                    } else {
+                        used += avail > delim_len ? avail - delim_len : 0;
+                        need_more = true;
+                    }
+                    break;
+                }
+                case UPLOAD_MP_DELIMITER:
+                    if (avail < 2) {
+                        need_more = true;
+                    } else if (p[0] == '-' && p[1] == '-') {
+                        state = UPLOAD_MP_DONE;
+                    } else if (p[0] == '\r' && p[1] == '\n') {
+                        used += 2;
+                        state = UPLOAD_MP_HEADERS;
+                    } else {
+                        error = "Malformed multipart body";
+                    }
+                    break;
+                case UPLOAD_MP_HEADERS: {
+                    const char *end = upload_find(p, avail, "\r\n\r\n", 4);
+                    size_t headers_len = end ? (size_t)(end - p) + 4 : 0;
+                    if (avail >= 2 && p[0] == '\r' && p[1] == '\n') {
+                        headers_len = 2;  // Part without headers
+                        end = p;
+                    }
+                    if (!end) {
+                        if (used == 0 && len == UPLOAD_BUF_SIZE) {
+                            error = "Part headers too large";
+                        }
+                        need_more = true;
+                        break;
+                    }
+                    p[headers_len - 2] = '\0';
+                    if (upload_part_filename(p, name, sizeof(name))) {
+                        if (!upload_name_valid(name)) {
+                            error = "Invalid file name";
+                        } else if (expect_sha256[0] && stored > 0) {
+                            error = "X-Content-SHA256 allows one file per request";
+                        } else if (!upload_file_open(&file, ep->dest_dir, name)) {
+                            error = "Cannot create file";
+                            error_code = HTTPD_500_INTERNAL_SERVER_ERROR;
+                        }
+                    }
+                    used += headers_len;
+                    state = UPLOAD_MP_DATA;
+                    break;
+                }
+                case UPLOAD_MP_DATA: {
+                    // Data runs up to CRLF--boundary; keep a possible partial match
+                    const char *d = upload_find(p, avail, delim, delim_len);
+                    size_t data_len = d ? (size_t)(d - p) : (avail >= delim_len ? avail - delim_len + 1 : 0);
+                    if (file.open && !upload_file_write(&file, p, data_len)) {
+                        error = "Write failed";
+                        error_code = HTTPD_500_INTERNAL_SERVER_ERROR;
+                        break;
+                    }
+                    used += data_len;
+                    if (!d) {
+                        need_more = true;
+                        break;
+                    }
+                    used += delim_len;
+                    state = UPLOAD_MP_DELIMITER;
+                    if (file.open) {
+                        upload_result_t result = upload_file_close(&file, true, expect_sha256, sha256_hex);
+                        if (result == UPLOAD_ERR_SHA) {
+                            error = "SHA-256 mismatch";
+                        } else if (result != UPLOAD_OK) {
+                            error = "Write failed";
+                            error_code = HTTPD_500_INTERNAL_SERVER_ERROR;
+                        } else {
+                            stored++;
+                            stored_bytes += file.size;
+                            upload_notify(index, &file, sha256_hex);
+                        }
+                    }
+                    break;
+                }
+                case UPLOAD_MP_DONE:
+                    break;
+            }
         }
-
-        // Get file size using seek
-        const mp_stream_p_t *key_stream = mp_get_stream(key_file_obj);
-        seek_s.offset = 0;
-        seek_s.whence = 2; // SEEK_END
-        int key_err;
-        key_stream->ioctl(key_file_obj, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &key_err);
-        long key_size = seek_s.offset;
-        
-        // Seek back to beginning
-        seek_s.offset = 0;
-        seek_s.whence = 0; // SEEK_SET
-        key_stream->ioctl(key_file_obj, MP_STREAM_SEEK, (mp_uint_t)(uintptr_t)&seek_s, &key_err);
-
-        server_key = malloc(key_size + 1);
-        if (!server_key) {
-            ESP_LOGE(TAG, "Failed to allocate memory for key (%ld bytes)", key_size);
-            mp_stream_close(key_file_obj);
-            free(server_cert);
-            server_cert = NULL;
-            vSemaphoreDelete(connection_tracking.mutex);
-            connection_tracking.mutex = NULL;
-            return mp_obj_new_bool(false);
+        memmove(buf, buf + used, len - used);
+        len -= used;
+        if (!error && need_more && remaining == 0) {
+            error = "Truncated multipart body";
         }
-
-        read_size = key_stream->read(key_file_obj, server_key, key_size, &key_err);
-        mp_stream_close(key_file_obj);
-        server_key[read_size] = '\0';
-        server_key_len = read_size + 1;
-
-        use_https = true;
-        ESP_LOGI(TAG, "SSL certificates loaded (cert: %zu bytes, key: %zu bytes)",
-                 server_cert_len, server_key_len);
-    } else if (has_cert || has_key) {
-        ESP_LOGE(TAG, "Both cert_file and key_file required for HTTPS");
-        vSemaphoreDelete(connection_tracking.mutex);
-        connection_tracking.mutex = NULL;
-        return mp_obj_new_bool(false);
     }
-
-    // Log current memory status
-    size_t free_heap = esp_get_free_heap_size();
-    size_t min_free_heap = esp_get_minimum_free_heap_size();
-    size_t largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
-    ESP_LOGI(TAG, "Memory status: free_heap=%u, min_free_heap=%u, largest_block=%u", 
-             free_heap, min_free_heap, largest_free_block);
-
-    // Initialize the queue for thread-safe message passing BEFORE starting servers
-    if (!http_queue_initialized) {
-        http_msg_queue = xQueueCreate(50, sizeof(http_queue_msg_t));
-        http_queue_mutex = xSemaphoreCreateMutex();
-
-        if (http_msg_queue != NULL && http_queue_mutex != NULL) {
-            http_queue_initialized = true;
-            ESP_LOGI(TAG, "HTTP queue initialized");
+    free(buf);
+
+    // Raw body complete: move it into place
+    if (!error && !multipart) {
+        upload_result_t result = upload_file_close(&file, true, expect_sha256, sha256_hex);
+        if (result == UPLOAD_ERR_SHA) {
+            error = "SHA-256 mismatch";
+        } else if (result != UPLOAD_OK) {
+            error = "Write failed";
+            error_code = HTTPD_500_INTERNAL_SERVER_ERROR;
         } else {
-            ESP_LOGE(TAG, "Failed to create HTTP queue");
-            vSemaphoreDelete(connection_tracking.mutex);
-            connection_tracking.mutex = NULL;
-            return mp_obj_new_bool(false);
+            stored = 1;
+            stored_bytes = file.size;
+            upload_notify(index, &file, sha256_hex);
         }
     }
-
-    // Initialize handler array on first start
-    static bool handlers_initialized = false;
-    if (!handlers_initialized) {
-        for (int i = 0; i < HTTP_HANDLER_MAX; i++) {
-            http_handlers[i].active = false;
-            http_handlers[i].func = MP_OBJ_NULL;
-            http_handlers[i].uri = NULL;
-            http_handlers[i].method = HTTP_GET;
-        }
-        handlers_initialized = true;
-        ESP_LOGI(TAG, "HTTP handlers initialized");
+    if (file.open) {
+        upload_file_close(&file, false, "", sha256_hex);
     }
 
-    // Start HTTP server on specified port
-    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.uri_match_fn = httpd_uri_match_wildcard;
-    config.stack_size = 8192;
-    config.max_uri_handlers = 12;
-    config.max_open_sockets = 4;  // Reduced from 10 - LWIP default allows max 7 total
-    config.lru_purge_enable = true;
-    config.backlog_conn = 5;
-    config.server_port = args[0].u_int;
+    if (error) {
+        ESP_LOGW(TAG, "Upload to %s failed: %s", ep->dest_dir, error);
+        httpd_resp_send_err(req, error_code, error);
+        return ESP_FAIL;
+    }
 
-    ESP_LOGI(TAG, "Starting HTTP server on port %d", config.server_port);
-    esp_err_t ret = httpd_start(&http_server, &config);
+    char response[128];
+    snprintf(response, sizeof(response), "{\"stored\":%d,\"bytes\":%u,\"sha256\":\"%s\"}",
+             stored, (unsigned)stored_bytes, stored == 1 ? sha256_hex : "");
+    ESP_LOGI(TAG, "Upload to %s: %d file(s), %u bytes", ep->dest_dir, stored, (unsigned)stored_bytes);
+    httpd_resp_set_status(req, stored > 0 ? "201 Created" : "200 OK");
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_sendstr(req, response);
+}
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start HTTP server: %d (0x%x)", ret, ret);
-        // Cleanup
-        if (server_cert) {
-            free(server_cert);
-            server_cert = NULL;
+static void upload_unregister(upload_endpoint_t *ep) {
+    static const httpd_method_t methods[] = { HTTP_PUT, HTTP_POST };
+    for (int m = 0; m < 2; m++) {
+        if (http_server) {
+            httpd_unregister_uri_handler(http_server, ep->uri, methods[m]);
         }
-        if (server_key) {
-            free(server_key);
-            server_key = NULL;
+        if (https_server) {
+            httpd_unregister_uri_handler(https_server, ep->uri, methods[m]);
         }
-        use_https = false;
-        vSemaphoreDelete(connection_tracking.mutex);
-        connection_tracking.mutex = NULL;
-        return mp_obj_new_bool(false);
     }
+    ep->active = false;
+}
 
-    ESP_LOGI(TAG, "HTTP server started successfully on port %d", config.server_port);
+// httpserver.upload(path_prefix, dest_dir, callback=None)
+// callback(path, size, sha256) runs once per stored file. dest_dir=None removes the endpoint.
+static mp_obj_t httpserver_upload(size_t n_args, const mp_obj_t *args) {
+    if (http_server == NULL) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Server not started"));
+    }
+    const char *prefix = mp_obj_str_get_str(args[0]);
+    size_t prefix_len = strlen(prefix);
+    while (prefix_len > 1 && prefix[prefix_len - 1] == '/') {
+        prefix_len--;  // "/upload/" and "/upload" are the same endpoint
+    }
+    if (prefix[0] != '/' || prefix_len + 4 > sizeof(upload_endpoints[0].uri)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid upload prefix"));
+    }
+    const char *dest_dir = args[1] == mp_const_none ? NULL : mp_obj_str_get_str(args[1]);
+    if (dest_dir && (dest_dir[0] != '/' || strlen(dest_dir) >= sizeof(upload_endpoints[0].dest_dir))) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid destination directory"));
+    }
+    mp_obj_t callback = n_args > 2 ? args[2] : mp_const_none;
+    if (callback != mp_const_none && !mp_obj_is_callable(callback)) {
+        mp_raise_TypeError(MP_ERROR_TEXT("callback must be callable"));
+    }
 
-    // Start HTTPS server if certificates were loaded
-    if (use_https) {
-        httpd_ssl_config_t https_conf = HTTPD_SSL_CONFIG_DEFAULT();
-        
-        // Configure HTTPS parameters
-        https_conf.httpd.uri_match_fn = httpd_uri_match_wildcard;
-        https_conf.httpd.stack_size = 10240;  // HTTPS needs more stack
-        https_conf.httpd.max_uri_handlers = 12;
-        https_conf.httpd.max_open_sockets = 3;  // SSL uses more memory per socket, keep total under 7
-        https_conf.httpd.lru_purge_enable = true;
-        https_conf.httpd.backlog_conn = 5;
-        https_conf.port_secure = 443;
-        https_conf.port_insecure = 80;
-        
-        // Disable session tickets to avoid session resumption issues
-        https_conf.session_tickets = false;
-        
-        // Set certificates
-        https_conf.servercert = server_cert;
-        https_conf.servercert_len = server_cert_len;
-        https_conf.prvtkey_pem = server_key;
-        https_conf.prvtkey_len = server_key_len;
+    char uri[sizeof(upload_endpoints[0].uri)];
+    snprintf(uri, sizeof(uri), "%.*s/?*", (int)prefix_len, prefix);
 
-        ESP_LOGI(TAG, "Starting HTTPS server on port 443");
-        
-        ret = httpd_ssl_start(&https_server, &https_conf);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to start HTTPS server: %d (0x%x)", ret, ret);
-            // Continue with HTTP only - don't fail completely
-            use_https = false;
-            free(server_cert);
-            free(server_key);
-            server_cert = NULL;
-            server_key = NULL;
-        } else {
-            ESP_LOGI(TAG, "HTTPS server started successfully on port 443");
+    // Same prefix: replace the registration
+    int index = -1;
+    for (int i = 0; i < UPLOAD_ENDPOINT_MAX; i++) {
+        if (upload_endpoints[i].active && strcmp(upload_endpoints[i].uri, uri) == 0) {
+            upload_unregister(&upload_endpoints[i]);
+            index = i;
         }
     }
-
-    return mp_obj_new_bool(true);
-}
-static MP_DEFINE_CONST_FUN_OBJ_KW(httpserver_start_obj, 0, httpserver_start);
-
-// Register a URI handler
-static mp_obj_t httpserver_on(size_t n_args, const mp_obj_t *args) {
-    httpd_method_t http_method = HTTP_GET; // Default method
-
-    if (n_args < 2 || http_server == NULL || !http_queue_initialized) {
-        mp_raise_ValueError(n_args < 2 ? MP_ERROR_TEXT("Missing arguments") :
-                           http_server == NULL ? MP_ERROR_TEXT("Server not started") :
-                           MP_ERROR_TEXT("Queue not initialized"));
+    if (!dest_dir) {
+        return mp_const_none;
+    }
+    for (int i = 0; index < 0 && i < UPLOAD_ENDPOINT_MAX; i++) {
+        if (!upload_endpoints[i].active) {
+            index = i;
+        }
+    }
+    if (index < 0) {
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("No more upload endpoints available"));
     }
 
-    if (!mp_obj_is_str(args[0]) || !mp_obj_is_callable(args[1])) {
-        mp_raise_TypeError(MP_ERROR_TEXT("String and callable required"));
+    if (MP_STATE_PORT(httpserver_upload_callbacks) == MP_OBJ_NULL) {
+        mp_obj_t items[UPLOAD_ENDPOINT_MAX] = { mp_const_none, mp_const_none };
+        MP_STATE_PORT(httpserver_upload_callbacks) = mp_obj_new_list(UPLOAD_ENDPOINT_MAX, items);
+    }
+    mp_obj_subscr(MP_STATE_PORT(httpserver_upload_callbacks), MP_OBJ_NEW_SMALL_INT(index), callback);
+
+    upload_endpoint_t *ep = &upload_endpoints[index];
+    strcpy(ep->uri, uri);
+    ep->prefix_len = prefix_len;
+    strcpy(ep->dest_dir, dest_dir);
+    size_t dest_len = strlen(ep->dest_dir);
+    if (dest_len > 1 && ep->dest_dir[dest_len - 1] == '/') {
+        ep->dest_dir[dest_len - 1] = '\0';
     }
+    ep->notify = callback != mp_const_none;
 
-    // Check for optional method argument
-    if (n_args >= 3) {
-        if (!mp_obj_is_str(args[2])) {
-            mp_raise_TypeError(MP_ERROR_TEXT("Method must be a string"));
-        }
-        const char *method_str = mp_obj_str_get_str(args[2]);
-        if (strcasecmp(method_str, "POST") == 0) {
-            http_method = HTTP_POST;
-        } else if (strcasecmp(method_str, "GET") != 0) {
-            mp_raise_ValueError(MP_ERROR_TEXT("Method must be 'GET' or 'POST'"));
+    static const httpd_method_t methods[] = { HTTP_PUT, HTTP_POST };
+    esp_err_t ret = ESP_OK;
+    for (int m = 0; m < 2 && ret == ESP_OK; m++) {
+        httpd_uri_t upload_uri = {
+            .uri      = ep->uri,
+            .method   = methods[m],
+            .handler  = httpserver_upload_handler,
+            .user_ctx = ep
+        };
+        ret = httpd_register_uri_handler(http_server, &upload_uri);
+        if (ret == ESP_OK && https_server) {
+            ret = httpd_register_uri_handler(https_server, &upload_uri);
         }
     }
+    ep->active = true;
+    if (ret != ESP_OK) {
+        upload_unregister(ep);
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to register upload path"));
+    }
+    ESP_LOGI(TAG, "Uploads at %s stored in %s", ep->uri, ep->dest_dir);
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_upload_obj, 2, 3, httpserver_upload);
 
-    const char *uri = mp_obj_str_get_str(args[0]);
-    ESP_LOGI(TAG, "Registering handler for URI: %s, Method: %s", uri,
-             http_method == HTTP_GET ? "GET" : "POST");
-    
+//=============================================================================
+// Firmware updates (httpserver.ota(path, authorize, done=None))
+//=============================================================================
+// POST/PUT <path> with the raw application image as the body and its
+// SHA-256 in X-Content-SHA256. authorize() runs in Python while the server
+// task answers 503 + Retry-After, so the server is never held up waiting for
+// it; the client's retry of the same update (size, digest, Authorization)
+// picks up the decision. Once accepted, the body is streamed from the
+// socket through otawriter (image and digest checks) into esp_ota_write in
+// the server task, one UPLOAD_BUF_SIZE block at a time. There is no copy on
+// the filesystem and Python is not involved while the image is written.
+// A verified image is set to boot and done() is called; rebooting is left
+// to Python. Progress goes out on the WBP event channel when webrepl is
+// built in.
+
+#define OTA_AUTHORIZE_TTL_MS 30000      // A decision (or question) is kept this long for the retry
+#define OTA_PROGRESS_STEP (64 * 1024)   // Bytes between progress events
+
+// Progress states, as sent in WBP_EVT_OTA events
+typedef enum {
+    OTA_STATE_STARTED = 0,
+    OTA_STATE_WRITING = 1,
+    OTA_STATE_DONE = 2,
+    OTA_STATE_FAILED = 3
+} ota_state_t;
 
-    // Find a free handler slot
-    int slot = -1;
-    for (int i = 0; i < HTTP_HANDLER_MAX; i++) {
-        if (!http_handlers[i].active) {
-            slot = i;
-            break;
+typedef enum {
+    OTA_AUTH_NONE = 0,
+    OTA_AUTH_PENDING,              // Asked, authorize() has not answered yet
+    OTA_AUTH_ALLOWED,
+    OTA_AUTH_DENIED
+} ota_auth_state_t;
+
+static struct {
+    bool active;
+    char uri[32];
+    SemaphoreHandle_t lock;        // Held by the handler for a whole update
+    SemaphoreHandle_t auth_mutex;  // Guards auth
+    struct {
+        ota_auth_state_t state;
+        uint32_t ticket;           // Matches the queued question
+        int64_t asked_us;
+        size_t size;
+        char sha256[65];
+        char token[128];
+    } auth;                        // The update last asked about
+    const esp_partition_t *partition;
+    esp_ota_handle_t handle;
+    bool flash_error;              // The target (not the image) failed
+} ota;
+
+MP_REGISTER_ROOT_POINTER(mp_obj_t httpserver_ota_callbacks);  // (authorize, done)
+
+static void ota_progress(ota_state_t state, size_t written, size_t total, const char *error) {
+#if HTTPSERVER_WBP_EVENTS
+    wbp_send_ota(state, written, total, error);
+#else
+    (void)state;
+    (void)written;
+    (void)total;
+    (void)error;
+#endif
+}
+
+// CONTEXT: Python task (process_queue)
+static void ota_authorize_reply(uint32_t ticket, bool allowed) {
+    if (!ota.auth_mutex) {
+        return;
+    }
+    xSemaphoreTake(ota.auth_mutex, portMAX_DELAY);
+    if (ota.auth.state == OTA_AUTH_PENDING && ota.auth.ticket == ticket) {
+        ota.auth.state = allowed ? OTA_AUTH_ALLOWED : OTA_AUTH_DENIED;
+    }
+    xSemaphoreGive(ota.auth_mutex);
+}
+
+// Take authorize()'s decision for this update, or ask Python for one and
+// return OTA_AUTH_PENDING without waiting. A decision is used once.
+// CONTEXT: HTTP server task
+static ota_auth_state_t ota_authorize(httpd_req_t *req, const char *sha256_hex) {
+    char token[sizeof(ota.auth.token)] = "";
+    httpd_req_get_hdr_value_str(req, "Authorization", token, sizeof(token));
+
+    xSemaphoreTake(ota.auth_mutex, portMAX_DELAY);
+    bool same = ota.auth.state != OTA_AUTH_NONE && ota.auth.size == req->content_len &&
+                strcmp(ota.auth.sha256, sha256_hex) == 0 && strcmp(ota.auth.token, token) == 0 &&
+                esp_timer_get_time() - ota.auth.asked_us < (int64_t)OTA_AUTHORIZE_TTL_MS * 1000;
+    if (same) {
+        ota_auth_state_t state = ota.auth.state;
+        if (state != OTA_AUTH_PENDING) {
+            ota.auth.state = OTA_AUTH_NONE;
         }
+        xSemaphoreGive(ota.auth_mutex);
+        return state;
     }
 
-    if (slot < 0) {
-        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("No more handler slots available"));
+    // New question; an answer to an earlier one no longer matches the ticket
+    ota.auth.state = OTA_AUTH_NONE;
+    ota.auth.ticket++;
+    ota_request_t *request = malloc(sizeof(ota_request_t));
+    if (request) {
+        request->ticket = ota.auth.ticket;
+        request->size = req->content_len;
+        strcpy(request->sha256, sha256_hex);
+        ota.auth.size = req->content_len;
+        strcpy(ota.auth.sha256, sha256_hex);
+        strcpy(ota.auth.token, token);
+        ota.auth.asked_us = esp_timer_get_time();
+        ota.auth.state = OTA_AUTH_PENDING;
     }
+    xSemaphoreGive(ota.auth_mutex);
 
-    // Store handler info
-    http_handlers[slot].active = true;
-    http_handlers[slot].func = args[1];  // Store the function reference
-    http_handlers[slot].uri = strdup(uri);  // Allocate and store URI
-    http_handlers[slot].method = http_method;  // Store HTTP method
-    
-    if (http_handlers[slot].uri == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate memory for URI");
-        http_handlers[slot].active = false;
-        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate URI memory"));
+    if (request && !httpserver_queue_message(HTTP_MSG_OTA_AUTHORIZE, 0, token, strlen(token), request)) {
+        free(request);
+        xSemaphoreTake(ota.auth_mutex, portMAX_DELAY);
+        ota.auth.state = OTA_AUTH_NONE;  // Ask again on the retry
+        xSemaphoreGive(ota.auth_mutex);
     }
-    
-    // Prevent garbage collection of the function object
-    // by making it a root pointer (persistent)
-    // NOTE: This keeps the function alive for the lifetime of the handler
-    // TODO: May need to handle cleanup in stop() to avoid memory leaks
-
-    ESP_LOGI(TAG, "Stored function %p for handler slot %d (URI: %s, method: %d)", 
-             http_handlers[slot].func, slot, http_handlers[slot].uri, http_method);
-
-    // Register the handler with ESP-IDF HTTP server
-    httpd_uri_t http_uri = {
-        .uri       = uri,
-        .method    = http_method,
-        .handler   = httpserver_handlers[slot],  // Use the appropriate handler function
-        .user_ctx  = (void*)(intptr_t)slot
-    };
+    return OTA_AUTH_PENDING;
+}
 
-    esp_err_t ret = httpd_register_uri_handler(http_server, &http_uri);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register URI handler on HTTP: %d", ret);
-        http_handlers[slot].active = false;
-        free(http_handlers[slot].uri);  // Free allocated URI memory
-        http_handlers[slot].uri = NULL;
-        return mp_obj_new_bool(false);
+static bool ota_target_begin(void *ctx, size_t size) {
+    (void)ctx;
+    // Sequential writes erase each sector as it is reached, not the whole image up front
+    if (size > ota.partition->size ||
+        esp_ota_begin(ota.partition, OTA_WITH_SEQUENTIAL_WRITES, &ota.handle) != ESP_OK) {
+        return false;
     }
+    return true;
+}
 
-    // Register OPTIONS handler for CORS preflight (for all handlers, not just POST)
-    // This enables browser cross-origin requests
-    httpd_uri_t options_uri = {
-        .uri       = uri,
-        .method    = HTTP_OPTIONS,
-        .handler   = httpserver_handlers[slot],  // Uses same handler which checks for OPTIONS
-        .user_ctx  = (void*)(intptr_t)slot
-    };
-    ret = httpd_register_uri_handler(http_server, &options_uri);
-    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_HANDLER_EXISTS) {
-        ESP_LOGW(TAG, "Failed to register OPTIONS handler on HTTP: %d (may already exist)", ret);
+static bool ota_target_write(void *ctx, const void *data, size_t len) {
+    (void)ctx;
+    if (esp_ota_write(ota.handle, data, len) != ESP_OK) {
+        ota.flash_error = true;
+        return false;
     }
+    return true;
+}
 
-    // Also register on HTTPS server if available
-    if (https_server != NULL) {
-        ret = httpd_register_uri_handler(https_server, &http_uri);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to register URI handler on HTTPS: %d", ret);
-            // Don't fail completely - HTTP handler is registered
-        } else {
-            ESP_LOGI(TAG, "Handler also registered on HTTPS server");
-        }
-        
-        // Register OPTIONS on HTTPS too
-        ret = httpd_register_uri_handler(https_server, &options_uri);
-        if (ret != ESP_OK && ret != ESP_ERR_HTTPD_HANDLER_EXISTS) {
-            ESP_LOGW(TAG, "Failed to register OPTIONS handler on HTTPS: %d", ret);
-        }
+static bool ota_target_end(void *ctx) {
+    (void)ctx;
+    // esp_ota_end runs the bootloader's own image verification
+    esp_err_t err = esp_ota_end(ota.handle);
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(ota.partition);
     }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "OTA activation failed: %s", esp_err_to_name(err));
+        ota.flash_error = err != ESP_ERR_OTA_VALIDATE_FAILED;
+        return false;
+    }
+    return true;
+}
 
-    // Return the handler slot
-    return mp_obj_new_int(slot);
+static void ota_target_abort(void *ctx) {
+    (void)ctx;
+    esp_ota_abort(ota.handle);
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_on_obj, 2, 3, httpserver_on);
 
-// Unregister a URI handler
-static mp_obj_t httpserver_off(size_t n_args, const mp_obj_t *args) {
-    httpd_method_t http_method = HTTP_GET; // Default method
+static const otawriter_target_t ota_target = {
+    .begin = ota_target_begin,
+    .write = ota_target_write,
+    .end = ota_target_end,
+    .abort = ota_target_abort,
+};
 
-    if (n_args < 1 || http_server == NULL) {
-        mp_raise_ValueError(n_args < 1 ? MP_ERROR_TEXT("Missing URI argument") :
-                           MP_ERROR_TEXT("Server not started"));
+// CONTEXT: HTTP server task
+static esp_err_t httpserver_ota_handler(httpd_req_t *req) {
+    char sha256_hex[65] = "";
+    uint8_t expect[32];
+    if (httpd_req_get_hdr_value_str(req, "X-Content-SHA256", sha256_hex, sizeof(sha256_hex)) != ESP_OK ||
+        !otawriter_parse_sha256(sha256_hex, expect)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "X-Content-SHA256 required");
+        return ESP_FAIL;
+    }
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (!partition) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No OTA partition");
+        return ESP_FAIL;
+    }
+    if (req->content_len > partition->size) {
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_set_hdr(req, "Connection", "close");
+        httpd_resp_sendstr(req, "Image larger than the OTA partition");
+        return ESP_FAIL;
+    }
+    // One update at a time, across both servers
+    if (xSemaphoreTake(ota.lock, 0) != pdTRUE) {
+        return httpserver_send_busy(req, 30);
+    }
+    ota_auth_state_t auth = ota_authorize(req, sha256_hex);
+    if (auth == OTA_AUTH_PENDING) {
+        // Not read: closing the connection discards the body
+        xSemaphoreGive(ota.lock);
+        httpd_resp_set_hdr(req, "Connection", "close");
+        httpserver_send_busy(req, 1);
+        return ESP_FAIL;
+    }
+    if (auth != OTA_AUTH_ALLOWED) {
+        xSemaphoreGive(ota.lock);
+        ESP_LOGW(TAG, "Firmware update refused");
+        httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "Update not authorized");
+        return ESP_FAIL;
     }
 
-    if (!mp_obj_is_str(args[0])) {
-        mp_raise_TypeError(MP_ERROR_TEXT("URI must be a string"));
+    char *buf = malloc(UPLOAD_BUF_SIZE);
+    otawriter_t *w = malloc(sizeof(otawriter_t));
+    if (!buf || !w) {
+        free(buf);
+        free(w);
+        xSemaphoreGive(ota.lock);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
     }
 
-    // Check for optional method argument
-    if (n_args >= 2) {
-        if (!mp_obj_is_str(args[1])) {
-            mp_raise_TypeError(MP_ERROR_TEXT("Method must be a string"));
+    ESP_LOGI(TAG, "Firmware update: %u bytes to %s", (unsigned)req->content_len, partition->label);
+    ota.partition = partition;
+    ota.flash_error = false;
+    size_t total = req->content_len;
+    size_t next_progress = OTA_PROGRESS_STEP;
+    ota_progress(OTA_STATE_STARTED, 0, total, NULL);
+
+    bool ok = otawriter_begin(w, &ota_target, total, CONFIG_IDF_FIRMWARE_CHIP_ID, expect);
+    while (ok && w->written < total) {
+        size_t want = total - w->written < UPLOAD_BUF_SIZE ? total - w->written : UPLOAD_BUF_SIZE;
+        int n = upload_recv(req, buf, want);
+        if (n <= 0) {
+            otawriter_abort(w, "Upload interrupted");
+            ok = false;
+            break;
         }
-        const char *method_str = mp_obj_str_get_str(args[1]);
-        if (strcasecmp(method_str, "POST") == 0) {
-            http_method = HTTP_POST;
-        } else if (strcasecmp(method_str, "GET") != 0) {
-            mp_raise_ValueError(MP_ERROR_TEXT("Method must be 'GET' or 'POST'"));
+        ok = otawriter_write(w, buf, n);
+        if (ok && w->written >= next_progress) {
+            ota_progress(OTA_STATE_WRITING, w->written, total, NULL);
+            next_progress = w->written + OTA_PROGRESS_STEP;
         }
     }
+    free(buf);
+
+    char version[33] = "";
+    char digest[65] = "";
+    otawriter_version(w, version, sizeof(version));
+    ok = ok && otawriter_end(w, digest);
+    size_t written = w->written;
+    const char *error = w->error;
+    bool flash_error = ota.flash_error;
+    free(w);
+    xSemaphoreGive(ota.lock);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "Firmware update failed after %u bytes: %s", (unsigned)written, error);
+        ota_progress(OTA_STATE_FAILED, written, total, error);
+        httpd_resp_send_err(req, flash_error ? HTTPD_500_INTERNAL_SERVER_ERROR : HTTPD_400_BAD_REQUEST, error);
+        return ESP_FAIL;
+    }
 
-    const char *uri = mp_obj_str_get_str(args[0]);
-    ESP_LOGI(TAG, "Unregistering handler for URI: %s, Method: %s", uri,
-             http_method == HTTP_GET ? "GET" : "POST");
+    ESP_LOGI(TAG, "Firmware %s written to %s, boots on next reset", version[0] ? version : "(unknown)",
+             partition->label);
+    ota_progress(OTA_STATE_DONE, written, total, NULL);
+    upload_done_t *done = malloc(sizeof(upload_done_t));
+    if (done) {
+        done->size = written;
+        strcpy(done->sha256, digest);
+        if (!httpserver_queue_message(HTTP_MSG_OTA_DONE, 0, version, strlen(version), done)) {
+            free(done);
+        }
+    }
 
+    char response[192];
+    snprintf(response, sizeof(response), "{\"bytes\":%u,\"sha256\":\"%s\",\"version\":\"%s\",\"partition\":\"%s\"}",
+             (unsigned)written, digest, version, partition->label);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_sendstr(req, response);
+}
 
-    // Find the matching handler slot first
-    int slot = -1;
-    for (int i = 0; i < HTTP_HANDLER_MAX; i++) {
-        if (http_handlers[i].active && 
-            http_handlers[i].uri != NULL &&
-            strcmp(http_handlers[i].uri, uri) == 0 &&
-            http_handlers[i].method == http_method) {
-            slot = i;
-            break;
+static void ota_unregister(void) {
+    static const httpd_method_t methods[] = { HTTP_PUT, HTTP_POST };
+    for (int m = 0; m < 2; m++) {
+        if (http_server) {
+            httpd_unregister_uri_handler(http_server, ota.uri, methods[m]);
+        }
+        if (https_server) {
+            httpd_unregister_uri_handler(https_server, ota.uri, methods[m]);
         }
     }
+    ota.active = false;
+}
 
-    if (slot < 0) {
-        ESP_LOGW(TAG, "Handler not found for URI: %s, method: %d", uri, http_method);
-        return mp_obj_new_bool(false);
+// httpserver.ota(path, authorize, done=None)
+// authorize(size, sha256, token) -> bool decides whether an update may be
+// written; done(size, sha256, version) runs once it is set to boot.
+// authorize=None removes the endpoint.
+static mp_obj_t httpserver_ota(size_t n_args, const mp_obj_t *args) {
+    if (http_server == NULL) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Server not started"));
     }
-
-    // Unregister from ESP-IDF HTTP server
-    esp_err_t ret = httpd_unregister_uri_handler(http_server, uri, http_method);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to unregister URI handler from HTTP: %d", ret);
-        // Still free our slot even if ESP-IDF unregister failed
+    const char *path = mp_obj_str_get_str(args[0]);
+    if (path[0] != '/' || strlen(path) >= sizeof(ota.uri)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid OTA path"));
+    }
+    mp_obj_t authorize = args[1];
+    mp_obj_t done = n_args > 2 ? args[2] : mp_const_none;
+    if ((authorize != mp_const_none && !mp_obj_is_callable(authorize)) ||
+        (done != mp_const_none && !mp_obj_is_callable(done))) {
+        mp_raise_TypeError(MP_ERROR_TEXT("callback must be callable"));
     }
 
-    // Also unregister from HTTPS server if available
-    if (https_server != NULL) {
-        ret = httpd_unregister_uri_handler(https_server, uri, http_method);
-        if (ret != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to unregister URI handler from HTTPS: %d", ret);
+    if (ota.active) {
+        ota_unregister();
+    }
+    if (authorize == mp_const_none) {
+        MP_STATE_PORT(httpserver_ota_callbacks) = MP_OBJ_NULL;
+        return mp_const_none;
+    }
+    if (!ota.lock) {
+        ota.lock = xSemaphoreCreateMutex();
+        ota.auth_mutex = xSemaphoreCreateMutex();
+        if (!ota.lock || !ota.auth_mutex) {
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to create OTA semaphores"));
         }
     }
-
-    // Free the handler slot and URI memory
-    http_handlers[slot].active = false;
-    http_handlers[slot].func = MP_OBJ_NULL;
-    if (http_handlers[slot].uri != NULL) {
-        free(http_handlers[slot].uri);
-        http_handlers[slot].uri = NULL;
+    xSemaphoreTake(ota.auth_mutex, portMAX_DELAY);
+    ota.auth.state = OTA_AUTH_NONE;  // Decisions of the old authorize() don't carry over
+    xSemaphoreGive(ota.auth_mutex);
+    mp_obj_t callbacks[2] = { authorize, done };
+    MP_STATE_PORT(httpserver_ota_callbacks) = mp_obj_new_tuple(2, callbacks);
+    strcpy(ota.uri, path);
+
+    static const httpd_method_t methods[] = { HTTP_PUT, HTTP_POST };
+    esp_err_t ret = ESP_OK;
+    for (int m = 0; m < 2 && ret == ESP_OK; m++) {
+        httpd_uri_t ota_uri = {
+            .uri      = ota.uri,
+            .method   = methods[m],
+            .handler  = httpserver_ota_handler,
+            .user_ctx = NULL
+        };
+        ret = httpd_register_uri_handler(http_server, &ota_uri);
+        if (ret == ESP_OK && https_server) {
+            ret = httpd_register_uri_handler(https_server, &ota_uri);
+        }
     }
-
-    ESP_LOGI(TAG, "Handler unregistered successfully for URI: %s (slot %d)", uri, slot);
-
-    return mp_obj_new_bool(true);
+    ota.active = true;
+    if (ret != ESP_OK) {
+        ota_unregister();
+        mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to register OTA path"));
+    }
+    ESP_LOGI(TAG, "Firmware updates at %s", ota.uri);
+    return mp_const_none;
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_off_obj, 1, 2, httpserver_off);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(httpserver_ota_obj, 2, 3, httpserver_ota);
 
 // Stop the HTTP server (and HTTPS if running)
 static mp_obj_t httpserver_stop(void) {
@@ -1093,17 +4673,38 @@ static mp_obj_t httpserver_stop(void) {
         return mp_obj_new_bool(false);  // Server not running
     }
 
-    // Clean up handler registrations
-    for (int i = 0; i < HTTP_HANDLER_MAX; i++) {
-        if (http_handlers[i].active) {
-            http_handlers[i].active = false;
-            http_handlers[i].func = MP_OBJ_NULL;
-            // Free URI memory
-            if (http_handlers[i].uri != NULL) {
-                free(http_handlers[i].uri);
-                http_handlers[i].uri = NULL;
+    // Clean up route registrations
+    xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+    http_route_clear();
+    xSemaphoreGive(http_route_mutex);
+
+    // SSE endpoints go with the servers (their sockets are closed below)
+    if (sse_mutex) {
+        xSemaphoreTake(sse_mutex, portMAX_DELAY);
+        for (int e = 0; e < SSE_ENDPOINT_MAX; e++) {
+            if (sse_endpoints[e].active) {
+                sse_endpoint_reset(&sse_endpoints[e], false);
             }
         }
+        sse_flush_pending[0] = sse_flush_pending[1] = false;
+        xSemaphoreGive(sse_mutex);
+    }
+    if (sse_retry_timer) {
+        esp_timer_stop(sse_retry_timer);
+    }
+
+    http_metrics_path[0] = '\0';
+    for (int i = 0; i < UPLOAD_ENDPOINT_MAX; i++) {
+        upload_endpoints[i].active = false;
+    }
+    ota.active = false;
+    webfiles_server_stopped();
+
+    // Stop the keep-alive sweep before the servers go away
+    if (connection_tracking.sweep_timer) {
+        esp_timer_stop(connection_tracking.sweep_timer);
+        esp_timer_delete(connection_tracking.sweep_timer);
+        connection_tracking.sweep_timer = NULL;
     }
 
     // Stop HTTPS server if running
@@ -1117,16 +4718,7 @@ static mp_obj_t httpserver_stop(void) {
         https_server = NULL;
         
         // Free certificates
-        if (server_cert) {
-            free(server_cert);
-            server_cert = NULL;
-            server_cert_len = 0;
-        }
-        if (server_key) {
-            free(server_key);
-            server_key = NULL;
-            server_key_len = 0;
-        }
+        httpserver_tls_free();
         use_https = false;
     }
 
@@ -1162,6 +4754,7 @@ static mp_obj_t httpserver_send(mp_obj_t content_obj) {
     // Set content type and send the response with explicit length
     httpd_resp_set_type(req, "text/html");
     esp_err_t ret = httpd_resp_send(req, content, content_len);
+    current_response_sent = true;
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to send response: %d", ret);
         return mp_obj_new_bool(false);
@@ -1203,45 +4796,144 @@ static esp_err_t httpserver_options_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-// Implementation of HTTP handler dispatched by each numbered handler
-static esp_err_t httpserver_http_handler_impl(httpd_req_t *req) {
+// Look up the Python route for a request and queue it.
+// CONTEXT: HTTP server task. Returns ESP_ERR_NOT_FOUND if no route matches the
+// path and method (path_found tells a 405 from a 404), otherwise ESP_OK or
+// ESP_FAIL like a URI handler.
+static esp_err_t httpserver_route_dispatch(httpd_req_t *req, bool *path_found) {
+    http_route_match_t match = { .handler_id = -1 };
+    bool found = false;
+    bool matched = false;
+    size_t max_body = 0;
+    http_priority_t priority = HTTP_PRIORITY_NORMAL;
+    uint32_t max_wait_ms = 0;
+    bool over_limit = false;
+    http_cache_entry_t *cached = NULL;
+    int64_t start_us = esp_timer_get_time();
+    size_t len = strcspn(req->uri, "?");  // Match the path only
+    // OPTIONS is answered for any path that has a route (CORS preflight)
+    int method = req->method == HTTP_OPTIONS ? HTTP_ROUTE_METHODS : http_route_method_from_httpd(req->method);
+
+    if (http_route_mutex) {
+        xSemaphoreTake(http_route_mutex, portMAX_DELAY);
+        if (http_route_root) {
+            matched = http_route_match(http_route_root, req->uri, 0, len, method, &match, &found);
+        }
+        if (matched) {
+            http_handler_t *handler = &http_handlers[match.handler_id];
+            match.route_id = handler->id;
+            max_body = handler->max_body;
+            // Cached response still fresh for this exact URI?
+            if (req->method == HTTP_GET && (cached = http_cache_find(handler, req->uri)) != NULL) {
+                cached->refs++;
+            } else if (req->method != HTTP_OPTIONS) {
+                priority = handler->priority;
+                max_wait_ms = handler->max_wait_ms;
+                // Take a concurrency slot now; released once Python answers
+                if (handler->max_concurrent > 0 && handler->concurrent >= handler->max_concurrent) {
+                    over_limit = true;
+                } else {
+                    handler->concurrent++;
+                }
+            }
+        }
+        xSemaphoreGive(http_route_mutex);
+    }
+    if (path_found) {
+        *path_found = found;
+    }
+    if (!matched) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
     // Handle OPTIONS preflight requests for CORS
     if (req->method == HTTP_OPTIONS) {
         return httpserver_options_handler(req);
     }
-    
-    // Get handler ID from user context
-    int handler_id = (int)(intptr_t)req->user_ctx;
 
-    ESP_LOGI(TAG, "HTTP handler called: URI=%s, method=%d, handler_id=%d", 
-             req->uri, req->method, handler_id);
-    
-    if (handler_id < 0 || handler_id >= HTTP_HANDLER_MAX || !http_handlers[handler_id].active) {
-        ESP_LOGE(TAG, "Invalid or inactive handler ID: %d", handler_id);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Invalid handler");
-        return ESP_FAIL;
+    uint32_t connect_us = httpserver_session_connect_us(req);
+
+    // Served from the cache without queueing anything
+    if (cached) {
+        ESP_LOGD(TAG, "HTTP route cache hit: URI=%s", req->uri);
+        int status;
+        esp_err_t ret = httpserver_cache_send(req, cached, &status);
+        httpserver_metrics_record_direct(&match, req, status, connect_us, start_us);
+        return ret;
     }
 
-    // Get the MicroPython function
-    mp_obj_t func = http_handlers[handler_id].func;
+    ESP_LOGI(TAG, "HTTP route matched: URI=%s, method=%d, handler_id=%d",
+             req->uri, req->method, match.handler_id);
 
-    if (func == MP_OBJ_NULL) {
-        ESP_LOGE(TAG, "MicroPython function is NULL for handler %d", handler_id);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Function error");
+    if (over_limit) {
+        ESP_LOGW(TAG, "Route at its concurrency limit, rejecting %s", req->uri);
+        xSemaphoreTake(http_queue_mutex, portMAX_DELAY);
+        http_admission.shed_concurrency++;
+        xSemaphoreGive(http_queue_mutex);
+        httpserver_send_busy(req, 1);
+        httpserver_metrics_record_direct(&match, req, 503, connect_us, start_us);
+        return ESP_OK;
+    }
+
+    // Reject oversized bodies before anything is read or queued. Returning
+    // ESP_FAIL closes the connection rather than draining the body.
+    if (max_body > 0 && req->content_len > max_body) {
+        ESP_LOGW(TAG, "Request body too large: %d > %d bytes", (int)req->content_len, (int)max_body);
+        httpserver_admission_release(&match);
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        httpd_resp_set_hdr(req, "Connection", "close");
+        httpd_resp_sendstr(req, "Request body too large");
+        httpserver_metrics_record_direct(&match, req, 413, connect_us, start_us);
         return ESP_FAIL;
     }
 
+    if (!httpserver_admit(priority, max_wait_ms)) {
+        ESP_LOGW(TAG, "Python queue backed up, rejecting %s", req->uri);
+        httpserver_admission_release(&match);
+        httpserver_send_busy(req, (max_wait_ms + 999) / 1000);
+        httpserver_metrics_record_direct(&match, req, 503, connect_us, start_us);
+        return ESP_OK;
+    }
+
     // Queue the request for MicroPython processing
-    if (httpserver_queue_web_request(handler_id, req, func)) {
+    if (httpserver_queue_web_request(&match, req, priority, connect_us)) {
         ESP_LOGI(TAG, "Request queued successfully for async processing");
         // Note: We don't send a response here - that will be done asynchronously
         // The async copy will be completed in httpserver_process_web_request
         return ESP_OK;
     } else {
         ESP_LOGE(TAG, "Failed to queue request");
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to queue message");
-        return ESP_FAIL;
+        httpserver_admission_release(&match);
+        xSemaphoreTake(http_queue_mutex, portMAX_DELAY);
+        http_admission.shed_busy++;
+        xSemaphoreGive(http_queue_mutex);
+        httpserver_send_busy(req, 1);
+        httpserver_metrics_record_direct(&match, req, 503, connect_us, start_us);
+        return ESP_OK;
+    }
+}
+
+// Catch-all for Python routes: registered as the 404 and 405 error handler,
+// so it only sees requests no C module URI handler took
+static esp_err_t httpserver_route_err_handler(httpd_req_t *req, httpd_err_code_t error) {
+    bool path_found = false;
+    esp_err_t ret = httpserver_route_dispatch(req, &path_found);
+    if (ret != ESP_ERR_NOT_FOUND) {
+        return ret;
     }
+    // Answered here in the server task; the VM never sees unknown routes
+    if (path_found || error == HTTPD_405_METHOD_NOT_ALLOWED) {
+        httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, NULL);
+    } else {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, NULL);
+    }
+    return ESP_OK;
+}
+
+// For C handlers that cover a whole prefix (webfiles): lets Python routes
+// below the prefix take precedence. Returns ESP_ERR_NOT_FOUND if no route matched.
+esp_err_t httpserver_route_request(httpd_req_t *req) {
+    return httpserver_route_dispatch(req, NULL);
 }
 
 // ------------------------------------------------------------------------
@@ -1254,15 +4946,85 @@ static mp_obj_t httpserver_https_running(void) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_0(httpserver_https_running_obj, httpserver_https_running);
 
+// Get connection/keep-alive statistics
+static mp_obj_t httpserver_stats(void) {
+    mp_obj_t dict = mp_obj_new_dict(21);
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_open_connections), mp_obj_new_int_from_uint(connection_tracking.count));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_http_connections), mp_obj_new_int_from_uint(connection_tracking.http_connections));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_tls_handshakes), mp_obj_new_int_from_uint(connection_tracking.tls_handshakes));
+
+    // Handshake timing, snapshot together
+    http_histogram_t tls_time[2] = {0};
+    uint32_t tls_max_us = 0;
+    if (connection_tracking.mutex) {
+        xSemaphoreTake(connection_tracking.mutex, portMAX_DELAY);
+        memcpy(tls_time, connection_tracking.tls_handshake_time, sizeof(tls_time));
+        tls_max_us = connection_tracking.tls_handshake_max_us;
+        xSemaphoreGive(connection_tracking.mutex);
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_tls_resumed), mp_obj_new_int_from_uint(tls_time[1].count));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_tls_full_avg_ms),
+                      mp_obj_new_int_from_uint(tls_time[0].count ? tls_time[0].total_us / tls_time[0].count / 1000 : 0));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_tls_resumed_avg_ms),
+                      mp_obj_new_int_from_uint(tls_time[1].count ? tls_time[1].total_us / tls_time[1].count / 1000 : 0));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_tls_handshake_max_ms), mp_obj_new_int_from_uint(tls_max_us / 1000));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_requests), mp_obj_new_int_from_uint(connection_tracking.requests));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_reused), mp_obj_new_int_from_uint(connection_tracking.reused));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_idle_closes), mp_obj_new_int_from_uint(connection_tracking.idle_closes));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_limit_closes), mp_obj_new_int_from_uint(connection_tracking.limit_closes));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_cache_hits), mp_obj_new_int_from_uint(http_cache_stats.hits));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_cache_not_modified), mp_obj_new_int_from_uint(http_cache_stats.not_modified));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_cache_stores), mp_obj_new_int_from_uint(http_cache_stats.stores));
+
+    // Snapshot the admission counters together (all zero before the first start)
+    uint16_t pending = 0;
+    uint32_t dequeued = 0;
+    uint64_t wait_total_us = 0;
+    uint32_t wait_max_us = 0;
+    uint32_t shed_busy = 0;
+    uint32_t shed_concurrency = 0;
+    uint32_t expired = 0;
+    if (http_queue_mutex) {
+        xSemaphoreTake(http_queue_mutex, portMAX_DELAY);
+        pending = http_admission.pending;
+        dequeued = http_admission.dequeued;
+        wait_total_us = http_admission.wait_total_us;
+        wait_max_us = http_admission.wait_max_us;
+        shed_busy = http_admission.shed_busy;
+        shed_concurrency = http_admission.shed_concurrency;
+        expired = http_admission.expired;
+        xSemaphoreGive(http_queue_mutex);
+    }
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_queued), mp_obj_new_int_from_uint(pending));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_dequeued), mp_obj_new_int_from_uint(dequeued));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_queue_wait_avg_ms),
+                      mp_obj_new_int_from_uint(dequeued ? wait_total_us / dequeued / 1000 : 0));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_queue_wait_max_ms), mp_obj_new_int_from_uint(wait_max_us / 1000));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_shed_busy), mp_obj_new_int_from_uint(shed_busy));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_shed_concurrency), mp_obj_new_int_from_uint(shed_concurrency));
+    mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_expired), mp_obj_new_int_from_uint(expired));
+    return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(httpserver_stats_obj, httpserver_stats);
+
 // Module globals table
 static const mp_rom_map_elem_t httpserver_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_httpserver) },
+    { MP_ROM_QSTR(MP_QSTR___init__), MP_ROM_PTR(&httpserver_module_init_obj) },
     { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&httpserver_start_obj) },
     { MP_ROM_QSTR(MP_QSTR_on), MP_ROM_PTR(&httpserver_on_obj) },
     { MP_ROM_QSTR(MP_QSTR_off), MP_ROM_PTR(&httpserver_off_obj) },
+    { MP_ROM_QSTR(MP_QSTR_invalidate), MP_ROM_PTR(&httpserver_invalidate_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sse), MP_ROM_PTR(&httpserver_sse_obj) },
+    { MP_ROM_QSTR(MP_QSTR_metrics), MP_ROM_PTR(&httpserver_metrics_obj) },
+    { MP_ROM_QSTR(MP_QSTR_access_log), MP_ROM_PTR(&httpserver_access_log_obj) },
+    { MP_ROM_QSTR(MP_QSTR_upload), MP_ROM_PTR(&httpserver_upload_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ota), MP_ROM_PTR(&httpserver_ota_obj) },
     { MP_ROM_QSTR(MP_QSTR_send), MP_ROM_PTR(&httpserver_send_obj) },
     { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&httpserver_stop_obj) },
     { MP_ROM_QSTR(MP_QSTR_process_queue), MP_ROM_PTR(&httpserver_process_queue_obj) },
+    { MP_ROM_QSTR(MP_QSTR_next_event), MP_ROM_PTR(&httpserver_next_event_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&httpserver_stats_obj) },
     { MP_ROM_QSTR(MP_QSTR_https_running), MP_ROM_PTR(&httpserver_https_running_obj) },
 };
 
@@ -1276,3 +5038,5 @@ const mp_obj_module_t httpserver_module = {
 };
 
 MP_REGISTER_MODULE(MP_QSTR_httpserver, httpserver_module);
+MP_REGISTER_ROOT_POINTER(mp_obj_t httpserver_event_flag);
+MP_REGISTER_ROOT_POINTER(mp_obj_t httpserver_event_guard);  // Finalised on soft reset
@@ -3,7 +3,7 @@
  *
  * Provides high-performance static file serving with:
  * - Direct file streaming from MicroPython VFS
- * - Automatic gzip compression support
+ * - Precompressed .br/.gz variants, generated in the background
  * - MIME type detection
  * - Cache control headers
  *
@@ -18,6 +18,8 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
+#include <time.h>
+#include <ctype.h>
 
 // ESP-IDF includes
 #define LOG_LOCAL_LEVEL ESP_LOG_INFO
@@ -28,6 +30,17 @@
 #include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_partition.h"
+
+// The deflate compressor in the chip ROM (miniz), for .gz variants
+#if __has_include("rom/miniz.h")
+#include "rom/miniz.h"
+#include "esp_rom_crc.h"
+#define WEBFILES_PRECOMPRESS 1
+#else
+#define WEBFILES_PRECOMPRESS 0
+#endif
 
 // MicroPython includes
 #include "py/runtime.h"
@@ -38,9 +51,13 @@
 #include "py/mpthread.h"
 #include "extmod/vfs.h"
 
+#include "webbundle.h"
+
 // External functions from httpserver module
 extern httpd_handle_t httpserver_get_handle(void);
+extern httpd_handle_t httpserver_get_https_handle(void);
 extern bool httpserver_ensure_mp_thread_state(void);
+extern esp_err_t httpserver_route_request(httpd_req_t *req);
 
 // Tag for logging
 static const char *TAG = "WEBFILES";
@@ -56,12 +73,95 @@ static bool www_partition_mounted = false;
 static bool www_partition_readonly = true;
 static const char *www_mount_point = "/www";
 
+// Asset bundle mapped from a flash partition (webfiles.serve_bundle())
+static webbundle_t bundle;
+static esp_partition_mmap_handle_t bundle_mmap;
+static char bundle_partition[17];
+#define BUNDLE_PREFIX_MAX 2        // Counted in HTTP_URI_HANDLERS_MAX (x GET/HEAD)
+static int bundle_prefixes;        // Registered on the running server
+
 // Maximum file path length
 #define FILE_PATH_MAX 128
 
 // Scratch buffer size for file transfers
 #define SCRATCH_BUFSIZE 4096
 
+// MicroPython VFS file currently being streamed by webfiles_handler
+MP_REGISTER_ROOT_POINTER(mp_obj_t webfiles_open_file);
+
+// Cache-Control policies, matched by extension ("*" is the fallback).
+// Names with a content hash (app.3f9a1c2b.js, index-BQ3kVl2m.js) never change
+// under the same URL, so they get the "hashed" policy instead.
+#define CACHE_POLICY_MAX 16
+#define CACHE_POLICY_LEN 64
+
+typedef struct {
+    char ext[12];
+    char value[CACHE_POLICY_LEN];
+} cache_policy_t;
+
+static cache_policy_t cache_policies[CACHE_POLICY_MAX] = {
+    { ".html", "no-cache" },
+    { "*", "max-age=3600" },
+};
+static char cache_policy_hashed[CACHE_POLICY_LEN] = "public, max-age=31536000, immutable";
+
+// Validators for a served file; strings outlive the response headers
+typedef struct {
+    char etag[32];
+    char last_modified[32];
+} webfiles_validators_t;
+
+// A hash segment is the part between the last '.' or '-' and the extension:
+// at least 8 characters of [A-Za-z0-9_] with both letters and digits
+static bool webfiles_is_hashed_name(const char *path) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *ext = strrchr(name, '.');
+    if (!ext) {
+        return false;
+    }
+    const char *start = ext;
+    while (start > name && start[-1] != '.' && start[-1] != '-') {
+        start--;
+    }
+    if (start == name || ext - start < 8) {
+        return false;
+    }
+    bool digit = false, alpha = false;
+    for (const char *p = start; p < ext; p++) {
+        if (*p >= '0' && *p <= '9') {
+            digit = true;
+        } else if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z')) {
+            alpha = true;
+        } else if (*p != '_') {
+            return false;
+        }
+    }
+    return digit && alpha;
+}
+
+// Cache-Control value for a file, or NULL to send none
+static const char *webfiles_cache_policy(const char *path) {
+    if (cache_policy_hashed[0] && webfiles_is_hashed_name(path)) {
+        return cache_policy_hashed;
+    }
+    const char *ext = strrchr(path, '.');
+    const char *fallback = NULL;
+    for (int i = 0; i < CACHE_POLICY_MAX; i++) {
+        if (!cache_policies[i].ext[0]) {
+            continue;
+        }
+        if (ext && strcasecmp(cache_policies[i].ext, ext) == 0) {
+            return cache_policies[i].value;
+        }
+        if (strcmp(cache_policies[i].ext, "*") == 0) {
+            fallback = cache_policies[i].value;
+        }
+    }
+    return fallback;
+}
+
 // MIME Type Mapping
 static const struct {
     const char *extension;
@@ -106,111 +206,1220 @@ const char* webfiles_get_mime_type(const char *path) {
 }
 
 
-// Resolve gzip version of file if available
-// This function uses mp_vfs_stat() so it MUST be called with GIL held
-void webfiles_resolve_gzip(char *filepath, size_t filepath_size, const char *accept_encoding, bool *use_compression) {
-    *use_compression = false;
+// Content codings a file may also be stored in, as <file>.gz or <file>.br
+typedef enum {
+    WEBFILES_ENC_IDENTITY = 0,
+    WEBFILES_ENC_GZIP,
+    WEBFILES_ENC_BR,
+    WEBFILES_ENCODINGS
+} webfiles_encoding_t;
+
+static const struct {
+    const char *name;    // Content-Encoding
+    const char *suffix;  // Appended to the file name
+    const char *tag;     // Appended to the ETag, one representation each
+} webfiles_encodings[] = {
+    [WEBFILES_ENC_IDENTITY] = { "identity", "", "" },
+    [WEBFILES_ENC_GZIP] = { "gzip", ".gz", "-gz" },
+    [WEBFILES_ENC_BR] = { "br", ".br", "-br" },
+};
+
+// Text formats worth storing compressed. Images and fonts already are.
+static bool webfiles_is_compressible(const char *path) {
+    static const char *const exts[] = {
+        ".html", ".htm", ".css", ".js", ".mjs", ".svg", ".json", ".wasm", ".map", NULL
+    };
+    const char *ext = strrchr(path, '.');
+    for (int i = 0; ext && exts[i]; i++) {
+        if (strcasecmp(ext, exts[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// q-value in thousandths ("q=0.8" -> 800); 1000 when absent or malformed
+static int webfiles_parse_q(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == ';')) {
+        p++;
+    }
+    if (end - p < 3 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=' || p[2] != '0') {
+        return 1000;  // Also "q=1" and "q=1.0"
+    }
+    int q = 0;
+    p += 3;
+    if (p < end && *p == '.') {
+        int scale = 100;
+        for (p++; p < end && *p >= '0' && *p <= '9' && scale > 0; p++, scale /= 10) {
+            q += (*p - '0') * scale;
+        }
+    }
+    return q;
+}
+
+// Codings the client takes, most preferred first, packed two bits each
+// (first choice in the low bits; 0 = identity ends the list). Follows the
+// Accept-Encoding q-values: q=0 refuses a coding and "*" covers unlisted
+// ones. Ties go to br, which is smaller.
+static uint8_t webfiles_accept_encodings(const char *header) {
+    int q_gzip = -1, q_br = -1, q_any = -1;
+    const char *p = header;
+    while (p && *p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        const char *end = strchr(p, ',');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        size_t len = strcspn(p, " ;,");
+        int q = webfiles_parse_q(p + len, end);
+        if ((len == 4 && strncasecmp(p, "gzip", 4) == 0) || (len == 6 && strncasecmp(p, "x-gzip", 6) == 0)) {
+            q_gzip = q;
+        } else if (len == 2 && strncasecmp(p, "br", 2) == 0) {
+            q_br = q;
+        } else if (len == 1 && *p == '*') {
+            q_any = q;
+        }
+        p = end;
+    }
+    if (q_gzip < 0) {
+        q_gzip = q_any;
+    }
+    if (q_br < 0) {
+        q_br = q_any;
+    }
+
+    uint8_t accept = 0;
+    if (q_br > 0 && q_br >= q_gzip) {
+        accept = WEBFILES_ENC_BR | (q_gzip > 0 ? WEBFILES_ENC_GZIP << 2 : 0);
+    } else if (q_gzip > 0) {
+        accept = WEBFILES_ENC_GZIP | (q_br > 0 ? WEBFILES_ENC_BR << 2 : 0);
+    }
+    return accept;
+}
+
+// Size and mtime (Unix time, 0 if the filesystem keeps none) of a VFS file.
+// Uses mp_vfs_stat() so it MUST be called with GIL held
+static bool webfiles_vfs_stat(const char *path, size_t *size, int64_t *mtime) {
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        // st_size is at index 6, st_mtime at index 8
+        mp_obj_t *items;
+        mp_obj_get_array_fixed_n(mp_vfs_stat(mp_obj_new_str(path, strlen(path))), 10, &items);
+        if (mp_obj_get_int(items[0]) & MP_S_IFDIR) {
+            nlr_pop();
+            return false;
+        }
+        *size = (size_t)mp_obj_get_int_truncated(items[6]);
+        *mtime = mp_obj_get_int_truncated(items[8]);
+        nlr_pop();
+    } else {
+        return false;
+    }
+#if !MICROPY_EPOCH_IS_1970
+    if (*mtime > 0) {
+        *mtime += 946684800;  // MicroPython timestamps count from 2000
+    }
+#endif
+    return true;
+}
+
+// Read a VFS file of exactly `size` bytes into buf; false if it is shorter or
+// longer. Uses the MicroPython VFS so it MUST be called with GIL held
+static bool webfiles_vfs_read_all(const char *path, char *buf, size_t size) {
+    bool ok = false;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { mp_obj_new_str(path, strlen(path)), MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+        mp_obj_t file_obj = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        MP_STATE_PORT(webfiles_open_file) = file_obj;
+        const mp_stream_p_t *stream = mp_get_stream_raise(file_obj, MP_STREAM_OP_READ);
+        size_t got = 0;
+        int errcode;
+        while (got < size) {
+            mp_uint_t len = stream->read(file_obj, buf + got, size - got, &errcode);
+            if (len == MP_STREAM_ERROR || len == 0) {
+                break;
+            }
+            got += len;
+        }
+        // Nothing may follow: the file grew since it was stat'ed
+        char extra;
+        ok = got == size && stream->read(file_obj, &extra, 1, &errcode) == 0;
+        mp_stream_close(file_obj);
+        nlr_pop();
+    }
+    MP_STATE_PORT(webfiles_open_file) = MP_OBJ_NULL;
+    return ok;
+}
+
+// Size and mtime of a file on the /www partition (ESP-IDF VFS)
+static bool webfiles_native_stat(const char *path, size_t *size, int64_t *mtime) {
+    struct stat st;
+    if (stat(path, &st) != 0 || S_ISDIR(st.st_mode)) {
+        return false;
+    }
+    *size = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+// Build full path including base path
+static const char* get_full_path(char *dest, const char *uri, size_t destsize) {
+    size_t base_len = strlen(base_path);
+    size_t prefix_len = strlen(uri_prefix);
+    size_t uri_len = strlen(uri);
+    
+    // Handle query parameters and fragments in URI
+    const char *query = strchr(uri, '?');
+    if (query) {
+        uri_len = query - uri;
+    }
+    const char *fragment = strchr(uri, '#');
+    if (fragment && (!query || fragment < query)) {
+        uri_len = fragment - uri;
+    }
+    
+    // Skip the URI prefix to get the relative path
+    const char *relative_path = uri;
+    if (prefix_len > 1 && strncmp(uri, uri_prefix, prefix_len) == 0) {
+        // Skip the prefix, keeping the trailing slash if present
+        // Example: uri="/diag/test.txt", prefix="/diag" -> relative_path="/test.txt"
+        relative_path = uri + prefix_len;
+        uri_len -= prefix_len;
+    }
     
-    // Only check for common text formats that benefit from compression
-    const char *ext = strrchr(filepath, '.');
-    if (!ext || !(strcasecmp(ext, ".html") == 0 || strcasecmp(ext, ".css") == 0 ||
-                  strcasecmp(ext, ".js") == 0 || strcasecmp(ext, ".svg") == 0)) {
-        return;  // Not a compressible file type
+    // Check if path will fit in destination buffer
+    if (base_len + uri_len + 1 > destsize) {
+        ESP_LOGE(TAG, "Path too long");
+        return NULL;
+    }
+    
+    // Construct full path
+    strcpy(dest, base_path);
+    if (base_len > 0 && base_path[base_len-1] == '/' && relative_path[0] == '/') {
+        // Avoid double slash
+        strlcpy(dest + base_len, relative_path + 1, uri_len);
+    } else {
+        strlcpy(dest + base_len, relative_path, uri_len + 1);
     }
     
-    // Check if client supports gzip
-    if (!accept_encoding || !strstr(accept_encoding, "gzip")) {
-        return;  // Client doesn't support gzip
+    return dest;
+}
+
+// Set content type based on file extension
+// Exported for use by modhttpserver.c
+void webfiles_set_content_type_from_file(httpd_req_t *req, const char *filepath) {
+    const char* mime_type = webfiles_get_mime_type(filepath);
+    httpd_resp_set_type(req, mime_type);
+
+    // Cache-Control from the per-extension policy (webfiles.cache_control())
+    const char *policy = webfiles_cache_policy(filepath);
+    if (policy) {
+        httpd_resp_set_hdr(req, "Cache-Control", policy);
+    }
+
+    // Add CORS headers for development convenience
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+}
+
+// Strong validators from size and mtime. A .gz or .br variant is a different
+// representation, so it gets its own tag. Files without an mtime get none,
+// since size alone would turn edits into false 304s.
+static void webfiles_validators_init(webfiles_validators_t *v, size_t size, int64_t mtime,
+                                     webfiles_encoding_t encoding) {
+    v->etag[0] = '\0';
+    v->last_modified[0] = '\0';
+    if (mtime <= 0) {
+        return;
+    }
+    snprintf(v->etag, sizeof(v->etag), "\"%lx-%llx%s\"",
+             (unsigned long)size, (unsigned long long)mtime, webfiles_encodings[encoding].tag);
+    time_t t = (time_t)mtime;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(v->last_modified, sizeof(v->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// True if any entity tag in an If-None-Match list matches (weak comparison)
+static bool webfiles_etag_listed(const char *list, const char *etag) {
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        while (len > 0 && p[len - 1] == ' ') {
+            len--;
+        }
+        if (len == etag_len && strncmp(p, etag, len) == 0) {
+            return true;
+        }
+        if (!end) {
+            break;
+        }
+        p = end;
+    }
+    return false;
+}
+
+// True when the client's copy is current. If-None-Match takes precedence over
+// If-Modified-Since; the date is compared with the exact Last-Modified string
+// we sent, which is what browsers echo back.
+static bool webfiles_not_modified(httpd_req_t *req, const webfiles_validators_t *v) {
+    if (!v->etag[0]) {
+        return false;
+    }
+    char value[128];
+    size_t len = httpd_req_get_hdr_value_len(req, "If-None-Match");
+    if (len > 0) {
+        return len < sizeof(value) &&
+               httpd_req_get_hdr_value_str(req, "If-None-Match", value, sizeof(value)) == ESP_OK &&
+               webfiles_etag_listed(value, v->etag);
+    }
+    if (httpd_req_get_hdr_value_str(req, "If-Modified-Since", value, sizeof(value)) == ESP_OK) {
+        return strcmp(value, v->last_modified) == 0;
+    }
+    return false;
+}
+
+// File responses are framed with Content-Length. esp_http_server only does
+// that for a body handed over in one piece, so the status line and headers
+// are written here with httpd_send() and the body follows in blocks.
+typedef struct {
+    char buf[640];
+    size_t len;
+} webfiles_head_t;
+
+static void webfiles_head_add(webfiles_head_t *h, const char *name, const char *value) {
+    if (h->len < sizeof(h->buf)) {
+        int n = snprintf(h->buf + h->len, sizeof(h->buf) - h->len, "%s: %s\r\n", name, value);
+        h->len += n > 0 ? (size_t)n : 0;
+    }
+}
+
+// Headers describing the file itself, the same for every status
+static void webfiles_head_add_file(webfiles_head_t *h, const char *type_path, const char *mime,
+                                   webfiles_encoding_t encoding, const webfiles_validators_t *validators) {
+    webfiles_head_add(h, "Content-Type", mime);
+    // Cache-Control from the per-extension policy (webfiles.cache_control())
+    const char *policy = webfiles_cache_policy(type_path);
+    if (policy) {
+        webfiles_head_add(h, "Cache-Control", policy);
+    }
+    // CORS for development convenience
+    webfiles_head_add(h, "Access-Control-Allow-Origin", "*");
+    if (encoding != WEBFILES_ENC_IDENTITY) {
+        webfiles_head_add(h, "Content-Encoding", webfiles_encodings[encoding].name);
+    }
+    // The original may be answered by a variant for other clients
+    if (webfiles_is_compressible(type_path)) {
+        webfiles_head_add(h, "Vary", "Accept-Encoding");
+    }
+    if (validators->etag[0]) {
+        webfiles_head_add(h, "ETag", validators->etag);
+        webfiles_head_add(h, "Last-Modified", validators->last_modified);
+    }
+    webfiles_head_add(h, "Accept-Ranges", "bytes");
+}
+
+// httpd_send() may write less than asked; loop until done or the socket fails
+static esp_err_t webfiles_send_all(httpd_req_t *req, const char *buf, size_t len) {
+    while (len > 0) {
+        int sent = httpd_send(req, buf, len);
+        if (sent <= 0) {
+            return ESP_FAIL;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return ESP_OK;
+}
+
+// Single "bytes=" range from a Range header, suffix form included.
+// Returns 1 with [*start, *end] set, 0 to send the whole file (multiple
+// ranges or a malformed header) or -1 when no byte of the file is covered.
+static int webfiles_parse_range(const char *value, size_t size, size_t *start, size_t *end) {
+    if (strncmp(value, "bytes=", 6) != 0 || strchr(value, ',')) {
+        return 0;
+    }
+    const char *p = value + 6;
+    char *next;
+    if (*p == '-') {
+        unsigned long long suffix = strtoull(p + 1, &next, 10);
+        if (next == p + 1 || *next != '\0') {
+            return 0;
+        }
+        if (suffix == 0 || size == 0) {
+            return -1;
+        }
+        *start = suffix >= size ? 0 : size - (size_t)suffix;
+        *end = size - 1;
+        return 1;
+    }
+    unsigned long long first = strtoull(p, &next, 10);
+    if (next == p || *next != '-') {
+        return 0;
+    }
+    p = next + 1;
+    unsigned long long last = size ? size - 1 : 0;
+    if (*p) {
+        last = strtoull(p, &next, 10);
+        if (*next != '\0' || last < first) {
+            return 0;
+        }
+    }
+    if (first >= size) {
+        return -1;
+    }
+    *start = (size_t)first;
+    *end = last >= size ? size - 1 : (size_t)last;
+    return 1;
+}
+
+// If-Range names the representation the client already has part of; a range
+// only applies while it is still current
+static bool webfiles_if_range_current(httpd_req_t *req, const webfiles_validators_t *v) {
+    char value[64];
+    if (httpd_req_get_hdr_value_str(req, "If-Range", value, sizeof(value)) != ESP_OK) {
+        return httpd_req_get_hdr_value_len(req, "If-Range") == 0;
+    }
+    if (!v->etag[0]) {
+        return false;
+    }
+    return strcmp(value, value[0] == '"' ? v->etag : v->last_modified) == 0;
+}
+
+// Status line and headers for a file, after conditional and Range handling.
+// headers holds the lines describing the file (see webfiles_head_add_file);
+// the status, Content-Range and Content-Length are added here and the whole
+// head goes out in one send. On return the caller sends *length body bytes
+// starting at *offset; that is 0 for HEAD, 304 and 416, where the response
+// is already complete.
+static esp_err_t webfiles_send_head_from(httpd_req_t *req, const char *headers, size_t headers_len,
+                                         const webfiles_validators_t *validators, size_t size,
+                                         size_t *offset, size_t *length) {
+    const char *status = "200 OK";
+    *offset = 0;
+    *length = size;
+    char content_range[48] = "";
+    char range[64];
+    if (webfiles_not_modified(req, validators)) {
+        status = "304 Not Modified";
+        *length = 0;
+    } else if (req->method == HTTP_GET &&
+               httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) == ESP_OK &&
+               webfiles_if_range_current(req, validators)) {
+        size_t start = 0, end = 0;
+        int r = webfiles_parse_range(range, size, &start, &end);
+        if (r > 0) {
+            status = "206 Partial Content";
+            snprintf(content_range, sizeof(content_range), "bytes %lu-%lu/%lu",
+                     (unsigned long)start, (unsigned long)end, (unsigned long)size);
+            *offset = start;
+            *length = end - start + 1;
+        } else if (r < 0) {
+            status = "416 Range Not Satisfiable";
+            snprintf(content_range, sizeof(content_range), "bytes */%lu", (unsigned long)size);
+            *length = 0;
+        }
+    }
+
+    webfiles_head_t h;
+    h.len = snprintf(h.buf, sizeof(h.buf), "HTTP/1.1 %s\r\n", status);
+    if (headers_len < sizeof(h.buf) - h.len) {
+        memcpy(h.buf + h.len, headers, headers_len);
+        h.len += headers_len;
+    } else {
+        h.len = sizeof(h.buf);
+    }
+    if (content_range[0]) {
+        webfiles_head_add(&h, "Content-Range", content_range);
+    }
+    // A 304 has no body and must not advertise one
+    char content_length[24];
+    if (status[0] != '3') {
+        snprintf(content_length, sizeof(content_length), "%lu", (unsigned long)*length);
+        webfiles_head_add(&h, "Content-Length", content_length);
+    }
+    if (h.len + 2 >= sizeof(h.buf)) {
+        ESP_LOGE(TAG, "Response headers too long");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Headers too long");
+        return ESP_FAIL;
+    }
+    memcpy(h.buf + h.len, "\r\n", 2);
+    h.len += 2;
+
+    if (webfiles_send_all(req, h.buf, h.len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (req->method == HTTP_HEAD || status[0] == '4') {
+        *length = 0;
+    }
+    ESP_LOGD(TAG, "%s %s (%lu of %lu bytes)", status, req->uri, (unsigned long)*length, (unsigned long)size);
+    return ESP_OK;
+}
+
+// As above for a file on a filesystem. type_path names the original file
+// when a .gz or .br variant is served; mime is its type.
+static esp_err_t webfiles_send_head(httpd_req_t *req, const char *type_path, const char *mime, size_t size,
+                                    int64_t mtime, webfiles_encoding_t encoding,
+                                    size_t *offset, size_t *length) {
+    webfiles_validators_t validators;
+    webfiles_validators_init(&validators, size, mtime, encoding);
+
+    webfiles_head_t h = { .len = 0 };
+    webfiles_head_add_file(&h, type_path, mime, encoding, &validators);
+    if (h.len >= sizeof(h.buf)) {
+        ESP_LOGE(TAG, "Response headers too long");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Headers too long");
+        return ESP_FAIL;
+    }
+    return webfiles_send_head_from(req, h.buf, h.len, &validators, size, offset, length);
+}
+
+// ------------------------------------------------------------------------
+// Asset cache
+// ------------------------------------------------------------------------
+// Small files are kept whole in PSRAM as a ready-to-send 200 response
+// (status line, headers and body), keyed by the requested path and the
+// codings the client takes. A plain GET hit is one send with no filesystem
+// access; conditional and Range requests on a hit are answered from the
+// same bytes. Least recently used entries are evicted to stay in budget.
+
+typedef struct asset_cache_entry {
+    struct asset_cache_entry *next;  // Towards least recently used
+    uint32_t refs;                   // Cache list plus requests sending it
+    uint32_t generation;             // asset_cache_generation when filled
+    uint32_t checked_ms;             // When size and mtime were last confirmed
+    uint8_t accept;                  // Key: webfiles_accept_encodings()
+    uint8_t encoding;                // Body is this variant (webfiles_encoding_t)
+    int64_t mtime;
+    size_t size;                     // Body bytes
+    size_t head_len;                 // Status line and headers before the body
+    size_t alloc;                    // Bytes charged to the budget
+    char *path;                      // Key: requested file path
+    char *response;                  // head_len + size bytes
+} asset_cache_entry_t;
+
+#define ASSET_CACHE_MAX_FILE_DEFAULT 16384
+
+static asset_cache_entry_t *asset_cache;  // Most recently used first
+static SemaphoreHandle_t asset_cache_mutex = NULL;
+static size_t asset_cache_budget = 0;     // 0 = disabled
+static size_t asset_cache_max_file = ASSET_CACHE_MAX_FILE_DEFAULT;
+static size_t asset_cache_used = 0;
+static uint32_t asset_cache_generation = 0;
+static struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stores;
+    uint32_t evictions;
+} asset_cache_stats;
+
+// Caller holds asset_cache_mutex
+static void asset_cache_unref(asset_cache_entry_t *entry) {
+    if (entry && --entry->refs == 0) {
+        asset_cache_used -= entry->alloc;
+        heap_caps_free(entry);
+    }
+}
+
+static void asset_cache_release(asset_cache_entry_t *entry) {
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    asset_cache_unref(entry);
+    xSemaphoreGive(asset_cache_mutex);
+}
+
+// Caller holds asset_cache_mutex; prev is the entry before it, or NULL
+static void asset_cache_remove(asset_cache_entry_t *prev, asset_cache_entry_t *entry) {
+    if (prev) {
+        prev->next = entry->next;
+    } else {
+        asset_cache = entry->next;
+    }
+    entry->next = NULL;
+    asset_cache_unref(entry);
+}
+
+// Drop least recently used entries until `extra` more bytes fit the budget.
+// Caller holds asset_cache_mutex
+static void asset_cache_evict(size_t extra) {
+    while (asset_cache && asset_cache_used + extra > asset_cache_budget) {
+        asset_cache_entry_t *prev = NULL, *tail = asset_cache;
+        while (tail->next) {
+            prev = tail;
+            tail = tail->next;
+        }
+        asset_cache_remove(prev, tail);
+        asset_cache_stats.evictions++;
+    }
+}
+
+// Returns a referenced entry, moved to the front, or NULL on a miss
+static asset_cache_entry_t *asset_cache_lookup(const char *path, uint8_t accept) {
+    if (!asset_cache_budget) {
+        return NULL;
+    }
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    asset_cache_entry_t *prev = NULL, *entry = asset_cache;
+    while (entry && !(entry->accept == accept && strcmp(entry->path, path) == 0)) {
+        prev = entry;
+        entry = entry->next;
+    }
+    if (entry) {
+        if (prev) {
+            prev->next = entry->next;
+            entry->next = asset_cache;
+            asset_cache = entry;
+        }
+        entry->refs++;
+        asset_cache_stats.hits++;
+    } else {
+        asset_cache_stats.misses++;
+    }
+    xSemaphoreGive(asset_cache_mutex);
+    return entry;
+}
+
+// Allocate an entry for a file about to be read, with its 200 head built.
+// The caller reads `size` bytes to entry->response + entry->head_len and then
+// commits or releases it. NULL if the file is not cacheable or out of PSRAM.
+static asset_cache_entry_t *asset_cache_prepare(const char *path, uint8_t accept, const char *type_path,
+                                                const char *mime, size_t size, int64_t mtime,
+                                                webfiles_encoding_t encoding) {
+    if (!asset_cache_budget || size > asset_cache_max_file) {
+        return NULL;
+    }
+
+    webfiles_validators_t validators;
+    webfiles_validators_init(&validators, size, mtime, encoding);
+    webfiles_head_t h = { .len = 0 };
+    h.len = snprintf(h.buf, sizeof(h.buf), "HTTP/1.1 200 OK\r\n");
+    webfiles_head_add_file(&h, type_path, mime, encoding, &validators);
+    char content_length[24];
+    snprintf(content_length, sizeof(content_length), "%lu", (unsigned long)size);
+    webfiles_head_add(&h, "Content-Length", content_length);
+    if (h.len + 2 >= sizeof(h.buf)) {
+        return NULL;
+    }
+    memcpy(h.buf + h.len, "\r\n", 2);
+    h.len += 2;
+
+    size_t path_len = strlen(path) + 1;
+    size_t alloc = sizeof(asset_cache_entry_t) + path_len + h.len + size;
+    if (alloc > asset_cache_budget) {
+        return NULL;
+    }
+    asset_cache_entry_t *entry = heap_caps_malloc(alloc, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!entry) {
+        return NULL;
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->refs = 1;
+    entry->checked_ms = mp_hal_ticks_ms();
+    entry->accept = accept;
+    entry->encoding = encoding;
+    entry->mtime = mtime;
+    entry->size = size;
+    entry->head_len = h.len;
+    entry->alloc = alloc;
+    entry->path = (char *)(entry + 1);
+    memcpy(entry->path, path, path_len);
+    entry->response = entry->path + path_len;
+    memcpy(entry->response, h.buf, h.len);
+
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    entry->generation = asset_cache_generation;
+    asset_cache_used += alloc;  // Charged now, so unref can always subtract
+    xSemaphoreGive(asset_cache_mutex);
+    return entry;
+}
+
+// Insert a filled entry; the caller keeps its reference. Skipped if the file
+// was invalidated while it was being read.
+static void asset_cache_commit(asset_cache_entry_t *entry) {
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    if (entry->generation == asset_cache_generation && asset_cache_budget) {
+        asset_cache_entry_t *prev = NULL, *old = asset_cache;
+        while (old && !(old->accept == entry->accept && strcmp(old->path, entry->path) == 0)) {
+            prev = old;
+            old = old->next;
+        }
+        if (old) {
+            asset_cache_remove(prev, old);
+        }
+        // This entry is already charged; make room for it
+        asset_cache_evict(0);
+        if (asset_cache_used <= asset_cache_budget) {
+            entry->refs++;
+            entry->next = asset_cache;
+            asset_cache = entry;
+            asset_cache_stats.stores++;
+        }
+    }
+    xSemaphoreGive(asset_cache_mutex);
+}
+
+// Serve a hit and drop the caller's reference. CONTEXT: HTTP server task
+// A GET that a stored 200 response answers as-is
+static bool webfiles_is_plain_get(httpd_req_t *req) {
+    return req->method == HTTP_GET &&
+           httpd_req_get_hdr_value_len(req, "If-None-Match") == 0 &&
+           httpd_req_get_hdr_value_len(req, "If-Modified-Since") == 0 &&
+           httpd_req_get_hdr_value_len(req, "Range") == 0;
+}
+
+static esp_err_t asset_cache_send(httpd_req_t *req, asset_cache_entry_t *entry) {
+    esp_err_t ret;
+    const char *body = entry->response + entry->head_len;
+    if (webfiles_is_plain_get(req)) {
+        ret = webfiles_send_all(req, entry->response, entry->head_len + entry->size);
+    } else {
+        // The key is the requested name, which is also what the type comes from
+        size_t offset = 0, length = 0;
+        ret = webfiles_send_head(req, entry->path, webfiles_get_mime_type(entry->path), entry->size, entry->mtime,
+                                 entry->encoding, &offset, &length);
+        if (ret == ESP_OK && length > 0) {
+            ret = webfiles_send_all(req, body + offset, length);
+        }
+    }
+    asset_cache_release(entry);
+    return ret;
+}
+
+// ------------------------------------------------------------------------
+// Metadata cache
+// ------------------------------------------------------------------------
+// Size and mtime of requested files and of the .gz/.br variants next to
+// them (missing ones included), plus the MIME type. A file requested again
+// is resolved without a single stat, and on the VFS without the GIL until
+// it is opened; a 304 needs neither. Entries are dropped with the asset
+// cache by webfiles_cache_invalidate() and re-checked after meta_ttl_ms,
+// which catches files changed from Python without an invalidate.
+
+#define META_CACHE_ENTRIES      32
+#define META_CACHE_TTL_DEFAULT  2000
+
+typedef struct {
+    char path[FILE_PATH_MAX];        // Key: requested file path ("" = free)
+    uint32_t checked_ms;             // When the filesystem was last asked
+    uint32_t used;                   // meta_cache_clock at the last use, for LRU
+    uint8_t present;                 // Bit per webfiles_encoding_t found
+    const char *mime;
+    size_t size[WEBFILES_ENCODINGS];
+    int64_t mtime[WEBFILES_ENCODINGS];
+} webfiles_meta_t;
+
+static webfiles_meta_t *meta_cache;  // META_CACHE_ENTRIES slots in PSRAM
+static uint32_t meta_cache_ttl_ms = META_CACHE_TTL_DEFAULT;  // 0 = disabled
+static uint32_t meta_cache_clock = 0;
+static struct {
+    uint32_t hits;
+    uint32_t misses;
+} meta_cache_stats;
+
+// Lock shared by both caches, and the metadata table. Called from the
+// setup functions; returns false when out of memory.
+// CONTEXT: Main MicroPython Task
+static bool webfiles_cache_setup(void) {
+    if (!asset_cache_mutex) {
+        asset_cache_mutex = xSemaphoreCreateMutex();
+        if (!asset_cache_mutex) {
+            return false;
+        }
+    }
+    if (!meta_cache) {
+        // Serving still works without it, with a stat per request
+        meta_cache = heap_caps_calloc(META_CACHE_ENTRIES, sizeof(webfiles_meta_t),
+                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    return true;
+}
+
+// Stat a file and, for compressible types, each variant of it. stat_fn is
+// one of the stat helpers above; the VFS one MUST be called with GIL held.
+static void webfiles_meta_probe(webfiles_meta_t *meta, const char *path,
+                                bool (*stat_fn)(const char *, size_t *, int64_t *)) {
+    meta->present = 0;
+    meta->mime = webfiles_get_mime_type(path);
+    int count = webfiles_is_compressible(path) && strlen(path) + 3 < FILE_PATH_MAX ? WEBFILES_ENCODINGS : 1;
+    for (int enc = 0; enc < count; enc++) {
+        char variant[FILE_PATH_MAX];
+        snprintf(variant, sizeof(variant), "%s%s", path, webfiles_encodings[enc].suffix);
+        if (stat_fn(variant, &meta->size[enc], &meta->mtime[enc])) {
+            meta->present |= 1 << enc;
+        }
+    }
+}
+
+// Metadata of path, from the cache while fresh, else probed and stored. vfs
+// picks the MicroPython VFS, whose stats take the GIL here (only on a miss),
+// over the native filesystem.
+// CONTEXT: HTTP server task
+static void webfiles_meta_get(const char *path, bool vfs, webfiles_meta_t *meta) {
+    uint32_t now = mp_hal_ticks_ms();
+    uint32_t generation = 0;
+    bool cache = meta_cache && meta_cache_ttl_ms && asset_cache_mutex;
+    if (cache) {
+        xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+        for (int i = 0; i < META_CACHE_ENTRIES; i++) {
+            webfiles_meta_t *entry = &meta_cache[i];
+            if (strcmp(entry->path, path) == 0) {
+                if (now - entry->checked_ms < meta_cache_ttl_ms) {
+                    entry->used = ++meta_cache_clock;
+                    *meta = *entry;
+                    meta_cache_stats.hits++;
+                    xSemaphoreGive(asset_cache_mutex);
+                    return;
+                }
+                break;
+            }
+        }
+        meta_cache_stats.misses++;
+        generation = asset_cache_generation;
+        xSemaphoreGive(asset_cache_mutex);
+    }
+
+    if (vfs) {
+        MP_THREAD_GIL_ENTER();
+    }
+    webfiles_meta_probe(meta, path, vfs ? webfiles_vfs_stat : webfiles_native_stat);
+    if (vfs) {
+        MP_THREAD_GIL_EXIT();
+    }
+    if (!cache || strlen(path) >= sizeof(meta->path)) {
+        return;
+    }
+
+    // Not stored if the file was invalidated while it was being checked.
+    // Takes the path's old slot, else a free one, else the least recent.
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    if (generation == asset_cache_generation) {
+        webfiles_meta_t *slot = &meta_cache[0];
+        for (int i = 0; i < META_CACHE_ENTRIES; i++) {
+            webfiles_meta_t *entry = &meta_cache[i];
+            if (strcmp(entry->path, path) == 0) {
+                slot = entry;
+                break;
+            }
+            if (slot->path[0] && (!entry->path[0] || entry->used < slot->used)) {
+                slot = entry;
+            }
+        }
+        *slot = *meta;
+        strcpy(slot->path, path);
+        slot->checked_ms = now;
+        slot->used = ++meta_cache_clock;
+    }
+    xSemaphoreGive(asset_cache_mutex);
+}
+
+// Pick what to send: the most preferred coding in `accept` with a variant
+// at least as new as the original (an older one is stale and skipped), else
+// the original. A variant without its original is still served. filepath,
+// the requested file on entry, names the chosen one on return. False if
+// neither exists.
+static bool webfiles_meta_pick(const webfiles_meta_t *meta, uint8_t accept, char *filepath, size_t filepath_size,
+                               webfiles_encoding_t *encoding, size_t *size, int64_t *mtime) {
+    bool found = meta->present & (1 << WEBFILES_ENC_IDENTITY);
+    *encoding = WEBFILES_ENC_IDENTITY;
+    *size = meta->size[WEBFILES_ENC_IDENTITY];
+    *mtime = meta->mtime[WEBFILES_ENC_IDENTITY];
+    for (; accept; accept >>= 2) {
+        webfiles_encoding_t enc = accept & 3;
+        if ((meta->present & (1 << enc)) && (!found || meta->mtime[enc] >= *mtime)) {
+            strlcat(filepath, webfiles_encodings[enc].suffix, filepath_size);
+            *encoding = enc;
+            *size = meta->size[enc];
+            *mtime = meta->mtime[enc];
+            return true;
+        }
+    }
+    return found;
+}
+
+// Drop cached copies of a file (and its .gz/.br variants), or everything when
+// path is NULL or relative. Safe from any task; files being read into the
+// cache right now are not stored. Exported for uploads and WebREPL writes.
+void webfiles_cache_invalidate(const char *path) {
+    if (!asset_cache_mutex) {
+        return;
+    }
+    char key[FILE_PATH_MAX];
+    if (path && path[0] == '/') {
+        strlcpy(key, path, sizeof(key));
+        size_t len = strlen(key);
+        if (len > 3 && (strcmp(key + len - 3, ".gz") == 0 || strcmp(key + len - 3, ".br") == 0)) {
+            key[len - 3] = '\0';
+        }
+    } else {
+        path = NULL;
+    }
+
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    asset_cache_generation++;
+    asset_cache_entry_t *prev = NULL, *entry = asset_cache;
+    while (entry) {
+        asset_cache_entry_t *next = entry->next;
+        if (!path || strcmp(entry->path, key) == 0) {
+            asset_cache_remove(prev, entry);
+        } else {
+            prev = entry;
+        }
+        entry = next;
+    }
+    for (int i = 0; meta_cache && i < META_CACHE_ENTRIES; i++) {
+        if (!path || strcmp(meta_cache[i].path, key) == 0) {
+            meta_cache[i].path[0] = '\0';
+        }
+    }
+    xSemaphoreGive(asset_cache_mutex);
+}
+
+// A hit older than the metadata TTL is checked against what the file looks
+// like now (through the metadata cache), so a file changed from Python
+// without invalidate() is not served from the cache for ever. Returns the
+// entry, or NULL after dropping it. vfs as for webfiles_meta_get().
+// CONTEXT: HTTP server task
+static asset_cache_entry_t *asset_cache_check(asset_cache_entry_t *entry, bool vfs) {
+    uint32_t now = mp_hal_ticks_ms();
+    uint32_t ttl = meta_cache_ttl_ms ? meta_cache_ttl_ms : META_CACHE_TTL_DEFAULT;
+    if (now - entry->checked_ms < ttl || (vfs && !httpserver_ensure_mp_thread_state())) {
+        return entry;
+    }
+    webfiles_meta_t meta;
+    webfiles_meta_get(entry->path, vfs, &meta);
+    char filepath[FILE_PATH_MAX];
+    strlcpy(filepath, entry->path, sizeof(filepath));
+    webfiles_encoding_t encoding;
+    size_t size = 0;
+    int64_t mtime = 0;
+    if (webfiles_meta_pick(&meta, entry->accept, filepath, sizeof(filepath), &encoding, &size, &mtime) &&
+        encoding == entry->encoding && size == entry->size && mtime == entry->mtime) {
+        xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+        entry->checked_ms = now;
+        xSemaphoreGive(asset_cache_mutex);
+        return entry;
+    }
+    webfiles_cache_invalidate(entry->path);
+    asset_cache_release(entry);
+    return NULL;
+}
+
+// ------------------------------------------------------------------------
+// Background precompression
+// ------------------------------------------------------------------------
+// Compressible files stored by copy_to_www(), httpserver.upload() or WebREPL
+// get a .gz variant from a low-priority task. It is written under a .part
+// name and renamed into place, so requests never see half of one, and until
+// then the old variant is skipped as older than its original. .br variants
+// can't be made on the device but are served when uploaded next to a file.
+
+#if WEBFILES_PRECOMPRESS
+
+#define PRECOMPRESS_QUEUE_LEN 16
+#define PRECOMPRESS_MIN_SIZE  512   // Less gains little over the gzip framing
+#define PRECOMPRESS_PROBES    768   // miniz level 9
+#define PRECOMPRESS_STACK     6144
+
+static QueueHandle_t precompress_queue = NULL;
+typedef struct {
+    uint32_t compressed;
+    uint32_t skipped;
+    uint32_t failed;
+    uint32_t dropped;
+} precompress_stats_t;
+static precompress_stats_t precompress_stats;  // Guarded by asset_cache_mutex
+
+static void precompress_count(uint32_t *counter) {
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    (*counter)++;
+    xSemaphoreGive(asset_cache_mutex);
+}
+
+// VFS files the task has open (source, .part), reachable by the GC
+MP_REGISTER_ROOT_POINTER(mp_obj_t webfiles_precompress_files[2]);
+
+// One file of a job: stdio on the www partition, otherwise a MicroPython VFS
+// file kept in its root pointer slot. VFS calls take the GIL per call.
+typedef struct {
+    bool native;
+    int slot;
+    FILE *fp;
+    size_t written;
+} precompress_file_t;
+
+static bool precompress_stat(bool native, const char *path, size_t *size, int64_t *mtime) {
+    if (native) {
+        return webfiles_native_stat(path, size, mtime);
+    }
+    MP_THREAD_GIL_ENTER();
+    bool found = webfiles_vfs_stat(path, size, mtime);
+    MP_THREAD_GIL_EXIT();
+    return found;
+}
+
+static void precompress_remove(bool native, const char *path) {
+    if (native) {
+        unlink(path);
+        return;
+    }
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_vfs_remove(mp_obj_new_str(path, strlen(path)));
+        nlr_pop();
+    }
+    MP_THREAD_GIL_EXIT();
+}
+
+static bool precompress_rename(bool native, const char *from, const char *to) {
+    precompress_remove(native, to);  // rename() may not replace an existing file
+    if (native) {
+        return rename(from, to) == 0;
+    }
+    bool ok = false;
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_vfs_rename(mp_obj_new_str(from, strlen(from)), mp_obj_new_str(to, strlen(to)));
+        nlr_pop();
+        ok = true;
+    }
+    MP_THREAD_GIL_EXIT();
+    return ok;
+}
+
+static bool precompress_open(precompress_file_t *f, const char *path, bool write) {
+    if (f->native) {
+        f->fp = fopen(path, write ? "wb" : "rb");
+        return f->fp != NULL;
+    }
+    bool ok = false;
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { mp_obj_new_str(path, strlen(path)), MP_OBJ_NEW_QSTR(write ? MP_QSTR_wb : MP_QSTR_rb) };
+        MP_STATE_PORT(webfiles_precompress_files)[f->slot] = mp_vfs_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        nlr_pop();
+        ok = true;
+    }
+    MP_THREAD_GIL_EXIT();
+    return ok;
+}
+
+// Bytes read, 0 at the end, -1 on error
+static int precompress_read(precompress_file_t *f, void *buf, size_t len) {
+    if (f->native) {
+        size_t n = fread(buf, 1, len, f->fp);
+        return n == 0 && ferror(f->fp) ? -1 : (int)n;
+    }
+    MP_THREAD_GIL_ENTER();
+    mp_obj_t file = MP_STATE_PORT(webfiles_precompress_files)[f->slot];
+    int errcode;
+    mp_uint_t n = mp_get_stream(file)->read(file, buf, len, &errcode);
+    MP_THREAD_GIL_EXIT();
+    return n == MP_STREAM_ERROR ? -1 : (int)n;
+}
+
+// tdefl output callback, also used for the gzip header and trailer
+static mz_bool precompress_write(const void *buf, int len, void *user) {
+    precompress_file_t *f = user;
+    const uint8_t *data = buf;
+    size_t left = len;
+    if (f->native) {
+        left -= fwrite(data, 1, left, f->fp);
+    } else {
+        MP_THREAD_GIL_ENTER();
+        mp_obj_t file = MP_STATE_PORT(webfiles_precompress_files)[f->slot];
+        const mp_stream_p_t *stream = mp_get_stream(file);
+        while (left > 0) {
+            int errcode;
+            mp_uint_t n = stream->write(file, data, left, &errcode);
+            if (n == MP_STREAM_ERROR || n == 0) {
+                break;
+            }
+            data += n;
+            left -= n;
+        }
+        MP_THREAD_GIL_EXIT();
+    }
+    f->written += len - left;
+    return left == 0;
+}
+
+static bool precompress_close(precompress_file_t *f) {
+    if (f->native) {
+        return fclose(f->fp) == 0;
     }
-    
-    // Try .gz version using MicroPython VFS stat
-    char gz_filepath[FILE_PATH_MAX + 4];  // +4 for ".gz" + null
-    snprintf(gz_filepath, sizeof(gz_filepath), "%s.gz", filepath);
-    
-    // Check if .gz file exists using MicroPython VFS
-    mp_obj_t gz_path_obj = mp_obj_new_str(gz_filepath, strlen(gz_filepath));
-    
-    // Use exception handler to check existence
+    bool ok = false;
+    MP_THREAD_GIL_ENTER();
     nlr_buf_t nlr;
     if (nlr_push(&nlr) == 0) {
-        mp_vfs_stat(gz_path_obj);  // Will raise if doesn't exist
+        mp_stream_close(MP_STATE_PORT(webfiles_precompress_files)[f->slot]);
         nlr_pop();
-        
-        // Success! .gz version exists
-        if (strlen(gz_filepath) < filepath_size) {
-            strcpy(filepath, gz_filepath);
-            *use_compression = true;
-            ESP_LOGI(TAG, "Using gzip version: %s", filepath);
+        ok = true;
+    }
+    MP_STATE_PORT(webfiles_precompress_files)[f->slot] = MP_OBJ_NULL;
+    MP_THREAD_GIL_EXIT();
+    return ok;
+}
+
+// Write <path>.gz, a single gzip member (RFC 1952) around raw deflate
+static void precompress_file(const char *path) {
+    bool native = strncmp(path, www_mount_point, 4) == 0 && path[4] == '/';
+    if (native && (!www_partition_mounted || www_partition_readonly)) {
+        precompress_count(&precompress_stats.skipped);
+        return;
+    }
+    if (!native && !httpserver_ensure_mp_thread_state()) {
+        precompress_count(&precompress_stats.failed);
+        return;
+    }
+
+    char gz_path[FILE_PATH_MAX + 4];
+    char part_path[FILE_PATH_MAX + 9];
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+    snprintf(part_path, sizeof(part_path), "%s.gz.part", path);
+
+    // A .gz at least as new as the original is current, or was uploaded by hand
+    size_t size = 0, gz_size = 0;
+    int64_t mtime = 0, gz_mtime = 0;
+    if (!precompress_stat(native, path, &size, &mtime) || size < PRECOMPRESS_MIN_SIZE ||
+        (mtime > 0 && precompress_stat(native, gz_path, &gz_size, &gz_mtime) && gz_mtime >= mtime)) {
+        precompress_count(&precompress_stats.skipped);
+        return;
+    }
+
+    // The compressor state is ~300 KB, so it only comes from PSRAM
+    tdefl_compressor *comp = heap_caps_malloc(sizeof(tdefl_compressor), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint8_t *buf = malloc(SCRATCH_BUFSIZE);
+    precompress_file_t in = { .native = native, .slot = 0 };
+    precompress_file_t out = { .native = native, .slot = 1 };
+    bool in_open = false, out_open = false;
+    bool ok = comp && buf &&
+              (in_open = precompress_open(&in, path, false)) &&
+              (out_open = precompress_open(&out, part_path, true));
+
+    if (ok) {
+        // Deflate, no name, mtime 0, maximum compression, unknown OS
+        static const uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 2, 0xff };
+        ok = precompress_write(header, sizeof(header), &out) &&
+             tdefl_init(comp, precompress_write, &out, PRECOMPRESS_PROBES) == TDEFL_STATUS_OKAY;
+        uint32_t crc = 0, total = 0;
+        tdefl_status status = TDEFL_STATUS_OKAY;
+        while (ok && status == TDEFL_STATUS_OKAY) {
+            int n = precompress_read(&in, buf, SCRATCH_BUFSIZE);
+            if (n < 0) {
+                ok = false;
+                break;
+            }
+            crc = esp_rom_crc32_le(crc, buf, n);
+            total += n;
+            status = tdefl_compress_buffer(comp, buf, n, n > 0 ? TDEFL_NO_FLUSH : TDEFL_FINISH);
+        }
+        if (ok && status == TDEFL_STATUS_DONE) {
+            const uint8_t trailer[8] = {
+                crc, crc >> 8, crc >> 16, crc >> 24, total, total >> 8, total >> 16, total >> 24
+            };
+            ok = precompress_write(trailer, sizeof(trailer), &out);
         } else {
-            ESP_LOGW(TAG, "Gzip path too long, using original");
+            ok = false;
+        }
+    }
+    if (in_open) {
+        precompress_close(&in);
+    }
+    if (out_open && !precompress_close(&out)) {
+        ok = false;
+    }
+    heap_caps_free(comp);
+    free(buf);
+
+    if (ok && out.written < size) {
+        ok = precompress_rename(native, part_path, gz_path);
+        if (ok) {
+            webfiles_cache_invalidate(path);
+            precompress_count(&precompress_stats.compressed);
+            ESP_LOGI(TAG, "Precompressed %s: %lu -> %lu bytes", path, (unsigned long)size, (unsigned long)out.written);
+            return;
         }
+    }
+    if (out_open) {
+        precompress_remove(native, part_path);
+    }
+    if (ok) {
+        // No smaller than the original; drop any older variant too
+        precompress_remove(native, gz_path);
+        precompress_count(&precompress_stats.skipped);
     } else {
-        // .gz doesn't exist, use original (no logging needed)
-        nlr_pop();
+        ESP_LOGW(TAG, "Precompressing %s failed", path);
+        precompress_count(&precompress_stats.failed);
     }
 }
 
-// Build full path including base path
-static const char* get_full_path(char *dest, const char *uri, size_t destsize) {
-    size_t base_len = strlen(base_path);
-    size_t prefix_len = strlen(uri_prefix);
-    size_t uri_len = strlen(uri);
-    
-    // Handle query parameters and fragments in URI
-    const char *query = strchr(uri, '?');
-    if (query) {
-        uri_len = query - uri;
-    }
-    const char *fragment = strchr(uri, '#');
-    if (fragment && (!query || fragment < query)) {
-        uri_len = fragment - uri;
+static void precompress_task(void *arg) {
+    QueueHandle_t queue = arg;
+    char path[FILE_PATH_MAX];
+    for (;;) {
+        if (xQueueReceive(queue, path, portMAX_DELAY) == pdTRUE) {
+            precompress_file(path);
+        }
     }
-    
-    // Skip the URI prefix to get the relative path
-    const char *relative_path = uri;
-    if (prefix_len > 1 && strncmp(uri, uri_prefix, prefix_len) == 0) {
-        // Skip the prefix, keeping the trailing slash if present
-        // Example: uri="/diag/test.txt", prefix="/diag" -> relative_path="/test.txt"
-        relative_path = uri + prefix_len;
-        uri_len -= prefix_len;
+}
+
+// Start the task on first use. Called from the MicroPython task when a file
+// server is set up, before uploads can queue to it. The counters need the
+// cache lock, so there is no task without it.
+static void precompress_start(void) {
+    if (precompress_queue || !webfiles_cache_setup()) {
+        return;
     }
-    
-    // Check if path will fit in destination buffer
-    if (base_len + uri_len + 1 > destsize) {
-        ESP_LOGE(TAG, "Path too long");
-        return NULL;
+    QueueHandle_t queue = xQueueCreate(PRECOMPRESS_QUEUE_LEN, FILE_PATH_MAX);
+    if (!queue) {
+        return;
     }
-    
-    // Construct full path
-    strcpy(dest, base_path);
-    if (base_len > 0 && base_path[base_len-1] == '/' && relative_path[0] == '/') {
-        // Avoid double slash
-        strlcpy(dest + base_len, relative_path + 1, uri_len);
-    } else {
-        strlcpy(dest + base_len, relative_path, uri_len + 1);
+    if (xTaskCreate(precompress_task, "webfiles_gz", PRECOMPRESS_STACK, queue, tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start precompression task");
+        vQueueDelete(queue);
+        return;
     }
-    
-    return dest;
+    precompress_queue = queue;
 }
 
-// Set content type based on file extension
-// Exported for use by modhttpserver.c
-void webfiles_set_content_type_from_file(httpd_req_t *req, const char *filepath) {
-    const char* mime_type = webfiles_get_mime_type(filepath);
-    httpd_resp_set_type(req, mime_type);
-    
-    // Set Cache-Control header for static assets
-    // Don't cache HTML, but cache other static assets
-    if (strstr(mime_type, "text/html") == NULL) {
-        // Cache for 1 hour (3600 seconds)
-        httpd_resp_set_hdr(req, "Cache-Control", "max-age=3600");
-    } else {
-        // Don't cache HTML content
-        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+#else
+
+static void precompress_start(void) {
+}
+
+#endif // WEBFILES_PRECOMPRESS
+
+// Queue a stored file for a .gz variant. Safe from any task; does nothing
+// before a file server is set up or for files that don't compress.
+// Exported for uploads and WebREPL writes.
+void webfiles_precompress_queue(const char *path) {
+#if WEBFILES_PRECOMPRESS
+    char item[FILE_PATH_MAX];
+    if (!precompress_queue || !path || path[0] != '/' || !webfiles_is_compressible(path) ||
+        strlcpy(item, path, sizeof(item)) >= sizeof(item)) {
+        return;
     }
-    
-    // Add CORS headers for development convenience
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    if (xQueueSend(precompress_queue, item, 0) != pdTRUE) {
+        precompress_count(&precompress_stats.dropped);
+    }
+#else
+    (void)path;
+#endif
 }
 
 // Mount the www partition for direct ESP-IDF file access (read-only)
@@ -395,6 +1604,12 @@ static bool copy_file_to_www(const char *src_path, const char *dst_filename) {
 static esp_err_t webfiles_direct_handler(httpd_req_t *req) {
     ESP_LOGI(TAG, "=== DIRECT WEBFILES HANDLER CALLED for URI: %s ===", req->uri);
 
+    // Python routes under the served prefix take precedence over files
+    esp_err_t route_ret = httpserver_route_request(req);
+    if (route_ret != ESP_ERR_NOT_FOUND) {
+        return route_ret;
+    }
+
     if (!www_partition_mounted) {
         ESP_LOGE(TAG, "www partition not mounted");
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "www partition not mounted");
@@ -432,55 +1647,103 @@ static esp_err_t webfiles_direct_handler(httpd_req_t *req) {
 
     ESP_LOGI(TAG, "Direct serving file: %s", filepath);
 
-    // Open file directly using ESP-IDF VFS
-    FILE *file = fopen(filepath, "rb");
-    if (!file) {
-        ESP_LOGE(TAG, "Failed to open file: %s", filepath);
+    char accept_encoding[128] = {0};
+    httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+    uint8_t accept = webfiles_accept_encodings(accept_encoding);
+
+    asset_cache_entry_t *cached = asset_cache_lookup(filepath, accept);
+    if (cached && (cached = asset_cache_check(cached, false)) != NULL) {
+        return asset_cache_send(req, cached);
+    }
+
+    // Variant, size and mtime for the validators; a 304 never opens the file.
+    // filepath becomes the variant, type_path keeps the requested name.
+    char type_path[FILE_PATH_MAX];
+    strlcpy(type_path, filepath, sizeof(type_path));
+    webfiles_meta_t meta;
+    webfiles_meta_get(type_path, false, &meta);
+    webfiles_encoding_t encoding;
+    size_t file_size = 0;
+    int64_t mtime = 0;
+    if (!webfiles_meta_pick(&meta, accept, filepath, sizeof(filepath), &encoding, &file_size, &mtime)) {
+        ESP_LOGE(TAG, "File not found: %s", filepath);
         httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
         return ESP_FAIL;
     }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    size_t file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    // Small files are read whole into the asset cache and served from there
+    if (req->method == HTTP_GET) {
+        cached = asset_cache_prepare(type_path, accept, type_path, meta.mime, file_size, mtime, encoding);
+        if (cached) {
+            // Stored only if the file is exactly what was stat'ed: same size
+            // (nothing left after it) and still the same size and mtime after
+            FILE *file = fopen(filepath, "rb");
+            size_t got = file ? fread(cached->response + cached->head_len, 1, cached->size, file) : 0;
+            bool ok = file && got == cached->size && fgetc(file) == EOF;
+            if (file) {
+                fclose(file);
+            }
+            size_t now_size;
+            int64_t now_mtime;
+            ok = ok && webfiles_native_stat(filepath, &now_size, &now_mtime) &&
+                 now_size == cached->size && now_mtime == cached->mtime;
+            if (ok) {
+                asset_cache_commit(cached);
+                return asset_cache_send(req, cached);
+            }
+            asset_cache_release(cached);
+            // Changed since it was cached; look again next time
+            webfiles_cache_invalidate(type_path);
+        }
+    }
 
-    ESP_LOGI(TAG, "File size: %d bytes", (int)file_size);
+    size_t offset = 0, length = 0;
+    if (webfiles_send_head(req, type_path, meta.mime, file_size, mtime, encoding, &offset, &length) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (length == 0) {
+        return ESP_OK;
+    }
 
-    // Set content type
-    webfiles_set_content_type_from_file(req, filepath);
+    // Headers are out; from here on a failure can only close the connection
+    FILE *file = fopen(filepath, "rb");
+    if (!file) {
+        ESP_LOGE(TAG, "Failed to open file: %s", filepath);
+        webfiles_cache_invalidate(type_path);
+        return ESP_FAIL;
+    }
+    if (offset > 0 && fseek(file, offset, SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "Failed to seek to %lu: %s", (unsigned long)offset, filepath);
+        fclose(file);
+        return ESP_FAIL;
+    }
 
     // Allocate buffer on heap to avoid stack overflow with large files
     char *buffer = malloc(SCRATCH_BUFSIZE);
     if (!buffer) {
         ESP_LOGE(TAG, "Failed to allocate buffer for file transfer");
         fclose(file);
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
         return ESP_FAIL;
     }
 
-    // Read and send file in chunks
-    size_t total_sent = 0;
-    size_t bytes_read;
-
-    while ((bytes_read = fread(buffer, 1, SCRATCH_BUFSIZE, file)) > 0) {
-        if (httpd_resp_send_chunk(req, buffer, bytes_read) != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to send chunk");
-            free(buffer);
-            fclose(file);
-            return ESP_FAIL;
+    // Read and send the requested bytes in blocks
+    size_t remaining = length;
+    while (remaining > 0) {
+        size_t bytes_read = fread(buffer, 1, remaining < SCRATCH_BUFSIZE ? remaining : SCRATCH_BUFSIZE, file);
+        if (bytes_read == 0 || webfiles_send_all(req, buffer, bytes_read) != ESP_OK) {
+            ESP_LOGE(TAG, "Transfer failed with %lu bytes left", (unsigned long)remaining);
+            break;
         }
-        total_sent += bytes_read;
+        remaining -= bytes_read;
     }
 
     free(buffer);
     fclose(file);
 
-    // Finish response
-    httpd_resp_send_chunk(req, NULL, 0);
-
-    ESP_LOGI(TAG, "Direct file served successfully: %d bytes", (int)total_sent);
-
+    if (remaining > 0) {
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Direct file served successfully: %d bytes", (int)length);
     return ESP_OK;
 }
 
@@ -492,9 +1755,12 @@ static esp_err_t webfiles_handler(httpd_req_t *req) {
     ESP_LOGD(TAG, "Serving file for URI: %s (method: %s)", req->uri, 
              req->method == HTTP_GET ? "GET" : "HEAD");
     
-    // Check if this is a HEAD request
-    bool is_head_request = (req->method == HTTP_HEAD);
-    
+    // Python routes under the served prefix take precedence over files
+    esp_err_t route_ret = httpserver_route_request(req);
+    if (route_ret != ESP_ERR_NOT_FOUND) {
+        return route_ret;
+    }
+
     // Process any URL query parameters if needed
     char *query = strchr(req->uri, '?');
     if (query) {
@@ -509,277 +1775,791 @@ static esp_err_t webfiles_handler(httpd_req_t *req) {
         return ESP_FAIL;
     }
 
-    // Restore query string if we modified it
-    if (query) *query = '?';
-    
-    // Get Accept-Encoding header for gzip detection
-    char accept_encoding[64] = {0};
-    httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+    // Restore query string if we modified it
+    if (query) *query = '?';
+    
+    // Codings the client takes, to pick a .br or .gz variant
+    char accept_encoding[128] = {0};
+    httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+    uint8_t accept = webfiles_accept_encodings(accept_encoding);
+
+    // Cache hits never touch the VFS or the GIL (but for a re-check every meta TTL)
+    asset_cache_entry_t *cached = asset_cache_lookup(filepath, accept);
+    if (cached && (cached = asset_cache_check(cached, true)) != NULL) {
+        return asset_cache_send(req, cached);
+    }
+
+    // Ensure HTTP worker thread has MP state
+    if (!httpserver_ensure_mp_thread_state()) {
+        ESP_LOGE(TAG, "Failed to initialize MP thread state");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Thread init failed");
+        return ESP_FAIL;
+    }
+
+    // Resolve the variant from the metadata cache, which only stats (under
+    // the GIL) on a miss. Validators are checked without the GIL, so a 304
+    // never opens the file. Content type and cache policy come from
+    // type_path, the requested name, when a variant is served.
+    char type_path[FILE_PATH_MAX];
+    strlcpy(type_path, filepath, sizeof(type_path));
+    webfiles_meta_t meta;
+    webfiles_meta_get(type_path, true, &meta);
+    webfiles_encoding_t encoding;
+    size_t file_size = 0;
+    int64_t mtime = 0;
+    if (!webfiles_meta_pick(&meta, accept, filepath, sizeof(filepath), &encoding, &file_size, &mtime)) {
+        ESP_LOGW(TAG, "File not found: %s", filepath);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
+    }
+
+    // Small files are read whole into the asset cache and served from there.
+    // type_path is the requested name, the key the lookup above used.
+    if (req->method == HTTP_GET) {
+        cached = asset_cache_prepare(type_path, accept, type_path, meta.mime, file_size, mtime, encoding);
+        if (cached) {
+            // Stored only if the file is still the size and mtime it was stat'ed with
+            size_t now_size;
+            int64_t now_mtime;
+            MP_THREAD_GIL_ENTER();
+            bool ok = webfiles_vfs_read_all(filepath, cached->response + cached->head_len, cached->size) &&
+                      webfiles_vfs_stat(filepath, &now_size, &now_mtime) &&
+                      now_size == cached->size && now_mtime == cached->mtime;
+            MP_THREAD_GIL_EXIT();
+            if (ok) {
+                asset_cache_commit(cached);
+                return asset_cache_send(req, cached);
+            }
+            asset_cache_release(cached);
+            // Changed since it was cached; look again next time
+            webfiles_cache_invalidate(type_path);
+        }
+    }
+
+    size_t offset = 0, length = 0;
+    if (webfiles_send_head(req, type_path, meta.mime, file_size, mtime, encoding, &offset, &length) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (length == 0) {
+        return ESP_OK;
+    }
+
+    // The GIL is held only to open the file and while each block is read from
+    // the VFS. Sends run with the GIL released, so Python keeps executing while
+    // the client drains the response. Headers are out, so from here on a
+    // failure can only close the connection.
+    char *buffer = malloc(SCRATCH_BUFSIZE);
+    if (!buffer) {
+        ESP_LOGE(TAG, "Failed to allocate file buffer");
+        return ESP_FAIL;
+    }
+
+    // Open once and read through the stream protocol directly into our buffer,
+    // so no bytes objects are allocated per block
+    MP_THREAD_GIL_ENTER();
+    mp_obj_t file_obj = MP_OBJ_NULL;
+    const mp_stream_p_t *stream = NULL;
+    int errcode = 0;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t path_obj = mp_obj_new_str(filepath, strlen(filepath));
+        mp_obj_t args[2] = { path_obj, MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+        file_obj = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        stream = mp_get_stream_raise(file_obj, MP_STREAM_OP_READ);
+        nlr_pop();
+    } else {
+        file_obj = MP_OBJ_NULL;
+    }
+
+    // This task's stack is not scanned by the GC, keep the file reachable
+    // while the GIL is released between blocks
+    MP_STATE_PORT(webfiles_open_file) = file_obj;
+
+    // Range requests start at the offset without reading what comes before
+    bool ok = file_obj != MP_OBJ_NULL;
+    if (ok && offset > 0) {
+        struct mp_stream_seek_t seek_s = { .offset = offset, .whence = MP_SEEK_SET };
+        ok = stream->ioctl && stream->ioctl(file_obj, MP_STREAM_SEEK, (uintptr_t)&seek_s, &errcode) != MP_STREAM_ERROR;
+    }
+    MP_THREAD_GIL_EXIT();
+
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to open %s at %lu: %d", filepath, (unsigned long)offset, errcode);
+        webfiles_cache_invalidate(type_path);
+    } else {
+        ESP_LOGI(TAG, "Serving file: %s", filepath);
+    }
+
+    size_t remaining = ok ? length : 0;
+    while (remaining > 0) {
+        mp_uint_t len = MP_STREAM_ERROR;
+        MP_THREAD_GIL_ENTER();
+        if (nlr_push(&nlr) == 0) {
+            len = stream->read(file_obj, buffer, remaining < SCRATCH_BUFSIZE ? remaining : SCRATCH_BUFSIZE, &errcode);
+            nlr_pop();
+        }
+        MP_THREAD_GIL_EXIT();
+
+        // A short file (truncated since the stat) cannot fill Content-Length
+        if (len == MP_STREAM_ERROR || len == 0) {
+            ESP_LOGE(TAG, "Read failed with %lu bytes left: %d", (unsigned long)remaining, errcode);
+            webfiles_cache_invalidate(type_path);
+            ok = false;
+            break;
+        }
+        if (webfiles_send_all(req, buffer, len) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send with %lu bytes left", (unsigned long)remaining);
+            ok = false;
+            break;
+        }
+        remaining -= len;
+    }
+
+    free(buffer);
+
+    // Close under the GIL; the root pointer kept the object alive until here
+    if (file_obj != MP_OBJ_NULL) {
+        MP_THREAD_GIL_ENTER();
+        if (nlr_push(&nlr) == 0) {
+            mp_stream_close(file_obj);
+            nlr_pop();
+        } else {
+            ESP_LOGW(TAG, "Failed to close file");
+        }
+        MP_STATE_PORT(webfiles_open_file) = MP_OBJ_NULL;
+        MP_THREAD_GIL_EXIT();
+    }
+
+    if (!ok) {
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "File served: %d bytes (%s)", (int)length, webfiles_encodings[encoding].name);
+    return ESP_OK;
+}
+
+// Serve an asset from the mapped bundle. Responses are stored complete, so
+// a plain GET is a single send straight from flash; conditional and Range
+// requests reuse the stored headers and body.
+static esp_err_t webfiles_bundle_handler(httpd_req_t *req) {
+    // Python routes under the served prefix take precedence over files
+    esp_err_t route_ret = httpserver_route_request(req);
+    if (route_ret != ESP_ERR_NOT_FOUND) {
+        return route_ret;
+    }
+
+    // Path inside the bundle: the URI after the prefix (its length is the
+    // handler's user_ctx), without the query
+    const char *uri = req->uri + (uintptr_t)req->user_ctx;
+    size_t uri_len = strcspn(uri, "?#");
+    char path[FILE_PATH_MAX];
+    if (uri_len + sizeof("/index.html") > sizeof(path)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
+    }
+    size_t len = 0;
+    if (uri_len == 0) {
+        path[len++] = '/';
+    }
+    memcpy(path + len, uri, uri_len);
+    len += uri_len;
+    if (path[len - 1] == '/') {
+        memcpy(path + len, "index.html", 10);
+        len += 10;
+    }
+
+    webbundle_asset_t asset;
+    if (!webbundle_find(&bundle, path, len, &asset)) {
+        ESP_LOGD(TAG, "Not in bundle: %.*s", (int)len, path);
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+        return ESP_FAIL;
+    }
+
+    if (webfiles_is_plain_get(req)) {
+        return webfiles_send_all(req, asset.response, asset.response_len);
+    }
+
+    // Bundled assets carry a content ETag and no Last-Modified
+    webfiles_validators_t validators = { .etag = "", .last_modified = "" };
+    if (asset.etag_len < sizeof(validators.etag)) {
+        memcpy(validators.etag, asset.etag, asset.etag_len);
+        validators.etag[asset.etag_len] = '\0';
+    }
+    size_t offset = 0, length = 0;
+    esp_err_t ret = webfiles_send_head_from(req, asset.headers, asset.headers_len, &validators,
+                                            asset.body_len, &offset, &length);
+    if (ret == ESP_OK && length > 0) {
+        ret = webfiles_send_all(req, asset.body + offset, length);
+    }
+    return ret;
+}
+
+// ------------------------------------------------------------------------
+// Directory index and batch fetch
+// ------------------------------------------------------------------------
+// For editors that open whole projects. GET <prefix>/list?path=<dir>&depth=N
+// returns a directory tree with sizes, mtimes and ETags as one JSON
+// document. POST <prefix>/batch streams every file named in the body as one
+// length-prefixed response. Both run in the server task: the MicroPython VFS
+// is read under the GIL, a few directory entries or one file block at a
+// time, and the www partition through ESP-IDF's VFS without it.
+//
+// Batch body: one path per line, relative to the root, optionally followed
+// by a tab and the ETag the client already has. The response has, for each
+// line in order, an 8-byte header
+//   u16 path_len, u8 etag_len, u8 status, u32 size   (little-endian)
+// then the path as requested, the ETag and, with status 0, size bytes of
+// content. Status 1: the client's ETag still matches (no content), 2: not
+// found.
+
+#define INDEX_DEPTH_MAX 8
+#define INDEX_ENTRIES_MAX 2000
+#define INDEX_PENDING_SIZE 2048         // Directories still to list
+#define INDEX_DIR_BATCH 16              // Entries read per GIL hold
+#define INDEX_BATCH_MAX 256             // Files per batch request
+#define INDEX_BODY_MAX (16 * 1024)
+
+enum {
+    INDEX_OK = 0,
+    INDEX_NOT_MODIFIED = 1,
+    INDEX_NOT_FOUND = 2
+};
+
+static char index_root[64] = "/";
+static char index_list_uri[48];
+static char index_batch_uri[48];
+
+// Directory iterator or file being read, per server task (HTTP, HTTPS)
+MP_REGISTER_ROOT_POINTER(mp_obj_t webfiles_index_objs[2]);
+
+// Chunked response through one SCRATCH_BUFSIZE buffer
+typedef struct {
+    httpd_req_t *req;
+    char *buf;
+    size_t len;
+    bool failed;
+} index_out_t;
+
+static void index_flush(index_out_t *o) {
+    if (!o->failed && o->len > 0 && httpd_resp_send_chunk(o->req, o->buf, o->len) != ESP_OK) {
+        o->failed = true;
+    }
+    o->len = 0;
+}
+
+static void index_put(index_out_t *o, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0 && !o->failed) {
+        size_t n = SCRATCH_BUFSIZE - o->len < len ? SCRATCH_BUFSIZE - o->len : len;
+        memcpy(o->buf + o->len, p, n);
+        o->len += n;
+        p += n;
+        len -= n;
+        if (o->len == SCRATCH_BUFSIZE) {
+            index_flush(o);
+        }
+    }
+}
+
+static void index_put_str(index_out_t *o, const char *s) {
+    index_put(o, s, strlen(s));
+}
+
+// Quoted JSON string
+static void index_put_json(index_out_t *o, const char *s) {
+    index_put(o, "\"", 1);
+    while (*s) {
+        size_t run = 0;
+        while (s[run] && s[run] != '"' && s[run] != '\\' && (unsigned char)s[run] >= 0x20) {
+            run++;
+        }
+        index_put(o, s, run);
+        s += run;
+        if (*s) {
+            char esc[8];
+            int n = (*s == '"' || *s == '\\') ? snprintf(esc, sizeof(esc), "\\%c", *s)
+                                              : snprintf(esc, sizeof(esc), "\\u%04x", (unsigned char)*s);
+            index_put(o, esc, n);
+            s++;
+        }
+    }
+    index_put(o, "\"", 1);
+}
+
+// Decode %XX and '+' in a query value, in place
+static void index_url_decode(char *s) {
+    char *out = s;
+    for (; *s; s++) {
+        if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+            char hex[3] = { s[1], s[2], '\0' };
+            *out++ = (char)strtol(hex, NULL, 16);
+            s += 2;
+        } else {
+            *out++ = *s == '+' ? ' ' : *s;
+        }
+    }
+    *out = '\0';
+}
+
+// index_root joined with a relative path; false if it has ".." or is too long
+static bool index_path(char *dest, size_t size, const char *rel, size_t rel_len) {
+    while (rel_len > 0 && *rel == '/') {
+        rel++;
+        rel_len--;
+    }
+    while (rel_len > 0 && rel[rel_len - 1] == '/') {
+        rel_len--;
+    }
+    for (size_t i = 0; i < rel_len;) {
+        size_t end = i;
+        while (end < rel_len && rel[end] != '/') {
+            end++;
+        }
+        if (end - i == 2 && rel[i] == '.' && rel[i + 1] == '.') {
+            return false;
+        }
+        i = end + 1;
+    }
+    size_t root_len = strlen(index_root);
+    const char *sep = rel_len == 0 || index_root[root_len - 1] == '/' ? "" : "/";
+    int n = snprintf(dest, size, "%s%s%.*s", index_root, sep, (int)rel_len, rel);
+    return n > 0 && (size_t)n < size;
+}
+
+static bool index_is_native(const char *path) {
+    return www_partition_mounted && strncmp(path, www_mount_point, 4) == 0 && (path[4] == '/' || path[4] == '\0');
+}
+
+typedef struct {
+    char name[FILE_PATH_MAX];     // Relative to the listed root
+    bool dir;
+    size_t size;
+    int64_t mtime;
+} index_entry_t;
+
+// One directory being listed: a DIR on the www partition, else a VFS
+// iterator in the task's root pointer slot
+typedef struct {
+    bool native;
+    int slot;
+    DIR *dir;
+    char path[FILE_PATH_MAX];     // Full path
+    char rel[FILE_PATH_MAX];      // Relative to the listed root, "" for the root
+} index_dir_t;
+
+static bool index_dir_open(index_dir_t *d) {
+    if (d->native) {
+        d->dir = opendir(d->path);
+        return d->dir != NULL;
+    }
+    bool ok = false;
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t path_obj = mp_obj_new_str(d->path, strlen(d->path));
+        MP_STATE_PORT(webfiles_index_objs)[d->slot] = mp_vfs_ilistdir(1, &path_obj);
+        nlr_pop();
+        ok = true;
+    }
+    MP_THREAD_GIL_EXIT();
+    return ok;
+}
+
+static void index_dir_close(index_dir_t *d) {
+    if (d->native) {
+        if (d->dir) {
+            closedir(d->dir);
+            d->dir = NULL;
+        }
+        return;
+    }
+    MP_THREAD_GIL_ENTER();
+    MP_STATE_PORT(webfiles_index_objs)[d->slot] = MP_OBJ_NULL;
+    MP_THREAD_GIL_EXIT();
+}
+
+static bool index_child(const index_dir_t *d, const char *name, index_entry_t *entry, char *path, size_t path_size) {
+    size_t len = strlen(d->path);
+    const char *sep = d->path[len - 1] == '/' ? "" : "/";
+    int n = snprintf(path, path_size, "%s%s%s", d->path, sep, name);
+    int m = snprintf(entry->name, sizeof(entry->name), "%s%s%s", d->rel, d->rel[0] ? "/" : "", name);
+    return n > 0 && (size_t)n < path_size && m > 0 && (size_t)m < sizeof(entry->name);
+}
 
-    // For HEAD requests, we need to use MicroPython VFS but can skip file reading
-    if (is_head_request) {
-        // Ensure HTTP worker thread has MP state
-        if (!httpserver_ensure_mp_thread_state()) {
-            ESP_LOGE(TAG, "Failed to initialize MP thread state");
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Thread init failed");
-            return ESP_FAIL;
+// Up to max entries of a directory, with size and mtime of files; 0 at the end
+static int index_dir_read(index_dir_t *d, index_entry_t *entries, int max) {
+    char path[FILE_PATH_MAX];
+    int count = 0;
+    if (d->native) {
+        struct dirent *e;
+        while (count < max && (e = readdir(d->dir)) != NULL) {
+            index_entry_t *entry = &entries[count];
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0 ||
+                !index_child(d, e->d_name, entry, path, sizeof(path))) {
+                continue;
+            }
+            struct stat st;
+            if (stat(path, &st) != 0) {
+                continue;
+            }
+            entry->dir = S_ISDIR(st.st_mode);
+            entry->size = entry->dir ? 0 : st.st_size;
+            entry->mtime = entry->dir ? 0 : st.st_mtime;
+            count++;
         }
+        return count;
+    }
 
-        // Acquire MicroPython GIL for VFS access
-        MP_THREAD_GIL_ENTER();
-        
-        // Check for gzip version
-        bool use_compression = false;
-        webfiles_resolve_gzip(filepath, sizeof(filepath), accept_encoding, &use_compression);
-        
-        // Use mp_vfs_stat to check file existence and get size
-        mp_obj_t path_obj = mp_obj_new_str(filepath, strlen(filepath));
-        nlr_buf_t nlr;
-        size_t file_size = 0;
-        
-        if (nlr_push(&nlr) == 0) {
-            // mp_vfs_stat returns a tuple with 10 elements, st_size is at index 6
-            mp_obj_t stat_result = mp_vfs_stat(path_obj);
-            
-            // Verify it's actually a tuple
-            if (!mp_obj_is_type(stat_result, &mp_type_tuple)) {
-                ESP_LOGE(TAG, "HEAD: mp_vfs_stat did not return a tuple!");
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("stat() returned non-tuple")));
-            }
-            
-            // Extract size from stat tuple (items[6] = st_size)
-            mp_obj_t *items;
-            size_t tuple_len;
-            mp_obj_get_array(stat_result, &tuple_len, &items);
-            
-            if (tuple_len < 7) {
-                ESP_LOGE(TAG, "HEAD: stat tuple too short (%d < 7)", (int)tuple_len);
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("stat() tuple too short")));
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t iter = MP_STATE_PORT(webfiles_index_objs)[d->slot];
+        mp_obj_t item;
+        while (count < max && (item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+            // (name, type, inode[, size])
+            mp_obj_t *fields;
+            size_t n_fields;
+            mp_obj_get_array(item, &n_fields, &fields);
+            index_entry_t *entry = &entries[count];
+            if (!index_child(d, mp_obj_str_get_str(fields[0]), entry, path, sizeof(path))) {
+                continue;
             }
-            
-            mp_obj_t size_obj = items[6];
-            
-            // Extract file size - try direct extraction first for small ints
-            if (mp_obj_is_small_int(size_obj)) {
-                file_size = (size_t)MP_OBJ_SMALL_INT_VALUE(size_obj);
-            } else {
-                // For larger integers or other int types, use mp_obj_get_int
-                mp_int_t size_int = mp_obj_get_int(size_obj);
-                file_size = (size_t)size_int;
+            entry->dir = mp_obj_get_int(fields[1]) & MP_S_IFDIR;
+            entry->size = 0;
+            entry->mtime = 0;
+            if (!entry->dir && !webfiles_vfs_stat(path, &entry->size, &entry->mtime)) {
+                continue;
             }
-            
-            nlr_pop();
-        } else {
-            // File doesn't exist
-            ESP_LOGE(TAG, "HEAD: File not found: %s", filepath);
-            nlr_pop();
-            MP_THREAD_GIL_EXIT();
-            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
-            return ESP_FAIL;
-        }
-        
-        // Set headers for HEAD request
-        const char *mime_type = webfiles_get_mime_type(filepath);
-        httpd_resp_set_type(req, mime_type);
-        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-        
-        if (use_compression) {
-            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-            httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
-        }
-        
-        // Set Content-Length for HEAD request (no chunked encoding for HEAD)
-        char content_length_str[32];
-        snprintf(content_length_str, sizeof(content_length_str), "%d", (int)file_size);
-        esp_err_t hdr_ret = httpd_resp_set_hdr(req, "Content-Length", content_length_str);
-        if (hdr_ret != ESP_OK) {
-            ESP_LOGE(TAG, "HEAD: Failed to set Content-Length header: %d", hdr_ret);
+            count++;
         }
-        
-        // Release GIL BEFORE finalizing response (ESP-IDF operations should not be under GIL)
-        MP_THREAD_GIL_EXIT();
+        nlr_pop();
+    }
+    MP_THREAD_GIL_EXIT();
+    return count;
+}
+
+static void index_put_entry(index_out_t *o, const index_entry_t *entry, bool first) {
+    index_put_str(o, first ? "{\"name\":" : ",{\"name\":");
+    index_put_json(o, entry->name);
+    if (entry->dir) {
+        index_put_str(o, ",\"type\":\"dir\"}");
+        return;
+    }
+    webfiles_validators_t v;
+    webfiles_validators_init(&v, entry->size, entry->mtime, WEBFILES_ENC_IDENTITY);
+    char fields[80];
+    snprintf(fields, sizeof(fields), ",\"type\":\"file\",\"size\":%lu,\"mtime\":%lld,\"etag\":",
+             (unsigned long)entry->size, (long long)entry->mtime);
+    index_put_str(o, fields);
+    if (v.etag[0]) {
+        index_put_json(o, v.etag);
+    } else {
+        index_put_str(o, "null");  // No mtime, no validator
+    }
+    index_put_str(o, "}");
+}
 
-        // Finalize HEAD response (no body) - use httpd_resp_send() for non-chunked
-        esp_err_t send_ret = httpd_resp_send(req, NULL, 0);
-        if (send_ret != ESP_OK) {
-            ESP_LOGE(TAG, "HEAD: httpd_resp_send() failed: %d", send_ret);
+// CONTEXT: HTTP server task
+static esp_err_t webfiles_index_list_handler(httpd_req_t *req) {
+    char query[FILE_PATH_MAX + 32] = "";
+    char rel[FILE_PATH_MAX] = "";
+    char value[8];
+    int depth = 1;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "path", rel, sizeof(rel));
+        if (httpd_query_key_value(query, "depth", value, sizeof(value)) == ESP_OK) {
+            depth = atoi(value);
         }
-        
-        ESP_LOGI(TAG, "HEAD: %s (%d bytes)%s", filepath, (int)file_size, 
-                 use_compression ? " [gzip]" : "");
-        return send_ret == ESP_OK ? ESP_OK : ESP_FAIL;
     }
+    index_url_decode(rel);
+    for (size_t len = strlen(rel); len > 0 && rel[len - 1] == '/'; len--) {
+        rel[len - 1] = '\0';
+    }
+    depth = depth < 1 ? 1 : depth > INDEX_DEPTH_MAX ? INDEX_DEPTH_MAX : depth;
 
-    // For GET requests, do full file processing with GIL
-    // Ensure HTTP worker thread has MP state
-    if (!httpserver_ensure_mp_thread_state()) {
-        ESP_LOGE(TAG, "Failed to initialize MP thread state");
+    index_dir_t d = { .slot = req->handle == httpserver_get_https_handle(), .dir = NULL };
+    if (!index_path(d.path, sizeof(d.path), rel, strlen(rel))) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid path");
+        return ESP_FAIL;
+    }
+    d.native = index_is_native(d.path);
+    if (!d.native && !httpserver_ensure_mp_thread_state()) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Thread init failed");
         return ESP_FAIL;
     }
+    if (!index_dir_open(&d)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Directory not found");
+        return ESP_FAIL;
+    }
 
-    // Acquire MicroPython GIL for VFS access
-    MP_THREAD_GIL_ENTER();
-    
-    // Check for gzip version
-    bool use_compression = false;
-    webfiles_resolve_gzip(filepath, sizeof(filepath), accept_encoding, &use_compression);
-    
-    ESP_LOGI(TAG, "Serving file: %s%s", filepath, use_compression ? " (gzipped)" : "");
-    
-    // Wrap entire file serving in exception handler
-    nlr_buf_t nlr_top;
-    mp_obj_t file_obj = MP_OBJ_NULL;
-    char *buffer = NULL;
-    esp_err_t result = ESP_OK;
-    
-    if (nlr_push(&nlr_top) == 0) {
-        // Open file using MicroPython VFS
-        mp_obj_t path_obj = mp_obj_new_str(filepath, strlen(filepath));
-        mp_obj_t args[2] = { path_obj, MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
-        file_obj = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
-
-        // Get file size by seeking to end
-        mp_obj_t seek_method = mp_load_attr(file_obj, MP_QSTR_seek);
-        mp_obj_t tell_method = mp_load_attr(file_obj, MP_QSTR_tell);
-        
-        // Seek to end (2 = SEEK_END)
-        mp_obj_t seek_args[2] = { MP_OBJ_NEW_SMALL_INT(0), MP_OBJ_NEW_SMALL_INT(2) };
-        mp_call_function_n_kw(seek_method, 2, 0, seek_args);
-        
-        // Get position (file size)
-        mp_obj_t size_obj = mp_call_function_0(tell_method);
-        size_t file_size = mp_obj_get_int(size_obj);
-        
-        // Seek back to start (0 = SEEK_SET)
-        seek_args[1] = MP_OBJ_NEW_SMALL_INT(0);
-        mp_call_function_n_kw(seek_method, 2, 0, seek_args);
-        
-        ESP_LOGD(TAG, "File size: %d bytes", (int)file_size);
-
-        // Set content type (use original filename for MIME type if compressed)
-        char original_filepath[FILE_PATH_MAX];
-        if (use_compression) {
-            // Strip .gz extension for MIME type detection
-            strcpy(original_filepath, filepath);
-            char *dot_pos = strrchr(original_filepath, '.');
-            if (dot_pos) {
-                *dot_pos = '\0';  // Remove .gz extension
-            }
-            const char *mime_type = webfiles_get_mime_type(original_filepath);
-            httpd_resp_set_type(req, mime_type);
-            
-            // Set compression headers
-            httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
-            httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
-        } else {
-            const char *mime_type = webfiles_get_mime_type(filepath);
-            httpd_resp_set_type(req, mime_type);
-        }
-        
-        // Enable CORS
-        httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-
-        // Note: We use chunked transfer encoding (via httpd_resp_send_chunk)
-        // Do NOT set Content-Length - it's incompatible with Transfer-Encoding: chunked
+    // Subdirectories still to list: depth byte, then the relative path, NUL-terminated
+    char *pending = malloc(INDEX_PENDING_SIZE);
+    index_entry_t *entries = malloc(INDEX_DIR_BATCH * sizeof(index_entry_t));
+    index_out_t out = { .req = req, .buf = malloc(SCRATCH_BUFSIZE) };
+    if (!pending || !entries || !out.buf) {
+        index_dir_close(&d);
+        free(pending);
+        free(entries);
+        free(out.buf);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t pending_len = 0;
+    int level = 1;
+    size_t listed = 0;
+    bool truncated = false;
 
-        // Read and send file content (GET requests only)
-        size_t total_sent = 0;
-        
-        // Allocate buffer for file transfer
-        #define FILE_BUFFER_SIZE 4096
-        buffer = malloc(FILE_BUFFER_SIZE);
-        if (!buffer) {
-            ESP_LOGE(TAG, "Failed to allocate file buffer");
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Out of memory")));
-        }
-
-        // Read and send file in chunks (keep GIL held throughout)
-        mp_obj_t read_method = mp_load_attr(file_obj, MP_QSTR_read);
-        esp_err_t send_err = ESP_OK;
-
-        while (total_sent < file_size && send_err == ESP_OK) {
-            // Read chunk from file
-            mp_obj_t chunk_size_obj = MP_OBJ_NEW_SMALL_INT(FILE_BUFFER_SIZE);
-            mp_obj_t chunk_obj = mp_call_function_1(read_method, chunk_size_obj);
-            
-            // Get buffer and length from bytes object
-            mp_buffer_info_t bufinfo;
-            mp_get_buffer_raise(chunk_obj, &bufinfo, MP_BUFFER_READ);
-            
-            if (bufinfo.len == 0) {
-                break; // EOF
-            }
-            
-            // Send chunk via HTTP (GIL still held)
-            send_err = httpd_resp_send_chunk(req, bufinfo.buf, bufinfo.len);
-            if (send_err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to send chunk: %d", send_err);
-                result = send_err;
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    index_put_str(&out, "{\"path\":");
+    index_put_json(&out, d.path);
+    index_put_str(&out, ",\"entries\":[");
+
+    // Depth first: a directory's subdirectories are listed after it
+    bool open = true;
+    while (!out.failed) {
+        int count = open ? index_dir_read(&d, entries, INDEX_DIR_BATCH) : 0;
+        for (int i = 0; i < count; i++) {
+            if (listed == INDEX_ENTRIES_MAX) {
+                truncated = true;
                 break;
             }
-            
-            total_sent += bufinfo.len;
+            index_put_entry(&out, &entries[i], listed++ == 0);
+            size_t len = strlen(entries[i].name);
+            if (entries[i].dir && level < depth) {
+                if (pending_len + len + 2 > INDEX_PENDING_SIZE) {
+                    truncated = true;
+                } else {
+                    pending[pending_len] = (char)(level + 1);
+                    memcpy(pending + pending_len + 1, entries[i].name, len + 1);
+                    pending_len += len + 2;
+                }
+            }
         }
+        if (count > 0 && !truncated) {
+            continue;
+        }
+        index_dir_close(&d);
+        if (truncated || pending_len == 0) {
+            break;
+        }
+        // Pop the last pending directory
+        size_t start = pending_len - 1;
+        while (start > 0 && pending[start - 1] != '\0') {
+            start--;
+        }
+        level = pending[start];  // Depth byte
+        strlcpy(d.rel, pending + start + 1, sizeof(d.rel));
+        pending_len = start;
+        char sub[FILE_PATH_MAX * 2];
+        snprintf(sub, sizeof(sub), "%s/%s", rel, d.rel);
+        d.dir = NULL;
+        open = index_path(d.path, sizeof(d.path), sub, strlen(sub)) && index_dir_open(&d);
+    }
+    index_put_str(&out, truncated ? "],\"truncated\":true}" : "],\"truncated\":false}");
+    index_flush(&out);
+    bool ok = !out.failed && httpd_resp_send_chunk(req, NULL, 0) == ESP_OK;
+
+    free(pending);
+    free(entries);
+    free(out.buf);
+    ESP_LOGI(TAG, "Listed %s: %u entries", rel[0] ? rel : "/", (unsigned)listed);
+    return ok ? ESP_OK : ESP_FAIL;
+}
 
-        ESP_LOGI(TAG, "File served: %d bytes (%s)", (int)total_sent, use_compression ? "gzip" : "uncompressed");
-
-        // NOTE: Skipping final empty chunk - httpd_resp_send_chunk(req, NULL, 0) causes crashes
-        // The HTTP server handles chunked transfer termination automatically
+// One file of a batch, read without the GIL on the www partition and with
+// it per block otherwise
+typedef struct {
+    bool native;
+    int slot;
+    FILE *fp;
+} index_file_t;
+
+static bool index_file_stat(const index_file_t *f, const char *path, size_t *size, int64_t *mtime) {
+    if (f->native) {
+        return webfiles_native_stat(path, size, mtime);
+    }
+    MP_THREAD_GIL_ENTER();
+    bool found = webfiles_vfs_stat(path, size, mtime);
+    MP_THREAD_GIL_EXIT();
+    return found;
+}
 
-        // NOTE: Skipping explicit file close - it causes crashes
-        // File was opened read-only, MicroPython GC will clean it up
+static bool index_file_open(index_file_t *f, const char *path) {
+    if (f->native) {
+        f->fp = fopen(path, "rb");
+        return f->fp != NULL;
+    }
+    bool ok = false;
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t args[2] = { mp_obj_new_str(path, strlen(path)), MP_OBJ_NEW_QSTR(MP_QSTR_rb) };
+        MP_STATE_PORT(webfiles_index_objs)[f->slot] = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+        nlr_pop();
+        ok = true;
+    }
+    MP_THREAD_GIL_EXIT();
+    return ok;
+}
 
-        // Protected code ends here
+// Bytes read, 0 at the end or on error
+static size_t index_file_read(index_file_t *f, void *buf, size_t len) {
+    if (f->native) {
+        return fread(buf, 1, len, f->fp);
+    }
+    mp_uint_t n = 0;
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t file = MP_STATE_PORT(webfiles_index_objs)[f->slot];
+        int errcode;
+        n = mp_get_stream(file)->read(file, buf, len, &errcode);
         nlr_pop();
-        
-    } else {
-        // Exception occurred during file serving
-        ESP_LOGE(TAG, "Exception during file serving");
-        
-        // Try to close file if it was opened
-        if (file_obj != MP_OBJ_NULL) {
-            nlr_buf_t close_nlr;
-            if (nlr_push(&close_nlr) == 0) {
-                mp_obj_t close_method = mp_load_attr(file_obj, MP_QSTR_close);
-                mp_call_function_0(close_method);
-                nlr_pop();
-            } else {
-                nlr_pop();
-                ESP_LOGW(TAG, "Failed to close file after exception");
-            }
-        }
-        
-        result = ESP_FAIL;
-        
-        // Release GIL before sending error response
-        MP_THREAD_GIL_EXIT();
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Error reading file");
-        MP_THREAD_GIL_ENTER();
     }
-    
-    // Clean up buffer if allocated
-    if (buffer) {
-        free(buffer);
+    MP_THREAD_GIL_EXIT();
+    return n == MP_STREAM_ERROR ? 0 : n;
+}
+
+static void index_file_close(index_file_t *f) {
+    if (f->native) {
+        fclose(f->fp);
+        return;
     }
-    
-    // Release MicroPython GIL
+    MP_THREAD_GIL_ENTER();
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_stream_close(MP_STATE_PORT(webfiles_index_objs)[f->slot]);
+        nlr_pop();
+    }
+    MP_STATE_PORT(webfiles_index_objs)[f->slot] = MP_OBJ_NULL;
     MP_THREAD_GIL_EXIT();
+}
+
+static void index_put_frame(index_out_t *o, const char *path, size_t path_len, const char *etag,
+                            uint8_t status, size_t size) {
+    size_t etag_len = strlen(etag);
+    uint8_t head[8] = {
+        path_len & 0xff, path_len >> 8, etag_len, status,
+        size & 0xff, (size >> 8) & 0xff, (size >> 16) & 0xff, (size >> 24) & 0xff,
+    };
+    index_put(o, head, sizeof(head));
+    index_put(o, path, path_len);
+    index_put(o, etag, etag_len);
+}
 
-    // Send final empty chunk to terminate chunked transfer
-    // This MUST be done for httpd_resp_send_chunk() to work correctly
-    // Done after GIL release since it's pure ESP-IDF operation
-    if (result == ESP_OK) {
-        ESP_LOGD(TAG, "Sending final empty chunk to terminate response");
-        esp_err_t chunk_err = httpd_resp_send_chunk(req, NULL, 0);
-        if (chunk_err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to send final chunk: %d", chunk_err);
-            return chunk_err;
+// CONTEXT: HTTP server task
+static esp_err_t webfiles_index_batch_handler(httpd_req_t *req) {
+    if (req->content_len == 0 || req->content_len > INDEX_BODY_MAX) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Expected a list of up to 16 KB of paths");
+        return ESP_FAIL;
+    }
+    if (!httpserver_ensure_mp_thread_state()) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Thread init failed");
+        return ESP_FAIL;
+    }
+    char *body = malloc(req->content_len + 1);
+    char *block = malloc(SCRATCH_BUFSIZE);
+    index_out_t out = { .req = req, .buf = malloc(SCRATCH_BUFSIZE) };
+    if (!body || !block || !out.buf) {
+        free(body);
+        free(block);
+        free(out.buf);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    size_t got = 0;
+    int timeouts = 0;
+    while (got < req->content_len) {
+        int n = httpd_req_recv(req, body + got, req->content_len - got);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3) {
+            continue;
+        }
+        if (n <= 0) {
+            free(body);
+            free(block);
+            free(out.buf);
+            return ESP_FAIL;
         }
-        ESP_LOGD(TAG, "Final chunk sent successfully");
+        got += n;
     }
+    body[got] = '\0';
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
 
-    return result;
+    int slot = req->handle == httpserver_get_https_handle();
+    int files = 0, sent = 0;
+    size_t bytes = 0;
+    char *line = body;
+    while (*line && files < INDEX_BATCH_MAX && !out.failed) {
+        char *next = line + strcspn(line, "\n");
+        if (*next) {
+            *next++ = '\0';
+        }
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        char *have = strchr(line, '\t');
+        if (have) {
+            *have++ = '\0';
+        }
+        size_t path_len = strlen(line);
+        if (path_len == 0) {
+            line = next;
+            continue;
+        }
+        files++;
+
+        char path[FILE_PATH_MAX];
+        index_file_t f = { .slot = slot };
+        size_t size = 0;
+        int64_t mtime = 0;
+        bool found = index_path(path, sizeof(path), line, path_len);
+        if (found) {
+            f.native = index_is_native(path);
+            found = index_file_stat(&f, path, &size, &mtime);
+        }
+        webfiles_validators_t v;
+        webfiles_validators_init(&v, size, mtime, WEBFILES_ENC_IDENTITY);
+        if (!found) {
+            index_put_frame(&out, line, path_len, "", INDEX_NOT_FOUND, 0);
+        } else if (have && v.etag[0] && strcmp(have, v.etag) == 0) {
+            index_put_frame(&out, line, path_len, v.etag, INDEX_NOT_MODIFIED, 0);
+        } else if (!index_file_open(&f, path)) {
+            index_put_frame(&out, line, path_len, "", INDEX_NOT_FOUND, 0);
+        } else {
+            // The size is promised in the frame: a file that shrank since the
+            // stat can't be framed, so the response is cut off
+            index_put_frame(&out, line, path_len, v.etag, INDEX_OK, size);
+            size_t remaining = size;
+            while (remaining > 0 && !out.failed) {
+                size_t n = index_file_read(&f, block, remaining < SCRATCH_BUFSIZE ? remaining : SCRATCH_BUFSIZE);
+                if (n == 0) {
+                    ESP_LOGE(TAG, "Batch: read of %s failed with %lu bytes left", path, (unsigned long)remaining);
+                    webfiles_cache_invalidate(path);
+                    out.failed = true;
+                    break;
+                }
+                index_put(&out, block, n);
+                remaining -= n;
+            }
+            index_file_close(&f);
+            bytes += size;
+            sent++;
+        }
+        line = next;
+    }
+    index_flush(&out);
+    bool ok = !out.failed && httpd_resp_send_chunk(req, NULL, 0) == ESP_OK;
+
+    free(body);
+    free(block);
+    free(out.buf);
+    ESP_LOGI(TAG, "Batch: %d of %d files sent, %lu bytes", sent, files, (unsigned long)bytes);
+    return ok ? ESP_OK : ESP_FAIL;
 }
 
 // ------------------------------------------------------------------------
@@ -898,6 +2678,8 @@ static mp_obj_t webfiles_serve(mp_obj_t base_path_obj, mp_obj_t uri_prefix_obj)
         return mp_obj_new_bool(false);
     }
     
+    webfiles_cache_setup();
+    precompress_start();
     mp_printf(&mp_plat_print, "[WEBFILES] File server started successfully\n");
     return mp_obj_new_bool(true);
 }
@@ -931,6 +2713,204 @@ static mp_obj_t webfiles_serve_file(mp_obj_t file_path_obj, mp_obj_t uri_obj) {
 }
 static MP_DEFINE_CONST_FUN_OBJ_2(webfiles_serve_file_obj, webfiles_serve_file);
 
+// webfiles.cache_control() returns the policies as a dict.
+// webfiles.cache_control(ext, policy) sets the Cache-Control value for an
+// extension (".js"), "*" for all others, or "hashed" for names carrying a
+// content hash; a policy of None (or omitted) removes it.
+static mp_obj_t webfiles_cache_control(size_t n_args, const mp_obj_t *args) {
+    if (n_args == 0) {
+        mp_obj_t dict = mp_obj_new_dict(0);
+        for (int i = 0; i < CACHE_POLICY_MAX; i++) {
+            if (cache_policies[i].ext[0]) {
+                mp_obj_dict_store(dict, mp_obj_new_str(cache_policies[i].ext, strlen(cache_policies[i].ext)),
+                                  mp_obj_new_str(cache_policies[i].value, strlen(cache_policies[i].value)));
+            }
+        }
+        if (cache_policy_hashed[0]) {
+            mp_obj_dict_store(dict, MP_OBJ_NEW_QSTR(MP_QSTR_hashed),
+                              mp_obj_new_str(cache_policy_hashed, strlen(cache_policy_hashed)));
+        }
+        return dict;
+    }
+
+    const char *ext = mp_obj_str_get_str(args[0]);
+    const char *value = "";
+    if (n_args > 1 && args[1] != mp_const_none) {
+        value = mp_obj_str_get_str(args[1]);
+    }
+    if (strlen(value) >= CACHE_POLICY_LEN) {
+        mp_raise_ValueError(MP_ERROR_TEXT("policy too long"));
+    }
+
+    // Cached responses carry the old Cache-Control header
+    webfiles_cache_invalidate(NULL);
+
+    if (strcmp(ext, "hashed") == 0) {
+        strlcpy(cache_policy_hashed, value, sizeof(cache_policy_hashed));
+        return mp_const_none;
+    }
+    if ((ext[0] != '.' && strcmp(ext, "*") != 0) || strlen(ext) >= sizeof(cache_policies[0].ext)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("expected '.ext', '*' or 'hashed'"));
+    }
+
+    cache_policy_t *slot = NULL;
+    for (int i = 0; i < CACHE_POLICY_MAX; i++) {
+        if (cache_policies[i].ext[0] && strcasecmp(cache_policies[i].ext, ext) == 0) {
+            slot = &cache_policies[i];
+            break;
+        }
+        if (!slot && !cache_policies[i].ext[0]) {
+            slot = &cache_policies[i];
+        }
+    }
+    if (!value[0]) {
+        if (slot && slot->ext[0]) {
+            slot->ext[0] = '\0';
+        }
+        return mp_const_none;
+    }
+    if (!slot) {
+        mp_raise_ValueError(MP_ERROR_TEXT("too many cache policies"));
+    }
+    // Value first, so the server task never sees the extension with a stale value
+    strlcpy(slot->value, value, sizeof(slot->value));
+    strlcpy(slot->ext, ext, sizeof(slot->ext));
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(webfiles_cache_control_obj, 0, 2, webfiles_cache_control);
+
+// webfiles.cache(budget=None, max_file=None, meta_ttl=None) -> dict
+// Set the asset cache's PSRAM budget in bytes (0 disables and empties it),
+// the largest file it holds and how long file metadata is trusted in ms
+// (0 disables the metadata cache); returns the statistics of both.
+static mp_obj_t webfiles_cache(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    enum { ARG_budget, ARG_max_file, ARG_meta_ttl };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_budget,   MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_max_file, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+        { MP_QSTR_meta_ttl, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (!webfiles_cache_setup()) {
+        mp_raise_OSError(MP_ENOMEM);
+    }
+
+    if (args[ARG_meta_ttl].u_obj != mp_const_none) {
+        mp_int_t ttl = mp_obj_get_int(args[ARG_meta_ttl].u_obj);
+        if (ttl < 0) {
+            mp_raise_ValueError(MP_ERROR_TEXT("meta_ttl must be >= 0"));
+        }
+        meta_cache_ttl_ms = ttl;
+    }
+
+    if (args[ARG_max_file].u_obj != mp_const_none) {
+        mp_int_t max_file = mp_obj_get_int(args[ARG_max_file].u_obj);
+        if (max_file < 0) {
+            mp_raise_ValueError(MP_ERROR_TEXT("max_file must be >= 0"));
+        }
+        asset_cache_max_file = max_file;
+    }
+    if (args[ARG_budget].u_obj != mp_const_none) {
+        mp_int_t budget = mp_obj_get_int(args[ARG_budget].u_obj);
+        if (budget < 0) {
+            mp_raise_ValueError(MP_ERROR_TEXT("budget must be >= 0"));
+        }
+        xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+        asset_cache_budget = budget;
+        asset_cache_evict(0);
+        xSemaphoreGive(asset_cache_mutex);
+    }
+
+    xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+    size_t entries = 0;
+    for (asset_cache_entry_t *entry = asset_cache; entry; entry = entry->next) {
+        entries++;
+    }
+    mp_obj_t stats[][2] = {
+        { MP_OBJ_NEW_QSTR(MP_QSTR_budget),    mp_obj_new_int_from_uint(asset_cache_budget) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_max_file),  mp_obj_new_int_from_uint(asset_cache_max_file) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_used),      mp_obj_new_int_from_uint(asset_cache_used) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_entries),   mp_obj_new_int_from_uint(entries) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_hits),      mp_obj_new_int_from_uint(asset_cache_stats.hits) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_misses),    mp_obj_new_int_from_uint(asset_cache_stats.misses) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_stores),    mp_obj_new_int_from_uint(asset_cache_stats.stores) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_evictions), mp_obj_new_int_from_uint(asset_cache_stats.evictions) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_meta_ttl),    mp_obj_new_int_from_uint(meta_cache ? meta_cache_ttl_ms : 0) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_meta_hits),   mp_obj_new_int_from_uint(meta_cache_stats.hits) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_meta_misses), mp_obj_new_int_from_uint(meta_cache_stats.misses) },
+    };
+    xSemaphoreGive(asset_cache_mutex);
+
+    mp_obj_t dict = mp_obj_new_dict(MP_ARRAY_SIZE(stats));
+    for (size_t i = 0; i < MP_ARRAY_SIZE(stats); i++) {
+        mp_obj_dict_store(dict, stats[i][0], stats[i][1]);
+    }
+    return dict;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(webfiles_cache_obj, 0, webfiles_cache);
+
+// webfiles.invalidate(path=None)
+// Drop the cached copy of a file (full filesystem path, e.g. "/www/app.js"),
+// or every cached file
+static mp_obj_t webfiles_invalidate(size_t n_args, const mp_obj_t *args) {
+    if (n_args > 0 && args[0] != mp_const_none) {
+        const char *path = mp_obj_str_get_str(args[0]);
+        if (path[0] != '/') {
+            mp_raise_ValueError(MP_ERROR_TEXT("path must be absolute"));
+        }
+        webfiles_cache_invalidate(path);
+    } else {
+        webfiles_cache_invalidate(NULL);
+    }
+    return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(webfiles_invalidate_obj, 0, 1, webfiles_invalidate);
+
+
+// webfiles.precompress(path=None) -> dict
+// Queue a file for a background .gz variant, e.g. after writing it from
+// Python. Returns the task's counters.
+static mp_obj_t webfiles_precompress(size_t n_args, const mp_obj_t *args) {
+    if (n_args > 0 && args[0] != mp_const_none) {
+        const char *path = mp_obj_str_get_str(args[0]);
+        if (path[0] != '/') {
+            mp_raise_ValueError(MP_ERROR_TEXT("path must be absolute"));
+        }
+#if WEBFILES_PRECOMPRESS
+        precompress_start();
+        webfiles_precompress_queue(path);
+#else
+        mp_raise_NotImplementedError(MP_ERROR_TEXT("no deflate compressor on this chip"));
+#endif
+    }
+
+#if WEBFILES_PRECOMPRESS
+    precompress_stats_t counts = {0};
+    if (precompress_queue) {
+        xSemaphoreTake(asset_cache_mutex, portMAX_DELAY);
+        counts = precompress_stats;
+        xSemaphoreGive(asset_cache_mutex);
+    }
+    mp_obj_t stats[][2] = {
+        { MP_OBJ_NEW_QSTR(MP_QSTR_pending),    mp_obj_new_int_from_uint(precompress_queue ? uxQueueMessagesWaiting(precompress_queue) : 0) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_compressed), mp_obj_new_int_from_uint(counts.compressed) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_skipped),    mp_obj_new_int_from_uint(counts.skipped) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_failed),     mp_obj_new_int_from_uint(counts.failed) },
+        { MP_OBJ_NEW_QSTR(MP_QSTR_dropped),    mp_obj_new_int_from_uint(counts.dropped) },
+    };
+    mp_obj_t dict = mp_obj_new_dict(MP_ARRAY_SIZE(stats));
+    for (size_t i = 0; i < MP_ARRAY_SIZE(stats); i++) {
+        mp_obj_dict_store(dict, stats[i][0], stats[i][1]);
+    }
+    return dict;
+#else
+    return mp_obj_new_dict(0);
+#endif
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(webfiles_precompress_obj, 0, 1, webfiles_precompress);
+
 // Forward declarations for www partition functions
 static mp_obj_t webfiles_mount_www(void);
 static mp_obj_t webfiles_mount_www_rw(void);
@@ -984,6 +2964,7 @@ static mp_obj_t webfiles_mount_www_rw(void) {
         mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Failed to mount www partition read-write (%d)\n", err);
         return mp_obj_new_bool(false);
     }
+    precompress_start();
     mp_printf(&mp_plat_print, "[WEBFILES] www partition mounted successfully (read-write)\n");
     return mp_obj_new_bool(true);
 }
@@ -1003,8 +2984,14 @@ static mp_obj_t webfiles_copy_to_www(mp_obj_t src_path_obj, mp_obj_t dst_filenam
     const char* src_path = mp_obj_str_get_str(src_path_obj);
     const char* dst_filename = mp_obj_str_get_str(dst_filename_obj);
 
+    // Drop cached copies before and after, so none is refilled from a partial file
+    char dst_path[FILE_PATH_MAX];
+    snprintf(dst_path, sizeof(dst_path), "%s/%s", www_mount_point, dst_filename);
+    webfiles_cache_invalidate(dst_path);
     bool success = copy_file_to_www(src_path, dst_filename);
+    webfiles_cache_invalidate(dst_path);
     if (success) {
+        webfiles_precompress_queue(dst_path);
         mp_printf(&mp_plat_print, "[WEBFILES] Successfully copied %s to /www/%s\n", src_path, dst_filename);
     } else {
         mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Failed to copy %s to /www/%s\n", src_path, dst_filename);
@@ -1016,6 +3003,7 @@ static mp_obj_t webfiles_copy_to_www(mp_obj_t src_path_obj, mp_obj_t dst_filenam
 // webfiles.unmount_www() -> bool
 // Unmount the www partition
 static mp_obj_t webfiles_unmount_www(void) {
+    webfiles_cache_invalidate(NULL);
     esp_err_t err = unmount_www_partition();
     if (err != ESP_OK) {
         mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Failed to unmount www partition (%d)\n", err);
@@ -1061,10 +3049,158 @@ static mp_obj_t webfiles_serve_www(mp_obj_t uri_prefix_obj) {
         return mp_obj_new_bool(false);
     }
 
+    webfiles_cache_setup();
+    precompress_start();
     mp_printf(&mp_plat_print, "[WEBFILES] Direct file server started at: %s\n", prefix);
     return mp_obj_new_bool(true);
 }
 
+// webfiles.serve_bundle(uri_prefix="/", partition="assets") -> bool
+// Map a bundle image written by tools/mkwebbundle.py and serve it at uri_prefix.
+// The partition stays mapped until reset; calling again adds another prefix,
+// up to BUNDLE_PREFIX_MAX.
+static mp_obj_t webfiles_serve_bundle(size_t n_args, const mp_obj_t *args) {
+    const char *prefix = n_args > 0 ? mp_obj_str_get_str(args[0]) : "/";
+    const char *label = n_args > 1 ? mp_obj_str_get_str(args[1]) : "assets";
+
+    httpd_handle_t server = httpserver_get_handle();
+    if (!server) {
+        mp_printf(&mp_plat_print, "[WEBFILES] ERROR: HTTP server not running\n");
+        return mp_obj_new_bool(false);
+    }
+    if (bundle_prefixes >= BUNDLE_PREFIX_MAX) {
+        mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Bundle already served at %d prefixes\n", BUNDLE_PREFIX_MAX);
+        return mp_obj_new_bool(false);
+    }
+
+    if (bundle.count == 0) {
+        const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                               ESP_PARTITION_SUBTYPE_ANY, label);
+        if (!part) {
+            mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Partition '%s' not found\n", label);
+            return mp_obj_new_bool(false);
+        }
+        const void *base = NULL;
+        esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &base, &bundle_mmap);
+        if (err != ESP_OK) {
+            mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Failed to map partition '%s' (%d)\n", label, err);
+            return mp_obj_new_bool(false);
+        }
+        if (!webbundle_open(&bundle, base, part->size)) {
+            esp_partition_munmap(bundle_mmap);
+            mp_printf(&mp_plat_print, "[WEBFILES] ERROR: No valid bundle in partition '%s'\n", label);
+            return mp_obj_new_bool(false);
+        }
+        strlcpy(bundle_partition, label, sizeof(bundle_partition));
+        mp_printf(&mp_plat_print, "[WEBFILES] Bundle mapped: %lu assets, %lu bytes\n",
+                  (unsigned long)bundle.count, (unsigned long)bundle.size);
+    } else if (strcmp(label, bundle_partition) != 0) {
+        // Requests may be reading the mapped image at any time, so it is never unmapped
+        mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Bundle already mapped from '%s'\n", bundle_partition);
+        return mp_obj_new_bool(false);
+    }
+
+    // The prefix is stripped from request paths, so "/app", "/app/" and
+    // "/app/*" all serve the bundle's /index.html at /app/
+    size_t len = strlen(prefix);
+    if (len > 0 && prefix[len - 1] == '*') {
+        len--;
+    }
+    if (len > 0 && prefix[len - 1] == '/') {
+        len--;
+    }
+    char pattern[64];
+    if (len + 3 > sizeof(pattern)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("URI prefix too long"));
+    }
+    snprintf(pattern, sizeof(pattern), "%.*s/*", (int)len, prefix);
+
+    httpd_method_t methods[] = { HTTP_GET, HTTP_HEAD };
+    for (size_t i = 0; i < MP_ARRAY_SIZE(methods); i++) {
+        httpd_uri_t uri_handler = {
+            .uri      = pattern,
+            .method   = methods[i],
+            .handler  = webfiles_bundle_handler,
+            .user_ctx = (void *)(uintptr_t)len
+        };
+        esp_err_t ret = httpd_register_uri_handler(server, &uri_handler);
+        if (ret != ESP_OK) {
+            mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Failed to register bundle handler (error %d)\n", ret);
+            if (i > 0) {
+                httpd_unregister_uri_handler(server, pattern, HTTP_GET);
+            }
+            return mp_obj_new_bool(false);
+        }
+    }
+    bundle_prefixes++;
+
+    mp_printf(&mp_plat_print, "[WEBFILES] Bundle server started at: %s\n", pattern);
+    return mp_obj_new_bool(true);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(webfiles_serve_bundle_obj, 0, 2, webfiles_serve_bundle);
+
+// Called by httpserver.stop(): the bundle's handlers went with the server
+void webfiles_server_stopped(void) {
+    bundle_prefixes = 0;
+}
+
+// webfiles.serve_index(prefix="/_fs", root="/") -> bool
+// Directory listings at <prefix>/list and batch file reads at <prefix>/batch,
+// for files under root, on the HTTP and HTTPS servers. Calling again moves them.
+static mp_obj_t webfiles_serve_index(size_t n_args, const mp_obj_t *args) {
+    const char *prefix = n_args > 0 ? mp_obj_str_get_str(args[0]) : "/_fs";
+    const char *root = n_args > 1 ? mp_obj_str_get_str(args[1]) : "/";
+
+    httpd_handle_t servers[2] = { httpserver_get_handle(), httpserver_get_https_handle() };
+    if (!servers[0]) {
+        mp_printf(&mp_plat_print, "[WEBFILES] ERROR: HTTP server not running\n");
+        return mp_obj_new_bool(false);
+    }
+    size_t len = strlen(prefix);
+    while (len > 1 && prefix[len - 1] == '/') {
+        len--;
+    }
+    if (prefix[0] != '/' || len + 7 > sizeof(index_list_uri)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid index prefix"));
+    }
+    if (root[0] != '/' || strlen(root) >= sizeof(index_root)) {
+        mp_raise_ValueError(MP_ERROR_TEXT("Invalid root directory"));
+    }
+
+    for (int s = 0; s < 2 && index_list_uri[0]; s++) {
+        if (servers[s]) {
+            httpd_unregister_uri_handler(servers[s], index_list_uri, HTTP_GET);
+            httpd_unregister_uri_handler(servers[s], index_batch_uri, HTTP_POST);
+        }
+    }
+    strlcpy(index_root, root, sizeof(index_root));
+    if (len == 1) {
+        len = 0;  // "/" serves /list and /batch
+    }
+    snprintf(index_list_uri, sizeof(index_list_uri), "%.*s/list", (int)len, prefix);
+    snprintf(index_batch_uri, sizeof(index_batch_uri), "%.*s/batch", (int)len, prefix);
+
+    httpd_uri_t handlers[2] = {
+        { .uri = index_list_uri, .method = HTTP_GET, .handler = webfiles_index_list_handler },
+        { .uri = index_batch_uri, .method = HTTP_POST, .handler = webfiles_index_batch_handler },
+    };
+    for (int s = 0; s < 2; s++) {
+        for (int h = 0; servers[s] && h < 2; h++) {
+            esp_err_t ret = httpd_register_uri_handler(servers[s], &handlers[h]);
+            if (ret != ESP_OK) {
+                mp_printf(&mp_plat_print, "[WEBFILES] ERROR: Failed to register %s (error %d)\n",
+                          handlers[h].uri, ret);
+                return mp_obj_new_bool(false);
+            }
+        }
+    }
+
+    webfiles_cache_setup();
+    mp_printf(&mp_plat_print, "[WEBFILES] Index of %s at %s and %s\n", index_root, index_list_uri, index_batch_uri);
+    return mp_obj_new_bool(true);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(webfiles_serve_index_obj, 0, 2, webfiles_serve_index);
+
 // webfiles.check_vfs(path) -> None
 // Diagnostic function to check ESP-IDF VFS access
 static mp_obj_t webfiles_check_vfs(mp_obj_t path_obj) {
@@ -1130,7 +3266,13 @@ static const mp_rom_map_elem_t webfiles_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_unmount_www), MP_ROM_PTR(&webfiles_unmount_www_obj) },
     { MP_ROM_QSTR(MP_QSTR_copy_to_www), MP_ROM_PTR(&webfiles_copy_to_www_obj) },
     { MP_ROM_QSTR(MP_QSTR_serve_www), MP_ROM_PTR(&webfiles_serve_www_obj) },
+    { MP_ROM_QSTR(MP_QSTR_serve_bundle), MP_ROM_PTR(&webfiles_serve_bundle_obj) },
+    { MP_ROM_QSTR(MP_QSTR_serve_index), MP_ROM_PTR(&webfiles_serve_index_obj) },
     { MP_ROM_QSTR(MP_QSTR_check_vfs), MP_ROM_PTR(&webfiles_check_vfs_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cache_control), MP_ROM_PTR(&webfiles_cache_control_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cache), MP_ROM_PTR(&webfiles_cache_obj) },
+    { MP_ROM_QSTR(MP_QSTR_invalidate), MP_ROM_PTR(&webfiles_invalidate_obj) },
+    { MP_ROM_QSTR(MP_QSTR_precompress), MP_ROM_PTR(&webfiles_precompress_obj) },
 
     // MIME type constants
     { MP_ROM_QSTR(MP_QSTR_MIME_HTML), MP_ROM_QSTR(MP_QSTR_text_html) },
@@ -6,12 +6,14 @@
  * - Activity tracking with automatic disconnect
  * - C callbacks for high-performance protocol implementations
  * - Pre-queue filter callbacks for urgent message handling
+ * - Additional C-only endpoints on their own paths (e.g. /gvret)
  *
  * Copyright (c) 2026 Jonathan Elliot Peace
  * SPDX-License-Identifier: MIT
  */
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
@@ -33,6 +35,8 @@
 #include "py/objstr.h"
 #include "py/mphal.h"
 
+#include "wsserver.h"
+
 // External functions from httpserver module
 extern httpd_handle_t httpserver_get_handle(void);
 extern httpd_handle_t httpserver_get_https_handle(void);
@@ -45,10 +49,8 @@ static const char *TAG = "WSSERVER";
 // Max number of concurrent clients
 #define MAX_WS_CLIENTS 5
 
-// Event types
-#define WSSERVER_EVENT_CONNECT    0
-#define WSSERVER_EVENT_DISCONNECT 1
-#define WSSERVER_EVENT_MESSAGE    2
+// Max number of additional C endpoints (paths other than the main wsserver path)
+#define MAX_WS_ENDPOINTS 4
 
 // Message types for queue - match those in modhttpserver.c
 #define HTTP_MSG_WEBSOCKET 1
@@ -59,6 +61,7 @@ typedef struct {
     bool active;
     int64_t last_activity;  // Timestamp of any client activity (microseconds)
     httpd_handle_t server_handle;  // Which server this client is connected to (HTTP or HTTPS)
+    int endpoint;  // Index into ws_endpoints, or -1 for the main wsserver path
 } ws_client_t;
 
 // Callback structure for MicroPython callbacks
@@ -67,13 +70,6 @@ typedef struct {
     mp_obj_t func;  // MicroPython function object
 } wsserver_callback_t;
 
-// C callback function types
-typedef void (*wsserver_connect_cb_t)(int client_id);
-typedef void (*wsserver_disconnect_cb_t)(int client_id);
-typedef void (*wsserver_message_cb_t)(int client_id, const uint8_t *data, size_t len, bool is_binary);
-// Pre-queue filter: return true to process normally, false to skip queuing
-typedef bool (*wsserver_prequeue_filter_cb_t)(int client_id, const uint8_t *data, size_t len, bool is_binary);
-
 // C callback structure
 typedef struct {
     bool active;
@@ -85,10 +81,21 @@ typedef struct {
     } func;
 } wsserver_c_callback_t;
 
+// Additional C endpoint (own path, own callbacks)
+// Messages for these clients are dispatched directly in the HTTP server task
+// and never queued to the MicroPython task
+typedef struct {
+    bool active;
+    char path[32];
+    wsserver_connect_cb_t connect;
+    wsserver_disconnect_cb_t disconnect;
+    wsserver_message_cb_t message;
+} wsserver_endpoint_t;
+
 // Forward declarations
 static void init_clients(void);
 static int find_free_client_slot(void);
-static int add_client(int sockfd, httpd_handle_t server_handle);
+static int add_client(int sockfd, httpd_handle_t server_handle, int endpoint);
 static int find_client_by_fd(int sockfd);
 static void remove_client(int slot);
 static bool is_client_valid(int client_id);
@@ -112,11 +119,11 @@ static ws_client_t ws_clients[MAX_WS_CLIENTS] = {0};
 static wsserver_callback_t wsserver_callbacks[3]; // CONNECT, DISCONNECT, MESSAGE
 
 // Storage for C callback functions (used by webrepl and other C modules)
-// Event types - need to add PREQUEUE_FILTER
-#define WSSERVER_EVENT_PREQUEUE_FILTER 3
-
 static wsserver_c_callback_t wsserver_c_callbacks[4]; // CONNECT, DISCONNECT, MESSAGE, PREQUEUE_FILTER
 
+// Additional C endpoints registered with wsserver_register_endpoint()
+static wsserver_endpoint_t ws_endpoints[MAX_WS_ENDPOINTS];
+
 // ------------------------------------------------------------------------
 // Client Management Functions
 // ------------------------------------------------------------------------
@@ -127,6 +134,7 @@ static void init_clients(void) {
         ws_clients[i].sockfd = -1;
         ws_clients[i].last_activity = 0;
         ws_clients[i].server_handle = NULL;
+        ws_clients[i].endpoint = -1;
     }
 }
 
@@ -139,14 +147,15 @@ static int find_free_client_slot(void) {
     return -1; // No free slots
 }
 
-static int add_client(int sockfd, httpd_handle_t server_handle) {
+static int add_client(int sockfd, httpd_handle_t server_handle, int endpoint) {
     int slot = find_free_client_slot();
     if (slot >= 0) {
         ws_clients[slot].sockfd = sockfd;
         ws_clients[slot].active = true;
         ws_clients[slot].last_activity = esp_timer_get_time() / 1000;  // Store in milliseconds
         ws_clients[slot].server_handle = server_handle;
-        ESP_LOGI(TAG, "Added client %d with socket %d on server %p", slot, sockfd, server_handle);
+        ws_clients[slot].endpoint = endpoint;
+        ESP_LOGI(TAG, "Added client %d with socket %d on server %p (endpoint %d)", slot, sockfd, server_handle, endpoint);
         return slot;
     }
     ESP_LOGE(TAG, "No free client slots available");
@@ -367,6 +376,17 @@ static void handle_client_disconnect(int client_slot) {
     int sockfd = ws_clients[client_slot].sockfd;
     ws_clients[client_slot].sockfd = -1;
     
+    // Endpoint clients only notify their own endpoint (no Python events)
+    int endpoint = ws_clients[client_slot].endpoint;
+    if (endpoint >= 0) {
+        ws_clients[client_slot].endpoint = -1;
+        if (ws_endpoints[endpoint].active && ws_endpoints[endpoint].disconnect) {
+            ws_endpoints[endpoint].disconnect(client_slot);
+        }
+        ESP_LOGI(TAG, "Endpoint client %d cleanup complete (socket %d closed)", client_slot, sockfd);
+        return;
+    }
+    
     // Call C disconnect callback IMMEDIATELY (don't queue)
     // This ensures cleanup happens even if the queue is blocked by long-running scripts
     if (wsserver_c_callbacks[WSSERVER_EVENT_DISCONNECT].active) {
@@ -399,9 +419,20 @@ static esp_err_t ws_handler(httpd_req_t *req) {
         ESP_LOGI(TAG, "WebSocket handshake received");
         int sockfd = httpd_req_to_sockfd(req);
         httpd_handle_t server_handle = req->handle;  // Store which server this client connected to
-        int client_slot = add_client(sockfd, server_handle);
+        int endpoint = req->user_ctx ? (int)(intptr_t)req->user_ctx - 1 : -1;
+        if (endpoint >= 0 && !ws_endpoints[endpoint].active) {
+            // Unregistered while this handshake was in flight
+            ESP_LOGW(TAG, "Rejecting client on disabled endpoint %d", endpoint);
+            return ESP_FAIL;
+        }
+        int client_slot = add_client(sockfd, server_handle, endpoint);
         
-        if (client_slot >= 0) {
+        if (client_slot >= 0 && endpoint >= 0) {
+            // Endpoint clients are handled entirely in C - no Python events
+            if (ws_endpoints[endpoint].active && ws_endpoints[endpoint].connect) {
+                ws_endpoints[endpoint].connect(client_slot);
+            }
+        } else if (client_slot >= 0) {
             ESP_LOGI(TAG, "Added client %d with socket %d", client_slot, sockfd);
             ESP_LOGI(TAG, "Client %d connected, socket fd: %d", client_slot, sockfd);
             
@@ -505,6 +536,17 @@ static esp_err_t ws_handler(httpd_req_t *req) {
         return ESP_OK;
     }
     
+    // Endpoint clients: dispatch directly in HTTP server task, skip the queue
+    int endpoint = ws_clients[client_slot].endpoint;
+    if (endpoint >= 0) {
+        if (ws_endpoints[endpoint].active && ws_endpoints[endpoint].message &&
+            (ws_pkt.type == HTTPD_WS_TYPE_TEXT || ws_pkt.type == HTTPD_WS_TYPE_BINARY)) {
+            ws_endpoints[endpoint].message(client_slot, buf, ws_pkt.len, ws_pkt.type == HTTPD_WS_TYPE_BINARY);
+        }
+        free(buf);
+        return ESP_OK;
+    }
+    
     // Process message based on type
     if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
         ESP_LOGI(TAG, "Rx TEXT msg: '%s'", buf);
@@ -572,12 +614,21 @@ static void ws_ping_timer_callback(void* arg) {
 // C API Functions (for use by other C modules like webrepl)
 // ------------------------------------------------------------------------
 
+// Sends queued by wsserver_send_to_client() that the HTTP server task has
+// not completed yet (bulk senders use it to pace themselves)
+static volatile int ws_sends_pending = 0;
+
 // Callback to free payload after async send completes
 static void wsserver_send_complete_cb(esp_err_t err, int sockfd, void *arg) {
     uint8_t *payload = (uint8_t *)arg;
     if (payload) {
         free(payload);
     }
+    __sync_fetch_and_sub(&ws_sends_pending, 1);
+}
+
+int wsserver_pending_sends(void) {
+    return ws_sends_pending;
 }
 
 // Register C callback for WebSocket events
@@ -614,6 +665,121 @@ bool wsserver_register_c_callback(int event_type, void *callback_func) {
     return true;
 }
 
+// Whether a client is still attached to endpoint slot i
+static bool endpoint_has_clients(int i) {
+    for (int c = 0; c < MAX_WS_CLIENTS; c++) {
+        if (ws_clients[c].active && ws_clients[c].endpoint == i) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Register an additional WebSocket endpoint on its own path
+// Unlike wsserver_register_c_callback(), the callbacks only see clients that
+// connected to this path, and all events (including messages) are delivered
+// in the HTTP server task without going through the MicroPython queue.
+// Replies are sent with wsserver_send_to_client() as usual.
+// wsserver must already be running (the endpoint shares its server handles).
+bool wsserver_register_endpoint(const char *path, wsserver_connect_cb_t connect_cb,
+                                wsserver_disconnect_cb_t disconnect_cb, wsserver_message_cb_t message_cb) {
+    if (!wsserver_running || !ws_server) {
+        ESP_LOGE(TAG, "wsserver must be running before registering endpoint");
+        return false;
+    }
+    if (!path || strlen(path) >= sizeof(ws_endpoints[0].path)) {
+        ESP_LOGE(TAG, "Invalid endpoint path");
+        return false;
+    }
+    
+    // Reuse an existing slot for the same path (re-registration replaces callbacks),
+    // else a free one: never used, or unregistered with none of its clients left
+    int slot = -1;
+    for (int i = 0; i < MAX_WS_ENDPOINTS; i++) {
+        if (ws_endpoints[i].path[0] && strcmp(ws_endpoints[i].path, path) == 0) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !ws_endpoints[i].active && !endpoint_has_clients(i)) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        ESP_LOGE(TAG, "No free endpoint slots available");
+        return false;
+    }
+    
+    // An unregistered slot no longer has its URI handler
+    bool is_new = !ws_endpoints[slot].active;
+    strcpy(ws_endpoints[slot].path, path);
+    ws_endpoints[slot].connect = connect_cb;
+    ws_endpoints[slot].disconnect = disconnect_cb;
+    ws_endpoints[slot].message = message_cb;
+    ws_endpoints[slot].active = true;
+    
+    if (!is_new) {
+        ESP_LOGI(TAG, "Updated callbacks for endpoint '%s'", path);
+        return true;
+    }
+    
+    // user_ctx carries the endpoint index + 1 (NULL means main wsserver path)
+    httpd_uri_t ws_uri = {
+        .uri = ws_endpoints[slot].path,
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .user_ctx = (void *)(intptr_t)(slot + 1)
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+        ,
+        .is_websocket = true,
+        .handle_ws_control_frames = true,
+        .supported_subprotocol = NULL
+#endif
+    };
+    
+    esp_err_t ret = httpd_register_uri_handler(ws_server, &ws_uri);
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_HANDLER_EXISTS) {
+        ESP_LOGE(TAG, "Failed to register endpoint '%s' on HTTP: %d (0x%x)", path, ret, ret);
+        memset(&ws_endpoints[slot], 0, sizeof(ws_endpoints[slot]));
+        return false;
+    }
+    
+    httpd_handle_t https_server = httpserver_get_https_handle();
+    if (https_server != NULL) {
+        ret = httpd_register_uri_handler(https_server, &ws_uri);
+        if (ret != ESP_OK && ret != ESP_ERR_HTTPD_HANDLER_EXISTS) {
+            ESP_LOGE(TAG, "Failed to register endpoint '%s' on HTTPS: %d (0x%x)", path, ret, ret);
+            // Don't fail completely - HTTP handler is registered
+        }
+    }
+    
+    ESP_LOGI(TAG, "Registered C endpoint '%s' (slot %d)", path, slot);
+    return true;
+}
+
+// Remove an endpoint: its URI handler goes and its clients are disconnected
+// (without callbacks). The slot is reused once they have all closed.
+void wsserver_unregister_endpoint(const char *path) {
+    for (int i = 0; i < MAX_WS_ENDPOINTS; i++) {
+        if (ws_endpoints[i].active && strcmp(ws_endpoints[i].path, path) == 0) {
+            ws_endpoints[i].active = false;
+            if (ws_server) {
+                httpd_unregister_uri_handler(ws_server, ws_endpoints[i].path, HTTP_GET);
+            }
+            httpd_handle_t https_server = httpserver_get_https_handle();
+            if (https_server != NULL) {
+                httpd_unregister_uri_handler(https_server, ws_endpoints[i].path, HTTP_GET);
+            }
+            for (int c = 0; c < MAX_WS_CLIENTS; c++) {
+                if (ws_clients[c].active && ws_clients[c].endpoint == i) {
+                    httpd_sess_trigger_close(ws_clients[c].server_handle, ws_clients[c].sockfd);
+                }
+            }
+            ESP_LOGI(TAG, "Unregistered C endpoint '%s'", path);
+            return;
+        }
+    }
+}
+
 // Get wsserver handle (for sending messages directly)
 httpd_handle_t wsserver_get_handle(void) {
     return ws_server;
@@ -662,11 +828,13 @@ bool wsserver_send_to_client(int client_id, const uint8_t *data, size_t len, boo
     
     // Use async send with callback to free payload after send completes
     // This queues the send to HTTP server task, ensuring thread safety
+    __sync_fetch_and_add(&ws_sends_pending, 1);
     esp_err_t ret = httpd_ws_send_data_async(server_handle, ws_clients[client_id].sockfd, &ws_pkt,
                                              wsserver_send_complete_cb, data_copy);
     
     if (ret != ESP_OK) {
         free(data_copy);  // Free on error (callback won't be called)
+        __sync_fetch_and_sub(&ws_sends_pending, 1);
         ESP_LOGE(TAG, "Failed to send to client %d: error %d (0x%x)", client_id, ret, ret);
         
         // Check for fatal errors that indicate dead connection
@@ -731,7 +899,7 @@ bool wsserver_start_c(const char *path, int ping_interval, int ping_timeout) {
         httpd_config_t config = HTTPD_DEFAULT_CONFIG();
         config.server_port = 8080;
         config.max_open_sockets = MAX_WS_CLIENTS + 2;
-        config.max_uri_handlers = 2;
+        config.max_uri_handlers = 2 + MAX_WS_ENDPOINTS;
         config.lru_purge_enable = true;
         config.recv_wait_timeout = 10;
         config.send_wait_timeout = 10;
@@ -869,7 +1037,7 @@ static mp_obj_t wsserver_start(size_t n_args, const mp_obj_t *pos_args, mp_map_t
         httpd_config_t config = HTTPD_DEFAULT_CONFIG();
         config.server_port = 8080;
         config.max_open_sockets = MAX_WS_CLIENTS + 2;
-        config.max_uri_handlers = 2;
+        config.max_uri_handlers = 2 + MAX_WS_ENDPOINTS;
         config.lru_purge_enable = true;
         config.recv_wait_timeout = 10;
         config.send_wait_timeout = 10;
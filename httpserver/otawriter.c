@@ -0,0 +1,391 @@
+/*
+ * otawriter.c - Streaming firmware image writer and verifier (see otawriter.h)
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "otawriter.h"
+
+#include <string.h>
+
+//=============================================================================
+// SHA-256
+//=============================================================================
+
+#ifdef ESP_PLATFORM
+
+void otawriter_sha256_init(otawriter_sha256_t *sha) {
+    mbedtls_sha256_init(sha);
+    mbedtls_sha256_starts(sha, 0);
+}
+
+void otawriter_sha256_update(otawriter_sha256_t *sha, const uint8_t *data, size_t len) {
+    mbedtls_sha256_update(sha, data, len);
+}
+
+void otawriter_sha256_finish(otawriter_sha256_t *sha, uint8_t digest[32]) {
+    mbedtls_sha256_finish(sha, digest);
+    mbedtls_sha256_free(sha);
+}
+
+static void otawriter_sha256_clone(otawriter_sha256_t *dst, const otawriter_sha256_t *src) {
+    mbedtls_sha256_init(dst);
+    mbedtls_sha256_clone(dst, src);
+}
+
+#else
+
+static const uint32_t otawriter_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define OTAWRITER_ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void otawriter_sha256_block(otawriter_sha256_t *sha, const uint8_t *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) |
+               ((uint32_t)p[i * 4 + 2] << 8) | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = OTAWRITER_ROR(w[i - 15], 7) ^ OTAWRITER_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = OTAWRITER_ROR(w[i - 2], 17) ^ OTAWRITER_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+    uint32_t e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (OTAWRITER_ROR(e, 6) ^ OTAWRITER_ROR(e, 11) ^ OTAWRITER_ROR(e, 25)) +
+                      ((e & f) ^ (~e & g)) + otawriter_sha256_k[i] + w[i];
+        uint32_t t2 = (OTAWRITER_ROR(a, 2) ^ OTAWRITER_ROR(a, 13) ^ OTAWRITER_ROR(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+    sha->state[5] += f;
+    sha->state[6] += g;
+    sha->state[7] += h;
+}
+
+void otawriter_sha256_init(otawriter_sha256_t *sha) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(sha->state, iv, sizeof(iv));
+    sha->bytes = 0;
+}
+
+void otawriter_sha256_update(otawriter_sha256_t *sha, const uint8_t *data, size_t len) {
+    size_t used = sha->bytes % 64;
+    sha->bytes += len;
+    if (used > 0) {
+        size_t n = 64 - used < len ? 64 - used : len;
+        memcpy(sha->block + used, data, n);
+        data += n;
+        len -= n;
+        if (used + n < 64) {
+            return;
+        }
+        otawriter_sha256_block(sha, sha->block);
+    }
+    for (; len >= 64; data += 64, len -= 64) {
+        otawriter_sha256_block(sha, data);
+    }
+    memcpy(sha->block, data, len);
+}
+
+void otawriter_sha256_finish(otawriter_sha256_t *sha, uint8_t digest[32]) {
+    uint64_t bits = sha->bytes * 8;
+    uint8_t pad[72] = { 0x80 };
+    size_t pad_len = (sha->bytes % 64 < 56 ? 56 : 120) - sha->bytes % 64;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    otawriter_sha256_update(sha, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t)(sha->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(sha->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(sha->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)sha->state[i];
+    }
+}
+
+static void otawriter_sha256_clone(otawriter_sha256_t *dst, const otawriter_sha256_t *src) {
+    *dst = *src;
+}
+
+#endif
+
+//=============================================================================
+// Image writer
+//=============================================================================
+
+static uint32_t otawriter_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int otawriter_hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+bool otawriter_parse_sha256(const char *hex, uint8_t digest[32]) {
+    if (strlen(hex) != 64) {
+        return false;
+    }
+    for (int i = 0; i < 32; i++) {
+        int hi = otawriter_hex_digit(hex[i * 2]);
+        int lo = otawriter_hex_digit(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        digest[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+static bool otawriter_fail(otawriter_t *w, const char *error) {
+    otawriter_abort(w, error);
+    return false;
+}
+
+void otawriter_abort(otawriter_t *w, const char *error) {
+    if (w->state == OTAWRITER_FAILED) {
+        return;
+    }
+    w->state = OTAWRITER_FAILED;
+    w->error = error;
+    if (w->sha_open) {
+        uint8_t digest[32];
+        otawriter_sha256_finish(&w->sha, digest);
+        w->sha_open = false;
+    }
+    if (w->started && w->target->abort) {
+        w->target->abort(w->target->ctx);
+    }
+    w->started = false;
+}
+
+bool otawriter_begin(otawriter_t *w, const otawriter_target_t *target, size_t size,
+                     uint16_t chip_id, const uint8_t expect_sha256[32]) {
+    memset(w, 0, sizeof(*w));
+    w->target = target;
+    w->state = OTAWRITER_HEADER;
+    w->size = size;
+    w->chip_id = chip_id;
+    memcpy(w->expect_sha256, expect_sha256, 32);
+    if (size < OTAWRITER_HEADER_SIZE + 8 + 1) {
+        return otawriter_fail(w, "Image too small");
+    }
+    if (!target->begin(target->ctx, size)) {
+        return otawriter_fail(w, "Image does not fit the OTA partition");
+    }
+    w->started = true;
+    otawriter_sha256_init(&w->sha);
+    w->sha_open = true;
+    return true;
+}
+
+// Collect a fixed-size field that may span chunks; returns the bytes taken
+static size_t otawriter_collect(otawriter_t *w, const uint8_t *p, size_t avail, size_t need) {
+    size_t n = need - w->field_len < avail ? need - w->field_len : avail;
+    memcpy(w->field + w->field_len, p, n);
+    w->field_len += n;
+    return n;
+}
+
+static void otawriter_next_segment(otawriter_t *w) {
+    w->field_len = 0;
+    w->state = ++w->segment < w->segments ? OTAWRITER_SEGMENT_HEADER : OTAWRITER_PADDING;
+}
+
+bool otawriter_write(otawriter_t *w, const void *data, size_t len) {
+    if (w->state == OTAWRITER_FAILED) {
+        return false;
+    }
+    if (len > w->size - w->written) {
+        return otawriter_fail(w, "Body longer than announced");
+    }
+    const uint8_t *p = data;
+    if (w->written < sizeof(w->head)) {
+        size_t n = sizeof(w->head) - w->written < len ? sizeof(w->head) - w->written : len;
+        memcpy(w->head + w->written, p, n);
+    }
+
+    // Parse the chunk before any of it reaches flash
+    size_t off = 0;
+    while (off < len) {
+        const uint8_t *q = p + off;
+        size_t avail = len - off;
+        size_t pos = w->written + off;
+        size_t take = avail;
+
+        switch (w->state) {
+            case OTAWRITER_HEADER:
+                take = otawriter_collect(w, q, avail, OTAWRITER_HEADER_SIZE);
+                if (w->field_len < OTAWRITER_HEADER_SIZE) {
+                    break;
+                }
+                if (w->field[0] != OTAWRITER_IMAGE_MAGIC) {
+                    return otawriter_fail(w, "Not an ESP application image");
+                }
+                w->segments = w->field[1];
+                if (w->segments == 0 || w->segments > OTAWRITER_SEGMENT_MAX) {
+                    return otawriter_fail(w, "Bad segment count");
+                }
+                if (w->chip_id != OTAWRITER_CHIP_ANY &&
+                    (w->field[12] | (w->field[13] << 8)) != w->chip_id) {
+                    return otawriter_fail(w, "Image is for another chip");
+                }
+                w->hash_appended = w->field[23] == 1;
+                w->checksum = 0xEF;
+                w->field_len = 0;
+                w->state = OTAWRITER_SEGMENT_HEADER;
+                break;
+
+            case OTAWRITER_SEGMENT_HEADER:
+                take = otawriter_collect(w, q, avail, 8);
+                if (w->field_len < 8) {
+                    break;
+                }
+                w->remaining = otawriter_u32(w->field + 4);
+                if (w->remaining % 4 != 0 || w->remaining > w->size - pos) {
+                    return otawriter_fail(w, "Bad segment length");
+                }
+                if (w->remaining > 0) {
+                    w->state = OTAWRITER_SEGMENT_DATA;
+                } else {
+                    otawriter_next_segment(w);
+                }
+                break;
+
+            case OTAWRITER_SEGMENT_DATA:
+                take = w->remaining < avail ? w->remaining : avail;
+                for (size_t i = 0; i < take; i++) {
+                    w->checksum ^= q[i];
+                }
+                w->remaining -= take;
+                if (w->remaining == 0) {
+                    otawriter_next_segment(w);
+                }
+                break;
+
+            case OTAWRITER_PADDING:
+                // Zero padding up to 15 mod 16, then the checksum byte
+                if (pos % 16 != 15) {
+                    size_t pad = 15 - pos % 16;
+                    take = pad < avail ? pad : avail;
+                    break;
+                }
+                take = 1;
+                if (q[0] != w->checksum) {
+                    return otawriter_fail(w, "Image checksum mismatch");
+                }
+                if (w->hash_appended) {
+                    otawriter_sha256_t image_sha;
+                    otawriter_sha256_update(&w->sha, q, 1);
+                    otawriter_sha256_clone(&image_sha, &w->sha);
+                    otawriter_sha256_finish(&image_sha, w->image_sha256);
+                    off += 1;
+                    w->field_len = 0;
+                    w->state = OTAWRITER_HASH;
+                    continue;
+                }
+                w->state = OTAWRITER_TRAILER;
+                break;
+
+            case OTAWRITER_HASH:
+                take = otawriter_collect(w, q, avail, 32);
+                if (w->field_len == 32) {
+                    if (memcmp(w->field, w->image_sha256, 32) != 0) {
+                        return otawriter_fail(w, "Image hash mismatch");
+                    }
+                    w->state = OTAWRITER_TRAILER;
+                }
+                break;
+
+            case OTAWRITER_TRAILER:
+            case OTAWRITER_FAILED:
+                break;
+        }
+        otawriter_sha256_update(&w->sha, q, take);
+        off += take;
+    }
+
+    if (!w->target->write(w->target->ctx, data, len)) {
+        return otawriter_fail(w, "Flash write failed");
+    }
+    w->written += len;
+    return true;
+}
+
+bool otawriter_end(otawriter_t *w, char sha256_hex[65]) {
+    if (w->state == OTAWRITER_FAILED) {
+        return false;
+    }
+    if (w->written != w->size || w->state != OTAWRITER_TRAILER) {
+        return otawriter_fail(w, "Image truncated");
+    }
+    uint8_t digest[32];
+    otawriter_sha256_finish(&w->sha, digest);
+    w->sha_open = false;
+    if (memcmp(digest, w->expect_sha256, 32) != 0) {
+        return otawriter_fail(w, "SHA-256 mismatch");
+    }
+    for (int i = 0; i < 32; i++) {
+        static const char hex[] = "0123456789abcdef";
+        sha256_hex[i * 2] = hex[digest[i] >> 4];
+        sha256_hex[i * 2 + 1] = hex[digest[i] & 0x0f];
+    }
+    sha256_hex[64] = '\0';
+    if (!w->target->end(w->target->ctx)) {
+        // The target has released the partition; don't abort it again
+        w->started = false;
+        return otawriter_fail(w, "Image rejected on activation");
+    }
+    w->started = false;
+    return true;
+}
+
+void otawriter_version(const otawriter_t *w, char *version, size_t size) {
+    // esp_app_desc_t follows the first segment header: magic, secure_version,
+    // 2 reserved words, version[32]
+    const uint8_t *desc = w->head + OTAWRITER_HEADER_SIZE + 8;
+    version[0] = '\0';
+    if (size == 0 || w->written < sizeof(w->head) || otawriter_u32(desc) != OTAWRITER_APP_DESC_MAGIC) {
+        return;
+    }
+    size_t len = strnlen((const char *)desc + 16, 32);
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(version, desc + 16, len);
+    version[len] = '\0';
+}
@@ -0,0 +1,124 @@
+/*
+ * otawriter.h - Streaming firmware image writer and verifier
+ *
+ * Feeds an ESP-IDF application image to an OTA target as it arrives,
+ * checking it on the way: header, chip, segment layout, the XOR checksum,
+ * the appended SHA-256 (if the image has one) and the SHA-256 of the whole
+ * body against the digest the client announced. Nothing is buffered beyond
+ * a few header bytes, so the body can go from the socket to flash in one
+ * pass.
+ *
+ * The target is a set of callbacks. On the device they wrap esp_ota_begin,
+ * esp_ota_write and esp_ota_end; on the host tools/ota_check.c uses a file
+ * as the partition. This file has no ESP-IDF dependencies except mbedtls
+ * for SHA-256 when built for the device.
+ *
+ * Image layout (esp_image_format.h), integers little-endian:
+ *
+ *   header    24 bytes: magic 0xE9, segment count, ..., chip id (u16 at
+ *             12), ..., hash_appended (byte 23)
+ *   segments  count x { load_addr u32, data_len u32, data }; the first
+ *             segment of an app starts with esp_app_desc_t
+ *   checksum  zero padding up to 15 mod 16, then the XOR of all segment
+ *             data seeded with 0xEF
+ *   hash      32-byte SHA-256 of everything above, if hash_appended
+ *   trailer   anything else (e.g. secure boot signature), not checked here
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef OTAWRITER_H
+#define OTAWRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "mbedtls/sha256.h"
+typedef mbedtls_sha256_context otawriter_sha256_t;
+#else
+typedef struct {
+    uint32_t state[8];
+    uint64_t bytes;
+    uint8_t block[64];
+} otawriter_sha256_t;
+#endif
+
+#define OTAWRITER_IMAGE_MAGIC      0xE9
+#define OTAWRITER_HEADER_SIZE      24
+#define OTAWRITER_SEGMENT_MAX      16        // ESP_IMAGE_MAX_SEGMENTS
+#define OTAWRITER_APP_DESC_MAGIC   0xABCD5432u
+#define OTAWRITER_CHIP_ANY         0xFFFF    // Skip the chip id check
+
+typedef struct {
+    bool (*begin)(void *ctx, size_t size);   // Image of size bytes follows
+    bool (*write)(void *ctx, const void *data, size_t len);
+    bool (*end)(void *ctx);                  // Complete and verified: make it bootable
+    void (*abort)(void *ctx);                // Discard what was written
+    void *ctx;
+} otawriter_target_t;
+
+typedef enum {
+    OTAWRITER_HEADER,
+    OTAWRITER_SEGMENT_HEADER,
+    OTAWRITER_SEGMENT_DATA,
+    OTAWRITER_PADDING,
+    OTAWRITER_HASH,
+    OTAWRITER_TRAILER,
+    OTAWRITER_FAILED
+} otawriter_state_t;
+
+typedef struct {
+    const otawriter_target_t *target;
+    otawriter_state_t state;
+    const char *error;          // Why the image was rejected (static string)
+    bool started;               // target->begin succeeded
+    size_t size;                // Announced body size
+    size_t written;             // Bytes passed to the target
+    uint16_t chip_id;
+    uint8_t expect_sha256[32];
+
+    // Parser
+    uint8_t head[80];           // First bytes of the body (header, app descriptor)
+    uint8_t field[32];          // Segment header or appended hash being collected
+    size_t field_len;
+    uint8_t segments;
+    uint8_t segment;
+    uint32_t remaining;         // In the current segment
+    uint8_t checksum;
+    bool hash_appended;
+
+    otawriter_sha256_t sha;     // Whole body
+    bool sha_open;
+    uint8_t image_sha256[32];   // Header to checksum, for the appended hash
+} otawriter_t;
+
+// Parse a 64-digit hex SHA-256; false if malformed
+bool otawriter_parse_sha256(const char *hex, uint8_t digest[32]);
+
+// Start an update of size bytes; chip_id is the running chip or
+// OTAWRITER_CHIP_ANY. False (with w->error set) if the target refused.
+bool otawriter_begin(otawriter_t *w, const otawriter_target_t *target, size_t size,
+                     uint16_t chip_id, const uint8_t expect_sha256[32]);
+
+// Verify and write the next chunk. False once the image is rejected; the
+// target has been aborted by then.
+bool otawriter_write(otawriter_t *w, const void *data, size_t len);
+
+// All bytes received: check completeness and digests, then target->end
+bool otawriter_end(otawriter_t *w, char sha256_hex[65]);
+
+// Give up (e.g. the connection dropped); safe to call in any state
+void otawriter_abort(otawriter_t *w, const char *error);
+
+// Firmware version from the image's app descriptor, "" if not seen yet
+void otawriter_version(const otawriter_t *w, char *version, size_t size);
+
+// Portable SHA-256 (mbedtls on the device)
+void otawriter_sha256_init(otawriter_sha256_t *sha);
+void otawriter_sha256_update(otawriter_sha256_t *sha, const uint8_t *data, size_t len);
+void otawriter_sha256_finish(otawriter_sha256_t *sha, uint8_t digest[32]);
+
+#endif // OTAWRITER_H
@@ -8,13 +8,42 @@ Tests the actual httpserver functionality that matters in production:
 - Error handling
 
 These tests run against the already-running HTTP server (don't call start/stop).
+Handlers are called by the device's own queue pump, the one that serves WebREPL;
+requests to them are made from the host, on the WebREPL URL's host and scheme.
 """
 
 import asyncio
+import json
+import ssl
 import sys
+import urllib.error
+import urllib.parse
+import urllib.request
 from webrepl_client import WebREPLTestClient, TestResult
 from test_helpers import TestAssertion
 
+async def http_request(client: WebREPLTestClient, method: str, path: str, body: bytes = None,
+                       timeout: float = 10.0):
+    """Request path from the device's HTTP server; returns (status, headers, body)"""
+    parts = urllib.parse.urlsplit(client.url)
+    scheme = 'https' if parts.scheme == 'wss' else 'http'
+    ssl_context = None
+    if scheme == 'https':
+        ssl_context = ssl.create_default_context()
+        if not client.ssl_verify:
+            ssl_context.check_hostname = False
+            ssl_context.verify_mode = ssl.CERT_NONE
+    req = urllib.request.Request(f"{scheme}://{parts.netloc}{path}", data=body, method=method)
+
+    def fetch():
+        try:
+            with urllib.request.urlopen(req, timeout=timeout, context=ssl_context) as resp:
+                return resp.status, resp.headers, resp.read()
+        except urllib.error.HTTPError as e:
+            return e.code, e.headers, e.read()
+
+    return await asyncio.to_thread(fetch)
+
 async def test_register_handler(client: WebREPLTestClient) -> bool:
     """Test registering a URI handler"""
     async with TestAssertion(client, "Register GET handler"):
@@ -133,41 +162,158 @@ httpserver.off('/test_post', 'POST')
         
         return True
 
+async def test_stream_handler(client: WebREPLTestClient) -> bool:
+    """Test a streaming POST handler reading the request body"""
+    async with TestAssertion(client, "Streaming POST handler"):
+        code = """
+import httpserver
+
+# Clean up
+try:
+    httpserver.off('/test_stream', 'POST')
+except:
+    pass
+
+# Streaming handler: second argument is an HTTPRequest body stream
+def stream_handler(uri, req, client_ip=None):
+    buf = bytearray(512)
+    total = 0
+    while True:
+        n = req.readinto(buf)
+        if not n:
+            break
+        total += n
+    return f"received {total} of {req.content_length} bytes"
+
+result = httpserver.on('/test_stream', stream_handler, 'POST', stream=True, max_body=1024 * 1024)
+print(f"Stream registration: {result}")
+assert result >= 0, f"Stream registration failed: {result}"
+"""
+        result = await client.run_test(code, timeout=10.0)
+        
+        if result.status != 'pass':
+            raise AssertionError(f"{result.error_type}: {result.error}")
+        
+        try:
+            # Several readinto() calls' worth, not a multiple of the buffer
+            payload = bytes(i % 251 for i in range(5000))
+            status, _, body = await http_request(client, 'POST', '/test_stream', payload)
+            assert status == 200, f"Expected 200, got {status}: {body[:200]}"
+            assert body == b"received 5000 of 5000 bytes", f"Unexpected body: {body[:200]}"
+        finally:
+            await client.run_test("import httpserver\nhttpserver.off('/test_stream', 'POST')", timeout=10.0)
+        
+        return True
+
+async def test_json_handler(client: WebREPLTestClient) -> bool:
+    """Test a handler that returns a dict (encoded to JSON in C)"""
+    async with TestAssertion(client, "JSON handler"):
+        code = """
+import httpserver
+
+try:
+    httpserver.off('/test_json', 'GET')
+except:
+    pass
+
+def json_handler(uri, post_data=None, client_ip=None):
+    return {"uri": uri, "items": list(range(300)), "ok": True, "none": None,
+            "nested": {"list": [1, [2, "three"]], "text": 'quote " and \\n'}}
+
+result = httpserver.on('/test_json', json_handler, 'GET')
+assert result >= 0, f"JSON registration failed: {result}"
+"""
+        result = await client.run_test(code, timeout=10.0)
+        
+        if result.status != 'pass':
+            raise AssertionError(f"{result.error_type}: {result.error}")
+        
+        try:
+            status, headers, body = await http_request(client, 'GET', '/test_json')
+            assert status == 200, f"Expected 200, got {status}: {body[:200]}"
+            # 300 items encode to more than one HTTP_JSON_CHUNK
+            assert headers.get('Transfer-Encoding', '').lower() == 'chunked', \
+                f"Expected a chunked response, got headers {dict(headers)}"
+            data = json.loads(body)
+            assert data['uri'] == '/test_json', f"Bad uri: {data['uri']}"
+            assert data['items'] == list(range(300)), "Items list corrupted"
+            assert data['ok'] is True and data['none'] is None, "Bad bool/None encoding"
+            assert data['nested'] == {"list": [1, [2, "three"]], "text": 'quote " and \n'}, \
+                f"Bad nesting: {data['nested']}"
+        finally:
+            await client.run_test("import httpserver\nhttpserver.off('/test_json', 'GET')", timeout=10.0)
+        
+        return True
+
+async def test_sse_publisher(client: WebREPLTestClient) -> bool:
+    """Test registering an SSE endpoint and publishing with no clients"""
+    async with TestAssertion(client, "SSE publisher"):
+        code = """
+import httpserver
+
+events = httpserver.sse('/test_events', queue_limit=8, replay=4)
+assert events.clients() == 0, "Expected no clients"
+
+# Nobody listening: nothing queued, but the ring keeps the events for replay
+for i in range(6):
+    queued = events.publish('tick', f'{i}\\nsecond line')
+    assert queued == 0, f"Queued to {queued} clients"
+
+stats = events.stats()
+print(f"SSE stats: {stats}")
+assert stats['published'] == 6 and stats['last_id'] == 6, "Bad SSE stats"
+
+# Same path returns the same endpoint
+again = httpserver.sse('/test_events')
+assert again.stats()['last_id'] == 6, "Endpoint not reused"
+
+events.close()
+try:
+    events.publish(None, 'closed')
+    assert False, "publish() after close() should raise"
+except OSError:
+    pass
+"""
+        result = await client.run_test(code, timeout=10.0)
+        
+        if result.status != 'pass':
+            raise AssertionError(f"{result.error_type}: {result.error}")
+        
+        return True
+
 async def test_handler_capacity(client: WebREPLTestClient) -> bool:
-    """Test maximum handler capacity (5 handlers max)"""
-    async with TestAssertion(client, "Test handler capacity limit"):
+    """Test route capacity: routes live in the radix router, not in httpd handler slots"""
+    async with TestAssertion(client, "Test route capacity"):
         code = """
 import httpserver
 
-# Clean up all test handlers
-for i in range(10):
+COUNT = 40  # Well past the old 5-handler limit and several table growth steps
+
+def dummy_handler(uri, post_data=None):
+    return "OK"
+
+for i in range(COUNT):
     try:
         httpserver.off(f'/capacity{i}', 'GET')
     except:
         pass
 
-# Register up to capacity (5 handlers)
-def dummy_handler(uri, post_data=None):
-    return "OK"
+# Every route registers, each in its own slot
+slots = [httpserver.on(f'/capacity{i}', dummy_handler, 'GET') for i in range(COUNT)]
+print(f"Slots: {slots}")
+assert all(s >= 0 for s in slots), f"Registration failed: {slots}"
+assert len(set(slots)) == COUNT, f"Slots not distinct: {slots}"
 
-results = []
-for i in range(6):  # Try to register 6 (one over limit)
-    try:
-        r = httpserver.on(f'/capacity{i}', dummy_handler, 'GET')
-        results.append(r)
-        print(f"Handler {i}: {r}")
-    except Exception as e:
-        results.append(-1)
-        print(f"Handler {i}: exception {e}")
+# Freed slots are reused, so the table does not grow with churn
+httpserver.off('/capacity7', 'GET')
+again = httpserver.on('/capacity_again', dummy_handler, 'GET')
+assert again == slots[7], f"Expected freed slot {slots[7]}, got {again}"
 
-# First 5 should succeed (>= 0), 6th should fail (< 0)
-print(f"Results: {results}")
-assert len(results) == 6, f"Expected 6 results, got {len(results)}"
-assert all(r >= 0 for r in results[:5]), f"First 5 should succeed: {results[:5]}"
-# Note: 6th might succeed if a slot was free, so we don't assert it must fail
+# Re-registering a route replaces it in place
+assert httpserver.on('/capacity3', dummy_handler, 'GET') == slots[3]
 
-# Clean up
-for i in range(6):
+httpserver.off('/capacity_again', 'GET')
+for i in range(COUNT):
     try:
         httpserver.off(f'/capacity{i}', 'GET')
     except:
@@ -231,6 +377,9 @@ async def run_all_tests(url: str, password: str, ssl_verify: bool = True, debug:
         ("Unregister Handler", test_unregister_handler),
         ("Multiple Handlers", test_multiple_handlers),
         ("POST Handler", test_post_handler),
+        ("Streaming Handler", test_stream_handler),
+        ("JSON Handler", test_json_handler),
+        ("SSE Publisher", test_sse_publisher),
         ("Handler Capacity", test_handler_capacity),
         ("Handler Replacement", test_handler_replacement),
     ]
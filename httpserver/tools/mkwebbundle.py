@@ -0,0 +1,350 @@
+#!/usr/bin/env python3
+"""
+Pack a web directory into a read-only asset bundle image for
+webfiles.serve_bundle() (format: ../webbundle.h).
+
+Every file is stored as a complete 200 response: status line, precomputed
+headers (Content-Type, Cache-Control, ETag, ...) and the body, gzipped when
+that makes it smaller. The device memory-maps the partition and sends
+straight from flash; paths are found through a minimal perfect hash.
+
+Usage:
+    python3 mkwebbundle.py web/ build/webbundle.bin [--size 0x100000]
+    python3 mkwebbundle.py --verify build/webbundle.bin web/
+    python3 mkwebbundle.py --selftest
+
+Flash it to a data partition (e.g. "assets, data, 0x40, , 1M" in the
+partition table):
+    parttool.py write_partition --partition-name assets --input build/webbundle.bin
+
+--selftest packs a temporary tree, verifies it with the Python reader, and,
+if a C compiler is available, builds webbundle_check.c against
+../webbundle.c and runs it on the image file standing in for the partition.
+"""
+import gzip
+import hashlib
+import os
+import re
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+MAGIC = 0x444E4257  # "WBND"
+VERSION = 1
+HEADER = struct.Struct('<8I')
+ENTRY = struct.Struct('<10I')
+FLAG_GZIP = 0x0001
+
+# Same table as modwebfiles.c
+MIME_TYPES = {
+    '.html': 'text/html', '.htm': 'text/html',
+    '.js': 'application/javascript', '.mjs': 'application/javascript',
+    '.css': 'text/css', '.png': 'image/png', '.jpg': 'image/jpeg',
+    '.jpeg': 'image/jpeg', '.gif': 'image/gif', '.ico': 'image/x-icon',
+    '.svg': 'image/svg+xml', '.json': 'application/json', '.txt': 'text/plain',
+    '.md': 'text/markdown', '.wasm': 'application/wasm', '.map': 'application/json',
+    '.woff': 'font/woff', '.woff2': 'font/woff2', '.ttf': 'font/ttf',
+    '.otf': 'font/otf', '.bin': 'application/octet-stream',
+}
+COMPRESSIBLE = {'.html', '.htm', '.js', '.mjs', '.css', '.svg', '.json', '.txt',
+                '.md', '.wasm', '.map', '.ico', '.ttf', '.otf'}
+
+# Same defaults as webfiles.cache_control()
+CACHE_CONTROL = {'.html': 'no-cache', '*': 'max-age=3600',
+                 'hashed': 'public, max-age=31536000, immutable'}
+HASHED_NAME = re.compile(r'[.-](?=[A-Za-z0-9_]*[0-9])(?=[A-Za-z0-9_]*[A-Za-z])[A-Za-z0-9_]{8,}\.[^./]+$')
+
+
+def hash(key, seed):
+    """FNV-1a from the seed, murmur3 finaliser; matches webbundle_hash()"""
+    h = 2166136261 ^ seed
+    for b in key:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xFFFFFFFF
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xFFFFFFFF
+    h ^= h >> 16
+    return h
+
+
+def build_index(keys):
+    """Hash-and-displace minimal perfect hash: (seeds per bucket, slot per key)"""
+    n = len(keys)
+    buckets = [[] for _ in range(n)]
+    for i, key in enumerate(keys):
+        buckets[hash(key, 0) % n].append(i)
+    seeds = [0] * n
+    slots = [0] * n
+    taken = [False] * n
+    # Biggest buckets first, while the table is still empty
+    for b in sorted(range(n), key=lambda b: -len(buckets[b])):
+        items = buckets[b]
+        if not items:
+            break
+        seed = 1
+        while True:
+            candidate = [hash(keys[i], seed) % n for i in items]
+            if len(set(candidate)) == len(items) and not any(taken[s] for s in candidate):
+                break
+            seed += 1
+            if seed > 1 << 24:
+                raise RuntimeError('no perfect hash found')
+        seeds[b] = seed
+        for i, s in zip(items, candidate):
+            taken[s] = True
+            slots[i] = s
+    return seeds, slots
+
+
+def cache_control(path, policies):
+    ext = os.path.splitext(path)[1].lower()
+    if policies.get('hashed') and HASHED_NAME.search(path.rsplit('/', 1)[-1]):
+        return policies['hashed']
+    return policies.get(ext, policies.get('*'))
+
+
+def collect(src):
+    """{url path: (file path, already gzipped)} for every file under src"""
+    files = {}
+    for root, dirs, names in os.walk(src):
+        dirs[:] = sorted(d for d in dirs if not d.startswith('.'))
+        for name in sorted(names):
+            if name.startswith('.'):
+                continue
+            full = os.path.join(root, name)
+            url = '/' + os.path.relpath(full, src).replace(os.sep, '/')
+            if url.endswith('.gz'):
+                if os.path.exists(full[:-3]):
+                    continue  # We compress the original ourselves
+                files[url[:-3]] = (full, True)
+            else:
+                files[url] = (full, False)
+    return files
+
+
+def make_response(path, data, pregzipped, policies, compress=True):
+    """(response bytes, header offset, header length, etag offset, etag length, flags, body length)"""
+    ext = os.path.splitext(path)[1].lower()
+    flags = 0
+    if pregzipped:
+        flags = FLAG_GZIP
+    elif compress and ext in COMPRESSIBLE:
+        packed = gzip.compress(data, 9, mtime=0)
+        if len(packed) < len(data):
+            data, flags = packed, FLAG_GZIP
+    etag = '"wb-%s"' % hashlib.sha256(data).hexdigest()[:16]
+
+    # Same order as webfiles_head_add_file()
+    lines = ['Content-Type: %s' % MIME_TYPES.get(ext, 'text/plain')]
+    policy = cache_control(path, policies)
+    if policy:
+        lines.append('Cache-Control: %s' % policy)
+    lines.append('Access-Control-Allow-Origin: *')
+    if flags & FLAG_GZIP:
+        lines += ['Content-Encoding: gzip', 'Vary: Accept-Encoding']
+    lines += ['ETag: %s' % etag, 'Accept-Ranges: bytes']
+    headers = ''.join(line + '\r\n' for line in lines).encode()
+
+    status = b'HTTP/1.1 200 OK\r\n'
+    head = status + headers + b'Content-Length: %d\r\n\r\n' % len(data)
+    etag_off = head.index(etag.encode())
+    return head + data, len(status), len(headers), etag_off, len(etag), flags, len(data)
+
+
+def pack(src, out, size=None, policies=None, compress=True):
+    policies = dict(CACHE_CONTROL, **(policies or {}))
+    files = collect(src)
+    if not files:
+        raise SystemExit('no files in %s' % src)
+    paths = sorted(files)
+    keys = [p.encode() for p in paths]
+    seeds, slots = build_index(keys)
+    n = len(paths)
+
+    seeds_off = HEADER.size
+    entries_off = seeds_off + 4 * n
+    data = bytearray()
+    base = entries_off + ENTRY.size * n
+    entries = [None] * n
+    raw_total = 0
+    for i, path in enumerate(paths):
+        full, pregzipped = files[path]
+        with open(full, 'rb') as f:
+            content = f.read()
+        raw_total += len(content)
+        path_off = base + len(data)
+        data += keys[i]
+        resp, hdr_off, hdr_len, etag_off, etag_len, flags, body_len = make_response(
+            path, content, pregzipped, policies, compress)
+        resp_off = base + len(data)
+        data += resp
+        entries[slots[i]] = (path_off, len(keys[i]), flags, resp_off, len(resp) - body_len,
+                             body_len, hdr_off, hdr_len, etag_off, etag_len)
+
+    image_size = base + len(data)
+    image = bytearray(HEADER.pack(MAGIC, VERSION, n, seeds_off, entries_off, image_size, 0, 0))
+    image += struct.pack('<%dI' % n, *seeds)
+    for e in entries:
+        image += ENTRY.pack(*e)
+    image += data
+    if size is not None and len(image) > size:
+        raise SystemExit('bundle is %d bytes, partition holds %d' % (len(image), size))
+    with open(out, 'wb') as f:
+        f.write(image)
+    print('%s: %d files, %d bytes (%d bytes of source)' % (out, n, len(image), raw_total))
+    return image
+
+
+class Bundle:
+    """Python reader, the same lookup as webbundle_find()"""
+
+    def __init__(self, image):
+        magic, version, self.count, self.seeds_off, self.entries_off, size, _, _ = HEADER.unpack_from(image)
+        if magic != MAGIC or version != VERSION or size > len(image):
+            raise ValueError('not a webbundle image')
+        self.image = image
+
+    def entry(self, slot):
+        return ENTRY.unpack_from(self.image, self.entries_off + slot * ENTRY.size)
+
+    def find(self, path):
+        key = path.encode()
+        bucket = hash(key, 0) % self.count
+        seed = struct.unpack_from('<I', self.image, self.seeds_off + 4 * bucket)[0]
+        path_off, path_len, flags, resp_off, head_len, body_len, _, _, _, _ = self.entry(hash(key, seed) % self.count)
+        if self.image[path_off:path_off + path_len] != key:
+            return None
+        head = bytes(self.image[resp_off:resp_off + head_len])
+        body = bytes(self.image[resp_off + head_len:resp_off + head_len + body_len])
+        return flags, head, body
+
+
+def verify(image_path, src):
+    with open(image_path, 'rb') as f:
+        bundle = Bundle(f.read())
+    ok = True
+    files = collect(src)
+    for path, (full, pregzipped) in sorted(files.items()):
+        found = bundle.find(path)
+        with open(full, 'rb') as f:
+            content = f.read()
+        if found is None:
+            print('FAIL: %s not found' % path)
+            ok = False
+            continue
+        flags, head, body = found
+        if flags & FLAG_GZIP and not pregzipped:
+            body = gzip.decompress(body)
+        if body != content or not head.endswith(b'Content-Length: %d\r\n\r\n' % len(found[2])):
+            print('FAIL: %s content mismatch' % path)
+            ok = False
+    for missing in ('/nope', '/index.htm', ''):
+        if missing not in files and bundle.find(missing) is not None:
+            print('FAIL: %r found but not packed' % missing)
+            ok = False
+    if bundle.count != len(files):
+        print('FAIL: %d entries for %d files' % (bundle.count, len(files)))
+        ok = False
+    print('%s: %s (%d files)' % ('PASS' if ok else 'FAIL', image_path, len(files)))
+    return ok
+
+
+def selftest():
+    here = os.path.dirname(os.path.abspath(__file__))
+    tmp = tempfile.mkdtemp(prefix='webbundle')
+    try:
+        src = os.path.join(tmp, 'web')
+        os.makedirs(os.path.join(src, 'assets'))
+        tree = {
+            'index.html': b'<!doctype html><title>t</title>' + b'<p>hello</p>' * 200,
+            'assets/app.3f9a1c2b.js': b'console.log("x");' * 100,
+            'assets/index-BQ3kVl2m.css': b'body{margin:0}' * 50,
+            'assets/logo.png': bytes(range(256)) * 4,
+            'docs/index.html': b'<p>docs</p>',
+            'tiny.txt': b'x',
+        }
+        for name in ['f%03d.json' % i for i in range(150)]:
+            tree[name] = b'{"n": "%s"}' % name.encode()
+        for name, content in tree.items():
+            path = os.path.join(src, name)
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            with open(path, 'wb') as f:
+                f.write(content)
+        with open(os.path.join(src, 'pre.js.gz'), 'wb') as f:
+            f.write(gzip.compress(b'var pre = 1;', mtime=0))
+
+        image_path = os.path.join(tmp, 'webbundle.bin')
+        pack(src, image_path)
+        ok = verify(image_path, src)
+
+        with open(image_path, 'rb') as f:
+            bundle = Bundle(f.read())
+        head = bundle.find('/assets/app.3f9a1c2b.js')[1]
+        if b'immutable' not in head or b'Content-Encoding: gzip' not in head:
+            print('FAIL: hashed asset headers %r' % head)
+            ok = False
+        if b'no-cache' not in bundle.find('/index.html')[1]:
+            print('FAIL: html Cache-Control')
+            ok = False
+        if b'Content-Encoding' in bundle.find('/tiny.txt')[1]:
+            print('FAIL: gzip kept although larger')
+            ok = False
+
+        cc = shutil.which('cc') or shutil.which('gcc')
+        if cc:
+            exe = os.path.join(tmp, 'webbundle_check')
+            subprocess.check_call([cc, '-std=c99', '-Wall', '-Werror', '-I', os.path.dirname(here),
+                                   os.path.join(here, 'webbundle_check.c'),
+                                   os.path.join(os.path.dirname(here), 'webbundle.c'), '-o', exe])
+            result = subprocess.run([exe, image_path], capture_output=True, text=True)
+            print('%s: C reader on image file (%s)' % ('PASS' if result.returncode == 0 else 'FAIL',
+                                                       result.stdout.strip().splitlines()[-1]))
+            ok = ok and result.returncode == 0
+            result = subprocess.run([exe, image_path, '/pre.js', '/missing.js'], capture_output=True, text=True)
+            if result.returncode != 1 or 'missing' not in result.stdout:
+                print('FAIL: C lookup of missing path')
+                ok = False
+        else:
+            print('SKIP: no C compiler for webbundle_check.c')
+        print('PASS' if ok else 'FAIL')
+        return ok
+    finally:
+        shutil.rmtree(tmp)
+
+
+def main(argv):
+    args = [a for a in argv if not a.startswith('--')]
+    if '--selftest' in argv:
+        return 0 if selftest() else 1
+    if '--verify' in argv:
+        if len(args) != 2:
+            raise SystemExit(__doc__)
+        return 0 if verify(args[0], args[1]) else 1
+
+    size = None
+    policies = {}
+    i = 0
+    rest = []
+    while i < len(argv):
+        if argv[i] == '--size':
+            size = int(argv[i + 1], 0)
+            i += 2
+        elif argv[i] == '--cache-control':
+            ext, _, value = argv[i + 1].partition('=')
+            policies[ext] = value or None
+            i += 2
+        else:
+            rest.append(argv[i])
+            i += 1
+    files = [a for a in rest if not a.startswith('--')]
+    if len(files) != 2:
+        raise SystemExit(__doc__)
+    pack(files[0], files[1], size, policies, compress='--no-gzip' not in rest)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,294 @@
+/*
+ * ota_check.c - Host check of the OTA write path (see ../otawriter.h)
+ *
+ * Streams a firmware image through the device's verifier in random-sized
+ * chunks, as the /ota endpoint receives it, into a file standing in for
+ * the OTA partition:
+ *
+ *   cc -I.. ota_check.c ../otawriter.c -o ota_check
+ *   ./ota_check build/firmware.bin /tmp/ota_0.bin $(sha256sum build/firmware.bin | cut -c1-64)
+ *   ./ota_check --chip 9 --partition-size 0x300000 build/firmware.bin /tmp/ota_0.bin SHA256
+ *   ./ota_check --selftest
+ *
+ * --selftest builds a synthetic image and checks that it is accepted and
+ * that damaged variants are rejected. Exits non-zero on any failure.
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "otawriter.h"
+
+// A file as the OTA partition
+typedef struct {
+    const char *path;
+    size_t capacity;
+    FILE *fp;
+    bool activated;
+} file_partition_t;
+
+static bool file_begin(void *ctx, size_t size) {
+    file_partition_t *part = ctx;
+    if (size > part->capacity) {
+        return false;
+    }
+    part->fp = fopen(part->path, "wb");
+    part->activated = false;
+    return part->fp != NULL;
+}
+
+static bool file_write(void *ctx, const void *data, size_t len) {
+    file_partition_t *part = ctx;
+    return fwrite(data, 1, len, part->fp) == len;
+}
+
+static bool file_end(void *ctx) {
+    file_partition_t *part = ctx;
+    bool ok = fclose(part->fp) == 0;
+    part->fp = NULL;
+    part->activated = ok;
+    return ok;
+}
+
+static void file_abort(void *ctx) {
+    file_partition_t *part = ctx;
+    if (part->fp) {
+        fclose(part->fp);
+        part->fp = NULL;
+    }
+    remove(part->path);
+}
+
+// Feed the image like the HTTP handler does; returns the error or NULL
+static const char *run(const uint8_t *image, size_t size, file_partition_t *part, uint16_t chip,
+                       const uint8_t expect[32], char sha256_hex[65], char *version, size_t version_size) {
+    otawriter_target_t target = { file_begin, file_write, file_end, file_abort, part };
+    otawriter_t w;
+    if (!otawriter_begin(&w, &target, size, chip, expect)) {
+        return w.error;
+    }
+    size_t off = 0;
+    while (off < size) {
+        size_t n = 1 + (size_t)rand() % 4096;
+        if (n > size - off) {
+            n = size - off;
+        }
+        if (!otawriter_write(&w, image + off, n)) {
+            return w.error;
+        }
+        off += n;
+    }
+    otawriter_version(&w, version, version_size);
+    if (!otawriter_end(&w, sha256_hex)) {
+        return w.error;
+    }
+    return NULL;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(len > 0 ? len : 1);
+    if (!data || fread(data, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = len;
+    return data;
+}
+
+//=============================================================================
+// Self-test
+//=============================================================================
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void sha256(const uint8_t *data, size_t len, uint8_t digest[32]) {
+    otawriter_sha256_t sha;
+    otawriter_sha256_init(&sha);
+    otawriter_sha256_update(&sha, data, len);
+    otawriter_sha256_finish(&sha, digest);
+}
+
+// Two segments (app descriptor + code), checksum, appended hash, 64-byte trailer
+static size_t build_image(uint8_t *image, uint16_t chip) {
+    static const uint32_t seg_len[2] = { 256, 1000 };
+    size_t pos = OTAWRITER_HEADER_SIZE;
+    memset(image, 0, 4096);
+    image[0] = OTAWRITER_IMAGE_MAGIC;
+    image[1] = 2;
+    image[12] = chip & 0xff;
+    image[13] = chip >> 8;
+    image[23] = 1;
+    uint8_t checksum = 0xEF;
+    for (int s = 0; s < 2; s++) {
+        put_u32(image + pos, 0x3c000020 + s * 0x10000);
+        put_u32(image + pos + 4, seg_len[s]);
+        pos += 8;
+        uint8_t *data = image + pos;
+        for (uint32_t i = 0; i < seg_len[s]; i++) {
+            data[i] = (uint8_t)(i * 7 + s);
+        }
+        if (s == 0) {
+            memset(data, 0, 48);
+            put_u32(data, OTAWRITER_APP_DESC_MAGIC);
+            strcpy((char *)data + 16, "v1.2.3");
+        }
+        for (uint32_t i = 0; i < seg_len[s]; i++) {
+            checksum ^= data[i];
+        }
+        pos += seg_len[s];
+    }
+    pos += 15 - pos % 16;
+    image[pos++] = checksum;
+    sha256(image, pos, image + pos);
+    pos += 32;
+    memset(image + pos, 0x5a, 64);
+    return pos + 64;
+}
+
+static int selftest(void) {
+    int failed = 0;
+    uint8_t digest[32];
+    static const char abc_hex[] = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    uint8_t abc[32];
+    otawriter_parse_sha256(abc_hex, abc);
+    sha256((const uint8_t *)"abc", 3, digest);
+    if (memcmp(digest, abc, 32) != 0) {
+        printf("FAIL sha256(\"abc\")\n");
+        failed++;
+    }
+
+    static uint8_t image[4096], bad[4096];
+    size_t size = build_image(image, 9);
+    uint8_t expect[32];
+    sha256(image, size, expect);
+
+    char tmpl[] = "/tmp/ota_check_XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/ota_0.bin", tmpl);
+    file_partition_t part = { path, 64 * 1024, NULL, false };
+    char hex[65], version[33];
+
+    // Accepted, and the partition holds exactly the image
+    const char *error = run(image, size, &part, 9, expect, hex, version, sizeof(version));
+    size_t stored_size = 0;
+    uint8_t *stored = error ? NULL : read_file(path, &stored_size);
+    if (error || !part.activated || !stored || stored_size != size || memcmp(stored, image, size) != 0 ||
+        strcmp(version, "v1.2.3") != 0) {
+        printf("FAIL valid image: %s\n", error ? error : "partition contents");
+        failed++;
+    }
+    free(stored);
+
+    struct {
+        const char *name;
+        size_t offset;         // Byte to flip (0 = none)
+        size_t size;           // Bytes sent
+        uint16_t chip;
+        bool wrong_sha;
+        size_t capacity;
+        const char *error;
+    } cases[] = {
+        { "wrong digest",   0,    size,      9,                  true,  64 * 1024, "SHA-256 mismatch" },
+        { "segment data",   100,  size,      9,                  false, 64 * 1024, "Image checksum mismatch" },
+        { "appended hash",  size - 80, size, 9,                  false, 64 * 1024, "Image hash mismatch" },
+        { "bad magic",      0,    size,      9,                  false, 64 * 1024, NULL },
+        { "truncated",      0,    size - 70, 9,                  false, 64 * 1024, "Image truncated" },
+        { "other chip",     0,    size,      2,                  false, 64 * 1024, "Image is for another chip" },
+        { "any chip",       0,    size,      OTAWRITER_CHIP_ANY, false, 64 * 1024, "" },
+        { "too large",      0,    size,      9,                  false, 1024,      "Image does not fit the OTA partition" },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        memcpy(bad, image, size);
+        const char *want = cases[i].error;
+        if (cases[i].offset) {
+            bad[cases[i].offset] ^= 0x01;
+        }
+        if (!want) {
+            bad[0] = 0x7f;
+            want = "Not an ESP application image";
+        }
+        uint8_t digest_bad[32];
+        sha256(bad, cases[i].size, digest_bad);
+        if (cases[i].wrong_sha) {
+            digest_bad[0] ^= 0xff;
+        }
+        part.capacity = cases[i].capacity;
+        error = run(bad, cases[i].size, &part, cases[i].chip, digest_bad, hex, version, sizeof(version));
+        bool ok = want[0] ? (error && strcmp(error, want) == 0 && access(path, F_OK) != 0) : !error;
+        if (!ok) {
+            printf("FAIL %s: got \"%s\", want \"%s\"\n", cases[i].name, error ? error : "accepted", want);
+            failed++;
+        }
+        remove(path);
+    }
+    rmdir(tmpl);
+
+    printf("%s (%d failure%s)\n", failed ? "FAILED" : "OK", failed, failed == 1 ? "" : "s");
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    srand(1);
+    if (argc == 2 && strcmp(argv[1], "--selftest") == 0) {
+        return selftest();
+    }
+
+    uint16_t chip = OTAWRITER_CHIP_ANY;
+    size_t capacity = (size_t)-1;
+    int arg = 1;
+    for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        if (strcmp(argv[arg], "--chip") == 0) {
+            chip = (uint16_t)strtoul(argv[arg + 1], NULL, 0);
+        } else if (strcmp(argv[arg], "--partition-size") == 0) {
+            capacity = strtoul(argv[arg + 1], NULL, 0);
+        } else {
+            break;
+        }
+    }
+    uint8_t expect[32];
+    if (argc - arg != 3 || !otawriter_parse_sha256(argv[arg + 2], expect)) {
+        fprintf(stderr, "usage: %s [--chip ID] [--partition-size N] IMAGE PARTITION_FILE SHA256\n"
+                        "       %s --selftest\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    size_t size;
+    uint8_t *image = read_file(argv[arg], &size);
+    if (!image) {
+        return 2;
+    }
+    file_partition_t part = { argv[arg + 1], capacity, NULL, false };
+    char hex[65], version[33];
+    const char *error = run(image, size, &part, chip, expect, hex, version, sizeof(version));
+    free(image);
+    if (error) {
+        fprintf(stderr, "%s: rejected: %s\n", argv[arg], error);
+        return 1;
+    }
+    printf("%s: %lu bytes, version \"%s\", sha256 %s\n", argv[arg], (unsigned long)size, version, hex);
+    return 0;
+}
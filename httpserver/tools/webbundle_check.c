@@ -0,0 +1,81 @@
+/*
+ * webbundle_check.c - Host check of a webbundle image (see ../webbundle.h)
+ *
+ * Runs the device's lookup code against an image file standing in for the
+ * partition:
+ *
+ *   cc -I.. webbundle_check.c ../webbundle.c -o webbundle_check
+ *   ./webbundle_check build/webbundle.bin               # every asset
+ *   ./webbundle_check build/webbundle.bin /index.html   # specific paths
+ *
+ * Exits non-zero if the image is invalid or a path is not found.
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "webbundle.h"
+
+static void print_asset(const webbundle_asset_t *asset) {
+    printf("%.*s %lu%s %.*s\n", (int)asset->path_len, asset->path, (unsigned long)asset->body_len,
+           (asset->flags & WEBBUNDLE_FLAG_GZIP) ? " gzip" : "", (int)asset->etag_len, asset->etag);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s IMAGE [PATH...]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 2;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *image = malloc(size > 0 ? size : 1);
+    if (!image || fread(image, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", argv[1]);
+        return 2;
+    }
+    fclose(f);
+
+    webbundle_t bundle;
+    if (!webbundle_open(&bundle, image, size)) {
+        fprintf(stderr, "%s: not a valid webbundle image\n", argv[1]);
+        return 2;
+    }
+
+    int failed = 0;
+    webbundle_asset_t asset;
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            if (webbundle_find(&bundle, argv[i], strlen(argv[i]), &asset)) {
+                print_asset(&asset);
+            } else {
+                printf("%s missing\n", argv[i]);
+                failed++;
+            }
+        }
+    } else {
+        // Every stored path must lead back to its own slot
+        for (uint32_t slot = 0; slot < bundle.count; slot++) {
+            webbundle_asset_t found;
+            webbundle_get(&bundle, slot, &asset);
+            if (!webbundle_find(&bundle, asset.path, asset.path_len, &found) || found.body != asset.body ||
+                asset.response + asset.response_len != asset.body + asset.body_len) {
+                printf("%.*s lookup failed\n", (int)asset.path_len, asset.path);
+                failed++;
+            }
+        }
+        printf("%lu assets, %d failed\n", (unsigned long)bundle.count, failed);
+    }
+    free(image);
+    return failed ? 1 : 0;
+}
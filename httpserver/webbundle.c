@@ -0,0 +1,126 @@
+/*
+ * webbundle.c - Read-only web asset bundle image (see webbundle.h)
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "webbundle.h"
+
+#include <string.h>
+
+// Images may sit in memory-mapped flash; read byte-wise, independent of
+// alignment and host byte order
+static uint32_t webbundle_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t webbundle_hash(const char *key, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)key[i]) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// [off, off + len) lies inside the image
+static bool webbundle_in(const webbundle_t *bundle, uint32_t off, uint32_t len) {
+    return off <= bundle->size && len <= bundle->size - off;
+}
+
+static bool webbundle_entry(const webbundle_t *bundle, uint32_t slot, webbundle_asset_t *asset, bool check) {
+    const uint8_t *e = bundle->entries + (size_t)slot * WEBBUNDLE_ENTRY_SIZE;
+    uint32_t path_off = webbundle_u32(e + 0);
+    uint32_t path_len = webbundle_u32(e + 4);
+    uint32_t flags = webbundle_u32(e + 8);
+    uint32_t resp_off = webbundle_u32(e + 12);
+    uint32_t head_len = webbundle_u32(e + 16);
+    uint32_t body_len = webbundle_u32(e + 20);
+    uint32_t hdr_off = webbundle_u32(e + 24);
+    uint32_t hdr_len = webbundle_u32(e + 28);
+    uint32_t etag_off = webbundle_u32(e + 32);
+    uint32_t etag_len = webbundle_u32(e + 36);
+
+    if (check) {
+        if (!webbundle_in(bundle, path_off, path_len) || path_len == 0 ||
+            head_len > UINT32_MAX - body_len ||
+            !webbundle_in(bundle, resp_off, head_len + body_len) ||
+            hdr_off > head_len || hdr_len > head_len - hdr_off ||
+            etag_off > head_len || etag_len > head_len - etag_off) {
+            return false;
+        }
+    }
+
+    const char *resp = (const char *)bundle->base + resp_off;
+    asset->path = (const char *)bundle->base + path_off;
+    asset->path_len = path_len;
+    asset->flags = flags;
+    asset->response = resp;
+    asset->response_len = (size_t)head_len + body_len;
+    asset->headers = resp + hdr_off;
+    asset->headers_len = hdr_len;
+    asset->etag = resp + etag_off;
+    asset->etag_len = etag_len;
+    asset->body = resp + head_len;
+    asset->body_len = body_len;
+    return true;
+}
+
+bool webbundle_open(webbundle_t *bundle, const void *base, size_t size) {
+    const uint8_t *p = base;
+    memset(bundle, 0, sizeof(*bundle));
+    if (size < WEBBUNDLE_HEADER_SIZE || webbundle_u32(p) != WEBBUNDLE_MAGIC ||
+        webbundle_u32(p + 4) != WEBBUNDLE_VERSION) {
+        return false;
+    }
+    uint32_t count = webbundle_u32(p + 8);
+    uint32_t seeds_off = webbundle_u32(p + 12);
+    uint32_t entries_off = webbundle_u32(p + 16);
+    uint32_t image_size = webbundle_u32(p + 20);
+    if (image_size > size || count == 0 || count > image_size / WEBBUNDLE_ENTRY_SIZE) {
+        return false;
+    }
+
+    bundle->base = p;
+    bundle->size = image_size;
+    if (!webbundle_in(bundle, seeds_off, count * 4) ||
+        !webbundle_in(bundle, entries_off, count * WEBBUNDLE_ENTRY_SIZE)) {
+        return false;
+    }
+    bundle->count = count;
+    bundle->seeds = p + seeds_off;
+    bundle->entries = p + entries_off;
+
+    webbundle_asset_t asset;
+    for (uint32_t slot = 0; slot < count; slot++) {
+        if (!webbundle_entry(bundle, slot, &asset, true)) {
+            bundle->count = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool webbundle_find(const webbundle_t *bundle, const char *path, size_t path_len, webbundle_asset_t *asset) {
+    if (bundle->count == 0) {
+        return false;
+    }
+    uint32_t bucket = webbundle_hash(path, path_len, 0) % bundle->count;
+    uint32_t seed = webbundle_u32(bundle->seeds + (size_t)bucket * 4);
+    uint32_t slot = webbundle_hash(path, path_len, seed) % bundle->count;
+    webbundle_entry(bundle, slot, asset, false);
+    // Paths not in the bundle hash to some slot too
+    return asset->path_len == path_len && memcmp(asset->path, path, path_len) == 0;
+}
+
+bool webbundle_get(const webbundle_t *bundle, uint32_t slot, webbundle_asset_t *asset) {
+    if (slot >= bundle->count) {
+        return false;
+    }
+    return webbundle_entry(bundle, slot, asset, false);
+}
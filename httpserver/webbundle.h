@@ -0,0 +1,80 @@
+/*
+ * webbundle.h - Read-only web asset bundle image
+ *
+ * A bundle is a flat image written to a data partition by
+ * tools/mkwebbundle.py and memory-mapped at runtime. Each asset is stored
+ * as a complete, ready-to-send 200 response (status line, headers and the
+ * usually pre-gzipped body back to back), so a plain GET is one send
+ * straight from flash. Paths are found through a minimal perfect hash.
+ *
+ * This file has no ESP-IDF dependencies so the index can be checked on the
+ * host against an image file (tools/webbundle_check.c).
+ *
+ * Image layout, all integers little-endian u32:
+ *
+ *   header   magic "WBND", version, count, seeds_off, entries_off,
+ *            image_size, 2 reserved
+ *   seeds    count displacement seeds, one per bucket
+ *   entries  count entries of WEBBUNDLE_ENTRY_SIZE bytes, indexed by slot:
+ *            path_off, path_len, flags, resp_off, head_len, body_len,
+ *            hdr_off, hdr_len, etag_off, etag_len
+ *            (resp_off and path_off are image offsets; hdr_off and
+ *            etag_off are relative to resp_off)
+ *   data     paths and responses
+ *
+ * Lookup: bucket = hash(path, 0) % count, slot = hash(path, seeds[bucket])
+ * % count, then the stored path is compared.
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef WEBBUNDLE_H
+#define WEBBUNDLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WEBBUNDLE_MAGIC        0x444E4257u  // "WBND"
+#define WEBBUNDLE_VERSION      1
+#define WEBBUNDLE_HEADER_SIZE  32
+#define WEBBUNDLE_ENTRY_SIZE   40
+
+#define WEBBUNDLE_FLAG_GZIP    0x0001  // Body is gzip (Content-Encoding: gzip)
+
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    uint32_t count;
+    const uint8_t *seeds;
+    const uint8_t *entries;
+} webbundle_t;
+
+typedef struct {
+    const char *path;          // Not NUL-terminated
+    size_t path_len;
+    uint32_t flags;
+    const char *response;      // 200 status line, headers, blank line, body
+    size_t response_len;
+    const char *headers;       // Header lines describing the asset, CRLF each,
+    size_t headers_len;        // without status line and Content-Length
+    const char *etag;          // Quoted strong ETag
+    size_t etag_len;
+    const char *body;
+    size_t body_len;
+} webbundle_asset_t;
+
+// FNV-1a over the key, started from the seed and finished with the murmur3
+// mixer. Must match hash() in tools/mkwebbundle.py.
+uint32_t webbundle_hash(const char *key, size_t len, uint32_t seed);
+
+// Check the header and every entry's bounds once, so lookups can trust them
+bool webbundle_open(webbundle_t *bundle, const void *base, size_t size);
+
+bool webbundle_find(const webbundle_t *bundle, const char *path, size_t path_len, webbundle_asset_t *asset);
+
+// Asset stored in a slot (0 .. count-1), for listing the bundle
+bool webbundle_get(const webbundle_t *bundle, uint32_t slot, webbundle_asset_t *asset);
+
+#endif // WEBBUNDLE_H
@@ -0,0 +1,51 @@
+/*
+ * wsserver.h - C API of the WebSocket server (modwsserver.c)
+ *
+ * For C modules that speak their own protocol over WebSocket. They either
+ * take over the main wsserver path with wsserver_register_c_callback()
+ * (WebREPL, webDAP) or serve a path of their own with
+ * wsserver_register_endpoint() (GVRET). C callbacks run in the HTTP
+ * server task.
+ *
+ * Copyright (c) 2026 Jonathan Elliot Peace
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef WSSERVER_H
+#define WSSERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_http_server.h"
+
+// Event types for wsserver_register_c_callback()
+#define WSSERVER_EVENT_CONNECT          0
+#define WSSERVER_EVENT_DISCONNECT       1
+#define WSSERVER_EVENT_MESSAGE          2
+#define WSSERVER_EVENT_PREQUEUE_FILTER  3
+
+// C callback function types
+typedef void (*wsserver_connect_cb_t)(int client_id);
+typedef void (*wsserver_disconnect_cb_t)(int client_id);
+typedef void (*wsserver_message_cb_t)(int client_id, const uint8_t *data, size_t len, bool is_binary);
+// Pre-queue filter: return true to process normally, false to skip queuing
+typedef bool (*wsserver_prequeue_filter_cb_t)(int client_id, const uint8_t *data, size_t len, bool is_binary);
+
+bool wsserver_register_c_callback(int event_type, void *callback_func);
+
+// Serve C-only clients on their own path; callbacks may be NULL
+bool wsserver_register_endpoint(const char *path, wsserver_connect_cb_t connect_cb,
+                                wsserver_disconnect_cb_t disconnect_cb, wsserver_message_cb_t message_cb);
+void wsserver_unregister_endpoint(const char *path);
+
+httpd_handle_t wsserver_get_handle(void);
+int wsserver_get_client_sockfd(int client_id);
+bool wsserver_send_to_client(int client_id, const uint8_t *data, size_t len, bool is_binary);
+// Sends queued by wsserver_send_to_client() and not yet completed, all clients
+int wsserver_pending_sends(void);
+bool wsserver_is_running(void);
+bool wsserver_start_c(const char *path, int ping_interval, int ping_timeout);
+
+#endif // WSSERVER_H
@@ -31,6 +31,11 @@
 
 static const char *TAG = "WBP";
 
+// webfiles (modwebfiles.c): uploads replace files its asset cache may hold,
+// and compressible ones get a .gz variant made in the background
+extern void webfiles_cache_invalidate(const char *path);
+extern void webfiles_precompress_queue(const char *path);
+
 //=============================================================================
 // Global State
 //=============================================================================
@@ -296,6 +301,32 @@ void wbp_send_log(uint8_t level, const uint8_t *message, size_t message_len,
     free(buf);
 }
 
+// Called from the httpserver task while an image is written
+void wbp_send_ota(uint8_t state, size_t written, size_t total, const char *error) {
+    if (!g_wbp_active_transport) {
+        return;  // No WebREPL session to report to
+    }
+    uint8_t buf[128];
+    CborEncoder encoder, arrayEncoder;
+    
+    cbor_encoder_init(&encoder, buf, sizeof(buf), 0);
+    
+    // [0, 5, state, written, total, ?error]
+    cbor_encoder_create_array(&encoder, &arrayEncoder, error ? 6 : 5);
+    cbor_encode_uint(&arrayEncoder, WBP_CH_EVENT);
+    cbor_encode_uint(&arrayEncoder, WBP_EVT_OTA);
+    cbor_encode_uint(&arrayEncoder, state);
+    cbor_encode_uint(&arrayEncoder, written);
+    cbor_encode_uint(&arrayEncoder, total);
+    if (error) {
+        cbor_encode_text_string(&arrayEncoder, error, strnlen(error, 64));
+    }
+    cbor_encoder_close_container(&encoder, &arrayEncoder);
+    
+    size_t len = cbor_encoder_get_buffer_size(&encoder, buf);
+    wbp_send_cbor(buf, len);
+}
+
 //=============================================================================
 // File Message Builders
 //=============================================================================
@@ -504,6 +535,10 @@ void wbp_close_transfer(void) {
         // Close the file
         mp_stream_close(g_file_transfer.file_obj);
     }
+    if (g_file_transfer.active && g_file_transfer.is_write) {
+        webfiles_cache_invalidate(g_file_transfer.path);
+        webfiles_precompress_queue(g_file_transfer.path);
+    }
     g_file_transfer.active = false;
     g_file_transfer.file_obj = MP_OBJ_NULL;
     g_file_transfer.block_num = 0;
@@ -537,6 +572,11 @@ void wbp_handle_wrq(const char *path, size_t tsize, size_t blksize) {
         return;
     }
     
+    // Relative or overlong paths make the cache drop everything
+    strlcpy(g_file_transfer.path, strlen(path) < sizeof(g_file_transfer.path) ? path : "",
+            sizeof(g_file_transfer.path));
+    webfiles_cache_invalidate(g_file_transfer.path);
+
     g_file_transfer.active = true;
     g_file_transfer.is_write = true;
     g_file_transfer.block_num = 0;
@@ -58,6 +58,7 @@
 #define WBP_EVT_AUTH_FAIL 2   // Authentication failure
 #define WBP_EVT_INFO      3   // Informational message
 #define WBP_EVT_LOG       4   // Structured log message
+#define WBP_EVT_OTA       5   // Firmware update progress (httpserver /ota)
 
 // File opcodes (Channel 23)
 #define WBP_FILE_RRQ    1   // Read Request (download)
@@ -131,6 +132,7 @@ typedef struct {
     size_t blksize;          // Block size
     size_t tsize;            // Total size (for progress)
     size_t transferred;      // Bytes transferred so far
+    char path[128];          // File being transferred
 } wbp_file_transfer_t;
 
 extern wbp_file_transfer_t g_file_transfer;
@@ -247,6 +249,7 @@ void wbp_send_auth_fail(const char *error);
 void wbp_send_info_json(mp_obj_t payload_obj);
 void wbp_send_log(uint8_t level, const uint8_t *message, size_t message_len,
                   int64_t timestamp, const char *source);
+void wbp_send_ota(uint8_t state, size_t written, size_t total, const char *error);
 
 // File messages
 void wbp_send_file_ack(uint16_t block_num, size_t tsize, 